@@ -0,0 +1,52 @@
+# Locate libwebp.
+# This module defines
+# WEBP_LIBRARY
+# WEBP_FOUND, if false, do not try to link to libwebp
+# WEBP_INCLUDE_DIR, where to find the headers
+
+FIND_PATH(WEBP_INCLUDE_DIR webp/decode.h
+  PATHS
+  $ENV{WEBP_DIR}
+  NO_DEFAULT_PATH
+    PATH_SUFFIXES include
+)
+
+FIND_PATH(WEBP_INCLUDE_DIR webp/decode.h
+  PATHS
+  ~/Library/Frameworks
+  /Library/Frameworks
+  /usr/local/include
+  /usr/include
+  /sw/include # Fink
+  /opt/local/include # DarwinPorts
+  /opt/csw/include # Blastwave
+  /opt/include
+)
+
+FIND_LIBRARY(WEBP_LIBRARY
+  NAMES libwebp webp
+  PATHS
+    $ENV{WEBP_DIR}
+    NO_DEFAULT_PATH
+    PATH_SUFFIXES lib64 lib
+)
+
+FIND_LIBRARY(WEBP_LIBRARY
+  NAMES libwebp webp
+  PATHS
+    ~/Library/Frameworks
+    /Library/Frameworks
+    /usr/local
+    /usr
+    /sw
+    /opt/local
+    /opt/csw
+    /opt
+    /usr/freeware
+  PATH_SUFFIXES lib64 lib
+)
+
+SET(WEBP_FOUND "NO")
+IF(WEBP_LIBRARY AND WEBP_INCLUDE_DIR)
+  SET(WEBP_FOUND "YES")
+ENDIF(WEBP_LIBRARY AND WEBP_INCLUDE_DIR)
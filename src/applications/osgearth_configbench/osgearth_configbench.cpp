@@ -0,0 +1,240 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/Notify>
+#include <osgEarth/Config>
+#include <osgEarth/XmlUtils>
+#include <osgEarth/StringUtils>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <iomanip>
+#include <sstream>
+
+#define LC "[configbench] "
+
+using namespace osgEarth;
+
+int
+usage(const std::string& msg)
+{
+    OE_NOTICE << msg << std::endl;
+    OE_NOTICE
+        << "\nUsage: osgearth_configbench [file.earth]\n"
+        << "         [--layers n]        : layers in the generated map when no file is given (default = 500)\n"
+        << "         [--iterations n]    : number of passes (default = 20)\n"
+        << "         [--out file]        : also write the map in the binary encoding to this file\n"
+        << std::endl;
+    return -1;
+}
+
+namespace
+{
+    // A map with "numLayers" image layers, each with a typical set of options.
+    Config makeMap(unsigned numLayers)
+    {
+        Config map("map");
+        map.set("name", "configbench");
+        map.set("type", "geocentric");
+        map.set("version", "2");
+
+        Config options("options");
+        options.set("lighting", true);
+        Config terrain("terrain");
+        terrain.set("driver", "rex");
+        terrain.set("tile_size", 17);
+        options.add(terrain);
+        map.add(options);
+
+        for (unsigned i = 0; i < numLayers; ++i)
+        {
+            Config layer(i % 4 == 0 ? "elevation" : "image");
+            layer.set("name", std::string(Stringify() << "layer_" << i));
+            layer.set("driver", "gdal");
+            layer.set("url", std::string(Stringify() << "data/tiles/layer_" << i << ".tif"));
+            layer.set("min_level", i % 3);
+            layer.set("max_level", 18 + i % 5);
+            layer.set("opacity", 0.25 + 0.5 * (double)(i % 3));
+            layer.set("visible", i % 7 != 0);
+
+            Config profile("profile");
+            profile.set("srs", "+proj=longlat +datum=WGS84");
+            profile.set("xmin", -180.0 + (double)i * 0.001);
+            profile.set("ymin", -90.0);
+            profile.set("xmax", 180.0);
+            profile.set("ymax", 90.0);
+            layer.add(profile);
+
+            Config cache("cache_policy");
+            cache.set("usage", "read_write");
+            layer.add(cache);
+
+            map.add(layer);
+        }
+        return map;
+    }
+
+    void report(const std::string& name, double ms, unsigned iterations, double bytes)
+    {
+        OE_NOTICE << LC << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(12) << ms / (double)iterations << " ms/pass";
+        if (bytes > 0.0)
+            OE_NOTICE << std::setw(12) << std::setprecision(1) << bytes / 1024.0 << " KB";
+        OE_NOTICE << std::endl;
+    }
+}
+
+/**
+ * Compares the cost of parsing a map Config from XML, JSON and the binary
+ * encoding, and of looking up children by key with a linear scan versus a
+ * ConfigIndex.
+ *
+ * Example:
+ *   osgearth_configbench --layers 2000 --out big.earth
+ *   osgearth_configbench ../data/boston.earth
+ */
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+    if (arguments.read("--help"))
+        return usage("");
+
+    unsigned numLayers = 500u;
+    arguments.read("--layers", numLayers);
+
+    unsigned iterations = 20u;
+    arguments.read("--iterations", iterations);
+
+    std::string outFile;
+    arguments.read("--out", outFile);
+
+    Config map;
+    for (int i = 1; i < arguments.argc(); ++i)
+    {
+        if (!arguments.isOption(i))
+        {
+            osg::ref_ptr<XmlDocument> doc = XmlDocument::load(std::string(arguments[i]));
+            if (!doc.valid())
+                return usage(Stringify() << "Failed to load " << arguments[i]);
+            Config docConf = doc->getConfig();
+            map = docConf.hasChild("map") ? docConf.child("map") : docConf.child("earth");
+            if (map.empty())
+                return usage(Stringify() << "No map found in " << arguments[i]);
+            break;
+        }
+    }
+
+    if (map.empty())
+        map = makeMap(numLayers);
+
+    // encode the map once in each format.
+    std::stringstream xmlStream;
+    osg::ref_ptr<XmlDocument> xml = new XmlDocument(map);
+    xml->store(xmlStream);
+    std::string xmlData = xmlStream.str();
+
+    std::string jsonData = map.toJSON(false);
+
+    std::stringstream binStream;
+    if (!map.toBinary(binStream))
+        return usage("Failed to encode the map in binary");
+    std::string binData = binStream.str();
+
+    if (!outFile.empty() && !map.writeBinaryFile(outFile))
+        OE_WARN << LC << "Failed to write " << outFile << std::endl;
+
+    OE_NOTICE << LC << map.children().size() << " top-level objects, " << iterations << " iterations" << std::endl;
+
+    osg::Timer* timer = osg::Timer::instance();
+
+    // parsing
+    {
+        osg::Timer_t start = timer->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            std::stringstream in(xmlData);
+            osg::ref_ptr<XmlDocument> doc = XmlDocument::load(in);
+            Config conf = doc.valid() ? doc->getConfig() : Config();
+        }
+        report("XML parse", timer->delta_m(start, timer->tick()), iterations, (double)xmlData.size());
+    }
+    {
+        osg::Timer_t start = timer->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            Config conf;
+            conf.fromJSON(jsonData);
+        }
+        report("JSON parse", timer->delta_m(start, timer->tick()), iterations, (double)jsonData.size());
+    }
+    {
+        osg::Timer_t start = timer->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            Config conf;
+            conf.fromBinary(binData.data(), binData.size());
+        }
+        report("binary decode", timer->delta_m(start, timer->tick()), iterations, (double)binData.size());
+    }
+    if (!outFile.empty())
+    {
+        osg::Timer_t start = timer->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            Config conf;
+            conf.readBinaryFile(outFile);
+        }
+        report("binary mmap read", timer->delta_m(start, timer->tick()), iterations, 0.0);
+    }
+
+    // child lookups: read every option of every layer by key, the way the
+    // option structures query their Config.
+    unsigned found = 0u;
+    {
+        osg::Timer_t start = timer->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            for (ConfigSet::const_iterator layer = map.children().begin(); layer != map.children().end(); ++layer)
+            {
+                for (ConfigSet::const_iterator opt = layer->children().begin(); opt != layer->children().end(); ++opt)
+                    found += layer->child_ptr(opt->key()) ? 1u : 0u;
+            }
+        }
+        report("linear lookup", timer->delta_m(start, timer->tick()), iterations, 0.0);
+    }
+    {
+        osg::Timer_t start = timer->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            for (ConfigSet::const_iterator layer = map.children().begin(); layer != map.children().end(); ++layer)
+            {
+                ConfigIndex index(*layer);
+                for (ConfigSet::const_iterator opt = layer->children().begin(); opt != layer->children().end(); ++opt)
+                    found += index.child_ptr(opt->key()) ? 1u : 0u;
+            }
+        }
+        report("indexed lookup", timer->delta_m(start, timer->tick()), iterations, 0.0);
+    }
+
+    OE_DEBUG << LC << found << " lookups hit" << std::endl;
+    return 0;
+}
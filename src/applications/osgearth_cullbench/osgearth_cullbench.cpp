@@ -0,0 +1,210 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/Notify>
+#include <osgEarth/MapNode>
+#include <osgEarth/XmlUtils>
+#include <osgEarth/URI>
+#include <osgEarth/StringUtils>
+#include <osgEarthUtil/EarthManipulator>
+#include <osgViewer/Viewer>
+#include <osgDB/Registry>
+#include <osg/ArgumentParser>
+#include <osg/Stats>
+#include <iomanip>
+#include <sstream>
+#include <cmath>
+
+#define LC "[cullbench] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const std::string& msg)
+{
+    OE_NOTICE << msg << std::endl;
+    OE_NOTICE
+        << "\nUsage: osgearth_cullbench file.earth\n"
+        << "         [--frames n]        : number of measured frames per mode (default = 600)\n"
+        << "         [--settle n]        : maximum number of frames to let paging settle (default = 1000)\n"
+        << "         [--degrees d]       : amplitude of the camera's heading oscillation (default = 0.05)\n"
+        << "         [--period n]        : frames per oscillation (default = 120)\n"
+        << "         [--tolerance m]     : coherent_culling_tolerance to test (default = 1.0)\n"
+        << std::endl;
+    return -1;
+}
+
+namespace
+{
+    // Loads the earth file with the rex coherent culling options overridden.
+    osg::Node* loadEarthFile(const std::string& file, bool coherent, float tolerance)
+    {
+        osg::ref_ptr<XmlDocument> doc = XmlDocument::load(file);
+        if (!doc.valid())
+            return 0L;
+
+        Config docConf = doc->getConfig();
+        Config* map = docConf.mutable_child("map");
+        if (!map)
+            map = docConf.mutable_child("earth");
+        if (!map)
+            return 0L;
+
+        if (!map->hasChild("options"))
+            map->add(Config("options"));
+        Config* options = map->mutable_child("options");
+
+        if (!options->hasChild("terrain"))
+            options->add(Config("terrain"));
+        Config* terrain = options->mutable_child("terrain");
+
+        terrain->set("coherent_culling", coherent);
+        terrain->set("coherent_culling_tolerance", tolerance);
+
+        std::stringstream buf;
+        osg::ref_ptr<XmlDocument> out = new XmlDocument(*map);
+        out->store(buf);
+
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("earth");
+        if (!rw)
+            return 0L;
+
+        osg::ref_ptr<osgDB::Options> dbOptions = new osgDB::Options();
+        URIContext(file).store(dbOptions.get());
+        return rw->readNode(buf, dbOptions.get()).takeNode();
+    }
+
+    // Runs frames until the pager has nothing left to load.
+    unsigned settle(osgViewer::Viewer& viewer, unsigned maxFrames)
+    {
+        unsigned frames = 0u;
+        do {
+            viewer.frame();
+        } while (++frames < maxFrames && (frames < 10u || viewer.getDatabasePager()->getRequestsInProgress()));
+        return frames;
+    }
+
+    // Sways the camera's heading around "view" and returns the average cull time.
+    double measure(osgViewer::Viewer& viewer, const osg::Matrixd& view, unsigned frames, double degrees, unsigned period)
+    {
+        osg::Stats* stats = viewer.getCamera()->getStats();
+        double total = 0.0;
+        unsigned samples = 0u;
+
+        for (unsigned i = 0; i < frames; ++i)
+        {
+            double angle = osg::DegreesToRadians(degrees) * sin(2.0 * osg::PI * (double)i / (double)period);
+            viewer.getCamera()->setViewMatrix(view * osg::Matrixd::rotate(angle, 0.0, 1.0, 0.0));
+            viewer.frame();
+
+            double ms;
+            if (stats && stats->getAttribute(viewer.getFrameStamp()->getFrameNumber(), "Cull traversal time taken", ms))
+            {
+                total += ms * 1000.0;
+                ++samples;
+            }
+        }
+        return samples > 0u ? total / (double)samples : 0.0;
+    }
+}
+
+/**
+ * Measures the rex cull traversal time with and without coherent culling
+ * while the camera sways slightly around the map's home view.
+ *
+ * Example:
+ *   osgearth_cullbench ../tests/readymap.earth --frames 1000 --degrees 0.1
+ */
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+    if (arguments.read("--help"))
+        return usage("");
+
+    unsigned frames = 600u;
+    arguments.read("--frames", frames);
+
+    unsigned maxSettleFrames = 1000u;
+    arguments.read("--settle", maxSettleFrames);
+
+    double degrees = 0.05;
+    arguments.read("--degrees", degrees);
+
+    unsigned period = 120u;
+    arguments.read("--period", period);
+    if (period == 0u)
+        period = 1u;
+
+    float tolerance = 1.0f;
+    arguments.read("--tolerance", tolerance);
+
+    std::string file;
+    for (int i = 1; i < arguments.argc(); ++i)
+    {
+        if (!arguments.isOption(i))
+        {
+            file = arguments[i];
+            break;
+        }
+    }
+    if (file.empty())
+        return usage("Please specify an earth file");
+
+    osg::ref_ptr<osg::Node> full = loadEarthFile(file, false, tolerance);
+    osg::ref_ptr<osg::Node> coherent = loadEarthFile(file, true, tolerance);
+    if (!MapNode::get(full.get()) || !MapNode::get(coherent.get()))
+        return usage(Stringify() << "Failed to load a map from " << file);
+
+    osgViewer::Viewer viewer(arguments);
+    viewer.setThreadingModel(viewer.SingleThreaded);
+    viewer.setCameraManipulator(new EarthManipulator(arguments));
+    viewer.setSceneData(full.get());
+    viewer.realize();
+
+    if (viewer.getCamera()->getStats())
+        viewer.getCamera()->getStats()->collectStats("rendering", true);
+
+    // Settle at the home view, then drive the camera directly.
+    OE_NOTICE << LC << "Paging settled after " << settle(viewer, maxSettleFrames) << " frames" << std::endl;
+    osg::Matrixd view = viewer.getCamera()->getViewMatrix();
+    viewer.setCameraManipulator(0L);
+
+    double fullMs = measure(viewer, view, frames, degrees, period);
+
+    viewer.setSceneData(coherent.get());
+    viewer.getCamera()->setViewMatrix(view);
+    OE_NOTICE << LC << "Paging settled after " << settle(viewer, maxSettleFrames) << " frames" << std::endl;
+
+    double coherentMs = measure(viewer, view, frames, degrees, period);
+
+    OE_NOTICE << LC << std::fixed << std::setprecision(3)
+        << "full cull:     " << std::setw(10) << fullMs << " ms/frame" << std::endl;
+    OE_NOTICE << LC << std::fixed << std::setprecision(3)
+        << "coherent cull: " << std::setw(10) << coherentMs << " ms/frame" << std::endl;
+
+    if (coherentMs > 0.0)
+        OE_NOTICE << LC << "Speedup: " << std::fixed << std::setprecision(1) << fullMs / coherentMs << "x" << std::endl;
+
+    return 0;
+}
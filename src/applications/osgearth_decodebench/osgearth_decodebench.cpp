@@ -0,0 +1,221 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/Notify>
+#include <osgEarth/ImageDecoder>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#define LC "[decodebench] "
+
+using namespace osgEarth;
+
+int
+usage(const std::string& msg)
+{
+    OE_NOTICE << msg << std::endl;
+    OE_NOTICE
+        << "\nUsage: osgearth_decodebench [tile files or folders...]\n"
+        << "         [--iterations n]    : number of passes over the corpus (default = 10)\n"
+        << std::endl;
+    return -1;
+}
+
+namespace
+{
+    struct Tile
+    {
+        std::string _name;
+        std::string _data;
+    };
+
+    struct Stats
+    {
+        Stats() : _ms(0.0), _images(0u), _pixels(0.0), _failed(0u) { }
+        double   _ms;
+        unsigned _images;
+        double   _pixels;
+        unsigned _failed;
+
+        void add(const osg::Image* image)
+        {
+            if (image) ++_images, _pixels += (double)image->s() * (double)image->t();
+            else ++_failed;
+        }
+
+        void report(const std::string& name, double encodedBytes) const
+        {
+            double s = _ms / 1000.0;
+            OE_NOTICE << LC << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(1)
+                << std::setw(10) << (s > 0.0 ? _images / s : 0.0) << " tiles/s"
+                << std::setw(10) << (s > 0.0 ? _pixels / s / 1.0e6 : 0.0) << " Mpix/s"
+                << std::setw(10) << (s > 0.0 ? encodedBytes / s / 1048576.0 : 0.0) << " MB/s in";
+            if (_failed > 0u)
+                OE_NOTICE << "  (" << _failed << " failed)";
+            OE_NOTICE << std::endl;
+        }
+    };
+
+    void load(const std::string& path, std::vector<Tile>& tiles)
+    {
+        if (osgDB::fileType(path) == osgDB::DIRECTORY)
+        {
+            osgDB::DirectoryContents files = osgDB::getDirectoryContents(path);
+            for (osgDB::DirectoryContents::const_iterator f = files.begin(); f != files.end(); ++f)
+            {
+                if (*f != "." && *f != "..")
+                    load(osgDB::concatPaths(path, *f), tiles);
+            }
+        }
+        else
+        {
+            std::ifstream in(path.c_str(), std::ios::binary);
+            if (in.is_open())
+            {
+                Tile tile;
+                tile._name = path;
+                tile._data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+                if (ImageDecoder::getFormat(tile._data.data(), tile._data.size()) != ImageDecoder::FORMAT_UNKNOWN)
+                    tiles.push_back(tile);
+            }
+        }
+    }
+}
+
+/**
+ * Measures tile decode throughput over a corpus of JPEG/PNG/WebP files,
+ * comparing the osgDB ReaderWriter stream path against ImageDecoder
+ * (with and without an image pool).
+ *
+ * Example:
+ *   osgearth_decodebench ~/tiles/jpeg ~/tiles/png --iterations 20
+ */
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+    if (arguments.read("--help"))
+        return usage("");
+
+    unsigned iterations = 10u;
+    arguments.read("--iterations", iterations);
+
+    std::vector<Tile> tiles;
+    double encodedBytes = 0.0;
+    for (int i = 1; i < arguments.argc(); ++i)
+    {
+        if (!arguments.isOption(i))
+            load(arguments[i], tiles);
+    }
+
+    if (tiles.empty())
+        return usage("No JPEG, PNG or WebP tiles found");
+
+    unsigned counts[4] = { 0u, 0u, 0u, 0u };
+    for (unsigned i = 0; i < tiles.size(); ++i)
+    {
+        encodedBytes += (double)tiles[i]._data.size();
+        counts[ImageDecoder::getFormat(tiles[i]._data.data(), tiles[i]._data.size())]++;
+    }
+
+    OE_NOTICE << LC << tiles.size() << " tiles (" << counts[ImageDecoder::FORMAT_JPEG] << " JPEG, "
+        << counts[ImageDecoder::FORMAT_PNG] << " PNG, " << counts[ImageDecoder::FORMAT_WEBP] << " WebP), "
+        << iterations << " iterations" << std::endl;
+
+    OE_NOTICE << LC << "Built-in decoders: JPEG=" << (ImageDecoder::isSupported(ImageDecoder::FORMAT_JPEG) ? "yes" : "no")
+        << ", PNG=" << (ImageDecoder::isSupported(ImageDecoder::FORMAT_PNG) ? "yes" : "no")
+        << ", WebP=" << (ImageDecoder::isSupported(ImageDecoder::FORMAT_WEBP) ? "yes" : "no") << std::endl;
+
+    encodedBytes *= (double)iterations;
+
+    // osgDB: the path the tile sources used before, through a std::istringstream.
+    Stats osgdb;
+    {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            for (unsigned i = 0; i < tiles.size(); ++i)
+            {
+                const std::string& data = tiles[i]._data;
+                const char* ext =
+                    data[0] == (char)0xFF ? "jpg" :
+                    data[0] == 'R' ? "webp" : "png";
+                osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+                osg::ref_ptr<osg::Image> image;
+                if (rw)
+                {
+                    std::istringstream in(data);
+                    osgDB::ReaderWriter::ReadResult rr = rw->readImage(in);
+                    if (rr.validImage())
+                        image = rr.takeImage();
+                }
+                osgdb.add(image.get());
+            }
+        }
+        osgdb._ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    }
+
+    // ImageDecoder, new image per tile.
+    Stats decoder;
+    {
+        ImageDecoder dec;
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            for (unsigned i = 0; i < tiles.size(); ++i)
+            {
+                osg::ref_ptr<osg::Image> image = dec.decode(tiles[i]._data.data(), tiles[i]._data.size());
+                decoder.add(image.get());
+            }
+        }
+        decoder._ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    }
+
+    // ImageDecoder, recycling images through a pool.
+    Stats pooled;
+    {
+        ImageDecoder dec;
+        dec.setImagePool(new ImageDecoder::ImagePool(4u));
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        for (unsigned n = 0; n < iterations; ++n)
+        {
+            for (unsigned i = 0; i < tiles.size(); ++i)
+            {
+                osg::ref_ptr<osg::Image> image = dec.decode(tiles[i]._data.data(), tiles[i]._data.size());
+                pooled.add(image.get());
+            }
+        }
+        pooled._ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    }
+
+    osgdb.report("osgDB", encodedBytes);
+    decoder.report("decoder", encodedBytes);
+    pooled.report("pooled", encodedBytes);
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/Notify>
+#include <osgEarth/MapNode>
+#include <osgEarth/GeoData>
+#include <osgEarth/StringUtils>
+#include <osgEarthUtil/FlatteningLayer>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <iomanip>
+
+#define LC "[flatbench] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const std::string& msg)
+{
+    OE_NOTICE << msg << std::endl;
+    OE_NOTICE
+        << "\nUsage: osgearth_flatbench file.earth\n"
+        << "         [--layer name]      : name of the flattening layer (default = first one)\n"
+        << "         [--lod n]           : LOD of the tiles to create (default = 15)\n"
+        << "         [--lat y --lon x]   : location of the center tile (default = 46.7629, -121.6310)\n"
+        << "         [--size n]          : create an n x n block of tiles (default = 4)\n"
+        << std::endl;
+    return -1;
+}
+
+/**
+ * Times the creation of a block of heightfields from a FlatteningLayer.
+ * Adjacent tiles share a parent key, so the block also exercises the
+ * layer's per-parent feature cache.
+ *
+ * Example, using the roads in tests/roads-flattened.earth:
+ *   osgearth_flatbench roads-flattened.earth --lod 16 --size 8
+ */
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+    if (arguments.read("--help"))
+        return usage("");
+
+    std::string layerName;
+    arguments.read("--layer", layerName);
+
+    unsigned lod = 15u;
+    arguments.read("--lod", lod);
+
+    double lat = 46.7629136754553, lon = -121.6310413445486;
+    arguments.read("--lat", lat);
+    arguments.read("--lon", lon);
+
+    int size = 4;
+    arguments.read("--size", size);
+    size = std::max(size, 1);
+
+    osg::ref_ptr<MapNode> mapNode = MapNode::load(arguments);
+    if (!mapNode.valid())
+        return usage("Failed to load an earth file");
+
+    const Map* map = mapNode->getMap();
+
+    FlatteningLayer* layer = 0L;
+    if (!layerName.empty())
+    {
+        layer = map->getLayerByName<FlatteningLayer>(layerName);
+    }
+    else
+    {
+        std::vector< osg::ref_ptr<FlatteningLayer> > layers;
+        map->getLayers(layers);
+        if (!layers.empty())
+            layer = layers.front().get();
+    }
+
+    if (!layer)
+        return usage("No flattening layer found");
+
+    if (layer->getStatus().isError())
+        return usage(Stringify() << "Layer error: " << layer->getStatus().message());
+
+    GeoPoint location(SpatialReference::get("wgs84"), lon, lat, 0.0, ALTMODE_ABSOLUTE);
+    GeoPoint mapLocation;
+    location.transform(map->getProfile()->getSRS(), mapLocation);
+
+    TileKey center = map->getProfile()->createTileKey(mapLocation.x(), mapLocation.y(), lod);
+    if (!center.valid())
+        return usage("Location is not in the map profile");
+
+    OE_NOTICE << LC << "Creating " << size << " x " << size << " tiles around " << center.str() << std::endl;
+
+    unsigned count = 0u, written = 0u;
+    double total = 0.0, slowest = 0.0;
+
+    for (int dy = -size/2; dy < size - size/2; ++dy)
+    {
+        for (int dx = -size/2; dx < size - size/2; ++dx)
+        {
+            TileKey key = center.createNeighborKey(dx, dy);
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            GeoHeightField hf = layer->createHeightField(key, 0L);
+            double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+            OE_NOTICE << LC << key.str() << " : " << std::fixed << std::setprecision(2) << ms << " ms"
+                << (hf.valid() ? "" : " (empty)") << std::endl;
+
+            total += ms;
+            slowest = std::max(slowest, ms);
+            ++count;
+            if (hf.valid())
+                ++written;
+        }
+    }
+
+    OE_NOTICE << LC << "Tiles = " << count << " (" << written << " with data)"
+        << ", total = " << std::fixed << std::setprecision(2) << total << " ms"
+        << ", average = " << total/(double)count << " ms"
+        << ", slowest = " << slowest << " ms" << std::endl;
+
+    return 0;
+}
@@ -34,6 +34,7 @@
 #include <osgEarthUtil/TMSPackager>
 #include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
 #include <osgEarthDrivers/tms/TMSOptions>
+#include <osgEarthDrivers/mbtiles/MBTilesOptions>
 
 #include <iostream>
 #include <sstream>
@@ -75,6 +76,10 @@ usage( const std::string& msg = "" )
         << "            [--mt]                          ; Use multithreading to process the tiles." << std::endl
         << "            [--concurrency]                 ; The number of threads or processes to use if --mp or --mt are provided." << std::endl
         << "            [--alpha-mask]                  ; Mask out imagery that isn't in the provided extents." << std::endl
+        << "            [--encode-threads <num>]        ; Encode and write tiles in a pipeline, with this many encoding threads" << std::endl
+        << "            [--write-batch <num>]           ; Number of tiles per write transaction in the pipeline (default=1000)" << std::endl
+        << "            [--mbtiles]                     ; Write each layer to an MBTiles file in the output folder (uses the pipeline)" << std::endl
+        << "            [--dedup]                       ; With --mbtiles, store identical single-color tiles once" << std::endl
         << std::endl
         << "            [--verbose]                     ; Displays progress of the operation" << std::endl;
 
@@ -150,6 +155,18 @@ makeTMS( osg::ArgumentParser& args )
 
     bool applyAlphaMask = args.read("--alpha-mask");
 
+    // Pipeline settings
+    unsigned encodeThreads = 0;
+    args.read("--encode-threads", encodeThreads);
+
+    unsigned writeBatch = 1000;
+    args.read("--write-batch", writeBatch);
+
+    bool mbtiles = args.read("--mbtiles");
+    bool dedup = args.read("--dedup");
+    if (mbtiles && encodeThreads == 0)
+        encodeThreads = 1;
+
     bool writeXML = true;
 
     // load up the map
@@ -333,6 +350,17 @@ makeTMS( osg::ArgumentParser& args )
     packager.setOverwrite(overwrite);
     packager.setKeepEmpties(keepEmpties);
     packager.setApplyAlphaMask(applyAlphaMask);
+    packager.setNumEncodeThreads(encodeThreads);
+    packager.setWriteBatchSize(writeBatch);
+    if (mbtiles)
+    {
+        MBTilesTileWriter* writer = new MBTilesTileWriter();
+        writer->setDeduplicate(dedup);
+        packager.setTileWriter(writer);
+
+        // There's no TMS XML for an MBTiles file.
+        writeXML = false;
+    }
 
 
     // new map for an output earth file if necessary.
@@ -410,15 +438,28 @@ makeTMS( osg::ArgumentParser& args )
             {
                 std::string layerFolder = toLegalFileName( packager.getLayerName() );
 
-                // new TMS driver info:
-                TMSOptions tms;
-                tms.url() = URI(
-                    osgDB::concatPaths( layerFolder, "tms.xml" ),
-                    outEarthFile );
+                if (mbtiles)
+                {
+                    // new MBTiles driver info:
+                    MBTilesTileSourceOptions mbt;
+                    mbt.filename() = URI( layerFolder + ".mbtiles", outEarthFile );
 
-                ImageLayerOptions layerOptions( packager.getLayerName(), tms );
+                    ImageLayerOptions layerOptions( packager.getLayerName(), mbt );
 
-                outMap->addLayer( new ImageLayer( layerOptions ) );
+                    outMap->addLayer( new ImageLayer( layerOptions ) );
+                }
+                else
+                {
+                    // new TMS driver info:
+                    TMSOptions tms;
+                    tms.url() = URI(
+                        osgDB::concatPaths( layerFolder, "tms.xml" ),
+                        outEarthFile );
+
+                    ImageLayerOptions layerOptions( packager.getLayerName(), tms );
+
+                    outMap->addLayer( new ImageLayer( layerOptions ) );
+                }
             }
         }    
 
@@ -447,15 +488,28 @@ makeTMS( osg::ArgumentParser& args )
             {
                 std::string layerFolder = toLegalFileName( packager.getLayerName() );
 
-                // new TMS driver info:
-                TMSOptions tms;
-                tms.url() = URI(
-                    osgDB::concatPaths( layerFolder, "tms.xml" ),
-                    outEarthFile );
+                if (mbtiles)
+                {
+                    // new MBTiles driver info:
+                    MBTilesTileSourceOptions mbt;
+                    mbt.filename() = URI( layerFolder + ".mbtiles", outEarthFile );
 
-                ElevationLayerOptions layerOptions( packager.getLayerName(), tms );
+                    ElevationLayerOptions layerOptions( packager.getLayerName(), mbt );
 
-                outMap->addLayer( new ElevationLayer( layerOptions ) );
+                    outMap->addLayer( new ElevationLayer( layerOptions ) );
+                }
+                else
+                {
+                    // new TMS driver info:
+                    TMSOptions tms;
+                    tms.url() = URI(
+                        osgDB::concatPaths( layerFolder, "tms.xml" ),
+                        outEarthFile );
+
+                    ElevationLayerOptions layerOptions( packager.getLayerName(), tms );
+
+                    outMap->addLayer( new ElevationLayer( layerOptions ) );
+                }
             }
         }
 
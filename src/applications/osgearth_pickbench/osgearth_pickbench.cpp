@@ -0,0 +1,228 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+
+#include <osgEarth/Notify>
+#include <osgEarth/MapNode>
+#include <osgEarth/IntersectionPicker>
+#include <osgEarthUtil/EarthManipulator>
+#include <osgEarthUtil/ExampleResources>
+#include <osgViewer/Viewer>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <algorithm>
+#include <iomanip>
+#include <cstdlib>
+
+#define LC "[pickbench] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+int
+usage(const std::string& msg)
+{
+    OE_NOTICE << msg << std::endl;
+    OE_NOTICE
+        << "\nUsage: osgearth_pickbench file.earth\n"
+        << "         [--picks n]         : number of random picks per pass (default = 1000)\n"
+        << "         [--buffer pixels]   : pick buffer around each point (default = 5)\n"
+        << "         [--frames n]        : maximum number of frames to let paging settle (default = 1000)\n"
+        << MapNodeHelper().usage() << std::endl;
+    return -1;
+}
+
+namespace
+{
+    // One hit of a pick: what was hit and where.
+    struct HitRecord
+    {
+        const osg::Drawable* _drawable;
+        unsigned             _primitiveIndex;
+        osg::Vec3d           _point;
+
+        // Hits at the same distance come back in no particular order, so
+        // sort by what was hit instead.
+        bool operator < (const HitRecord& rhs) const
+        {
+            if (_drawable != rhs._drawable) return _drawable < rhs._drawable;
+            if (_primitiveIndex != rhs._primitiveIndex) return _primitiveIndex < rhs._primitiveIndex;
+            return _point < rhs._point;
+        }
+
+        bool matches(const HitRecord& rhs) const
+        {
+            return
+                _drawable == rhs._drawable &&
+                _primitiveIndex == rhs._primitiveIndex &&
+                (_point - rhs._point).length() <= 1e-6 * osg::maximum(1.0, _point.length());
+        }
+    };
+    typedef std::vector<HitRecord> HitRecords;
+
+    bool sameHits(const HitRecords& a, const HitRecords& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (unsigned i = 0; i < a.size(); ++i)
+        {
+            if (!a[i].matches(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+    struct Pass
+    {
+        Pass() : _ms(0.0), _hits(0u) { }
+        double                  _ms;
+        unsigned                _hits;
+        std::vector<HitRecords> _records;
+
+        void run(IntersectionPicker& picker, const std::vector<osg::Vec2f>& points)
+        {
+            std::vector<IntersectionPicker::Hits> results(points.size());
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                picker.pick(points[i].x(), points[i].y(), results[i]);
+            }
+            _ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+            // record the hits outside the timed loop
+            _records.resize(points.size());
+            for (unsigned i = 0; i < points.size(); ++i)
+            {
+                HitRecords& records = _records[i];
+                records.clear();
+                for (IntersectionPicker::Hits::const_iterator h = results[i].begin(); h != results[i].end(); ++h)
+                {
+                    HitRecord record;
+                    record._drawable       = h->drawable.get();
+                    record._primitiveIndex = h->primitiveIndex;
+                    record._point          = h->getLocalIntersectPoint();
+                    records.push_back(record);
+                }
+                std::sort(records.begin(), records.end());
+                _hits += records.size();
+            }
+        }
+
+        void report(const std::string& name) const
+        {
+            OE_NOTICE << LC << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(3)
+                << std::setw(10) << (_records.empty() ? 0.0 : _ms / (double)_records.size()) << " ms/pick"
+                << std::setw(10) << _hits << " hits" << std::endl;
+        }
+    };
+}
+
+/**
+ * Measures IntersectionPicker latency over a paged scene, comparing the
+ * full primitive scan against the per-geometry PrimitiveBVH, and checks
+ * that both return the same hits.
+ *
+ * Example:
+ *   osgearth_pickbench boston_buildings.earth --picks 500
+ */
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser arguments(&argc, argv);
+    if (arguments.read("--help"))
+        return usage("");
+
+    unsigned numPicks = 1000u;
+    arguments.read("--picks", numPicks);
+
+    float buffer = 5.0f;
+    arguments.read("--buffer", buffer);
+
+    unsigned maxFrames = 1000u;
+    arguments.read("--frames", maxFrames);
+
+    osgViewer::Viewer viewer(arguments);
+    viewer.setCameraManipulator(new EarthManipulator(arguments));
+
+    osg::Node* node = MapNodeHelper().load(arguments, &viewer);
+    MapNode* mapNode = MapNode::get(node);
+    if (!mapNode)
+        return usage("Failed to load a map");
+
+    viewer.setSceneData(node);
+    viewer.realize();
+
+    // Let the pager finish loading the current view.
+    unsigned frames = 0u;
+    do {
+        viewer.frame();
+    } while (++frames < maxFrames && (frames < 10u || viewer.getDatabasePager()->getRequestsInProgress()));
+
+    OE_NOTICE << LC << "Paging settled after " << frames << " frames" << std::endl;
+
+    const osg::Viewport* vp = viewer.getCamera()->getViewport();
+    if (!vp)
+        return usage("No viewport");
+
+    std::vector<osg::Vec2f> points(numPicks);
+    ::srand(1234);
+    for (unsigned i = 0; i < numPicks; ++i)
+    {
+        points[i].set(
+            vp->x() + vp->width()  * (float)::rand() / (float)RAND_MAX,
+            vp->y() + vp->height() * (float)::rand() / (float)RAND_MAX);
+    }
+
+    IntersectionPicker picker(&viewer, mapNode, ~0u, buffer, IntersectionPicker::NO_LIMIT);
+
+    Pass scan;
+    picker.setUseBVH(false);
+    scan.run(picker, points);
+
+    // First pass builds the BVHs; time the second.
+    Pass build, bvh;
+    picker.setUseBVH(true);
+    build.run(picker, points);
+    bvh.run(picker, points);
+
+    scan.report("scan");
+    build.report("bvh-build");
+    bvh.report("bvh");
+
+    unsigned mismatches = 0u;
+    for (unsigned i = 0; i < numPicks; ++i)
+    {
+        if (!sameHits(scan._records[i], bvh._records[i]))
+            ++mismatches;
+    }
+
+    if (mismatches > 0u)
+    {
+        OE_WARN << LC << mismatches << " of " << numPicks << " picks returned different hits" << std::endl;
+        return -1;
+    }
+
+    if (bvh._ms > 0.0)
+        OE_NOTICE << LC << "Speedup: " << std::fixed << std::setprecision(1) << scan._ms / bvh._ms << "x" << std::endl;
+
+    return 0;
+}
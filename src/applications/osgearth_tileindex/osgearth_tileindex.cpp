@@ -30,6 +30,8 @@
 
 #include <osgEarth/Progress>
 #include <osgEarthUtil/TileIndexBuilder>
+#include <osgEarthUtil/DataScanner>
+#include <osgEarth/StringUtils>
 
 
 
@@ -42,7 +44,87 @@ int main(int argc, char** argv)
     osg::ArgumentParser arguments(&argc,argv);
 
     std::string indexFilename = "index.shp";
-    while (arguments.read("--index", indexFilename));
+    bool indexSet = false;
+    while (arguments.read("--index", indexFilename)) indexSet = true;
+
+    // Convert an existing index to a packed (.oeidx) index instead of building one
+    std::string convertFilename;
+    while (arguments.read("--convert", convertFilename));
+
+    if (!convertFilename.empty())
+    {
+        if (!indexSet)
+        {
+            indexFilename = osgDB::getNameLessExtension( convertFilename ) + ".oeidx";
+        }
+
+        if (osgDB::fileExists( indexFilename ) )
+        {
+            OE_NOTICE << indexFilename << " exists, cannot overwrite existing index" << std::endl;
+            return 1;
+        }
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        TileIndexBuilder builder;
+        builder.setProgressCallback( new ConsoleProgressCallback() );
+        if (!builder.convert( convertFilename, indexFilename ))
+        {
+            OE_NOTICE << "Failed to convert " << convertFilename << std::endl;
+            return 1;
+        }
+
+        osg::Timer_t end = osg::Timer::instance()->tick();
+        OE_NOTICE << "Converted " << convertFilename << " to " << indexFilename << " in " << osg::Timer::instance()->delta_s( start, end) << "s" << std::endl;
+        return 0;
+    }
+
+    // Scan a directory on several threads and write a packed index, keeping
+    // what was learned about each file in a manifest for the next scan
+    std::string scanPath;
+    while (arguments.read("--scan", scanPath));
+
+    if (!scanPath.empty())
+    {
+        if (!indexSet)
+        {
+            indexFilename = "index.oeidx";
+        }
+
+        std::string extensions = "tif";
+        while (arguments.read("--extensions", extensions));
+
+        std::vector<std::string> extensionList;
+        StringTokenizer( extensions, extensionList, ",;", "", false, true );
+
+        DataScanner scanner;
+        scanner.setProgressCallback( new ConsoleProgressCallback() );
+
+        std::string manifest;
+        while (arguments.read("--manifest", manifest));
+        scanner.setManifest( manifest );
+
+        unsigned threads = 0;
+        while (arguments.read("--threads", threads));
+        if (threads > 0)
+        {
+            scanner.setNumThreads( threads );
+        }
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        std::vector<DataScanner::Entry> entries;
+        if (!scanner.scan( scanPath, extensionList, entries ) ||
+            !DataScanner::writeTileIndex( entries, indexFilename ))
+        {
+            OE_NOTICE << "Failed to build " << indexFilename << " from " << scanPath << std::endl;
+            return 1;
+        }
+
+        osg::Timer_t end = osg::Timer::instance()->tick();
+        OE_NOTICE << "Built index " << indexFilename << " of " << entries.size() << " files in " << osg::Timer::instance()->delta_s( start, end) << "s" << std::endl;
+        return 0;
+    }
 
     OE_NOTICE << "index name = " << indexFilename << std::endl;
 
@@ -78,7 +160,11 @@ int main(int argc, char** argv)
     {
         builder.getFilenames().push_back( filenames[i] );
     }        
-    builder.build( indexFilename );
+    if (!builder.build( indexFilename ))
+    {
+        OE_NOTICE << "Failed to build " << indexFilename << std::endl;
+        return 1;
+    }
 
     osg::Timer_t end = osg::Timer::instance()->tick();
     OE_NOTICE << "Built index " << indexFilename << " in " << osg::Timer::instance()->delta_s( start, end) << "s" << std::endl;
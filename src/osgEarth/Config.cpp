@@ -29,6 +29,23 @@
 #include <sstream>
 #include <fstream>
 #include <iomanip>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef NOGDI
+#    define NOGDI
+#  endif
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
 
 using namespace osgEarth;
 
@@ -441,3 +458,354 @@ Config::operator - ( const Config& rhs ) const
 
     return result;
 }
+
+/****************************************************************/
+
+namespace
+{
+    // Binary Config layout, in host byte order with a byte order mark:
+    //   BinaryHeader
+    //   BinaryNode[numNodes]       breadth-first; node 0 is the root and the
+    //                              children of each node are consecutive
+    //   uint32_t[numStrings+1]     offsets of the strings in the string data
+    //   char[stringBytes]          string data; string 0 is ""
+    const char     BINARY_MAGIC[8] = { 'O','E','C','O','N','F','I','G' };
+    const uint32_t BINARY_BYTE_ORDER = 0x01020304u;
+    const uint32_t BINARY_VERSION = 1u;
+
+    struct BinaryHeader
+    {
+        char     _magic[8];
+        uint32_t _byteOrder;
+        uint32_t _version;
+        uint32_t _numNodes;
+        uint32_t _numStrings;
+        uint32_t _stringBytes;
+        uint32_t _reserved;
+    };
+
+    struct BinaryNode
+    {
+        uint32_t _key;
+        uint32_t _value;
+        uint32_t _externalRef;
+        uint32_t _flags;
+        uint32_t _firstChild;
+        uint32_t _numChildren;
+    };
+
+    const uint32_t FLAG_IS_LOCATION = 1u;
+
+    // Assigns each distinct string an index.
+    struct StringTable
+    {
+        StringTable() : _bytes(0u)
+        {
+            intern( std::string() );
+        }
+
+        uint32_t intern(const std::string& value)
+        {
+            std::map<std::string, uint32_t>::const_iterator i = _indices.find(value);
+            if ( i != _indices.end() )
+                return i->second;
+
+            uint32_t index = (uint32_t)_strings.size();
+            _indices[value] = index;
+            _strings.push_back( &_indices.find(value)->first );
+            _bytes += value.size();
+            return index;
+        }
+
+        std::map<std::string, uint32_t>   _indices;
+        std::vector<const std::string*>   _strings;
+        uint64_t                          _bytes;
+    };
+
+    // Read-only memory mapping of a whole file.
+    class MappedFile
+    {
+    public:
+        MappedFile() : _data(0L), _size(0)
+#ifdef _WIN32
+            , _file(INVALID_HANDLE_VALUE), _mapping(0L)
+#endif
+        { }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if ( _data )
+                ::UnmapViewOfFile( _data );
+            if ( _mapping )
+                ::CloseHandle( _mapping );
+            if ( _file != INVALID_HANDLE_VALUE )
+                ::CloseHandle( _file );
+#else
+            if ( _data )
+                ::munmap( _data, _size );
+#endif
+        }
+
+        bool map(const std::string& filename)
+        {
+#ifdef _WIN32
+            _file = ::CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0L, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0L );
+            if ( _file == INVALID_HANDLE_VALUE )
+                return false;
+
+            LARGE_INTEGER size;
+            if ( !::GetFileSizeEx(_file, &size) || size.QuadPart == 0 )
+                return false;
+            _size = (size_t)size.QuadPart;
+
+            _mapping = ::CreateFileMappingA( _file, 0L, PAGE_READONLY, 0, 0, 0L );
+            if ( !_mapping )
+                return false;
+
+            _data = ::MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+            return _data != 0L;
+#else
+            int fd = ::open( filename.c_str(), O_RDONLY );
+            if ( fd < 0 )
+                return false;
+
+            struct stat info;
+            if ( ::fstat(fd, &info) != 0 || info.st_size == 0 )
+            {
+                ::close( fd );
+                return false;
+            }
+            _size = (size_t)info.st_size;
+
+            void* data = ::mmap( 0L, _size, PROT_READ, MAP_SHARED, fd, 0 );
+            ::close( fd );
+            if ( data == MAP_FAILED )
+                return false;
+
+            _data = data;
+            return true;
+#endif
+        }
+
+        const void* data() const { return _data; }
+        size_t size() const { return _size; }
+
+    private:
+        void*  _data;
+        size_t _size;
+#ifdef _WIN32
+        HANDLE _file;
+        HANDLE _mapping;
+#endif
+    };
+}
+
+bool
+Config::toBinary( std::ostream& out ) const
+{
+    // Lay the objects out breadth-first so that siblings are consecutive.
+    std::vector<const Config*> order;
+    order.push_back( this );
+
+    StringTable strings;
+    std::vector<BinaryNode> nodes;
+
+    for(unsigned i = 0; i < order.size(); ++i)
+    {
+        const Config* conf = order[i];
+
+        BinaryNode node;
+        node._key         = strings.intern( conf->_key );
+        node._value       = strings.intern( conf->_defaultValue );
+        node._externalRef = strings.intern( conf->_externalRef );
+        node._flags       = conf->_isLocation ? FLAG_IS_LOCATION : 0u;
+        node._firstChild  = (uint32_t)order.size();
+        node._numChildren = (uint32_t)conf->_children.size();
+        nodes.push_back( node );
+
+        for(ConfigSet::const_iterator c = conf->_children.begin(); c != conf->_children.end(); ++c)
+            order.push_back( &(*c) );
+    }
+
+    if ( strings._bytes > 0xFFFFFFFFu )
+    {
+        OE_WARN << LC << "Config is too large to encode" << std::endl;
+        return false;
+    }
+
+    BinaryHeader header;
+    ::memcpy( header._magic, BINARY_MAGIC, sizeof(header._magic) );
+    header._byteOrder   = BINARY_BYTE_ORDER;
+    header._version     = BINARY_VERSION;
+    header._numNodes    = (uint32_t)nodes.size();
+    header._numStrings  = (uint32_t)strings._strings.size();
+    header._stringBytes = (uint32_t)strings._bytes;
+    header._reserved    = 0u;
+
+    std::vector<uint32_t> offsets;
+    offsets.reserve( strings._strings.size() + 1 );
+    uint32_t offset = 0u;
+    for(unsigned i = 0; i < strings._strings.size(); ++i)
+    {
+        offsets.push_back( offset );
+        offset += (uint32_t)strings._strings[i]->size();
+    }
+    offsets.push_back( offset );
+
+    out.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    out.write( reinterpret_cast<const char*>(&nodes[0]), nodes.size() * sizeof(BinaryNode) );
+    out.write( reinterpret_cast<const char*>(&offsets[0]), offsets.size() * sizeof(uint32_t) );
+    for(unsigned i = 0; i < strings._strings.size(); ++i)
+        out.write( strings._strings[i]->data(), strings._strings[i]->size() );
+
+    return !out.fail();
+}
+
+bool
+Config::isBinary( const void* data, size_t size )
+{
+    return
+        data != 0L &&
+        size >= sizeof(BinaryHeader) &&
+        ::memcmp( data, BINARY_MAGIC, sizeof(BINARY_MAGIC) ) == 0;
+}
+
+bool
+Config::fromBinary( const void* data, size_t size )
+{
+    if ( !isBinary(data, size) )
+        return false;
+
+    BinaryHeader header;
+    ::memcpy( &header, data, sizeof(header) );
+    if ( header._byteOrder != BINARY_BYTE_ORDER || header._version != BINARY_VERSION || header._numNodes == 0u )
+    {
+        OE_WARN << LC << "Unsupported binary Config" << std::endl;
+        return false;
+    }
+
+    uint64_t nodesOffset   = sizeof(BinaryHeader);
+    uint64_t offsetsOffset = nodesOffset + (uint64_t)header._numNodes * sizeof(BinaryNode);
+    uint64_t stringsOffset = offsetsOffset + ((uint64_t)header._numStrings + 1u) * sizeof(uint32_t);
+    if ( stringsOffset + header._stringBytes > (uint64_t)size )
+    {
+        OE_WARN << LC << "Truncated binary Config" << std::endl;
+        return false;
+    }
+
+    const char*       base    = static_cast<const char*>(data);
+    const BinaryNode* nodes   = reinterpret_cast<const BinaryNode*>(base + nodesOffset);
+    const uint32_t*   offsets = reinterpret_cast<const uint32_t*>(base + offsetsOffset);
+    const char*       chars   = base + stringsOffset;
+
+    // Each string is copied out once and shared by every object using it.
+    std::vector<std::string> strings( header._numStrings );
+    for(uint32_t i = 0; i < header._numStrings; ++i)
+    {
+        if ( offsets[i] > offsets[i+1] || offsets[i+1] > header._stringBytes )
+            return false;
+        strings[i].assign( chars + offsets[i], offsets[i+1] - offsets[i] );
+    }
+
+    // Make sure the nodes form a single breadth-first tree.
+    uint64_t next = 1u;
+    for(uint32_t i = 0; i < header._numNodes; ++i)
+    {
+        const BinaryNode& node = nodes[i];
+        if ( node._key >= header._numStrings || node._value >= header._numStrings || node._externalRef >= header._numStrings )
+            return false;
+        if ( node._numChildren > 0u && node._firstChild != next )
+            return false;
+        next += node._numChildren;
+    }
+    if ( next != header._numNodes )
+        return false;
+
+    *this = Config();
+
+    std::vector< std::pair<Config*, uint32_t> > stack;
+    stack.push_back( std::make_pair(this, 0u) );
+    while( !stack.empty() )
+    {
+        Config*           conf = stack.back().first;
+        const BinaryNode& node = nodes[stack.back().second];
+        stack.pop_back();
+
+        conf->_key          = strings[node._key];
+        conf->_defaultValue = strings[node._value];
+        conf->_externalRef  = strings[node._externalRef];
+        conf->_isLocation   = (node._flags & FLAG_IS_LOCATION) != 0u;
+
+        for(uint32_t c = 0; c < node._numChildren; ++c)
+        {
+            conf->_children.push_back( Config() );
+            stack.push_back( std::make_pair(&conf->_children.back(), node._firstChild + c) );
+        }
+    }
+
+    return true;
+}
+
+bool
+Config::writeBinaryFile( const std::string& filename ) const
+{
+    osgEarth::makeDirectoryForFile( filename );
+    std::ofstream out( filename.c_str(), std::ios::out | std::ios::binary );
+    if ( !out.is_open() )
+        return false;
+    return toBinary( out );
+}
+
+bool
+Config::readBinaryFile( const std::string& filename )
+{
+    MappedFile file;
+    if ( !file.map(filename) || !isBinary(file.data(), file.size()) )
+        return false;
+
+    if ( !fromBinary(file.data(), file.size()) )
+        return false;
+
+    setReferrer( filename );
+    return true;
+}
+
+/****************************************************************/
+
+ConfigIndex::ConfigIndex( const Config& conf )
+{
+    for( ConfigSet::const_iterator i = conf.children().begin(); i != conf.children().end(); ++i )
+    {
+        _index[i->key()].push_back( &(*i) );
+    }
+}
+
+bool
+ConfigIndex::hasChild( const std::string& key ) const
+{
+    return _index.find( key ) != _index.end();
+}
+
+const Config*
+ConfigIndex::child_ptr( const std::string& key ) const
+{
+    Index::const_iterator i = _index.find( key );
+    return i != _index.end() ? i->second.front() : 0L;
+}
+
+const Config&
+ConfigIndex::child( const std::string& key ) const
+{
+    const Config* c = child_ptr( key );
+    static Config s_emptyConf;
+    return c ? *c : s_emptyConf;
+}
+
+const std::vector<const Config*>&
+ConfigIndex::children( const std::string& key ) const
+{
+    Index::const_iterator i = _index.find( key );
+    static std::vector<const Config*> s_empty;
+    return i != _index.end() ? i->second : s_empty;
+}
@@ -109,6 +109,12 @@ ElevationLayerOptions::mergeConfig( const Config& conf )
 
 namespace
 {
+    // Heightfield and normal map shared by coalesced createHeightField requests.
+    struct SharedHeightField : public osg::Referenced
+    {
+        GeoHeightField _hf;
+    };
+
     // Opeartion that replaces invalid heights with the NO_DATA_VALUE marker.
     struct NormalizeNoDataValues : public TileSource::HeightFieldOperation
     {
@@ -415,6 +421,33 @@ ElevationLayer::createHeightField(const TileKey& key)
 GeoHeightField
 ElevationLayer::createHeightField(const TileKey&    key,
                                   ProgressCallback* progress )
+{
+    // Concurrent requests for the same tile share a single result.
+    std::string requestKey = Stringify() << key.str() << "_" << key.getProfile()->getFullSignature();
+
+    osg::ref_ptr<osg::Referenced> shared;
+    if ( joinTileRequest(requestKey, progress, shared) )
+    {
+        SharedHeightField* hf = static_cast<SharedHeightField*>( shared.get() );
+        return hf ? hf->_hf : GeoHeightField::INVALID;
+    }
+
+    GeoHeightField result = createHeightFieldImpl( key, progress );
+
+    osg::ref_ptr<SharedHeightField> hf;
+    if ( result.valid() )
+    {
+        hf = new SharedHeightField();
+        hf->_hf = result;
+    }
+    endTileRequest( requestKey, hf.get(), progress && progress->isCanceled() );
+
+    return result;
+}
+
+GeoHeightField
+ElevationLayer::createHeightFieldImpl(const TileKey&    key,
+                                      ProgressCallback* progress )
 {
     METRIC_SCOPED_EX("ElevationLayer::createHeightField", 2,
                      "key", key.str().c_str(),
@@ -17,13 +17,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/GeometryClamper>
+#include <osgEarth/GeoData>
 
 #include <osgUtil/IntersectionVisitor>
 
 #include <osg/Geode>
 #include <osg/Geometry>
+#include <osg/TriangleFunctor>
 #include <osg/UserDataContainer>
 
+#include <float.h>
+#include <set>
+
 #define LC "[GeometryClamper] "
 
 using namespace osgEarth;
@@ -192,3 +197,551 @@ GeometryClamperCallback::onTileAdded(const TileKey&          key,
 {
     tile->accept( _clamper );
 }
+
+//-----------------------------------------------------------------------
+
+#undef  LC
+#define LC "[AsyncGeometryClamper] "
+
+struct AsyncGeometryClamper::CollectTargets : public osg::NodeVisitor
+{
+    CollectTargets() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+    {
+        this->setNodeMaskOverride( ~0 );
+    }
+
+    void apply(osg::Transform& xform)
+    {
+        osg::Matrixd matrix;
+        if ( !_matrixStack.empty() ) matrix = _matrixStack.back();
+        xform.computeLocalToWorldMatrix( matrix, this );
+        _matrixStack.push_back( matrix );
+        traverse(xform);
+        _matrixStack.pop_back();
+    }
+
+    void apply(osg::Drawable& drawable)
+    {
+        osg::Geometry* geom = drawable.asGeometry();
+        if ( geom && dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) )
+        {
+            _geoms.push_back( geom );
+            _matrices.push_back( _matrixStack.back() );
+        }
+    }
+
+    osg::fast_back_stack<osg::Matrixd>        _matrixStack;
+    std::vector< osg::ref_ptr<osg::Geometry> > _geoms;
+    std::vector<osg::Matrixd>                  _matrices;
+};
+
+namespace
+{
+    struct CopyTriangles
+    {
+        osg::Vec3Array* _verts;
+
+        void operator()(const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3, bool)
+        {
+            _verts->push_back( v1 );
+            _verts->push_back( v2 );
+            _verts->push_back( v3 );
+        }
+    };
+}
+
+// Copies the triangles of the tile's drawables, so the worker never touches
+// geometry the update thread may change or expire.
+struct AsyncGeometryClamper::CollectTileDrawables : public osg::NodeVisitor
+{
+    CollectTileDrawables() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) { }
+
+    void apply(osg::Transform& xform)
+    {
+        osg::Matrixd matrix;
+        if ( !_matrixStack.empty() ) matrix = _matrixStack.back();
+        xform.computeLocalToWorldMatrix( matrix, this );
+        _matrixStack.push_back( matrix );
+        traverse(xform);
+        _matrixStack.pop_back();
+    }
+
+    void apply(osg::Drawable& drawable)
+    {
+        osg::ref_ptr<osg::Vec3Array> verts = new osg::Vec3Array();
+        osg::TriangleFunctor<CopyTriangles> copy;
+        copy._verts = verts.get();
+        drawable.accept( copy );
+        if ( verts->empty() )
+            return;
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setUseDisplayList( false );
+        geom->setVertexArray( verts.get() );
+        geom->addPrimitiveSet( new osg::DrawArrays(GL_TRIANGLES, 0, verts->size()) );
+
+        TileDrawable td;
+        td._drawable = geom;
+        td._local2world = _matrixStack.back();
+        td._world2local.invert( td._local2world );
+        _drawables.push_back( td );
+    }
+
+    osg::fast_back_stack<osg::Matrixd> _matrixStack;
+    TileDrawables                      _drawables;
+};
+
+struct AsyncGeometryClamper::ReclampTask : public TaskRequest
+{
+    // The clamper outlives its tasks: its destructor shuts down the
+    // worker before any members go away.
+    ReclampTask(AsyncGeometryClamper* clamper, const TileKey& key, const TileDrawables& drawables) :
+        _clamper  ( clamper ),
+        _key      ( key ),
+        _drawables( drawables ) { }
+
+    void operator()(ProgressCallback* progress)
+    {
+        _clamper->reclamp( _key, _drawables );
+    }
+
+    AsyncGeometryClamper* _clamper;
+    TileKey               _key;
+    TileDrawables         _drawables;
+};
+
+struct AsyncGeometryClamper::PublishCallback : public osg::NodeCallback
+{
+    PublishCallback(AsyncGeometryClamper* clamper, Registration* reg) :
+        _clamper( clamper ),
+        _reg    ( reg ) { }
+
+    void operator()(osg::Node* node, osg::NodeVisitor* nv)
+    {
+        osg::ref_ptr<AsyncGeometryClamper> clamper;
+        if ( _clamper.lock(clamper) )
+            clamper->publish( _reg );
+        traverse(node, nv);
+    }
+
+    osg::observer_ptr<AsyncGeometryClamper> _clamper;
+    Registration*                           _reg;      // owns this callback
+};
+
+
+AsyncGeometryClamper::AsyncGeometryClamper(const Profile* profile) :
+_profile    ( profile ),
+_indexLevel ( 14u ),
+_pendingJobs( 0u )
+{
+    // A single worker: jobs run in tile arrival order, and only the worker
+    // ever writes the back buffers.
+    _service = new TaskService( "AsyncGeometryClamper", 1 );
+}
+
+AsyncGeometryClamper::~AsyncGeometryClamper()
+{
+    // waits for the running job, if any
+    _service = 0L;
+
+    for(Registrations::iterator i = _registrations.begin(); i != _registrations.end(); ++i)
+    {
+        osg::ref_ptr<osg::Node> graph;
+        if ( (*i)->_graph.lock(graph) )
+            graph->removeUpdateCallback( (*i)->_callback.get() );
+    }
+}
+
+void
+AsyncGeometryClamper::add(osg::Node* graph, bool preserveZ, float offset, float scale)
+{
+    if ( !graph || !_profile.valid() )
+        return;
+
+    remove( graph );
+
+    const SpatialReference*    srs          = _profile->getSRS();
+    const osg::EllipsoidModel* em           = srs->getEllipsoid();
+    bool                       isGeocentric = srs->isGeographic();
+
+    CollectTargets collect;
+    graph->accept( collect );
+    if ( collect._geoms.empty() )
+        return;
+
+    osg::ref_ptr<Registration> reg = new Registration();
+    reg->_graph = graph;
+    reg->_dirty = false;
+
+    // index the vertices outside the lock and merge them in afterwards.
+    VertexIndex index;
+
+    for(unsigned i=0; i<collect._geoms.size(); ++i)
+    {
+        osg::Geometry* geom = collect._geoms[i].get();
+        const osg::Vec3Array* verts = static_cast<const osg::Vec3Array*>(geom->getVertexArray());
+
+        Target* target = new Target();
+        target->_geom         = geom;
+        target->_local2world  = collect._matrices[i];
+        target->_world2local.invert( target->_local2world );
+        target->_back.assign( verts->begin(), verts->end() );
+        target->_offset       = offset;
+        target->_scale        = scale;
+        target->_registration = reg.get();
+        target->_removed      = false;
+
+        // Reuse the z offsets recorded by a GeometryClamper; failing that,
+        // record the current heights.
+        bool buildZOffsets = false;
+        if ( preserveZ )
+        {
+            const osg::UserDataContainer* udc = geom->getUserDataContainer();
+            if ( udc )
+            {
+                unsigned n = udc->getUserObjectIndex( ZOFFSETS_NAME );
+                const osg::FloatArray* zOffsets = n < udc->getNumUserObjects() ?
+                    dynamic_cast<const osg::FloatArray*>(udc->getUserObject(n)) : 0L;
+                if ( zOffsets && zOffsets->size() == verts->size() )
+                    target->_zOffsets.assign( zOffsets->begin(), zOffsets->end() );
+            }
+            buildZOffsets = target->_zOffsets.empty();
+        }
+
+        for( unsigned k=0; k<verts->size(); ++k )
+        {
+            osg::Vec3d vw = (*verts)[k];
+            vw = vw * target->_local2world;
+
+            if ( buildZOffsets )
+            {
+                if ( isGeocentric )
+                {
+                    double lat, lon, hae;
+                    em->convertXYZToLatLongHeight(vw.x(), vw.y(), vw.z(), lat, lon, hae);
+                    target->_zOffsets.push_back( hae );
+                }
+                else
+                {
+                    target->_zOffsets.push_back( float(vw.z()) );
+                }
+            }
+
+            GeoPoint point;
+            if ( point.fromWorld(srs, vw) )
+            {
+                TileKey key = _profile->createTileKey( point.x(), point.y(), _indexLevel );
+                if ( key.valid() )
+                {
+                    VertexRef ref;
+                    ref._target = target;
+                    ref._index  = k;
+                    index[key].push_back( ref );
+                }
+            }
+        }
+
+        // vertices now change during the update traversal.
+        geom->setDataVariance( osg::Object::DYNAMIC );
+
+        reg->_targets.push_back( target );
+    }
+
+    reg->_callback = new PublishCallback( this, reg.get() );
+    graph->addUpdateCallback( reg->_callback.get() );
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    // forget graphs that have gone away.
+    for(Registrations::iterator i = _registrations.begin(); i != _registrations.end(); )
+    {
+        if ( !(*i)->_graph.valid() )
+        {
+            removeTargets( i->get() );
+            i = _registrations.erase( i );
+        }
+        else ++i;
+    }
+
+    for(VertexIndex::iterator i = index.begin(); i != index.end(); ++i)
+    {
+        VertexRefs& refs = _index[i->first];
+        refs.insert( refs.end(), i->second.begin(), i->second.end() );
+    }
+
+    _registrations.push_back( reg.get() );
+
+    OE_DEBUG << LC << "Indexed " << index.size() << " tiles of vertices" << std::endl;
+}
+
+void
+AsyncGeometryClamper::remove(osg::Node* graph)
+{
+    osg::ref_ptr<Registration> reg;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+
+        for(Registrations::iterator i = _registrations.begin(); i != _registrations.end(); ++i)
+        {
+            if ( (*i)->_graph.get() == graph )
+            {
+                reg = i->get();
+                _registrations.erase( i );
+                break;
+            }
+        }
+
+        if ( !reg.valid() )
+            return;
+
+        removeTargets( reg.get() );
+    }
+
+    graph->removeUpdateCallback( reg->_callback.get() );
+}
+
+void
+AsyncGeometryClamper::removeTargets(const Registration* reg)
+{
+    // a running job may still hold these targets; it checks the flag
+    // before touching the registration.
+    for(Targets::const_iterator t = reg->_targets.begin(); t != reg->_targets.end(); ++t)
+        (*t)->_removed = true;
+
+    for(VertexIndex::iterator i = _index.begin(); i != _index.end(); )
+    {
+        VertexRefs& refs = i->second;
+        unsigned k = 0;
+        for(unsigned j = 0; j < refs.size(); ++j)
+        {
+            if ( refs[j]._target->_registration != reg )
+                refs[k++] = refs[j];
+        }
+        refs.resize( k );
+
+        if ( refs.empty() )
+            _index.erase( i++ );
+        else
+            ++i;
+    }
+}
+
+unsigned
+AsyncGeometryClamper::getNumPendingJobs() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _pendingJobs;
+}
+
+bool
+AsyncGeometryClamper::findAffected(const TileKey& key, VertexRefs* output) const
+{
+    if ( key.getLOD() >= _indexLevel )
+    {
+        VertexIndex::const_iterator i = _index.find( key.createAncestorKey(_indexLevel) );
+        if ( i == _index.end() )
+            return false;
+        if ( output )
+            output->insert( output->end(), i->second.begin(), i->second.end() );
+        return true;
+    }
+
+    bool found = false;
+    for(VertexIndex::const_iterator i = _index.begin(); i != _index.end(); ++i)
+    {
+        if ( i->first.createAncestorKey(key.getLOD()) == key )
+        {
+            if ( !output )
+                return true;
+            output->insert( output->end(), i->second.begin(), i->second.end() );
+            found = true;
+        }
+    }
+    return found;
+}
+
+void
+AsyncGeometryClamper::onTileAdded(const TileKey&          key,
+                                  osg::Node*              tile,
+                                  TerrainCallbackContext& context)
+{
+    if ( !tile || !key.valid() )
+        return;
+
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        if ( !findAffected(key, 0L) )
+            return;
+    }
+
+    // Copy the tile's triangles now, on the update thread; the worker
+    // intersects the copies and never touches the live scene graph.
+    CollectTileDrawables collect;
+    tile->accept( collect );
+    if ( collect._drawables.empty() )
+        return;
+
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        ++_pendingJobs;
+    }
+
+    _service->add( new ReclampTask(this, key, collect._drawables) );
+}
+
+void
+AsyncGeometryClamper::reclamp(const TileKey& key, const TileDrawables& drawables)
+{
+    VertexRefs refs;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        findAffected( key, &refs );
+    }
+
+    const SpatialReference*    srs          = _profile->getSRS();
+    const osg::EllipsoidModel* em           = srs->getEllipsoid();
+    bool                       isGeocentric = srs->isGeographic();
+
+    double r = std::min( em->getRadiusEquator(), em->getRadiusPolar() );
+
+    osg::ref_ptr<osgUtil::LineSegmentIntersector> lsi =
+        new osgUtil::LineSegmentIntersector(osg::Vec3d(0,0,0), osg::Vec3d(0,0,0));
+    osgUtil::IntersectionVisitor iv( lsi.get() );
+
+    std::vector<unsigned>   hits;
+    std::vector<osg::Vec3f> results;
+
+    osg::Vec3d n_vector(0,0,1), msl;
+
+    for(unsigned i=0; i<refs.size(); ++i)
+    {
+        // Only this thread writes _back, so it is safe to read unlocked.
+        const Target* target = refs[i]._target.get();
+        unsigned      k      = refs[i]._index;
+
+        osg::Vec3d vw = target->_back[k];
+        vw = vw * target->_local2world;
+
+        if ( isGeocentric )
+        {
+            n_vector = em->computeLocalUpVector(vw.x(),vw.y(),vw.z());
+
+            if ( target->_scale != 1.0 )
+            {
+                double lat,lon,hae;
+                em->convertXYZToLatLongHeight(vw.x(), vw.y(), vw.z(), lat, lon, hae);
+                msl = vw - n_vector*hae;
+            }
+        }
+
+        osg::Vec3d start = vw + n_vector*r*target->_scale;
+        osg::Vec3d end   = vw - n_vector*r;
+
+        bool       hit  = false;
+        double     best = DBL_MAX;
+        osg::Vec3d fw;
+
+        for(TileDrawables::const_iterator d = drawables.begin(); d != drawables.end(); ++d)
+        {
+            lsi->reset();
+            lsi->setStart( start * d->_world2local );
+            lsi->setEnd( end * d->_world2local );
+            lsi->setIntersectionLimit( lsi->LIMIT_NEAREST );
+            lsi->intersect( iv, d->_drawable.get() );
+
+            if ( lsi->containsIntersections() )
+            {
+                osg::Vec3d p = lsi->getFirstIntersection().getLocalIntersectPoint() * d->_local2world;
+                double dist2 = (p - start).length2();
+                if ( dist2 < best )
+                {
+                    best = dist2;
+                    fw   = p;
+                    hit  = true;
+                }
+            }
+        }
+
+        if ( hit )
+        {
+            if ( target->_scale != 1.0 )
+            {
+                osg::Vec3d delta = fw - msl;
+                fw += delta*target->_scale;
+            }
+            if ( target->_offset != 0.0 )
+            {
+                fw += n_vector*target->_offset;
+            }
+            if ( !target->_zOffsets.empty() )
+            {
+                fw += n_vector * target->_zOffsets[k];
+            }
+
+            hits.push_back( i );
+            results.push_back( fw * target->_world2local );
+        }
+    }
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    for(unsigned i=0; i<hits.size(); ++i)
+    {
+        Target* target = refs[hits[i]]._target.get();
+        if ( target->_removed )
+            continue;
+
+        unsigned k = refs[hits[i]]._index;
+        target->_back[k] = results[i];
+        target->_changed.push_back( k );
+        target->_registration->_dirty = true;
+    }
+
+    --_pendingJobs;
+
+    OE_DEBUG << LC << key.str() << ": clamped " << hits.size() << " of " << refs.size() << " verts." << std::endl;
+}
+
+void
+AsyncGeometryClamper::publish(Registration* reg)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( !reg->_dirty )
+        return;
+
+    for(Targets::iterator t = reg->_targets.begin(); t != reg->_targets.end(); ++t)
+    {
+        Target* target = t->get();
+        if ( target->_changed.empty() )
+            continue;
+
+        osg::ref_ptr<osg::Geometry> geom;
+        if ( target->_geom.lock(geom) )
+        {
+            osg::Vec3Array* verts = dynamic_cast<osg::Vec3Array*>(geom->getVertexArray());
+            if ( verts && verts->size() == target->_back.size() )
+            {
+                for(std::vector<unsigned>::const_iterator k = target->_changed.begin(); k != target->_changed.end(); ++k)
+                {
+                    (*verts)[*k] = target->_back[*k];
+                }
+
+                geom->dirtyBound();
+                if ( geom->getUseVertexBufferObjects() && verts->getVertexBufferObject() )
+                {
+                    verts->getVertexBufferObject()->setUsage( GL_DYNAMIC_DRAW_ARB );
+                    verts->dirty();
+                }
+                else
+                {
+                    geom->dirtyDisplayList();
+                }
+            }
+        }
+
+        target->_changed.clear();
+    }
+
+    reg->_dirty = false;
+}
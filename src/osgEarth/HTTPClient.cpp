@@ -22,6 +22,7 @@
 #include <osgEarth/Progress>
 #include <osgEarth/StringUtils>
 #include <osgEarth/Metrics>
+#include <osgEarth/ImageDecoder>
 #include <osgDB/ReadFile>
 #include <osgDB/Registry>
 #include <osgDB/FileNameUtils>
@@ -1398,6 +1399,46 @@ namespace
 
         return reader;
     }
+
+    // Reads the contents of a stream buffer in place. Naming the protected
+    // accessors through a derived class is what makes this legal.
+    struct StreamBufferAccess : public std::streambuf
+    {
+        static const char* data(std::streambuf* buf, unsigned& size)
+        {
+            char* begin = (buf->*&StreamBufferAccess::eback)();
+            char* end   = (buf->*&StreamBufferAccess::egptr)();
+
+            // data written through the put area may be past the get area.
+            char* put = (buf->*&StreamBufferAccess::pptr)();
+            if ( put )
+            {
+                begin = (buf->*&StreamBufferAccess::pbase)();
+                if ( put > end )
+                    end = put;
+            }
+
+            size = begin && end > begin ? (unsigned)(end - begin) : 0u;
+            return begin;
+        }
+    };
+
+    // Decodes the first response part straight from memory if it is in a
+    // format with a built-in ImageDecoder; otherwise returns NULL.
+    osg::Image*
+    decodeImage( const HTTPResponse& response )
+    {
+        if ( response.getNumParts() == 0 )
+            return 0L;
+
+        unsigned size = 0u;
+        const char* data = StreamBufferAccess::data( response.getPartStream(0).rdbuf(), size );
+        if ( size == 0u || !ImageDecoder::isSupported(ImageDecoder::getFormat(data, size)) )
+            return 0L;
+
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        return ImageDecoder().decodeInto(data, size, image.get()) ? image.release() : 0L;
+    }
 }
 
 ReadResult
@@ -1413,8 +1454,14 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
 
     if (response.isOK())
     {
-        osgDB::ReaderWriter* reader = getReader(request.getURL(), response);
-        if (!reader)
+        osg::ref_ptr<osg::Image> image = decodeImage(response);
+        osgDB::ReaderWriter* reader = image.valid() ? 0L : getReader(request.getURL(), response);
+        if (image.valid())
+        {
+            result = ReadResult(image.release());
+        }
+
+        else if (!reader)
         {
             result = ReadResult(ReadResult::RESULT_NO_READER);
         }
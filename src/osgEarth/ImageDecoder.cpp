@@ -0,0 +1,477 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/ImageDecoder>
+#include <osgEarth/Notify>
+#include <osgDB/Registry>
+#include <cstring>
+#include <istream>
+#include <streambuf>
+
+#ifdef OSGEARTH_HAVE_LIBJPEG
+#include <cstdio>
+#include <csetjmp>
+extern "C" {
+#include <jpeglib.h>
+}
+#endif
+
+#ifdef OSGEARTH_HAVE_LIBPNG
+#include <png.h>
+#endif
+
+#ifdef OSGEARTH_HAVE_LIBWEBP
+#include <webp/decode.h>
+#endif
+
+#define LC "[ImageDecoder] "
+
+using namespace osgEarth;
+
+namespace
+{
+    // (Re)allocates an image only if its size or format is changing.
+    void prepare(osg::Image* image, int s, int t, GLenum format)
+    {
+        if (image->data() == 0L ||
+            image->s() != s ||
+            image->t() != t ||
+            image->r() != 1 ||
+            image->getPixelFormat() != format ||
+            image->getDataType() != GL_UNSIGNED_BYTE ||
+            image->getPacking() != 1)
+        {
+            image->allocateImage(s, t, 1, format, GL_UNSIGNED_BYTE, 1);
+        }
+        image->setInternalTextureFormat(format);
+        image->setFileName(std::string());
+    }
+
+    // Read-only streambuf over a memory span, for the osgDB fallback.
+    struct MemoryStreamBuf : public std::streambuf
+    {
+        MemoryStreamBuf(const void* data, unsigned size)
+        {
+            char* begin = const_cast<char*>(static_cast<const char*>(data));
+            setg(begin, begin, begin + size);
+        }
+
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+        {
+            char* target =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr() + off :
+                                            egptr() + off;
+            if (target < eback() || target > egptr())
+                return pos_type(off_type(-1));
+            setg(eback(), target, egptr());
+            return pos_type(target - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    osgDB::ReaderWriter* getReaderWriter(ImageDecoder::Format format)
+    {
+        const char* ext =
+            format == ImageDecoder::FORMAT_JPEG ? "jpg" :
+            format == ImageDecoder::FORMAT_PNG  ? "png" :
+            format == ImageDecoder::FORMAT_WEBP ? "webp" :
+                                                  0L;
+        return ext ? osgDB::Registry::instance()->getReaderWriterForExtension(ext) : 0L;
+    }
+
+    //------------------------------------------------------------------------
+
+#ifdef OSGEARTH_HAVE_LIBJPEG
+
+    struct JPEGError
+    {
+        jpeg_error_mgr _mgr;
+        jmp_buf        _jump;
+    };
+
+    void jpegErrorExit(j_common_ptr cinfo)
+    {
+        longjmp(reinterpret_cast<JPEGError*>(cinfo->err)->_jump, 1);
+    }
+
+    void jpegOutputMessage(j_common_ptr cinfo)
+    {
+        //nop - failures fall back to osgDB, which will report them.
+    }
+
+    // Memory source manager (jpeg_mem_src is not in libjpeg 6b).
+    void jpegInitSource(j_decompress_ptr cinfo) { }
+
+    boolean jpegFillInputBuffer(j_decompress_ptr cinfo)
+    {
+        // Premature end of data; insert a fake EOI marker like libjpeg does.
+        static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+        cinfo->src->next_input_byte = eoi;
+        cinfo->src->bytes_in_buffer = 2;
+        return TRUE;
+    }
+
+    void jpegSkipInputData(j_decompress_ptr cinfo, long count)
+    {
+        if (count > 0)
+        {
+            size_t n = osg::minimum((size_t)count, cinfo->src->bytes_in_buffer);
+            cinfo->src->next_input_byte += n;
+            cinfo->src->bytes_in_buffer -= n;
+        }
+    }
+
+    void jpegTermSource(j_decompress_ptr cinfo) { }
+
+    bool decodeJPEG(const unsigned char* data, unsigned size, osg::Image* image)
+    {
+        jpeg_decompress_struct cinfo;
+        jpeg_source_mgr        src;
+        JPEGError              err;
+
+        cinfo.err = jpeg_std_error(&err._mgr);
+        err._mgr.error_exit = jpegErrorExit;
+        err._mgr.output_message = jpegOutputMessage;
+
+        if (setjmp(err._jump))
+        {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        jpeg_create_decompress(&cinfo);
+
+        src.next_input_byte   = data;
+        src.bytes_in_buffer   = size;
+        src.init_source       = jpegInitSource;
+        src.fill_input_buffer = jpegFillInputBuffer;
+        src.skip_input_data   = jpegSkipInputData;
+        src.resync_to_restart = jpeg_resync_to_restart;
+        src.term_source       = jpegTermSource;
+        cinfo.src = &src;
+
+        jpeg_read_header(&cinfo, TRUE);
+
+        // leave CMYK and friends to the plugin
+        if (cinfo.num_components != 1 && cinfo.num_components != 3)
+        {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        GLenum format = cinfo.num_components == 1 ? GL_LUMINANCE : GL_RGB;
+        cinfo.out_color_space = cinfo.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+
+        jpeg_start_decompress(&cinfo);
+
+        prepare(image, cinfo.output_width, cinfo.output_height, format);
+
+        // osg images are bottom-up.
+        while (cinfo.output_scanline < cinfo.output_height)
+        {
+            JSAMPROW row = image->data(0, cinfo.output_height - 1 - cinfo.output_scanline);
+            jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        return true;
+    }
+
+#endif // OSGEARTH_HAVE_LIBJPEG
+
+    //------------------------------------------------------------------------
+
+#ifdef OSGEARTH_HAVE_LIBPNG
+
+    struct PNGSource
+    {
+        const unsigned char* _data;
+        png_size_t           _size;
+        png_size_t           _pos;
+    };
+
+    void pngRead(png_structp png, png_bytep out, png_size_t count)
+    {
+        PNGSource* src = static_cast<PNGSource*>(png_get_io_ptr(png));
+        if (src->_pos + count > src->_size)
+            png_error(png, "Read past end of data");
+        std::memcpy(out, src->_data + src->_pos, count);
+        src->_pos += count;
+    }
+
+    void pngError(png_structp png, png_const_charp message)
+    {
+        longjmp(png_jmpbuf(png), 1);
+    }
+
+    void pngWarning(png_structp png, png_const_charp message)
+    {
+        //nop
+    }
+
+    bool decodePNG(const unsigned char* data, unsigned size, osg::Image* image)
+    {
+        png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0L, pngError, pngWarning);
+        if (!png)
+            return false;
+
+        png_infop info = png_create_info_struct(png);
+        if (!info)
+        {
+            png_destroy_read_struct(&png, 0L, 0L);
+            return false;
+        }
+
+        if (setjmp(png_jmpbuf(png)))
+        {
+            png_destroy_read_struct(&png, &info, 0L);
+            return false;
+        }
+
+        PNGSource src;
+        src._data = data;
+        src._size = size;
+        src._pos  = 0;
+        png_set_read_fn(png, &src, pngRead);
+
+        png_read_info(png, info);
+
+        // 16-bit data (elevation, usually) is left to the plugin, which
+        // preserves the full precision.
+        if (png_get_bit_depth(png, info) > 8)
+        {
+            png_destroy_read_struct(&png, &info, 0L);
+            return false;
+        }
+
+        png_byte colorType = png_get_color_type(png, info);
+        if (colorType == PNG_COLOR_TYPE_PALETTE)
+            png_set_palette_to_rgb(png);
+        if (colorType == PNG_COLOR_TYPE_GRAY && png_get_bit_depth(png, info) < 8)
+            png_set_expand_gray_1_2_4_to_8(png);
+        if (png_get_valid(png, info, PNG_INFO_tRNS))
+            png_set_tRNS_to_alpha(png);
+
+        int passes = png_set_interlace_handling(png);
+        png_read_update_info(png, info);
+
+        int channels = png_get_channels(png, info);
+        GLenum format =
+            channels == 1 ? GL_LUMINANCE :
+            channels == 2 ? GL_LUMINANCE_ALPHA :
+            channels == 3 ? GL_RGB :
+                            GL_RGBA;
+
+        int width  = png_get_image_width(png, info);
+        int height = png_get_image_height(png, info);
+
+        prepare(image, width, height, format);
+
+        // osg images are bottom-up.
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            for (int t = 0; t < height; ++t)
+            {
+                png_read_row(png, image->data(0, height - 1 - t), 0L);
+            }
+        }
+
+        png_read_end(png, 0L);
+        png_destroy_read_struct(&png, &info, 0L);
+        return true;
+    }
+
+#endif // OSGEARTH_HAVE_LIBPNG
+
+    //------------------------------------------------------------------------
+
+#ifdef OSGEARTH_HAVE_LIBWEBP
+
+    bool decodeWEBP(const unsigned char* data, unsigned size, osg::Image* image)
+    {
+        WebPBitstreamFeatures features;
+        if (WebPGetFeatures(data, size, &features) != VP8_STATUS_OK)
+            return false;
+
+        GLenum format = features.has_alpha ? GL_RGBA : GL_RGB;
+        prepare(image, features.width, features.height, format);
+
+        uint8_t* out = features.has_alpha ?
+            WebPDecodeRGBAInto(data, size, image->data(), image->getTotalSizeInBytes(), image->getRowStepInBytes()) :
+            WebPDecodeRGBInto (data, size, image->data(), image->getTotalSizeInBytes(), image->getRowStepInBytes());
+
+        if (out == 0L)
+            return false;
+
+        // WebP is top-down; osg images are bottom-up.
+        image->flipVertical();
+        return true;
+    }
+
+#endif // OSGEARTH_HAVE_LIBWEBP
+}
+
+//------------------------------------------------------------------------
+
+ImageDecoder::ImagePool::ImagePool(unsigned maxImages) :
+_maxImages( osg::maximum(maxImages, 1u) ),
+_next     ( 0u )
+{
+    //nop
+}
+
+osg::ref_ptr<osg::Image>
+ImageDecoder::ImagePool::get()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // Round-robin so a just-returned image is not immediately overwritten
+    // while a freshly decoded one sits idle. An image is free when only the
+    // pool and "image" below reference it.
+    for (unsigned i = 0; i < _images.size(); ++i)
+    {
+        osg::ref_ptr<osg::Image> image = _images[(_next + i) % _images.size()];
+        if (image->referenceCount() == 2)
+        {
+            _next = (_next + i + 1) % _images.size();
+            return image;
+        }
+    }
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    if (_images.size() < _maxImages)
+    {
+        _images.push_back(image);
+    }
+    return image;
+}
+
+//------------------------------------------------------------------------
+
+ImageDecoder::ImageDecoder()
+{
+    //nop
+}
+
+ImageDecoder::Format
+ImageDecoder::getFormat(const void* data, unsigned size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    if (p == 0L)
+        return FORMAT_UNKNOWN;
+
+    if (size >= 3 && p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF)
+        return FORMAT_JPEG;
+
+    if (size >= 8 && std::memcmp(p, "\x89PNG\r\n\x1a\n", 8) == 0)
+        return FORMAT_PNG;
+
+    if (size >= 12 && std::memcmp(p, "RIFF", 4) == 0 && std::memcmp(p + 8, "WEBP", 4) == 0)
+        return FORMAT_WEBP;
+
+    return FORMAT_UNKNOWN;
+}
+
+bool
+ImageDecoder::isSupported(Format format)
+{
+    switch (format)
+    {
+#ifdef OSGEARTH_HAVE_LIBJPEG
+    case FORMAT_JPEG: return true;
+#endif
+#ifdef OSGEARTH_HAVE_LIBPNG
+    case FORMAT_PNG: return true;
+#endif
+#ifdef OSGEARTH_HAVE_LIBWEBP
+    case FORMAT_WEBP: return true;
+#endif
+    default: return false;
+    }
+}
+
+bool
+ImageDecoder::decodeInto(const void* data, unsigned size, osg::Image* image) const
+{
+    if (data == 0L || size == 0u || image == 0L)
+        return false;
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    switch (getFormat(data, size))
+    {
+#ifdef OSGEARTH_HAVE_LIBJPEG
+    case FORMAT_JPEG: return decodeJPEG(bytes, size, image);
+#endif
+#ifdef OSGEARTH_HAVE_LIBPNG
+    case FORMAT_PNG: return decodePNG(bytes, size, image);
+#endif
+#ifdef OSGEARTH_HAVE_LIBWEBP
+    case FORMAT_WEBP: return decodeWEBP(bytes, size, image);
+#endif
+    default: return false;
+    }
+}
+
+osg::ref_ptr<osg::Image>
+ImageDecoder::decode(const void*           data,
+                     unsigned              size,
+                     const osgDB::Options* options,
+                     osgDB::ReaderWriter*  fallback) const
+{
+    if (data == 0L || size == 0u)
+        return 0L;
+
+    Format format = getFormat(data, size);
+
+    if (isSupported(format))
+    {
+        osg::ref_ptr<osg::Image> image;
+        if (_pool.valid())
+            image = _pool->get();
+        else
+            image = new osg::Image();
+
+        if (decodeInto(data, size, image.get()))
+        {
+            return image;
+        }
+    }
+
+    // No built-in decoder, or it declined (e.g. a 16-bit PNG); use osgDB.
+    osgDB::ReaderWriter* rw = fallback ? fallback : getReaderWriter(format);
+    if (!rw)
+    {
+        OE_DEBUG << LC << "No ReaderWriter available to decode image" << std::endl;
+        return 0L;
+    }
+
+    MemoryStreamBuf buf(data, size);
+    std::istream in(&buf);
+    osgDB::ReaderWriter::ReadResult rr = rw->readImage(in, options);
+    return rr.validImage() ? rr.takeImage() : 0L;
+}
@@ -29,6 +29,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/Metrics>
+#include <osgEarth/TextureCompressor>
 #include <osg/Version>
 #include <osgDB/WriteFile>
 #include <memory.h>
@@ -133,6 +134,7 @@ ImageLayerOptions::fromConfig(const Config& conf)
     conf.getIfSet("texture_compression", "none", _texcomp, osg::Texture::USE_IMAGE_DATA_FORMAT);
     conf.getIfSet("texture_compression", "auto", _texcomp, (osg::Texture::InternalFormatMode)~0);
     conf.getIfSet("texture_compression", "fastdxt", _texcomp, (osg::Texture::InternalFormatMode)(~0 - 1));
+    conf.getIfSet("texture_compression", "cpu", _texcomp, (osg::Texture::InternalFormatMode)(~0 - 2));
     //TODO add all the enums
 
     // uniform names
@@ -182,6 +184,7 @@ ImageLayerOptions::getConfig() const
     conf.set("texture_compression", "auto", _texcomp, (osg::Texture::InternalFormatMode)~0);
     conf.set("texture_compression", "on",   _texcomp, (osg::Texture::InternalFormatMode)~0);
     conf.set("texture_compression", "fastdxt", _texcomp, (osg::Texture::InternalFormatMode)(~0 - 1));
+    conf.set("texture_compression", "cpu", _texcomp, (osg::Texture::InternalFormatMode)(~0 - 2));
     //TODO add all the enums
 
     // uniform names
@@ -198,16 +201,12 @@ ImageLayerOptions::getConfig() const
 
 namespace
 {
-    struct ImageLayerPreCacheOperation : public TileSource::ImageOperation
+    // Image shared by coalesced createImage requests.
+    struct SharedImage : public osg::Referenced
     {
-        void operator()( osg::ref_ptr<osg::Image>& image )
-        {
-            _processor.process( image );
-        }
-
-        ImageLayerTileProcessor _processor;
+        GeoImage _image;
     };
-    
+
     struct ApplyChromaKey
     {
         osg::Vec4f _chromaKey;
@@ -293,6 +292,38 @@ ImageLayerTileProcessor::process( osg::ref_ptr<osg::Image>& image ) const
     }    
 }
 
+bool
+ImageLayerTileProcessor::willCompress() const
+{
+    return
+        _options.coverage() != true &&
+        _options.textureCompression() == (osg::Texture::InternalFormatMode)(~0 - 2);
+}
+
+void
+ImageLayerTileProcessor::compress( osg::ref_ptr<osg::Image>& image ) const
+{
+    if ( !image.valid() || !willCompress() )
+        return;
+
+    // Only build mipmaps if the texture will use them.
+    osg::Texture::FilterMode minFilter = _options.minFilter().get();
+    bool mipmaps =
+        minFilter == osg::Texture::LINEAR_MIPMAP_LINEAR ||
+        minFilter == osg::Texture::LINEAR_MIPMAP_NEAREST ||
+        minFilter == osg::Texture::NEAREST_MIPMAP_LINEAR ||
+        minFilter == osg::Texture::NEAREST_MIPMAP_NEAREST;
+
+    TextureCompressor compressor;
+    compressor.setGenerateMipmaps( mipmaps );
+
+    osg::ref_ptr<osg::Image> compressed = compressor.compress( image.get() );
+    if ( compressed.valid() )
+    {
+        image = compressed.get();
+    }
+}
+
 //------------------------------------------------------------------------
 
 ImageLayer::ImageLayer() :
@@ -450,7 +481,7 @@ ImageLayer::setTargetProfileHint( const Profile* profile )
     _preCacheOp = 0L;
 }
 
-TileSource::ImageOperation*
+ImageLayerPreCacheOperation*
 ImageLayer::getOrCreatePreCacheOp()
 {
     if ( !_preCacheOp.valid() )
@@ -464,7 +495,7 @@ ImageLayer::getOrCreatePreCacheOp()
                 _targetProfileHint->isEquivalentTo( getProfile() );
 
             ImageLayerPreCacheOperation* op = new ImageLayerPreCacheOperation();
-            op->_processor.init( options(), _readOptions.get(), layerInTargetProfile );
+            op->getProcessor().init( options(), _readOptions.get(), layerInTargetProfile );
 
             _preCacheOp = op;
         }
@@ -530,13 +561,33 @@ ImageLayer::createImageInNativeProfile(const TileKey&    key,
         std::vector<TileKey> nativeKeys;
         nativeProfile->getIntersectingTiles(key, nativeKeys);
 
+        // CPU-compressed tiles cannot be mosaicked, and the cached native tiles
+        // are stored compressed. In that case read the native tiles from the
+        // source (as assembleImage does) and compress the finished mosaic.
+        osg::ref_ptr<ImageLayerPreCacheOperation> preCacheOp = getOrCreatePreCacheOp();
+        bool compressMosaic = preCacheOp->getProcessor().willCompress();
+
         // build a mosaic of the images from the native profile keys:
         bool foundAtLeastOneRealTile = false;
 
         ImageMosaic mosaic;
         for( std::vector<TileKey>::iterator k = nativeKeys.begin(); k != nativeKeys.end(); ++k )
         {
-            GeoImage image = createImageInKeyProfile( *k, progress );
+            GeoImage image;
+            if ( compressMosaic )
+            {
+                if ( isKeyInLegalRange(*k) )
+                {
+                    image = createImageImplementation( *k, progress );
+                    if ( image.valid() )
+                        ImageUtils::fixInternalFormat( image.getImage() );
+                }
+            }
+            else
+            {
+                image = createImageInKeyProfile( *k, progress );
+            }
+
             if ( image.valid() )
             {
                 foundAtLeastOneRealTile = true;
@@ -556,8 +607,12 @@ ImageLayer::createImageInNativeProfile(const TileKey&    key,
             double rxmin, rymin, rxmax, rymax;
             mosaic.getExtents( rxmin, rymin, rxmax, rymax );
 
+            osg::ref_ptr<osg::Image> image = mosaic.createImage();
+            if ( compressMosaic )
+                preCacheOp->getProcessor().compress( image );
+
             result = GeoImage(
-                mosaic.createImage(), 
+                image.get(), 
                 GeoExtent( nativeProfile->getSRS(), rxmin, rymin, rxmax, rymax ) );
         }
     }
@@ -569,6 +624,33 @@ ImageLayer::createImageInNativeProfile(const TileKey&    key,
 GeoImage
 ImageLayer::createImageInKeyProfile(const TileKey&    key, 
                                     ProgressCallback* progress)
+{
+    // Concurrent requests for the same tile share a single result.
+    std::string requestKey = Stringify() << key.str() << "_" << key.getProfile()->getHorizSignature();
+
+    osg::ref_ptr<osg::Referenced> shared;
+    if ( joinTileRequest(requestKey, progress, shared) )
+    {
+        SharedImage* image = static_cast<SharedImage*>( shared.get() );
+        return image ? image->_image : GeoImage::INVALID;
+    }
+
+    GeoImage result = createImageInKeyProfileImpl( key, progress );
+
+    osg::ref_ptr<SharedImage> image;
+    if ( result.valid() )
+    {
+        image = new SharedImage();
+        image->_image = result;
+    }
+    endTileRequest( requestKey, image.get(), progress && progress->isCanceled() );
+
+    return result;
+}
+
+GeoImage
+ImageLayer::createImageInKeyProfileImpl(const TileKey&    key, 
+                                        ProgressCallback* progress)
 {
     // If the layer is disabled, bail out.
     if ( !getEnabled() )
@@ -683,6 +765,16 @@ ImageLayer::createImageInKeyProfile(const TileKey&    key,
         ImageUtils::fixInternalFormat( result.getImage() );
     }
 
+    // CPU texture compression happens here, after any mosaicing and before
+    // caching, so each tile is only compressed once.
+    osg::ref_ptr<ImageLayerPreCacheOperation> preCacheOp = getOrCreatePreCacheOp();
+    if ( result.valid() && preCacheOp->getProcessor().willCompress() )
+    {
+        osg::ref_ptr<osg::Image> image = result.getImage();
+        preCacheOp->getProcessor().compress( image );
+        result = GeoImage( image.get(), result.getExtent() );
+    }
+
     // memory cache first:
     if ( result.valid() && _memCache.valid() )
     {
@@ -1036,6 +1128,11 @@ ImageLayer::applyTextureCompressionMode(osg::Texture* tex) const
         }
 
     }
+    else if ( options().textureCompression() == (osg::Texture::InternalFormatMode)(~0 - 2))
+    {
+        // cpu mode: the image was compressed before caching (see createImageInKeyProfile)
+        tex->setInternalFormatMode(osg::Texture::USE_IMAGE_DATA_FORMAT);
+    }
     else if ( options().textureCompression().isSet() )
     {
         // use specifically picked a mode.
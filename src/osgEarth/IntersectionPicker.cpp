@@ -30,7 +30,8 @@ _view    ( view ),
 _root    ( root ),
 _travMask( travMask ),
 _buffer  ( buffer ),
-_limit   ( limit )
+_limit   ( limit ),
+_useBVH  ( true )
 {
     if ( root )
         _path = root->getParentalNodePaths()[0];
@@ -42,6 +43,12 @@ IntersectionPicker::setLimit(const IntersectionPicker::Limit& value)
     _limit = value;
 }
 
+void
+IntersectionPicker::setUseBVH(bool value)
+{
+    _useBVH = value;
+}
+
 void
 IntersectionPicker::setTraversalMask(unsigned value)
 {
@@ -120,6 +127,7 @@ IntersectionPicker::pick( float x, float y, Hits& results ) const
     }
 
     picker->setIntersectionLimit( (osgUtil::Intersector::IntersectionLimit)_limit );
+    picker->setUseBVH( _useBVH );
     osgUtil::IntersectionVisitor iv(picker.get());
 
     //picker->setIntersectionLimit( osgUtil::Intersector::LIMIT_ONE_PER_DRAWABLE );
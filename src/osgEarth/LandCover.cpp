@@ -19,6 +19,7 @@
 #include <osgEarth/LandCover>
 #include <osgEarth/XmlUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/ImageUtils>
 
 #define LC "[LandCover] "
 
@@ -310,3 +311,214 @@ _optionsConcrete(options)
     init();
 }
 
+
+//...........................................................................
+
+#undef  LC
+#define LC "[LandCoverTile] "
+
+namespace
+{
+    const char LCT_MAGIC[4] = { 'L', 'C', 'T', '1' };
+
+    void writeU16(std::string& buf, unsigned value)
+    {
+        buf.push_back((char)(value & 0xff));
+        buf.push_back((char)((value >> 8) & 0xff));
+    }
+
+    void writeI32(std::string& buf, int value)
+    {
+        unsigned u = (unsigned)value;
+        for (unsigned i = 0; i < 4; ++i)
+            buf.push_back((char)((u >> (8*i)) & 0xff));
+    }
+
+    unsigned readU16(const std::string& buf, unsigned& pos)
+    {
+        unsigned value =
+            (unsigned)(unsigned char)buf[pos] |
+            ((unsigned)(unsigned char)buf[pos+1] << 8);
+        pos += 2;
+        return value;
+    }
+
+    int readI32(const std::string& buf, unsigned& pos)
+    {
+        unsigned u = 0u;
+        for (unsigned i = 0; i < 4; ++i)
+            u |= (unsigned)(unsigned char)buf[pos+i] << (8*i);
+        pos += 4;
+        return (int)u;
+    }
+}
+
+LandCoverTile::LandCoverTile(const osg::Image* image, const LandCoverDictionary* dictionary) :
+_s(0u),
+_t(0u)
+{
+    _values.push_back(-1);
+
+    if (!image || image->s() <= 0 || image->t() <= 0)
+    {
+        resolve(dictionary);
+        return;
+    }
+
+    _s = image->s();
+    _t = image->t();
+    _indices.assign(_s*_t, 0u);
+
+    ImageUtils::PixelReader read(image);
+    read.setBilinear(false);
+
+    // neighboring texels usually share a class, so remember the last one
+    // to avoid searching the palette.
+    bool haveLast = false;
+    int lastValue = 0;
+    unsigned char lastIndex = 0u;
+
+    for (unsigned t = 0; t < _t; ++t)
+    {
+        for (unsigned s = 0; s < _s; ++s)
+        {
+            float r = read(s, t).r();
+            if (r == NO_DATA_VALUE)
+                continue;
+
+            int value = (int)r;
+            if (!haveLast || value != lastValue)
+            {
+                lastIndex = getOrCreatePaletteIndex(value);
+                lastValue = value;
+                haveLast = true;
+            }
+            _indices[t*_s + s] = lastIndex;
+        }
+    }
+
+    resolve(dictionary);
+}
+
+LandCoverTile::LandCoverTile(const std::string& buf, const LandCoverDictionary* dictionary) :
+_s(0u),
+_t(0u)
+{
+    _values.push_back(-1);
+
+    // header: magic, s, t, palette size
+    unsigned pos = 0u;
+    if (buf.size() < 9u || buf.compare(0, 4, LCT_MAGIC, 4) != 0)
+    {
+        resolve(dictionary);
+        return;
+    }
+    pos += 4;
+
+    unsigned s = readU16(buf, pos);
+    unsigned t = readU16(buf, pos);
+    unsigned paletteSize = (unsigned char)buf[pos++];
+
+    if (paletteSize == 0u || buf.size() < pos + (paletteSize-1)*4u)
+    {
+        resolve(dictionary);
+        return;
+    }
+
+    for (unsigned i = 1; i < paletteSize; ++i)
+        _values.push_back(readI32(buf, pos));
+
+    // runs of (length, index)
+    std::vector<unsigned char> indices;
+    indices.reserve(s*t);
+    while (pos + 1u < buf.size() && indices.size() < s*t)
+    {
+        unsigned length = (unsigned char)buf[pos++];
+        unsigned char index = (unsigned char)buf[pos++];
+        if (index >= paletteSize)
+            break;
+        indices.insert(indices.end(), length, index);
+    }
+
+    if (indices.size() != s*t)
+    {
+        OE_WARN << LC << "Corrupt tile buffer; ignoring" << std::endl;
+        _values.resize(1);
+        resolve(dictionary);
+        return;
+    }
+
+    _s = s;
+    _t = t;
+    _indices.swap(indices);
+    resolve(dictionary);
+}
+
+unsigned char
+LandCoverTile::getOrCreatePaletteIndex(int value)
+{
+    for (unsigned i = 1; i < _values.size(); ++i)
+    {
+        if (_values[i] == value)
+            return (unsigned char)i;
+    }
+
+    if (_values.size() >= MAX_PALETTE_SIZE)
+    {
+        OE_WARN << LC << "Too many land cover classes in one tile; value " << value << " ignored" << std::endl;
+        return 0u;
+    }
+
+    _values.push_back(value);
+    return (unsigned char)(_values.size() - 1);
+}
+
+void
+LandCoverTile::resolve(const LandCoverDictionary* dictionary)
+{
+    _classes.assign(_values.size(), osg::ref_ptr<const LandCoverClass>());
+    if (dictionary)
+    {
+        for (unsigned i = 1; i < _values.size(); ++i)
+            _classes[i] = dictionary->getClassByValue(_values[i]);
+    }
+}
+
+unsigned char
+LandCoverTile::getIndexByUV(double u, double v) const
+{
+    if (!valid())
+        return 0u;
+
+    // same sampling as a nearest-neighbor ImageUtils::PixelReader
+    int s = osg::clampBetween((int)(u * (double)(_s - 1)), 0, (int)_s - 1);
+    int t = osg::clampBetween((int)(v * (double)(_t - 1)), 0, (int)_t - 1);
+    return _indices[t*_s + s];
+}
+
+void
+LandCoverTile::encode(std::string& buf) const
+{
+    buf.clear();
+    buf.append(LCT_MAGIC, 4);
+    writeU16(buf, _s);
+    writeU16(buf, _t);
+    buf.push_back((char)_values.size());
+
+    for (unsigned i = 1; i < _values.size(); ++i)
+        writeI32(buf, _values[i]);
+
+    unsigned i = 0u;
+    const unsigned n = _indices.size();
+    while (i < n)
+    {
+        unsigned char index = _indices[i];
+        unsigned length = 1u;
+        while (i + length < n && length < 255u && _indices[i + length] == index)
+            ++length;
+
+        buf.push_back((char)length);
+        buf.push_back((char)index);
+        i += length;
+    }
+}
@@ -22,6 +22,9 @@
 #include <osgEarth/Map>
 #include <osgEarth/MetaTile>
 #include <osgEarth/SimplexNoise>
+#include <osgEarth/CacheBin>
+#include <osgEarth/IOTypes>
+#include <osgEarth/StringUtils>
 
 using namespace osgEarth;
 
@@ -433,7 +436,8 @@ LandCoverLayerOptions::getConfig() const
 
 LandCoverLayer::LandCoverLayer() :
 ImageLayer(&_optionsConcrete),
-_options(&_optionsConcrete)
+_options(&_optionsConcrete),
+_tiles(true, 64u)
 {
     init();
 }
@@ -441,7 +445,8 @@ _options(&_optionsConcrete)
 LandCoverLayer::LandCoverLayer(const LandCoverLayerOptions& options) :
 ImageLayer(&_optionsConcrete),
 _options(&_optionsConcrete),
-_optionsConcrete(options)
+_optionsConcrete(options),
+_tiles(true, 64u)
 {
     init();
 }
@@ -606,3 +611,51 @@ LandCoverLayer::getClassByUV(const GeoImage& tile, double u, double v) const
 
     return _lcDictionary->getClassByValue((int)value);
 }
+
+osg::ref_ptr<LandCoverTile>
+LandCoverLayer::createTile(const TileKey& key, ProgressCallback* progress)
+{
+    // shared in-memory tiles first:
+    LRUCache<TileKey, osg::ref_ptr<LandCoverTile> >::Record rec;
+    if (_tiles.get(key, rec))
+        return rec.value();
+
+    osg::ref_ptr<LandCoverTile> tile;
+
+    std::string cacheKey = Stringify() << "lct_" << key.str() << "_" << key.getProfile()->getHorizSignature();
+    const CachePolicy& policy = getCacheSettings()->cachePolicy().get();
+    CacheBin* cacheBin = getCacheBin(key.getProfile());
+
+    if (cacheBin && policy.isCacheReadable())
+    {
+        ReadResult r = cacheBin->readString(cacheKey, 0L);
+        if (r.succeeded() && !policy.isExpired(r.lastModifiedTime()))
+        {
+            tile = new LandCoverTile(r.getString(), _lcDictionary.get());
+            if (!tile->valid())
+                tile = 0L;
+        }
+    }
+
+    if (!tile.valid() && !policy.isCacheOnly())
+    {
+        GeoImage image = createImage(key, progress);
+        if (!image.valid())
+            return 0L;
+
+        tile = new LandCoverTile(image.getImage(), _lcDictionary.get());
+
+        if (cacheBin && policy.isCacheWriteable())
+        {
+            std::string buffer;
+            tile->encode(buffer);
+            osg::ref_ptr<StringObject> temp = new StringObject(buffer);
+            cacheBin->write(cacheKey, temp.get(), 0L);
+        }
+    }
+
+    if (tile.valid())
+        _tiles.insert(key, tile);
+
+    return tile;
+}
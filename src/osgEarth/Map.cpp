@@ -25,6 +25,8 @@
 #include <osgEarth/URI>
 #include <osgEarth/ElevationPool>
 #include <osgEarth/Utils>
+#include <osgEarth/Metrics>
+#include <osgEarth/TaskService>
 #include <iterator>
 
 using namespace osgEarth;
@@ -33,6 +35,45 @@ using namespace osgEarth;
 
 //------------------------------------------------------------------------
 
+namespace
+{
+    // Opens a layer, reporting the time it took through Metrics.
+    double openLayer(Layer* layer)
+    {
+        METRIC_BEGIN("map.open_layer", 2,
+            "name", layer->getName().c_str(),
+            "type", layer->getTypeName());
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        layer->open();
+        double ms = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+        METRIC_END("map.open_layer", 2,
+            "status", layer->getStatus().toString().c_str(),
+            "ms", std::string(Stringify() << ms).c_str());
+
+        OE_DEBUG << LC << "Opened " << layer->getTypeName() << " \"" << layer->getName() << "\" in " << ms << " ms" << std::endl;
+        return ms;
+    }
+
+    struct OpenLayerTask : public TaskRequest
+    {
+        OpenLayerTask(Layer* layer) : _layer(layer), _ms(0.0) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            _ms = openLayer( _layer.get() );
+            _opened.set();
+        }
+
+        osg::ref_ptr<Layer> _layer;
+        double              _ms;
+        Threading::Event    _opened;
+    };
+}
+
+//------------------------------------------------------------------------
+
 Map::ElevationLayerCB::ElevationLayerCB(Map* map) :
 _map(map)
 {
@@ -267,53 +308,118 @@ Map::addLayer(Layer* layer)
     {
         if (layer->getEnabled())
         {
-            // Pass along the Read Options (including the cache settings, etc.) to the layer:
-            layer->setReadOptions(_readOptions.get());
-            
-            // If this is a terrain layer, tell it about the Map profile.
-            TerrainLayer* terrainLayer = dynamic_cast<TerrainLayer*>(layer);
-            if (terrainLayer && _profile.valid())
-            {
-                terrainLayer->setTargetProfileHint( _profile.get() );
-            }            
+            prepareLayer(layer);
 
             // Attempt to open the layer. Don't check the status here.
-            layer->open();
+            openLayer(layer);
+        }
 
-            // If this is an elevation layer, install a callback so we know when
-            // it's visibility changes:
-            ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(layer);
-            if (elevationLayer)
-            {
-                elevationLayer->addCallback(_elevationLayerCB.get());
+        installLayer(layer);
+    }
+}
 
-                // invalidate the elevation pool
-                getElevationPool()->clear();
-            }
-        }
+void
+Map::addLayers(const LayerVector& layers)
+{
+    unsigned numThreads = std::min( _mapOptions.layerOpenThreads().get(), (unsigned)layers.size() );
+    if ( numThreads <= 1u )
+    {
+        for(LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
+            addLayer( i->get() );
+        return;
+    }
 
-        int newRevision;
-        unsigned index = -1;
+    osgEarth::Registry::instance()->clearBlacklist();
 
-        // Add the layer to our stack.
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    double totalMs = 0.0;
+
+    osg::ref_ptr<TaskService> service = new TaskService( "Map layer open", numThreads );
+
+    // Open all the enabled layers at once..
+    std::vector< osg::ref_ptr<OpenLayerTask> > tasks( layers.size() );
+    for(unsigned i = 0; i < layers.size(); ++i)
+    {
+        Layer* layer = layers[i].get();
+        if ( layer && layer->getEnabled() )
         {
-            Threading::ScopedWriteLock lock( _mapDataMutex );
+            prepareLayer( layer );
+            tasks[i] = new OpenLayerTask( layer );
+            service->add( tasks[i].get() );
+        }
+    }
 
-            _layers.push_back( layer );
-            index = _layers.size() - 1;
-            newRevision = ++_dataModelRevision;
+    // ..and add them in order, each one as soon as it is ready.
+    for(unsigned i = 0; i < layers.size(); ++i)
+    {
+        if ( tasks[i].valid() )
+        {
+            tasks[i]->_opened.wait();
+            totalMs += tasks[i]->_ms;
+        }
+        if ( layers[i].valid() )
+        {
+            installLayer( layers[i].get() );
         }
+    }
 
-        // tell the layer it was just added.
-        layer->addedToMap(this);
+    OE_INFO << LC << "Opened " << layers.size() << " layers on " << numThreads << " threads in "
+        << osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick())
+        << " ms (" << totalMs << " ms serially)" << std::endl;
+}
 
-        // a separate block b/c we don't need the mutex
-        for( MapCallbackList::iterator i = _mapCallbacks.begin(); i != _mapCallbacks.end(); i++ )
+void
+Map::prepareLayer(Layer* layer)
+{
+    // Pass along the Read Options (including the cache settings, etc.) to the layer:
+    layer->setReadOptions(_readOptions.get());
+
+    // If this is a terrain layer, tell it about the Map profile.
+    TerrainLayer* terrainLayer = dynamic_cast<TerrainLayer*>(layer);
+    if (terrainLayer && _profile.valid())
+    {
+        terrainLayer->setTargetProfileHint( _profile.get() );
+    }
+}
+
+void
+Map::installLayer(Layer* layer)
+{
+    if (layer->getEnabled())
+    {
+        // If this is an elevation layer, install a callback so we know when
+        // it's visibility changes:
+        ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>(layer);
+        if (elevationLayer)
         {
-            i->get()->onMapModelChanged(MapModelChange(
-                MapModelChange::ADD_LAYER, newRevision, layer, index));
+            elevationLayer->addCallback(_elevationLayerCB.get());
+
+            // invalidate the elevation pool
+            getElevationPool()->clear();
         }
     }
+
+    int newRevision;
+    unsigned index = -1;
+
+    // Add the layer to our stack.
+    {
+        Threading::ScopedWriteLock lock( _mapDataMutex );
+
+        _layers.push_back( layer );
+        index = _layers.size() - 1;
+        newRevision = ++_dataModelRevision;
+    }
+
+    // tell the layer it was just added.
+    layer->addedToMap(this);
+
+    // a separate block b/c we don't need the mutex
+    for( MapCallbackList::iterator i = _mapCallbacks.begin(); i != _mapCallbacks.end(); i++ )
+    {
+        i->get()->onMapModelChanged(MapModelChange(
+            MapModelChange::ADD_LAYER, newRevision, layer, index));
+    }
 }
 
 void
@@ -26,6 +26,7 @@
 #include <osgEarth/CullingUtils>
 #include <osgEarth/DrapeableNode>
 #include <osgEarth/DrapingTechnique>
+#include <osgEarth/GeometryClamper>
 #include <osgEarth/MapNodeObserver>
 #include <osgEarth/MaskNode>
 #include <osgEarth/NodeUtils>
@@ -423,6 +424,11 @@ MapNode::~MapNode()
 
     this->clearExtensions();
 
+    if ( _geometryClamper.valid() && getTerrain() )
+    {
+        getTerrain()->removeTerrainCallback( _geometryClamper.get() );
+    }
+
     osg::observer_ptr<TerrainEngineNode> te = _terrainEngine;
     removeChildren(0, getNumChildren());
     
@@ -540,6 +546,21 @@ MapNode::getResourceReleaser() const
     return _resourceReleaser;
 }
 
+AsyncGeometryClamper*
+MapNode::getGeometryClamper()
+{
+    if ( !_geometryClamper.valid() )
+    {
+        Threading::ScopedMutexLock lock( _geometryClamperMutex );
+        if ( !_geometryClamper.valid() && getTerrain() )
+        {
+            _geometryClamper = new AsyncGeometryClamper( getMap()->getProfile() );
+            getTerrain()->addTerrainCallback( _geometryClamper.get() );
+        }
+    }
+    return _geometryClamper.get();
+}
+
 void
 MapNode::addExtension(Extension* extension, const osgDB::Options* options)
 {
@@ -45,6 +45,8 @@ MapOptions::fromConfig( const Config& conf )
     conf.getIfSet( "elevation_interpolation", "average",     _elevationInterpolation, INTERP_AVERAGE);
     conf.getIfSet( "elevation_interpolation", "bilinear",    _elevationInterpolation, INTERP_BILINEAR);
     conf.getIfSet( "elevation_interpolation", "triangulate", _elevationInterpolation, INTERP_TRIANGULATE);
+
+    conf.getIfSet( "layer_open_threads", _layerOpenThreads );
 }
 
 Config
@@ -66,5 +68,7 @@ MapOptions::getConfig() const
     conf.set( "elevation_interpolation", "bilinear",    _elevationInterpolation, INTERP_BILINEAR);
     conf.set( "elevation_interpolation", "triangulate", _elevationInterpolation, INTERP_TRIANGULATE);
 
+    conf.set( "layer_open_threads", _layerOpenThreads );
+
     return conf;
 }
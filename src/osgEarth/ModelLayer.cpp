@@ -22,6 +22,7 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/ShaderFactory>
 #include <osgEarth/Lighting>
+#include <osgEarth/PrimitiveBVH>
 #include <osg/Depth>
 
 #define LC "[ModelLayer] Layer \"" << getName() << "\" "
@@ -81,6 +82,7 @@ VisibleLayerOptions(rhs)
     _maskOptions = optional<MaskSourceOptions>(rhs._maskOptions);
     _maskMinLevel = optional<unsigned>(rhs._maskMinLevel);
     _terrainPatch = optional<bool>(rhs._terrainPatch);
+    _pickingBVH = optional<bool>(rhs._pickingBVH);
 }
 
 ModelLayerOptions& ModelLayerOptions::operator =(const ModelLayerOptions& rhs)
@@ -91,6 +93,7 @@ ModelLayerOptions& ModelLayerOptions::operator =(const ModelLayerOptions& rhs)
     _maskOptions = optional<MaskSourceOptions>(rhs._maskOptions);
     _maskMinLevel = optional<unsigned>(rhs._maskMinLevel);
     _terrainPatch = optional<bool>(rhs._terrainPatch);
+    _pickingBVH = optional<bool>(rhs._pickingBVH);
 
     return *this;
 }
@@ -101,6 +104,7 @@ ModelLayerOptions::setDefaults()
     _lighting.init    ( true );
     _maskMinLevel.init( 0 );
     _terrainPatch.init( false );
+    _pickingBVH.init  ( false );
 }
 
 Config
@@ -113,6 +117,7 @@ ModelLayerOptions::getConfig() const
     conf.set( "lighting",       _lighting );
     conf.set( "mask_min_level", _maskMinLevel );
     conf.set( "patch",          _terrainPatch );  
+    conf.set( "picking_bvh",    _pickingBVH );
 
     // Merge the MaskSource options
     if ( mask().isSet() )
@@ -127,6 +132,7 @@ ModelLayerOptions::fromConfig( const Config& conf )
     conf.getIfSet( "lighting",       _lighting );
     conf.getIfSet( "mask_min_level", _maskMinLevel );
     conf.getIfSet( "patch",          _terrainPatch );
+    conf.getIfSet( "picking_bvh",    _pickingBVH );
 
     if ( conf.hasValue("driver") )
         driver() = ModelSourceOptions(conf);
@@ -205,6 +211,11 @@ ModelLayer::init()
 {
     VisibleLayer::init();
     _sgCallbacks = new SceneGraphCallbacks();
+
+    if ( options().pickingBVH() == true )
+    {
+        _sgCallbacks->add( new PrimitiveBVH::BuildCallback() );
+    }
 }
 
 const Status&
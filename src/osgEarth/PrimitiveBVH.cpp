@@ -0,0 +1,531 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+#include <osgEarth/PrimitiveBVH>
+#include <osg/TemplatePrimitiveFunctor>
+#include <algorithm>
+
+#define LC "[PrimitiveBVH] "
+
+using namespace osgEarth;
+
+#define BVH_NAME "osgEarth.PrimitiveBVH"
+
+namespace
+{
+    typedef PrimitiveBVH::Primitive Primitive;
+
+    // geometries with fewer primitives than this are cheaper to scan
+    const unsigned MIN_PRIMITIVES = 32u;
+
+    // serializes attaching hierarchies to geometries
+    Threading::Mutex s_attachMutex;
+
+    // primitives per leaf
+    const unsigned MAX_LEAF_SIZE  = 8u;
+
+    // number of bins when searching for the best split
+    const unsigned NUM_BINS       = 16u;
+
+    struct Node
+    {
+        float    _min[3], _max[3];
+        unsigned _first;        // first primitive of a leaf, or first of two children
+        unsigned _count;        // number of primitives in a leaf; 0 for an inner node
+    };
+
+    // Records the primitives of a geometry in the order the functor reports
+    // them, by vertex index.
+    struct CollectPrimitives
+    {
+        CollectPrimitives() : _base(0L), _output(0L), _index(0u), _ok(true) { }
+
+        const osg::Vec3*        _base;
+        std::vector<Primitive>* _output;
+        unsigned                _index;
+        bool                    _ok;
+
+        void add(unsigned n, const osg::Vec3* v1, const osg::Vec3* v2, const osg::Vec3* v3, const osg::Vec3* v4, bool temporary)
+        {
+            // copies of the vertex data can't be traced back to the array:
+            if ( temporary )
+                _ok = false;
+
+            if ( !_ok )
+                return;
+
+            Primitive p;
+            p._vertices[0] = v1 - _base;
+            p._vertices[1] = v2 ? v2 - _base : 0u;
+            p._vertices[2] = v3 ? v3 - _base : 0u;
+            p._vertices[3] = v4 ? v4 - _base : 0u;
+            p._numVertices = n;
+            p._index       = _index++;
+            _output->push_back( p );
+        }
+
+        void operator () (const osg::Vec3& v1, bool temporary)
+        {
+            add( 1u, &v1, 0L, 0L, 0L, temporary );
+        }
+
+        void operator () (const osg::Vec3& v1, const osg::Vec3& v2, bool temporary)
+        {
+            add( 2u, &v1, &v2, 0L, 0L, temporary );
+        }
+
+        void operator () (const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3, bool temporary)
+        {
+            add( 3u, &v1, &v2, &v3, 0L, temporary );
+        }
+
+        void operator () (const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3, const osg::Vec3& v4, bool temporary)
+        {
+            add( 4u, &v1, &v2, &v3, &v4, temporary );
+        }
+    };
+
+    // Number of primitives the functor will report for a geometry.
+    unsigned countPrimitives(const osg::Geometry* geometry)
+    {
+        unsigned count = 0u;
+        for (unsigned i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+        {
+            const osg::PrimitiveSet* ps = geometry->getPrimitiveSet(i);
+            unsigned n = ps->getNumIndices();
+            switch( ps->getMode() )
+            {
+            case osg::PrimitiveSet::POINTS:         count += n; break;
+            case osg::PrimitiveSet::LINES:          count += n / 2u; break;
+            case osg::PrimitiveSet::LINE_STRIP:     count += n > 1u ? n - 1u : 0u; break;
+            case osg::PrimitiveSet::LINE_LOOP:      count += n > 1u ? n : 0u; break;
+            case osg::PrimitiveSet::TRIANGLES:      count += n / 3u; break;
+            case osg::PrimitiveSet::TRIANGLE_STRIP:
+            case osg::PrimitiveSet::TRIANGLE_FAN:
+            case osg::PrimitiveSet::POLYGON:        count += n > 2u ? n - 2u : 0u; break;
+            case osg::PrimitiveSet::QUADS:          count += n / 4u; break;
+            case osg::PrimitiveSet::QUAD_STRIP:     count += n > 3u ? (n - 2u) / 2u : 0u; break;
+            default: break;
+            }
+        }
+        return count;
+    }
+
+    struct Bin
+    {
+        Bin() : _count(0u) { }
+        osg::BoundingBox _box;
+        unsigned         _count;
+    };
+
+    float halfArea(const osg::BoundingBox& box)
+    {
+        if ( !box.valid() )
+            return 0.0f;
+        osg::Vec3 d = box._max - box._min;
+        return d.x()*d.y() + d.y()*d.z() + d.z()*d.x();
+    }
+
+    struct InLowerBins
+    {
+        InLowerBins(const std::vector<osg::Vec3>& centers, int axis, float min, float scale, unsigned split) :
+            _centers(centers), _axis(axis), _min(min), _scale(scale), _split(split) { }
+
+        bool operator()(unsigned i) const
+        {
+            unsigned bin = std::min( NUM_BINS-1u, (unsigned)((_centers[i][_axis] - _min) * _scale) );
+            return bin < _split;
+        }
+
+        const std::vector<osg::Vec3>& _centers;
+        int      _axis;
+        float    _min, _scale;
+        unsigned _split;
+    };
+
+    struct LessOnAxis
+    {
+        LessOnAxis(const std::vector<osg::Vec3>& centers, int axis) : _centers(centers), _axis(axis) { }
+        bool operator()(unsigned a, unsigned b) const { return _centers[a][_axis] < _centers[b][_axis]; }
+        const std::vector<osg::Vec3>& _centers;
+        int _axis;
+    };
+
+    struct LessIndex
+    {
+        bool operator()(const Primitive& a, const Primitive& b) const { return a._index < b._index; }
+    };
+
+    // node to fill in and the run of primitives under it
+    struct Range
+    {
+        unsigned _node, _begin, _end;
+    };
+
+    void setBounds(Node& node, const osg::BoundingBox& box)
+    {
+        for(int i = 0; i < 3; ++i)
+        {
+            node._min[i] = box._min[i];
+            node._max[i] = box._max[i];
+        }
+    }
+
+    // Builds a hierarchy over "primitives" with binned surface area
+    // heuristic splits, reordering the primitives so that each leaf refers
+    // to a contiguous run of them.
+    void buildTree(const osg::Vec3* verts, std::vector<Primitive>& primitives, std::vector<Node>& nodes)
+    {
+        const unsigned n = primitives.size();
+
+        std::vector<osg::BoundingBox> boxes( n );
+        std::vector<osg::Vec3>        centers( n );
+        std::vector<unsigned>         order( n );
+
+        for(unsigned i = 0; i < n; ++i)
+        {
+            const Primitive& p = primitives[i];
+            for(unsigned v = 0; v < p._numVertices; ++v)
+                boxes[i].expandBy( verts[p._vertices[v]] );
+            centers[i] = boxes[i].center();
+            order[i] = i;
+        }
+
+        std::vector<Range> stack;
+
+        nodes.clear();
+        nodes.reserve( 2u*n/MAX_LEAF_SIZE + 1u );
+        nodes.push_back( Node() );
+        Range root = { 0u, 0u, n };
+        stack.push_back( root );
+
+        while( !stack.empty() )
+        {
+            Range r = stack.back();
+            stack.pop_back();
+
+            osg::BoundingBox bounds, centerBounds;
+            for(unsigned i = r._begin; i < r._end; ++i)
+            {
+                bounds.expandBy( boxes[order[i]] );
+                centerBounds.expandBy( centers[order[i]] );
+            }
+            setBounds( nodes[r._node], bounds );
+
+            unsigned count = r._end - r._begin;
+
+            int axis = 0;
+            osg::Vec3 extent = centerBounds._max - centerBounds._min;
+            if ( extent.y() > extent[axis] ) axis = 1;
+            if ( extent.z() > extent[axis] ) axis = 2;
+
+            if ( count <= MAX_LEAF_SIZE || extent[axis] <= 0.0f )
+            {
+                nodes[r._node]._first = r._begin;
+                nodes[r._node]._count = count;
+                continue;
+            }
+
+            // sort the primitive centers into bins along the axis, then find
+            // the bin boundary with the lowest surface area cost:
+            float min   = centerBounds._min[axis];
+            float scale = (float)NUM_BINS / extent[axis];
+
+            Bin bins[NUM_BINS];
+            for(unsigned i = r._begin; i < r._end; ++i)
+            {
+                unsigned b = std::min( NUM_BINS-1u, (unsigned)((centers[order[i]][axis] - min) * scale) );
+                bins[b]._count++;
+                bins[b]._box.expandBy( boxes[order[i]] );
+            }
+
+            float    rightCost[NUM_BINS];
+            unsigned rightCount = 0u;
+            osg::BoundingBox rightBox;
+            for(unsigned b = NUM_BINS-1u; b > 0u; --b)
+            {
+                rightCount += bins[b]._count;
+                rightBox.expandBy( bins[b]._box );
+                rightCost[b] = rightCount * halfArea(rightBox);
+            }
+
+            unsigned bestSplit = 0u;
+            float    bestCost  = count * halfArea(bounds);
+            unsigned leftCount = 0u;
+            osg::BoundingBox leftBox;
+            for(unsigned b = 1u; b < NUM_BINS; ++b)
+            {
+                leftCount += bins[b-1]._count;
+                leftBox.expandBy( bins[b-1]._box );
+                float cost = leftCount * halfArea(leftBox) + rightCost[b];
+                if ( leftCount > 0u && leftCount < count && cost < bestCost )
+                {
+                    bestCost  = cost;
+                    bestSplit = b;
+                }
+            }
+
+            unsigned mid;
+            if ( bestSplit > 0u )
+            {
+                mid = std::partition(
+                    order.begin() + r._begin, order.begin() + r._end,
+                    InLowerBins(centers, axis, min, scale, bestSplit) ) - order.begin();
+            }
+            else
+            {
+                // no split beats a leaf by area; split at the median anyway
+                // to keep leaves small:
+                mid = r._begin + count/2u;
+                std::nth_element(
+                    order.begin() + r._begin, order.begin() + mid, order.begin() + r._end,
+                    LessOnAxis(centers, axis) );
+            }
+
+            unsigned left = nodes.size();
+            nodes[r._node]._first = left;
+            nodes[r._node]._count = 0u;
+            nodes.push_back( Node() );
+            nodes.push_back( Node() );
+
+            Range lower = { left,    r._begin, mid    };
+            Range upper = { left+1u, mid,      r._end };
+            stack.push_back( lower );
+            stack.push_back( upper );
+        }
+
+        std::vector<Primitive> sorted( n );
+        for(unsigned i = 0; i < n; ++i)
+            sorted[i] = primitives[order[i]];
+        primitives.swap( sorted );
+    }
+
+    // Whether the segment from "s" along "d" (for t in [0,1]) crosses a
+    // node's bounds grown by "radius".
+    bool crosses(const Node& node, const osg::Vec3d& s, const osg::Vec3d& d, double radius)
+    {
+        double t0 = 0.0, t1 = 1.0;
+        for(int i = 0; i < 3; ++i)
+        {
+            double lo = (double)node._min[i] - radius;
+            double hi = (double)node._max[i] + radius;
+            if ( d[i] == 0.0 )
+            {
+                if ( s[i] < lo || s[i] > hi )
+                    return false;
+            }
+            else
+            {
+                double ta = (lo - s[i]) / d[i];
+                double tb = (hi - s[i]) / d[i];
+                if ( ta > tb ) std::swap( ta, tb );
+                t0 = std::max( t0, ta );
+                t1 = std::min( t1, tb );
+                if ( t0 > t1 )
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Sum of the modified counts of a geometry's primitive sets, which
+    // changes whenever one of them is dirtied.
+    unsigned getPrimitivesRevision(const osg::Geometry* geometry)
+    {
+        unsigned revision = geometry->getNumPrimitiveSets();
+        for(unsigned i = 0; i < geometry->getNumPrimitiveSets(); ++i)
+            revision += geometry->getPrimitiveSet(i)->getModifiedCount();
+        return revision;
+    }
+}
+
+//........................................................................
+
+struct PrimitiveBVH::Tree : public osg::Referenced
+{
+    const osg::Array*      _vertices;
+    unsigned               _verticesRevision;
+    unsigned               _primitivesRevision;
+    bool                   _usable;
+    std::vector<Node>      _nodes;
+    std::vector<Primitive> _primitives;
+
+    bool matches(const osg::Geometry* geometry) const
+    {
+        const osg::Array* vertices = geometry->getVertexArray();
+        return
+            vertices == _vertices &&
+            vertices->getModifiedCount() == _verticesRevision &&
+            getPrimitivesRevision(geometry) == _primitivesRevision;
+    }
+};
+
+PrimitiveBVH::PrimitiveBVH()
+{
+    setName( BVH_NAME );
+}
+
+PrimitiveBVH::PrimitiveBVH(const PrimitiveBVH& rhs, const osg::CopyOp& copyop) :
+osg::Object( rhs, copyop ),
+_tree      ( rhs._tree.get() )
+{
+    //nop
+}
+
+PrimitiveBVH::~PrimitiveBVH()
+{
+    //nop
+}
+
+PrimitiveBVH*
+PrimitiveBVH::getOrCreate(osg::Geometry* geometry)
+{
+    if ( !geometry || !dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray()) )
+        return 0L;
+
+    // Small geometries are scanned, so don't attach anything to them.
+    if ( countPrimitives(geometry) < MIN_PRIMITIVES )
+        return 0L;
+
+    Threading::ScopedMutexLock lock( s_attachMutex );
+
+    osg::UserDataContainer* udc = geometry->getOrCreateUserDataContainer();
+    unsigned i = udc->getUserObjectIndex( BVH_NAME );
+    if ( i < udc->getNumUserObjects() )
+        return dynamic_cast<PrimitiveBVH*>( udc->getUserObject(i) );
+
+    PrimitiveBVH* bvh = new PrimitiveBVH();
+    udc->addUserObject( bvh );
+    return bvh;
+}
+
+bool
+PrimitiveBVH::update(const osg::Geometry* geometry)
+{
+    const osg::Vec3Array* vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+    if ( !vertices || vertices->empty() )
+        return false;
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( _tree.valid() && _tree->matches(geometry) )
+        return _tree->_usable;
+
+    osg::ref_ptr<Tree> tree = new Tree();
+    tree->_vertices           = vertices;
+    tree->_verticesRevision   = vertices->getModifiedCount();
+    tree->_primitivesRevision = getPrimitivesRevision(geometry);
+
+    osg::TemplatePrimitiveFunctor<CollectPrimitives> collect;
+    collect._base   = &vertices->front();
+    collect._output = &tree->_primitives;
+    geometry->accept( collect );
+
+    tree->_usable = collect._ok && tree->_primitives.size() >= MIN_PRIMITIVES;
+    if ( tree->_usable )
+    {
+        buildTree( collect._base, tree->_primitives, tree->_nodes );
+        OE_DEBUG << LC << "Indexed " << tree->_primitives.size() << " primitives in " << tree->_nodes.size() << " nodes" << std::endl;
+    }
+    else
+    {
+        tree->_primitives.clear();
+    }
+
+    _tree = tree.get();
+    return _tree->_usable;
+}
+
+bool
+PrimitiveBVH::intersect(const osg::Geometry*    geometry,
+                        const osg::Vec3d&       start,
+                        const osg::Vec3d&       end,
+                        double                  radius,
+                        std::vector<Primitive>& output)
+{
+    output.clear();
+
+    if ( !update(geometry) )
+        return false;
+
+    osg::ref_ptr<Tree> tree;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        tree = _tree.get();
+    }
+
+    // allow for the float precision of the bounds:
+    radius += 1e-4;
+
+    osg::Vec3d d = end - start;
+    std::vector<unsigned> stack;
+    stack.push_back( 0u );
+
+    while( !stack.empty() )
+    {
+        const Node& node = tree->_nodes[stack.back()];
+        stack.pop_back();
+
+        if ( !crosses(node, start, d, radius) )
+            continue;
+
+        if ( node._count > 0u )
+        {
+            output.insert(
+                output.end(),
+                tree->_primitives.begin() + node._first,
+                tree->_primitives.begin() + node._first + node._count );
+        }
+        else
+        {
+            stack.push_back( node._first+1u );
+            stack.push_back( node._first );
+        }
+    }
+
+    std::sort( output.begin(), output.end(), LessIndex() );
+    return true;
+}
+
+//........................................................................
+
+PrimitiveBVH::BuildVisitor::BuildVisitor() :
+osg::NodeVisitor( osg::NodeVisitor::TRAVERSE_ALL_CHILDREN )
+{
+    //nop
+}
+
+void
+PrimitiveBVH::BuildVisitor::apply(osg::Drawable& drawable)
+{
+    osg::Geometry* geometry = drawable.asGeometry();
+    PrimitiveBVH* bvh = PrimitiveBVH::getOrCreate( geometry );
+    if ( bvh )
+        bvh->update( geometry );
+}
+
+void
+PrimitiveBVH::BuildCallback::onPreMergeNode(osg::Node* node)
+{
+    if ( node )
+    {
+        BuildVisitor visitor;
+        node->accept( visitor );
+    }
+}
@@ -18,6 +18,7 @@
  */
 
 #include <osgEarth/PrimitiveIntersector>
+#include <osgEarth/PrimitiveBVH>
 #include <osgEarth/StringUtils>
 #include <osgEarth/Utils>
 #include <osg/Geode>
@@ -317,7 +318,8 @@ struct PrimitiveIntersectorFunctor
 PrimitiveIntersector::PrimitiveIntersector() :
 _parent(0),
 _thicknessVal(0),
-_overlayIgnore(false)
+_overlayIgnore(false),
+_useBVH(true)
 {
     //nop
 }
@@ -325,7 +327,8 @@ _overlayIgnore(false)
 PrimitiveIntersector::PrimitiveIntersector(CoordinateFrame cf, double x, double y, double thickness):
     Intersector(cf),
     _parent(0),
-    _overlayIgnore(false)
+    _overlayIgnore(false),
+    _useBVH(true)
 {
     switch(cf)
     {
@@ -341,7 +344,8 @@ PrimitiveIntersector::PrimitiveIntersector(CoordinateFrame cf, double x, double
 PrimitiveIntersector::PrimitiveIntersector(CoordinateFrame cf, const osg::Vec3d& start, const osg::Vec3d& end, double thickness, bool overlayIgnore):
     Intersector(cf),
     _parent(0),
-    _overlayIgnore(overlayIgnore)
+    _overlayIgnore(overlayIgnore),
+    _useBVH(true)
 {
   _start.set(start);
   _end.set(end);
@@ -381,6 +385,7 @@ osgUtil::Intersector* PrimitiveIntersector::clone(osgUtil::IntersectionVisitor&
         lsi->_thicknessVal = _thicknessVal;
         lsi->_parent = this;
         lsi->_intersectionLimit = _intersectionLimit;
+        lsi->_useBVH = _useBVH;
 
         return lsi.release();
     }
@@ -421,6 +426,7 @@ osgUtil::Intersector* PrimitiveIntersector::clone(osgUtil::IntersectionVisitor&
     lsi->_thicknessVal = _thicknessVal;
     lsi->_parent = this;
     lsi->_intersectionLimit = _intersectionLimit;
+    lsi->_useBVH = _useBVH;
     
     return lsi.release();
 }
@@ -462,11 +468,39 @@ void PrimitiveIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Draw
 
     ti.set(s,e,_thickness-_start);
     ti._limitOneIntersection = (_intersectionLimit == LIMIT_ONE_PER_DRAWABLE || _intersectionLimit == LIMIT_ONE);
-    drawable->accept(ti);
+
+    osg::Geometry* geometry = drawable->asGeometry();
+
+    // With a BVH, replay only the primitives near the segment through the
+    // functor, numbered as the full traversal would number them.
+    std::vector<PrimitiveBVH::Primitive> candidates;
+    PrimitiveBVH* bvh = _useBVH ? PrimitiveBVH::getOrCreate(geometry) : 0L;
+    if ( bvh && bvh->intersect(geometry, s, e, (_thickness - _start).length(), candidates) )
+    {
+        const osg::Vec3* v = &static_cast<const osg::Vec3Array*>(geometry->getVertexArray())->front();
+        for(std::vector<PrimitiveBVH::Primitive>::const_iterator p = candidates.begin(); p != candidates.end(); ++p)
+        {
+            if (ti._limitOneIntersection && ti._hit)
+                break;
+
+            const unsigned* i = p->_vertices;
+            ti._index = p->_index;
+            switch(p->_numVertices)
+            {
+            case 1: ti(v[i[0]], false); break;
+            case 2: ti(v[i[0]], v[i[1]], false); break;
+            case 3: ti(v[i[0]], v[i[1]], v[i[2]], false); break;
+            case 4: ti(v[i[0]], v[i[1]], v[i[2]], v[i[3]], false); break;
+            }
+        }
+    }
+    else
+    {
+        drawable->accept(ti);
+    }
 
     if (ti._hit)
     {
-        osg::Geometry* geometry = drawable->asGeometry();
 
         for(PrimitiveIntersections::iterator thitr = ti._intersections.begin(); thitr != ti._intersections.end(); ++thitr)
         {
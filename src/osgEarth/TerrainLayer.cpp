@@ -24,6 +24,7 @@
 #include <osgEarth/URI>
 #include <osgEarth/MemCache>
 #include <osgEarth/CacheBin>
+#include <osgEarth/Metrics>
 #include <osgDB/WriteFile>
 #include <osg/Version>
 #include <OpenThreads/ScopedLock>
@@ -245,7 +246,9 @@ TerrainLayer::TerrainLayer(TerrainLayerOptions* optionsPtr) :
 VisibleLayer(optionsPtr ? optionsPtr : &_optionsConcrete),
 _options(optionsPtr ? optionsPtr : &_optionsConcrete),
 _openCalled(false),
-_tileSourceExpected(true)
+_tileSourceExpected(true),
+_numTileRequests(0u),
+_numCoalescedTileRequests(0u)
 {
     //nop - init() called by subclass
 }
@@ -255,7 +258,9 @@ VisibleLayer(optionsPtr ? optionsPtr : &_optionsConcrete),
 _options(optionsPtr ? optionsPtr : &_optionsConcrete),
 _tileSource(tileSource),
 _openCalled(false),
-_tileSourceExpected(true)
+_tileSourceExpected(true),
+_numTileRequests(0u),
+_numCoalescedTileRequests(0u)
 {
     //nop - init() called by subclass
 }
@@ -1016,6 +1021,81 @@ TerrainLayer::dirtyDataExtents()
     _dataExtentsUnion = GeoExtent::INVALID;
 }
 
+bool
+TerrainLayer::joinTileRequest(const std::string&             requestKey,
+                              ProgressCallback*              progress,
+                              osg::ref_ptr<osg::Referenced>& result)
+{
+    while ( true )
+    {
+        Threading::Future<TileRequestResult> future;
+        {
+            Threading::ScopedMutexLock lock( _tileRequestsMutex );
+            TileRequestMap::iterator i = _tileRequests.find( requestKey );
+            if ( i == _tileRequests.end() )
+            {
+                // nobody is working on this tile; the caller takes it on.
+                _tileRequests.insert( std::make_pair(requestKey, Threading::Promise<TileRequestResult>()) );
+                ++_numTileRequests;
+                return false;
+            }
+            future = i->second.getFuture();
+        }
+
+        // wait for the other thread, unless our own request goes away first.
+        while ( !future.wait(10u) && !future.isAbandoned() )
+        {
+            if ( progress && progress->isCanceled() )
+            {
+                result = 0L;
+                return true;
+            }
+        }
+
+        osg::ref_ptr<TileRequestResult> shared = future.get();
+
+        // if the other request was canceled, go around again and take it on
+        // (or join another thread that got there first).
+        if ( shared.valid() && !shared->_canceled )
+        {
+            unsigned numRequests, numCoalesced, numInFlight;
+            {
+                Threading::ScopedMutexLock lock( _tileRequestsMutex );
+                numRequests = _numTileRequests;
+                numCoalesced = ++_numCoalescedTileRequests;
+                numInFlight = _tileRequests.size();
+            }
+
+            if ( Metrics::enabled() )
+            {
+                Metrics::counter( Stringify() << getName() << " tile requests",
+                    "created",   (double)numRequests,
+                    "coalesced", (double)numCoalesced,
+                    "in flight", (double)numInFlight );
+            }
+
+            result = shared->_object.get();
+            return true;
+        }
+    }
+}
+
+void
+TerrainLayer::endTileRequest(const std::string& requestKey, osg::Referenced* result, bool canceled)
+{
+    osg::ref_ptr<TileRequestResult> shared = new TileRequestResult();
+    shared->_object = result;
+    shared->_canceled = canceled;
+
+    Threading::ScopedMutexLock lock( _tileRequestsMutex );
+    TileRequestMap::iterator i = _tileRequests.find( requestKey );
+    if ( i != _tileRequests.end() )
+    {
+        i->second.resolve( shared.get() );
+        _tileRequests.erase( i );
+    }
+}
+
 const GeoExtent&
 TerrainLayer::getDataExtentsUnion() const
 {
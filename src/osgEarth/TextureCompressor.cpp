@@ -0,0 +1,503 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/TextureCompressor>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/Notify>
+#include <OpenThreads/Thread>
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#define LC "[TextureCompressor] "
+
+#ifndef GL_RG
+#define GL_RG 0x8227
+#endif
+
+using namespace osgEarth;
+
+namespace
+{
+    // One RGBA8 level of the source image.
+    struct Level
+    {
+        unsigned s, t;
+        std::vector<unsigned char> rgba;
+    };
+
+    // Copies the image into an RGBA8 buffer. 8-bit images are copied directly;
+    // anything else goes through the PixelReader.
+    bool readLevel(const osg::Image* image, Level& out)
+    {
+        out.s = image->s();
+        out.t = image->t();
+        out.rgba.resize(out.s * out.t * 4);
+
+        GLenum format = image->getPixelFormat();
+
+        if (image->getDataType() == GL_UNSIGNED_BYTE &&
+            (format == GL_RGB  || format == GL_RGBA || format == GL_BGR || format == GL_BGRA ||
+             format == GL_RED  || format == GL_RG   || format == GL_LUMINANCE || format == GL_LUMINANCE_ALPHA))
+        {
+            unsigned n = osg::Image::computeNumComponents(format);
+            bool bgr = (format == GL_BGR || format == GL_BGRA);
+
+            for (unsigned t = 0; t < out.t; ++t)
+            {
+                const unsigned char* src = image->data(0, t);
+                unsigned char* dst = &out.rgba[t * out.s * 4];
+
+                for (unsigned s = 0; s < out.s; ++s, src += n, dst += 4)
+                {
+                    switch (format)
+                    {
+                    case GL_RED:
+                        dst[0] = src[0], dst[1] = 0, dst[2] = 0, dst[3] = 255; break;
+                    case GL_RG:
+                        dst[0] = src[0], dst[1] = src[1], dst[2] = 0, dst[3] = 255; break;
+                    case GL_LUMINANCE:
+                        dst[0] = dst[1] = dst[2] = src[0], dst[3] = 255; break;
+                    case GL_LUMINANCE_ALPHA:
+                        dst[0] = dst[1] = dst[2] = src[0], dst[3] = src[1]; break;
+                    default:
+                        dst[0] = src[bgr ? 2 : 0];
+                        dst[1] = src[1];
+                        dst[2] = src[bgr ? 0 : 2];
+                        dst[3] = n == 4 ? src[3] : 255;
+                    }
+                }
+            }
+            return true;
+        }
+
+        if (!ImageUtils::PixelReader::supports(image))
+            return false;
+
+        ImageUtils::PixelReader read(image);
+        unsigned char* dst = &out.rgba[0];
+        for (unsigned t = 0; t < out.t; ++t)
+        {
+            for (unsigned s = 0; s < out.s; ++s, dst += 4)
+            {
+                osg::Vec4f c = read(s, t);
+                for (unsigned i = 0; i < 4; ++i)
+                    dst[i] = (unsigned char)(osg::clampBetween(c[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+        }
+        return true;
+    }
+
+    // 2x2 box filter to the next mipmap level.
+    void downsample(const Level& in, Level& out)
+    {
+        out.s = osg::maximum(in.s >> 1, 1u);
+        out.t = osg::maximum(in.t >> 1, 1u);
+        out.rgba.resize(out.s * out.t * 4);
+
+        for (unsigned t = 0; t < out.t; ++t)
+        {
+            unsigned t0 = osg::minimum(t * 2, in.t - 1), t1 = osg::minimum(t * 2 + 1, in.t - 1);
+            for (unsigned s = 0; s < out.s; ++s)
+            {
+                unsigned s0 = osg::minimum(s * 2, in.s - 1), s1 = osg::minimum(s * 2 + 1, in.s - 1);
+                const unsigned char* a = &in.rgba[(t0 * in.s + s0) * 4];
+                const unsigned char* b = &in.rgba[(t0 * in.s + s1) * 4];
+                const unsigned char* c = &in.rgba[(t1 * in.s + s0) * 4];
+                const unsigned char* d = &in.rgba[(t1 * in.s + s1) * 4];
+                unsigned char* dst = &out.rgba[(t * out.s + s) * 4];
+                for (unsigned i = 0; i < 4; ++i)
+                    dst[i] = (unsigned char)((a[i] + b[i] + c[i] + d[i] + 2) >> 2);
+            }
+        }
+    }
+
+    // Gathers the 4x4 block at (bx,by), clamping at the image edges.
+    void fetchBlock(const Level& level, unsigned bx, unsigned by, unsigned char* block)
+    {
+        for (unsigned y = 0; y < 4; ++y)
+        {
+            unsigned t = osg::minimum(by * 4 + y, level.t - 1);
+            for (unsigned x = 0; x < 4; ++x)
+            {
+                unsigned s = osg::minimum(bx * 4 + x, level.s - 1);
+                std::memcpy(block + (y * 4 + x) * 4, &level.rgba[(t * level.s + s) * 4], 4);
+            }
+        }
+    }
+
+    inline unsigned short to565(const float* c)
+    {
+        int r = osg::clampBetween((int)(c[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+        int g = osg::clampBetween((int)(c[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+        int b = osg::clampBetween((int)(c[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+        return (unsigned short)((r << 11) | (g << 5) | b);
+    }
+
+    inline void from565(unsigned short v, int* c)
+    {
+        int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+        c[0] = (r << 3) | (r >> 2);
+        c[1] = (g << 2) | (g >> 4);
+        c[2] = (b << 3) | (b >> 2);
+    }
+
+    // BC1 color block: endpoints are the extremes of the block along its
+    // principal axis, inset slightly, and each texel takes the nearest of the
+    // four palette entries.
+    void encodeBC1(const unsigned char* block, unsigned char* out)
+    {
+        float mean[3] = { 0, 0, 0 };
+        for (unsigned i = 0; i < 16; ++i)
+            for (unsigned c = 0; c < 3; ++c)
+                mean[c] += block[i * 4 + c];
+        for (unsigned c = 0; c < 3; ++c)
+            mean[c] /= 16.0f;
+
+        // covariance (symmetric: rr, rg, rb, gg, gb, bb)
+        float cov[6] = { 0, 0, 0, 0, 0, 0 };
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            float r = block[i * 4 + 0] - mean[0];
+            float g = block[i * 4 + 1] - mean[1];
+            float b = block[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+
+        // principal axis by power iteration
+        float axis[3] = { 1, 1, 1 };
+        for (unsigned iter = 0; iter < 4; ++iter)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float m = osg::maximum(osg::absolute(x), osg::maximum(osg::absolute(y), osg::absolute(z)));
+            if (m <= 0.0f)
+                break;
+            axis[0] = x / m, axis[1] = y / m, axis[2] = z / m;
+        }
+
+        unsigned iMin = 0, iMax = 0;
+        float dMin = FLT_MAX, dMax = -FLT_MAX;
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            float d = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+            if (d < dMin) dMin = d, iMin = i;
+            if (d > dMax) dMax = d, iMax = i;
+        }
+
+        float hi[3], lo[3];
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            float a = block[iMax * 4 + c], b = block[iMin * 4 + c];
+            float inset = (a - b) / 16.0f;
+            hi[c] = a - inset;
+            lo[c] = b + inset;
+        }
+
+        unsigned short c0 = to565(hi), c1 = to565(lo);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        out[0] = c0 & 0xff, out[1] = c0 >> 8;
+        out[2] = c1 & 0xff, out[3] = c1 >> 8;
+
+        if (c0 == c1)
+        {
+            // Solid block; index 0 everywhere. (c0 > c1 would be required for
+            // four-color mode, but index 0 decodes the same in either mode.)
+            out[4] = out[5] = out[6] = out[7] = 0;
+            return;
+        }
+
+        int palette[4][3];
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        for (unsigned c = 0; c < 3; ++c)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (unsigned y = 0; y < 4; ++y)
+        {
+            unsigned char bits = 0;
+            for (unsigned x = 0; x < 4; ++x)
+            {
+                const unsigned char* px = block + (y * 4 + x) * 4;
+                unsigned best = 0;
+                int bestDist = INT_MAX;
+                for (unsigned p = 0; p < 4; ++p)
+                {
+                    int dr = px[0] - palette[p][0], dg = px[1] - palette[p][1], db = px[2] - palette[p][2];
+                    int dist = dr * dr + dg * dg + db * db;
+                    if (dist < bestDist)
+                        bestDist = dist, best = p;
+                }
+                bits |= (unsigned char)(best << (x * 2));
+            }
+            out[4 + y] = bits;
+        }
+    }
+
+    // BC4 channel block: endpoints are the channel's min and max (eight-value
+    // mode) and each texel snaps to the nearest of the eight interpolants.
+    void encodeBC4(const unsigned char* block, unsigned channel, unsigned char* out)
+    {
+        int lo = 255, hi = 0;
+        for (unsigned i = 0; i < 16; ++i)
+        {
+            int v = block[i * 4 + channel];
+            lo = osg::minimum(lo, v);
+            hi = osg::maximum(hi, v);
+        }
+
+        out[0] = (unsigned char)hi;
+        out[1] = (unsigned char)lo;
+
+        if (hi == lo)
+        {
+            std::memset(out + 2, 0, 6);
+            return;
+        }
+
+        // 16 3-bit indices, packed into two 24-bit groups of eight.
+        int range = hi - lo;
+        for (unsigned half = 0; half < 2; ++half)
+        {
+            unsigned bits = 0;
+            for (unsigned i = 0; i < 8; ++i)
+            {
+                int v = block[(half * 8 + i) * 4 + channel];
+                // position along lo..hi in sevenths; 7 is "hi" (index 0),
+                // 0 is "lo" (index 1) and k in between is index 8-k.
+                int k = ((v - lo) * 14 + range) / (range * 2);
+                unsigned index = k == 7 ? 0u : k == 0 ? 1u : (unsigned)(8 - k);
+                bits |= index << (i * 3);
+            }
+            out[2 + half * 3 + 0] = (unsigned char)(bits & 0xff);
+            out[2 + half * 3 + 1] = (unsigned char)((bits >> 8) & 0xff);
+            out[2 + half * 3 + 2] = (unsigned char)((bits >> 16) & 0xff);
+        }
+    }
+
+    inline unsigned getBlockSize(TextureCompressor::Format format)
+    {
+        return format == TextureCompressor::FORMAT_BC1 || format == TextureCompressor::FORMAT_BC4 ? 8u : 16u;
+    }
+
+    // Encodes block rows [by0..by1) of a level.
+    void encodeRows(const Level& level, TextureCompressor::Format format, unsigned by0, unsigned by1, unsigned char* out)
+    {
+        unsigned blocksX = (level.s + 3) / 4;
+        unsigned blockSize = getBlockSize(format);
+        unsigned char block[64];
+
+        for (unsigned by = by0; by < by1; ++by)
+        {
+            unsigned char* dst = out + by * blocksX * blockSize;
+            for (unsigned bx = 0; bx < blocksX; ++bx, dst += blockSize)
+            {
+                fetchBlock(level, bx, by, block);
+                switch (format)
+                {
+                case TextureCompressor::FORMAT_BC1:
+                    encodeBC1(block, dst);
+                    break;
+                case TextureCompressor::FORMAT_BC3:
+                    encodeBC4(block, 3, dst);
+                    encodeBC1(block, dst + 8);
+                    break;
+                case TextureCompressor::FORMAT_BC4:
+                    encodeBC4(block, 0, dst);
+                    break;
+                default:
+                    encodeBC4(block, 0, dst);
+                    encodeBC4(block, 1, dst + 8);
+                }
+            }
+        }
+    }
+
+    class EncodeRowsThread : public Threading::Thread
+    {
+    public:
+        EncodeRowsThread(const Level& level, TextureCompressor::Format format, unsigned by0, unsigned by1, unsigned char* out) :
+            _level(level), _format(format), _by0(by0), _by1(by1), _out(out) { }
+
+        void run()
+        {
+            encodeRows(_level, _format, _by0, _by1, _out);
+        }
+
+    private:
+        const Level& _level;
+        TextureCompressor::Format _format;
+        unsigned _by0, _by1;
+        unsigned char* _out;
+    };
+
+    void encodeLevel(const Level& level, TextureCompressor::Format format, unsigned numThreads, unsigned char* out)
+    {
+        unsigned blocksY = (level.t + 3) / 4;
+
+        // small levels are not worth a thread
+        numThreads = osg::minimum(numThreads, blocksY / 4u);
+        if (numThreads <= 1u)
+        {
+            encodeRows(level, format, 0u, blocksY, out);
+            return;
+        }
+
+        std::vector<EncodeRowsThread*> threads;
+        unsigned rowsPerThread = blocksY / numThreads;
+        unsigned extra = blocksY % numThreads;
+        unsigned by0 = 0u;
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            unsigned by1 = by0 + rowsPerThread + (i < extra ? 1u : 0u);
+            EncodeRowsThread* thread = new EncodeRowsThread(level, format, by0, by1, out);
+            thread->start();
+            threads.push_back(thread);
+            by0 = by1;
+        }
+
+        for (unsigned i = 0; i < threads.size(); ++i)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+    }
+
+    inline bool isPowerOfTwo(unsigned v)
+    {
+        return v > 0 && (v & (v - 1)) == 0;
+    }
+}
+
+//------------------------------------------------------------------------
+
+TextureCompressor::TextureCompressor() :
+_format    ( FORMAT_AUTO ),
+_mipmaps   ( true ),
+_numThreads( 0u )
+{
+    //nop
+}
+
+TextureCompressor::Format
+TextureCompressor::getAutoFormat(const osg::Image* image)
+{
+    if (image == 0L)
+        return FORMAT_BC1;
+
+    GLenum format = image->getPixelFormat();
+    if (format == GL_RED)
+        return FORMAT_BC4;
+    if (format == GL_RG)
+        return FORMAT_BC5;
+    if (ImageUtils::hasTransparency(image, 1.0f))
+        return FORMAT_BC3;
+    return FORMAT_BC1;
+}
+
+GLenum
+TextureCompressor::getPixelFormat(Format format)
+{
+    switch (format)
+    {
+    case FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1_EXT;
+    case FORMAT_BC5: return GL_COMPRESSED_RED_GREEN_RGTC2_EXT;
+    default:         return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+}
+
+osg::Image*
+TextureCompressor::compress(const osg::Image* image) const
+{
+    if (image == 0L || image->data() == 0L || image->s() < 1 || image->t() < 1 || image->r() != 1)
+        return 0L;
+
+    if (ImageUtils::isCompressed(image))
+        return 0L;
+
+    std::vector<Level> levels(1);
+    if (!readLevel(image, levels[0]))
+    {
+        OE_WARN << LC << "Unsupported pixel format; image not compressed" << std::endl;
+        return 0L;
+    }
+
+    Format format = _format;
+    if (format == FORMAT_AUTO)
+        format = getAutoFormat(image);
+
+    if (_mipmaps && isPowerOfTwo(levels[0].s) && isPowerOfTwo(levels[0].t))
+    {
+        while (levels.back().s > 1 || levels.back().t > 1)
+        {
+            levels.push_back(Level());
+            downsample(levels[levels.size() - 2], levels.back());
+        }
+    }
+
+    // Lay out all levels in one buffer.
+    unsigned blockSize = getBlockSize(format);
+    std::vector<unsigned> offsets(levels.size());
+    unsigned totalSize = 0u;
+    for (unsigned i = 0; i < levels.size(); ++i)
+    {
+        offsets[i] = totalSize;
+        totalSize += ((levels[i].s + 3) / 4) * ((levels[i].t + 3) / 4) * blockSize;
+    }
+
+    unsigned numThreads = _numThreads > 0u ? _numThreads : (unsigned)osg::maximum(1, OpenThreads::GetNumberOfProcessors());
+
+    unsigned char* data = new unsigned char[totalSize];
+    for (unsigned i = 0; i < levels.size(); ++i)
+    {
+        encodeLevel(levels[i], format, numThreads, data + offsets[i]);
+    }
+
+    GLenum pixelFormat = getPixelFormat(format);
+
+    osg::Image* result = new osg::Image();
+    result->setImage(
+        levels[0].s, levels[0].t, 1,
+        pixelFormat, pixelFormat, GL_UNSIGNED_BYTE,
+        data, osg::Image::USE_NEW_DELETE);
+
+    if (levels.size() > 1)
+    {
+        osg::Image::MipmapDataType mipmaps(offsets.begin() + 1, offsets.end());
+        result->setMipmapLevels(mipmaps);
+    }
+
+    result->setFileName(image->getFileName());
+    result->setOrigin(image->getOrigin());
+
+    return result;
+}
@@ -23,6 +23,9 @@
 #include <osgEarth/Registry>
 #include <osgEarth/Progress>
 #include <osgEarth/FileUtils>
+#include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
+#include <osgEarth/DateTime>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/ReaderWriter>
@@ -288,6 +291,7 @@ namespace
 
     struct ReadObject
     {
+        bool usesImageCache() const { return false; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readObject(key, 0L); }
@@ -305,6 +309,7 @@ namespace
 
     struct ReadNode
     {
+        bool usesImageCache() const { return false; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key ) { return bin->readObject(key, 0L); }
@@ -322,6 +327,7 @@ namespace
 
     struct ReadImage
     {
+        bool usesImageCache() const { return true; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { 
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_IMAGES) != 0); 
         }
@@ -354,6 +360,7 @@ namespace
 
     struct ReadString
     {
+        bool usesImageCache() const { return false; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_STRINGS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readString(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readString(key, 0L); }
@@ -421,7 +428,31 @@ namespace
                 }
             }
 
-            if ( result.empty() )
+            // check the shared decoded-image cache. If another thread is already
+            // reading this URI, this waits for it instead of reading it again.
+            // A "no_cache" policy bypasses it entirely.
+            URIImageCache* imageCache = 0L;
+            std::string imageCacheKey;
+            if ( result.empty() && reader.usesImageCache() && URIImageCache::instance()->getMaxBytes() > 0u )
+            {
+                CacheSettings* cacheSettings = CacheSettings::get(localOptions.get());
+                const CachePolicy& policy =
+                    cacheSettings && cacheSettings->cachePolicy().isSet() ? cacheSettings->cachePolicy().get() :
+                    CachePolicy::DEFAULT;
+
+                if ( policy.isCacheEnabled() )
+                {
+                    imageCacheKey = Stringify() << uri.full() << "|" << localOptions->getOptionString();
+                    bool leader = false;
+                    if ( !URIImageCache::instance()->acquire(imageCacheKey, policy, progress, result, leader) && leader )
+                    {
+                        imageCache = URIImageCache::instance();
+                    }
+                }
+            }
+
+            // a canceled wait in the image cache ends the read.
+            if ( result.empty() && result.code() != ReadResult::RESULT_CANCELED )
             {
                 // see if there's a read callback installed.
                 URIReadCallback* cb = Registry::instance()->getURIReadCallback();
@@ -544,6 +575,12 @@ namespace
                 }
             }
 
+            if ( imageCache )
+            {
+                // callback results are not cached, same as the memCache above.
+                imageCache->release( imageCacheKey, result, result.succeeded() && !gotResultFromCallback );
+            }
+
             OE_TEST << LC
                 << uri.base() << ": "
                 << (result.succeeded() ? "OK" : "FAILED")
@@ -592,6 +629,227 @@ URI::readString(const osgDB::Options* dbOptions,
 }
 
 
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Copies a result so the caller gets its own image.
+    ReadResult cloneResult(const ReadResult& in)
+    {
+        if ( !in.getImage() )
+            return in;
+
+        ReadResult out(
+            in.code(),
+            new osg::Image(*in.getImage(), osg::CopyOp::DEEP_COPY_ALL),
+            in.metadata() );
+
+        out.setIsFromCache( in.isFromCache() );
+        out.setLastModifiedTime( in.lastModifiedTime() );
+        out.setDuration( in.duration() );
+        return out;
+    }
+}
+
+URIImageCache*
+URIImageCache::instance()
+{
+    static URIImageCache* s_singleton =0L;
+    static Threading::Mutex s_singletonMutex;
+
+    if ( !s_singleton )
+    {
+        Threading::ScopedMutexLock lock(s_singletonMutex);
+        if ( !s_singleton )
+        {
+            s_singleton = new URIImageCache();
+        }
+    }
+    return s_singleton;
+}
+
+URIImageCache::URIImageCache() :
+_maxBytes( 64u * 1024u * 1024u ),
+_bytes   ( 0u ),
+_hits    ( 0u ),
+_misses  ( 0u )
+{
+    const char* value = ::getenv("OSGEARTH_URI_IMAGE_CACHE_SIZE");
+    if ( value )
+    {
+        _maxBytes = as<unsigned>(std::string(value), 64u) * 1024u * 1024u;
+        OE_INFO << LC << "Shared image cache size = " << (_maxBytes / 1024u / 1024u) << "MB" << std::endl;
+    }
+}
+
+void
+URIImageCache::setMaxBytes(unsigned value)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _maxBytes = value;
+    trim();
+}
+
+void
+URIImageCache::clear()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _entries.clear();
+    _lru.clear();
+    _bytes = 0u;
+}
+
+bool
+URIImageCache::acquire(const std::string& key, const CachePolicy& policy, ProgressCallback* progress, ReadResult& result, bool& leader)
+{
+    leader = false;
+    ReadResult cached;
+    osg::ref_ptr<Flight> flight;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        EntryMap::iterator i = _entries.find(key);
+        if ( i != _entries.end() && policy.isExpired(i->second._timestamp) )
+        {
+            // too old for this reader's policy; drop it and read it again.
+            _bytes -= i->second._bytes;
+            _lru.erase( i->second._lru );
+            _entries.erase( i );
+            i = _entries.end();
+        }
+
+        if ( i != _entries.end() )
+        {
+            // move to the front of the LRU list:
+            _lru.splice( _lru.begin(), _lru, i->second._lru );
+            ++_hits;
+            report();
+            cached = i->second._result;
+        }
+
+        FlightMap::iterator f = _flights.find(key);
+        if ( !cached.empty() )
+        {
+            // hit; copy it below, outside the lock
+        }
+        else if ( f == _flights.end() )
+        {
+            // nobody is reading it; the caller will.
+            _flights[key] = new Flight();
+            ++_misses;
+            report();
+            leader = true;
+            return false;
+        }
+
+        else
+        {
+            flight = f->second.get();
+        }
+    }
+
+    if ( flight.valid() )
+    {
+        // another thread is reading it; wait for its result unless the
+        // caller gives up first.
+        while ( !flight->_done.wait(100u) )
+        {
+            if ( progress && progress->isCanceled() )
+            {
+                result = ReadResult( ReadResult::RESULT_CANCELED );
+                return true;
+            }
+        }
+
+        // if that read failed (or was canceled), the caller reads it independently.
+        if ( !flight->_result.succeeded() )
+            return false;
+
+        Threading::ScopedMutexLock lock(_mutex);
+        ++_hits;
+        report();
+        cached = flight->_result;
+    }
+
+    // cached images are never modified, so they can be copied without the lock.
+    result = cloneResult( cached );
+    return true;
+}
+
+void
+URIImageCache::release(const std::string& key, const ReadResult& result, bool store)
+{
+    // keep a private copy; the caller may modify the one it has.
+    ReadResult shared;
+    if ( store && result.getImage() )
+    {
+        shared = cloneResult( result );
+    }
+
+    osg::ref_ptr<Flight> flight;
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        FlightMap::iterator f = _flights.find(key);
+        if ( f != _flights.end() )
+        {
+            flight = f->second.get();
+            _flights.erase( f );
+        }
+
+        if ( !shared.empty() && _maxBytes > 0u && _entries.find(key) == _entries.end() )
+        {
+            Entry& entry = _entries[key];
+            entry._result = shared;
+            entry._bytes = shared.getImage()->getTotalSizeInBytesIncludingMipmaps();
+            entry._timestamp =
+                shared.isFromCache() && shared.lastModifiedTime() > 0 ? shared.lastModifiedTime() :
+                DateTime().asTimeStamp();
+            _lru.push_front( key );
+            entry._lru = _lru.begin();
+            _bytes += entry._bytes;
+            trim();
+        }
+    }
+
+    if ( flight.valid() )
+    {
+        // waiters copy from the flight, so they still get the image even if
+        // it was evicted (or too big to cache) in the meantime.
+        flight->_result = shared;
+        flight->_done.set();
+    }
+}
+
+void
+URIImageCache::trim()
+{
+    // assumes the mutex is locked.
+    while ( _bytes > _maxBytes && !_lru.empty() )
+    {
+        EntryMap::iterator i = _entries.find( _lru.back() );
+        if ( i != _entries.end() )
+        {
+            _bytes -= i->second._bytes;
+            _entries.erase( i );
+        }
+        _lru.pop_back();
+    }
+}
+
+void
+URIImageCache::report() const
+{
+    // assumes the mutex is locked.
+    if ( Metrics::enabled() )
+    {
+        Metrics::counter("URIImageCache",
+            "Hits",   (double)_hits,
+            "Misses", (double)_misses,
+            "MB",     (double)_bytes / 1048576.0);
+    }
+}
+
 //------------------------------------------------------------------------
 
 void
@@ -124,12 +124,18 @@ _clampDirty     ( false )
     setStyle( style );
 }
 
+FeatureNode::~FeatureNode()
+{
+    stopAsyncClamping();
+}
+
 void
 FeatureNode::build()
 {
     if ( !_clampCallback.valid() )
         _clampCallback = new ClampCallback(this);
 
+    stopAsyncClamping();
     _attachPoint = 0L;
 
     // if there is existing geometry, kill it
@@ -336,29 +342,13 @@ FeatureNode::onTileAdded(const TileKey&          key,
                          osg::Node*              graph,
                          TerrainCallbackContext& context)
 {
-    if (!_clampDirty)
+    // New tiles are handled by the map's AsyncGeometryClamper, which only
+    // re-clamps the vertices under each tile. Without a valid tilekey we
+    // don't know the extent of the change, so clamp everything.
+    if (!_clampDirty && !key.valid())
     {
-        bool needsClamp;
-
-        if (key.valid())
-        {
-            osg::Polytope tope;
-            key.getExtent().createPolytope(tope);
-            needsClamp = tope.contains(this->getBound());
-        }
-        else
-        {
-            // without a valid tilekey we don't know the extent of the change,
-            // so clamping is required.
-            needsClamp = true;
-        }
-
-        if (needsClamp)
-        {
-            _clampDirty = true;
-            ADJUST_UPDATE_TRAV_COUNT(this, +1);
-            //clamp(graph, context.getTerrain());
-        }
+        _clampDirty = true;
+        ADJUST_UPDATE_TRAV_COUNT(this, +1);
     }
 }
 
@@ -381,7 +371,29 @@ FeatureNode::clamp(osg::Node* graph, const Terrain* terrain)
         clamper.setOffset( offset );
 
         this->accept( clamper );
+
+        // keep the geometry clamped as new tiles arrive.
+        AsyncGeometryClamper* asyncClamper = getMapNode() ? getMapNode()->getGeometryClamper() : 0L;
+        if ( asyncClamper && _attachPoint )
+        {
+            if ( _asyncClamper.get() != asyncClamper )
+                stopAsyncClamping();
+
+            asyncClamper->add( _attachPoint, relative, offset );
+            _asyncClamper = asyncClamper;
+        }
+    }
+}
+
+void
+FeatureNode::stopAsyncClamping()
+{
+    osg::ref_ptr<AsyncGeometryClamper> asyncClamper;
+    if ( _asyncClamper.lock(asyncClamper) && _attachPoint )
+    {
+        asyncClamper->remove( _attachPoint );
     }
+    _asyncClamper = 0L;
 }
 
 void
@@ -22,8 +22,7 @@
 #include <osgEarthFeatures/TransformFilter>
 #include <osgEarthFeatures/BufferFilter>
 #include <osgEarthSymbology/Style>
-//TODO: replace this with GeometryRasterizer
-#include <osgEarthSymbology/AGG.h>
+#include <osgEarthSymbology/ScanlineRasterizer>
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageUtils>
@@ -38,6 +37,7 @@
 #include "AGGLiteOptions"
 
 #include <sstream>
+#include <cstring>
 #include <OpenThreads/Mutex>
 #include <OpenThreads/ScopedLock>
 
@@ -49,57 +49,6 @@ using namespace osgEarth::Symbology;
 using namespace osgEarth::Drivers;
 using namespace OpenThreads;
 
-namespace
-{
-    struct float32
-    {
-        float32() : value(NO_DATA_VALUE) { }
-        float32(float v) : value(v) { }
-
-        float value;
-    };
-
-    struct span_coverage32
-    {
-        static void render(unsigned char* ptr, 
-                           int x,
-                           unsigned count, 
-                           const unsigned char* covers, 
-                           const float32& c)
-        {
-            unsigned char* p = ptr + (x << 2);
-            float* f = (float*)p;
-            do
-            {
-                unsigned char cover = *covers++;
-                int hasData = cover > 127;
-                *f++ = hasData ? c.value : NO_DATA_VALUE;
-            }
-            while(--count);
-        }
-
-        static void hline(unsigned char* ptr, 
-                          int x,
-                          unsigned count, 
-                          const float32& c)
-        {
-            unsigned char* p = ptr + (x << 2);
-            float* f = (float*)p;
-            do {
-                *f++ = c.value;
-            }
-            while(--count);
-        }
-
-        static float32 get(unsigned char* ptr, int x)
-        {
-            unsigned char* p = ptr + (x << 2);
-            float* f = (float*)p;
-            return float32(*f);
-        }
-    };
-}
-
 /********************************************************************/
 
 class AGGLiteRasterizerTileSource : public FeatureTileSource
@@ -134,18 +83,16 @@ public:
     //override
     bool preProcess(osg::Image* image, osg::Referenced* buildData)
     {
-        agg::rendering_buffer rbuf( image->data(), image->s(), image->t(), image->s()*4 );
-
         // clear the buffer.
         if ( _options.coverage() == true )
         {
-            agg::renderer<span_coverage32, float32> ren(rbuf);
-            ren.clear( float32(NO_DATA_VALUE) );
+            float* f = (float*)image->data();
+            for(int i=0; i<image->s()*image->t(); ++i)
+                f[i] = NO_DATA_VALUE;
         }
         else
         {
-            agg::renderer<agg::span_abgr32, agg::rgba8> ren(rbuf);
-            ren.clear(agg::rgba8(0,0,0,0));
+            memset(image->data(), 0, image->getTotalSizeInBytes());
         }
         return true;
     }
@@ -303,19 +250,19 @@ public:
         FilterContext polysContext = xform.push( polygons, context );
         FilterContext linesContext = xform.push( lines, context );
 
-        // set up the AGG renderer:
-        agg::rendering_buffer rbuf( image->data(), image->s(), image->t(), image->s()*4 );
+        // Set up the rasterizer. All the features are submitted first and then
+        // drawn together in one (multi-threaded) pass. In coverage mode each
+        // feature's value goes to the pixels it covers by at least half; other
+        // pixels keep what is already there (no-data, or an earlier feature).
+        ScanlineRasterizer ras;
 
-        // Create the renderer and the rasterizer
-        agg::rasterizer ras;
-
-        // Setup the rasterizer
         if ( _options.coverage() == true )
-            ras.gamma(1.0);
+            ras.setGamma(1.0);
         else
-            ras.gamma(_options.gamma().get());
+            ras.setGamma(_options.gamma().get());
 
-        ras.filling_rule(agg::fill_even_odd);
+        ras.setFillRule(ScanlineRasterizer::FILL_EVEN_ODD);
+        ras.setTransform(frame.xmin, frame.ymin, frame.xf, frame.yf);
 
         // construct an extent for cropping the geometry to our tile.
         // extend just outside the actual extents so we don't get edge artifacts:
@@ -350,12 +297,12 @@ public:
                 if ( _options.coverage() == true && covValue.isSet() )
                 {
                     float value = (float)feature->eval(covValue.mutable_value(), &context);
-                    rasterizeCoverage(croppedGeometry.get(), value, frame, ras, rbuf);
+                    ras.add(croppedGeometry.get(), value);
                 }
                 else
                 {
                     osg::Vec4f color = poly->fill()->color();
-                    rasterize(croppedGeometry.get(), color, frame, ras, rbuf);
+                    ras.add(croppedGeometry.get(), toColor(color));
                 }
                 
             }
@@ -377,90 +324,25 @@ public:
                 if ( _options.coverage() == true && covValue.isSet() )
                 {
                     float value = (float)feature->eval(covValue.mutable_value(), &context);
-                    rasterizeCoverage(croppedGeometry.get(), value, frame, ras, rbuf);
+                    ras.add(croppedGeometry.get(), value);
                 }
                 else
                 {   osg::Vec4f color = line ? static_cast<osg::Vec4>(line->stroke()->color()) : osg::Vec4(1,1,1,1);
-                    rasterize(croppedGeometry.get(), color, frame, ras, rbuf);
+                    ras.add(croppedGeometry.get(), toColor(color));
                 }
             }
         }
 
-        return true;
-    }
-
-    //override
-    bool postProcess( osg::Image* image, osg::Referenced* data )
-    {
-        if ( _options.coverage() == false )
-        {
-            //convert from ABGR to RGBA
-            unsigned char* pixel = image->data();
-            for(int i=0; i<image->s()*image->t()*4; i+=4, pixel+=4)
-            {
-                std::swap( pixel[0], pixel[3] );
-                std::swap( pixel[1], pixel[2] );
-            }
-        }
+        ras.render(image);
 
         return true;
     }
 
-    // rasterizes a geometry to color
-    void rasterize(const Geometry* geometry, const osg::Vec4& color, RenderFrame& frame, 
-                   agg::rasterizer& ras, agg::rendering_buffer& buffer)
+    // converts a fill color to 8 bits, scaling the alpha up
+    osg::Vec4ub toColor(const osg::Vec4f& color) const
     {
-        unsigned a = (unsigned)(127.0f+(color.a()*255.0f)/2.0f); // scale alpha up
-        agg::rgba8 fgColor = agg::rgba8( (unsigned)(color.r()*255.0f), (unsigned)(color.g()*255.0f), (unsigned)(color.b()*255.0f), a );
-        
-        ConstGeometryIterator gi( geometry );
-        while( gi.hasMore() )
-        {
-            const Geometry* g = gi.next();
-
-            for( Geometry::const_iterator p = g->begin(); p != g->end(); p++ )
-            {
-                const osg::Vec3d& p0 = *p;
-                double x0 = frame.xf*(p0.x()-frame.xmin);
-                double y0 = frame.yf*(p0.y()-frame.ymin);
-
-                if ( p == g->begin() )
-                    ras.move_to_d( x0, y0 );
-                else
-                    ras.line_to_d( x0, y0 );
-            }
-        }
-        agg::renderer<agg::span_abgr32, agg::rgba8> ren(buffer);
-        ras.render(ren, fgColor);
-
-        ras.reset();
-    }
-
-
-    void rasterizeCoverage(const Geometry* geometry, float value, RenderFrame& frame, 
-                           agg::rasterizer& ras, agg::rendering_buffer& buffer)
-    {
-        ConstGeometryIterator gi( geometry );
-        while( gi.hasMore() )
-        {
-            const Geometry* g = gi.next();
-
-            for( Geometry::const_iterator p = g->begin(); p != g->end(); p++ )
-            {
-                const osg::Vec3d& p0 = *p;
-                double x0 = frame.xf*(p0.x()-frame.xmin);
-                double y0 = frame.yf*(p0.y()-frame.ymin);
-
-                if ( p == g->begin() )
-                    ras.move_to_d( x0, y0 );
-                else
-                    ras.line_to_d( x0, y0 );
-            }
-        }
-        
-        agg::renderer<span_coverage32, float32> ren(buffer);
-        ras.render(ren, value);
-        ras.reset();
+        unsigned a = (unsigned)(127.0f+(color.a()*255.0f)/2.0f);
+        return osg::Vec4ub( (unsigned)(color.r()*255.0f), (unsigned)(color.g()*255.0f), (unsigned)(color.b()*255.0f), a );
     }
 
 
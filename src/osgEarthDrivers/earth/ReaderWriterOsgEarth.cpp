@@ -68,6 +68,10 @@ using namespace osgEarth;
 // cause the writer to try making absolute paths relative to the new save location.
 #define EARTH_REWRITE_ABSOLUTE_PATHS "RewriteAbsolutePaths"
 
+// Writes the earth file in the binary Config encoding instead of XML. The reader
+// detects the encoding automatically and memory-maps local binary files.
+#define EARTH_WRITE_BINARY           "Binary"
+
 
 namespace
 {
@@ -127,7 +131,7 @@ class ReaderWriterEarth : public osgDB::ReaderWriter
             if ( !acceptsExtension( osgDB::getFileExtension(fileName) ) )
                 return WriteResult::FILE_NOT_HANDLED;
 
-            std::ofstream out( fileName.c_str());
+            std::ofstream out( fileName.c_str(), isBinary(options) ? std::ios::out|std::ios::binary : std::ios::out );
             if ( out.is_open() )
             {
                 osg::ref_ptr<osgDB::Options> myOptions = Registry::instance()->cloneOrCreateOptions(options);
@@ -172,6 +176,11 @@ class ReaderWriterEarth : public osgDB::ReaderWriter
 
             Config conf = ser.serialize( mapNode, uriContext.referrer() );
 
+            if ( isBinary(options) )
+            {
+                return conf.toBinary( out ) ? WriteResult::FILE_SAVED : WriteResult::ERROR_IN_WRITING_FILE;
+            }
+
             // dump that Config out as XML.
             osg::ref_ptr<XmlDocument> xml = new XmlDocument( conf );
             xml->store( out );
@@ -207,6 +216,18 @@ class ReaderWriterEarth : public osgDB::ReaderWriter
                     if (fullFileName.empty()) return ReadResult::FILE_NOT_FOUND;
                 }
 
+                // A local binary earth file is mapped and decoded in place.
+                if ( !osgDB::containsServerAddress( fullFileName ) )
+                {
+                    Config docConf;
+                    if ( docConf.readBinaryFile( fullFileName ) )
+                    {
+                        osg::ref_ptr<osgDB::Options> myReadOptions = Registry::instance()->cloneOrCreateOptions(readOptions);
+                        URIContext( fullFileName ).store( myReadOptions.get() );
+                        return readMap( docConf, myReadOptions.get() );
+                    }
+                }
+
                 osgEarth::ReadResult r = URI(fullFileName).readString( readOptions );
                 if ( r.failed() )
                     return ReadResult::ERROR_IN_READING_FILE;
@@ -228,15 +249,52 @@ class ReaderWriterEarth : public osgDB::ReaderWriter
             // from an "anonymous" stream here)
             URIContext uriContext( readOptions ); 
 
+            // binary earth files start with a signature; anything else is XML.
+            char sig[64];
+            in.read( sig, sizeof(sig) );
+            std::streamsize sigSize = in.gcount();
+            in.clear();
+            in.seekg( 0, std::ios::beg );
+
+            if ( Config::isBinary(sig, (size_t)sigSize) )
+            {
+                std::stringstream buf;
+                buf << in.rdbuf();
+                std::string data = buf.str();
+
+                Config docConf;
+                if ( !docConf.fromBinary(data.data(), data.size()) )
+                    return ReadResult::ERROR_IN_READING_FILE;
+
+                docConf.setReferrer( uriContext.referrer() );
+                return readMap( docConf, readOptions );
+            }
+
             osg::ref_ptr<XmlDocument> doc = XmlDocument::load( in, uriContext );
             if ( !doc.valid() )
                 return ReadResult::ERROR_IN_READING_FILE;
 
-            Config docConf = doc->getConfig();
+            return readMap( doc->getConfig(), readOptions );
+        }
+
+    private:
+        bool isBinary(const osgDB::Options* options) const
+        {
+            return
+                options &&
+                osgEarth::toLower(options->getOptionString()).find(toLower(EARTH_WRITE_BINARY)) != std::string::npos;
+        }
+
+        ReadResult readMap(const Config& docConf, const osgDB::Options* readOptions) const
+        {
+            URIContext uriContext( readOptions );
 
-            // support both "map" and "earth" tag names at the top level
+            // support both "map" and "earth" tag names at the top level; a binary
+            // earth file holds the map itself.
             Config conf;
-            if ( docConf.hasChild( "map" ) )
+            if ( docConf.key() == "map" || docConf.key() == "earth" )
+                conf = docConf;
+            else if ( docConf.hasChild( "map" ) )
                 conf = docConf.child( "map" );
             else if ( docConf.hasChild( "earth" ) )
                 conf = docConf.child( "earth" );
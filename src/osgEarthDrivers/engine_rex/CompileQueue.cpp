@@ -0,0 +1,205 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2014 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "CompileQueue"
+#include "GeometryPool"
+
+#include <osgEarth/Metrics>
+#include <osg/FrameStamp>
+#include <osg/Texture>
+#include <osg/Timer>
+
+using namespace osgEarth::Drivers::RexTerrainEngine;
+using namespace osgEarth;
+
+#define LC "[CompileQueue] "
+
+
+CompileQueue::CompileQueue() :
+_timeBudget( 2.0 ),
+_byteBudget( 8u * 1024u * 1024u ),
+_frameNumber( ~0u ),
+_frameCount ( 0u ),
+_frameBytes ( 0u ),
+_frameTime  ( 0.0 )
+{
+    // ensure this node always gets traversed:
+    this->setCullingActive(false);
+
+    // ensure the draw runs synchronously:
+    this->setDataVariance(DYNAMIC);
+
+    // force the draw to run every frame:
+    this->setUseDisplayList(false);
+}
+
+void
+CompileQueue::push(Loader::Request* request)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _pending.push_back(request);
+}
+
+void
+CompileQueue::getCompleted(RequestList& output)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    output.insert(output.end(), _completed.begin(), _completed.end());
+    _completed.clear();
+}
+
+unsigned
+CompileQueue::size() const
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    return _pending.size();
+}
+
+namespace
+{
+    // Compiles a texture if it has no GL object yet; returns the number of bytes uploaded.
+    unsigned compileTexture(osg::Texture* texture, osg::State& state)
+    {
+        unsigned contextID = state.getContextID();
+        if (texture == 0L || texture->getTextureObject(contextID) != 0L)
+            return 0u;
+
+        unsigned bytes = 0u;
+        for (unsigned i = 0; i < texture->getNumImages(); ++i)
+        {
+            const osg::Image* image = texture->getImage(i);
+            if (image)
+                bytes += image->getTotalSizeInBytes();
+        }
+
+        // apply() binds the texture to the active unit, so tell the State about it
+        // to keep its attribute tracking accurate.
+        unsigned unit = state.getActiveTextureUnit();
+        texture->apply(state);
+        state.haveAppliedTextureAttribute(unit, texture);
+
+        return bytes;
+    }
+
+    // Compiles a drawable's buffer objects; returns the number of bytes uploaded.
+    unsigned compileDrawable(osg::Drawable* drawable, osg::RenderInfo& ri)
+    {
+        if (drawable == 0L)
+            return 0u;
+
+        SharedGeometry* geom = dynamic_cast<SharedGeometry*>(drawable);
+        if (geom)
+        {
+            // pooled geometries are usually resident already
+            if (!geom->needsCompile(ri.getContextID()))
+                return 0u;
+
+            geom->compileGLObjects(ri);
+            return geom->getTotalDataSize();
+        }
+
+        drawable->compileGLObjects(ri);
+        return 0u;
+    }
+}
+
+void
+CompileQueue::drawImplementation(osg::RenderInfo& ri) const
+{
+    osg::State& state = *ri.getState();
+    const unsigned frame = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0u;
+
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        // The budgets apply per frame, not per draw; several cameras may
+        // draw the queue in one frame.
+        if (frame != _frameNumber)
+        {
+            _frameNumber = frame;
+            _frameCount = 0u;
+            _frameBytes = 0u;
+            _frameTime = 0.0;
+        }
+
+        if (_pending.empty())
+        {
+            Metrics::counter("RexStats", "CompileQueue", 0.0, "CompileBytes", 0.0);
+            return;
+        }
+    }
+
+    METRIC_SCOPED("CompileQueue");
+
+    unsigned bytes = 0u;
+    unsigned depth = 0u;
+
+    while (true)
+    {
+        const osg::Timer_t start = osg::Timer::instance()->tick();
+
+        osg::ref_ptr<Loader::Request> request;
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+
+            depth = _pending.size();
+
+            // Always compile at least one request per frame so a single large
+            // request cannot stall the queue.
+            bool overBudget =
+                _frameCount > 0u &&
+                (_frameBytes >= _byteBudget || _frameTime >= _timeBudget);
+
+            if (_pending.empty() || overBudget)
+                break;
+
+            request = _pending.front();
+            _pending.pop_front();
+            ++_frameCount;
+        }
+
+        unsigned requestBytes = 0u;
+
+        // Requests the loader has abandoned do not need compiling.
+        if (!request->isIdle())
+        {
+            for (Loader::Request::TextureList::const_iterator i = request->_texturesToCompile.begin();
+                i != request->_texturesToCompile.end();
+                ++i)
+            {
+                requestBytes += compileTexture(i->get(), state);
+            }
+
+            for (Loader::Request::DrawableList::const_iterator i = request->_drawablesToCompile.begin();
+                i != request->_drawablesToCompile.end();
+                ++i)
+            {
+                requestBytes += compileDrawable(i->get(), ri);
+            }
+        }
+
+        bytes += requestBytes;
+
+        Threading::ScopedMutexLock lock(_mutex);
+        _completed.push_back(request.get());
+        _frameBytes += requestBytes;
+        _frameTime += osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+    }
+
+    Metrics::counter("RexStats", "CompileQueue", (double)depth, "CompileBytes", (double)bytes);
+}
@@ -75,5 +75,6 @@ void
 PerContextDrawState::clear()
 {
     _samplerState.clear();
+    _boundGeom = 0L;
     _pcp = 0L;
 }
@@ -125,6 +125,13 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
 
     if (_drawCallback)
     {
+        // custom drawing may touch the buffer bindings, so release ours first.
+        if (ds._boundGeom)
+        {
+            ds._boundGeom->unbindArrays(state);
+            ds._boundGeom = 0L;
+        }
+
         PatchLayer::DrawContext dc;
 
         //TODO: might not need any of this. review. -gw
@@ -149,7 +156,29 @@ DrawTileCommand::draw(osg::RenderInfo& ri, DrawState& dsMaster, osg::Referenced*
     {
         GLenum ptype = _drawPatch ? GL_PATCHES : GL_TRIANGLES;
 
-        _geom->render(ptype, ri);
+        if (dsMaster._batchDrawCommands)
+        {
+            // Tiles are sorted by geometry, so only bind the vertex arrays
+            // when the geometry changes; LayerDrawable unbinds at the end.
+            if (ds._boundGeom != _geom.get())
+            {
+                if (ds._boundGeom)
+                    ds._boundGeom->unbindArrays(state);
+
+                _geom->bindArrays(state);
+                ds._boundGeom = _geom.get();
+                ++ds._numGeometryBinds;
+            }
+
+            _geom->drawPrimitives(ptype, state);
+        }
+        else
+        {
+            _geom->render(ptype, ri);
+            ++ds._numGeometryBinds;
+        }
+
+        ++ds._numTileDraws;
 #if 0
         // Set up the vertex arrays:
         _geom->drawVertexArraysImplementation(ri);
@@ -29,10 +29,10 @@ using namespace osgEarth::Drivers::RexTerrainEngine;
 
 #define LC "[GeometryPool] "
 
-// TODO: experiment with sharing a single texture coordinate array 
-//// across all shared geometries.
-/// JB:  Disabled to fix issues with ATI.
-//#define SHARE_TEX_COORDS 1
+// Unmasked tiles of the same size share a single texture coordinate array
+// and a single index buffer. The shared texture coordinates live in their own
+// VBO rather than in the first geometry's VBO, so releasing one pooled
+// geometry never invalidates the array the others draw from.
 
 //struct DebugGeometry : public osg::Geometry {
 //    void compileGLObjects(osg::RenderInfo& renderInfo) const {
@@ -154,11 +154,11 @@ namespace
 { \
     verts->push_back( (*verts)[INDEX] ); \
     normals->push_back( (*normals)[INDEX] ); \
-    texCoords->push_back( (*texCoords)[INDEX] ); \
+    if ( populateTexCoords ) texCoords->push_back( (*texCoords)[INDEX] ); \
     if ( neighbors ) neighbors->push_back( (*neighbors)[INDEX] ); \
     verts->push_back( (*verts)[INDEX] - ((*normals)[INDEX])*(HEIGHT) ); \
     normals->push_back( (*normals)[INDEX] ); \
-    texCoords->push_back( (*texCoords)[INDEX] ); \
+    if ( populateTexCoords ) texCoords->push_back( (*texCoords)[INDEX] ); \
     if ( neighbors ) neighbors->push_back( (*neighbors)[INDEX] - ((*normals)[INDEX])*(HEIGHT) ); \
 }
 
@@ -215,17 +215,45 @@ GeometryPool::createGeometry(const TileKey& tileKey,
 
     osg::BoundingSphere tileBound;
 
+    osg::ref_ptr<GeoLocator> locator = GeoLocator::createForKey( tileKey, mapInfo );
+
+    // TODO: do we really need this??
+    bool swapOrientation = !locator->orientationOpenGL();
+
+    // Tiles without masking all have the same tessellation and the same
+    // texture coordinates, so we can share those arrays across the pool.
+    bool shareArrays = _enabled && (maskSet == 0L || maskSet->hasMasks() == false);
+
+    osg::DrawElements* sharedPrimSet = 0L;
+    osg::Vec3Array*    sharedTexCoords = 0L;
+    if ( shareArrays )
+    {
+        SharedDrawElementsMap::const_iterator i = _sharedDrawElements.find(IndexKey(tileSize, swapOrientation));
+        if ( i != _sharedDrawElements.end() )
+            sharedPrimSet = i->second.get();
+
+        SharedTexCoordsMap::const_iterator j = _sharedTexCoords.find(tileSize);
+        if ( j != _sharedTexCoords.end() )
+            sharedTexCoords = j->second.get();
+    }
+
     // the geometry:
     osg::ref_ptr<SharedGeometry> geom = new SharedGeometry();
     geom->setUseVertexBufferObjects(true);
+    geom->setHasSharedArrays(shareArrays);
     //geom->setUseDisplayList(false);
 
     osg::ref_ptr<osg::VertexBufferObject> vbo = new osg::VertexBufferObject();
 
     // Pre-allocate enough space for all triangles.
-    osg::DrawElements* primSet = new osg::DrawElementsUShort(mode);
-    primSet->setElementBufferObject(new osg::ElementBufferObject());
-    primSet->reserveElements(numIndiciesInSurface + numIncidesInSkirt);
+    bool populatePrimSet = (sharedPrimSet == 0L);
+    osg::DrawElements* primSet = sharedPrimSet;
+    if ( populatePrimSet )
+    {
+        primSet = new osg::DrawElementsUShort(mode);
+        primSet->setElementBufferObject(new osg::ElementBufferObject());
+        primSet->reserveElements(numIndiciesInSurface + numIncidesInSkirt);
+    }
     geom->setDrawElements(primSet);
 
     // the vertex locations:
@@ -256,22 +284,16 @@ GeometryPool::createGeometry(const TileKey& tileKey,
 
     // tex coord is [0..1] across the tile. The 3rd dimension tracks whether the
     // vert is masked: 0=yes, 1=no
-#ifdef SHARE_TEX_COORDS
-    bool populateTexCoords = false;
-    if ( !_sharedTexCoords.valid() )
+    bool populateTexCoords = (sharedTexCoords == 0L);
+    osg::Vec3Array* texCoords = sharedTexCoords;
+    if ( populateTexCoords )
     {
-        _sharedTexCoords = new osg::Vec3Array();
-        _sharedTexCoords->reserve( numVerts );
-        populateTexCoords = true;
-    }    
-    osg::Vec3Array* texCoords = _sharedTexCoords.get();
-#else
-    bool populateTexCoords = true;
-    osg::Vec3Array* texCoords = new osg::Vec3Array();
-    texCoords->setBinding(texCoords->BIND_PER_VERTEX);
-    texCoords->setVertexBufferObject(vbo.get());
-    texCoords->reserve( numVerts );
-#endif
+        texCoords = new osg::Vec3Array();
+        texCoords->setBinding(texCoords->BIND_PER_VERTEX);
+        // shared texcoords get their own VBO so they outlive this geometry's buffer.
+        texCoords->setVertexBufferObject(shareArrays ? new osg::VertexBufferObject() : vbo.get());
+        texCoords->reserve( numVerts );
+    }
 
     geom->setTexCoordArray(texCoords);
     
@@ -280,8 +302,6 @@ GeometryPool::createGeometry(const TileKey& tileKey,
     tdelta.normalize();
     osg::Vec3d vZero(0,0,0);
 
-    osg::ref_ptr<GeoLocator> locator = GeoLocator::createForKey( tileKey, mapInfo );
-
     for(unsigned row=0; row<tileSize; ++row)
     {
         float ny = (float)row/(float)(tileSize-1);
@@ -318,11 +338,7 @@ GeometryPool::createGeometry(const TileKey& tileKey,
     }
 
     // Now tessellate the surface.
-    
-    // TODO: do we really need this??
-    bool swapOrientation = !locator->orientationOpenGL();
-
-    for(unsigned j=0; j<tileSize-1; ++j)
+    for(unsigned j=0; populatePrimSet && j<tileSize-1; ++j)
     {
         for(unsigned i=0; i<tileSize-1; ++i)
         {
@@ -454,11 +470,24 @@ GeometryPool::createGeometry(const TileKey& tileKey,
             addSkirtDataForIndex( r*tileSize, height ); //left
     
         // then create the elements indices:
-        int i;
-        for(i=skirtIndex; i<(int)verts->size()-2; i+=2)
-            addSkirtTriangles( i, i+2 );
+        if ( populatePrimSet )
+        {
+            int i;
+            for(i=skirtIndex; i<(int)verts->size()-2; i+=2)
+                addSkirtTriangles( i, i+2 );
+
+            addSkirtTriangles( i, skirtIndex );
+        }
+    }
+
+    // First unmasked geometry of this size: publish its shareable arrays.
+    if ( shareArrays )
+    {
+        if ( populatePrimSet )
+            _sharedDrawElements[IndexKey(tileSize, swapOrientation)] = primSet;
 
-        addSkirtTriangles( i, skirtIndex );
+        if ( populateTexCoords )
+            _sharedTexCoords[tileSize] = texCoords;
     }
 
     return geom.release();
@@ -543,6 +572,15 @@ GeometryPool::clear()
 
         _geometryMap.clear();
 
+        // the shared arrays go too, since no pooled geometry references them now
+        for (SharedDrawElementsMap::iterator i = _sharedDrawElements.begin(); i != _sharedDrawElements.end(); ++i)
+            objects.push_back(i->second.get());
+        _sharedDrawElements.clear();
+
+        for (SharedTexCoordsMap::iterator i = _sharedTexCoords.begin(); i != _sharedTexCoords.end(); ++i)
+            objects.push_back(i->second.get());
+        _sharedTexCoords.clear();
+
         if (!objects.empty())
         {
             OE_INFO << LC << "Cleared " << objects.size() << " objects from the geometry pool\n";
@@ -559,7 +597,8 @@ GeometryPool::clear()
 //.........................................................................
 // Code mostly adapted from osgTerrain SharedGeometry.
 
-SharedGeometry::SharedGeometry()
+SharedGeometry::SharedGeometry() :
+_hasSharedArrays(false)
 {
     setSupportsDisplayList(false);
     _supportsVertexBufferObjects = true;
@@ -572,7 +611,8 @@ SharedGeometry::SharedGeometry(const SharedGeometry& rhs,const osg::CopyOp& copy
     _texcoordArray(rhs._texcoordArray),
     _neighborArray(rhs._neighborArray),
     _drawElements(rhs._drawElements),
-    _maskElements(rhs._maskElements)
+    _maskElements(rhs._maskElements),
+    _hasSharedArrays(rhs._hasSharedArrays)
 {
     //nop
 }
@@ -641,9 +681,21 @@ void SharedGeometry::compileGLObjects(osg::RenderInfo& renderInfo) const
             extensions->glBindBuffer(GL_ARRAY_BUFFER_ARB,0);
         }
 
+        // shared texture coordinates live in a separate VBO:
+        osg::BufferObject* tbo = _texcoordArray.valid() ? _texcoordArray->getVertexBufferObject() : 0L;
+        if (tbo && tbo != vbo)
+        {
+            osg::GLBufferObject* tbo_glBufferObject = tbo->getOrCreateGLBufferObject(contextID);
+            if (tbo_glBufferObject && tbo_glBufferObject->isDirty())
+            {
+                tbo_glBufferObject->compileBuffer();
+                extensions->glBindBuffer(GL_ARRAY_BUFFER_ARB,0);
+            }
+        }
+
         osg::BufferObject* ebo = _drawElements->getElementBufferObject();
         osg::GLBufferObject* ebo_glBufferObject = ebo->getOrCreateGLBufferObject(contextID);
-        if (ebo_glBufferObject && vbo_glBufferObject->isDirty())
+        if (ebo_glBufferObject && ebo_glBufferObject->isDirty())
         {
             // OSG_NOTICE<<"Compile buffer "<<glBufferObject<<std::endl;
             ebo_glBufferObject->compileBuffer();
@@ -676,6 +728,28 @@ void SharedGeometry::compileGLObjects(osg::RenderInfo& renderInfo) const
     }
 }
 
+bool SharedGeometry::needsCompile(unsigned contextID) const
+{
+    osg::BufferObject* vbo = _vertexArray.valid() ? _vertexArray->getVertexBufferObject() : 0L;
+    if (!vbo)
+        return false;
+
+    osg::GLBufferObject* glBufferObject = vbo->getGLBufferObject(contextID);
+    return glBufferObject == 0L || glBufferObject->isDirty();
+}
+
+unsigned SharedGeometry::getTotalDataSize() const
+{
+    unsigned size = 0u;
+    if (_vertexArray.valid()) size += _vertexArray->getTotalDataSize();
+    if (_normalArray.valid()) size += _normalArray->getTotalDataSize();
+    if (_colorArray.valid()) size += _colorArray->getTotalDataSize();
+    if (_texcoordArray.valid()) size += _texcoordArray->getTotalDataSize();
+    if (_neighborArray.valid()) size += _neighborArray->getTotalDataSize();
+    if (_drawElements.valid()) size += _drawElements->getTotalDataSize();
+    return size;
+}
+
 void SharedGeometry::resizeGLObjectBuffers(unsigned int maxSize)
 {
     Drawable::resizeGLObjectBuffers(maxSize);
@@ -683,6 +757,10 @@ void SharedGeometry::resizeGLObjectBuffers(unsigned int maxSize)
     osg::BufferObject* vbo = _vertexArray->getVertexBufferObject();
     if (vbo) vbo->resizeGLObjectBuffers(maxSize);
 
+    // shared texture coordinates have their own VBO, compiled in compileGLObjects:
+    osg::BufferObject* tbo = _texcoordArray.valid() ? _texcoordArray->getVertexBufferObject() : 0L;
+    if (tbo && tbo != vbo) tbo->resizeGLObjectBuffers(maxSize);
+
     osg::BufferObject* ebo = _drawElements->getElementBufferObject();
     if (ebo) ebo->resizeGLObjectBuffers(maxSize);
 }
@@ -694,15 +772,26 @@ void SharedGeometry::releaseGLObjects(osg::State* state) const
     osg::BufferObject* vbo = _vertexArray->getVertexBufferObject();
     if (vbo) vbo->releaseGLObjects(state);
 
-    osg::BufferObject* ebo = _drawElements->getElementBufferObject();
-    if (ebo) ebo->releaseGLObjects(state);
+    // Shared indices belong to the GeometryPool, which releases them in clear().
+    if (!_hasSharedArrays)
+    {
+        osg::BufferObject* ebo = _drawElements->getElementBufferObject();
+        if (ebo) ebo->releaseGLObjects(state);
+    }
 }
 
 // called from DrawTileCommand
 void SharedGeometry::render(GLenum primitiveType, osg::RenderInfo& renderInfo) const
 {
     osg::State& state = *renderInfo.getState();
-    
+
+    bindArrays(state);
+    drawPrimitives(primitiveType, state);
+    unbindArrays(state);
+}
+
+void SharedGeometry::bindArrays(osg::State& state) const
+{
 #if OSG_VERSION_LESS_THAN(3,5,6)
     osg::ArrayDispatchers& dispatchers = state.getArrayDispatchers();
 #else
@@ -760,27 +849,25 @@ void SharedGeometry::render(GLenum primitiveType, osg::RenderInfo& renderInfo) c
         state.applyDisablingOfVertexAttributes();
     }
 
+    osg::GLBufferObject* ebo = _drawElements->getOrCreateGLBufferObject(state.getContextID());
+    if (ebo)
+    {
+        state.bindElementBufferObject(ebo);
+    }
+}
 
-#ifdef SUPPORTS_VAO
-    bool request_bind_unbind = !state.useVertexArrayObject(_useVertexArrayObject) || state.getCurrentVertexArrayState()->getRequiresSetArrays();
-#else
-    bool request_bind_unbind = true;
-#endif
-
+void SharedGeometry::drawPrimitives(GLenum primitiveType, osg::State& state) const
+{
     osg::GLBufferObject* ebo = _drawElements->getOrCreateGLBufferObject(state.getContextID());
 
     if (ebo)
     {
-        /*if (request_bind_unbind)*/ state.bindElementBufferObject(ebo);
-
         glDrawElements(primitiveType, _drawElements->getNumIndices(), _drawElements->getDataType(), (const GLvoid *)(ebo->getOffset(_drawElements->getBufferIndex())));
 
         if (_maskElements.valid())
         {
             glDrawElements(primitiveType, _maskElements->getNumIndices(), _maskElements->getDataType(), (const GLvoid *)(ebo->getOffset(_maskElements->getBufferIndex())));
         }
-
-        /*if (request_bind_unbind)*/ state.unbindElementBufferObject();
     }
     else
     {
@@ -791,6 +878,20 @@ void SharedGeometry::render(GLenum primitiveType, osg::RenderInfo& renderInfo) c
             glDrawElements(primitiveType, _maskElements->getNumIndices(), _maskElements->getDataType(), _maskElements->getDataPointer());
         }
     }
+}
+
+void SharedGeometry::unbindArrays(osg::State& state) const
+{
+#ifdef SUPPORTS_VAO
+    bool request_bind_unbind = !state.useVertexArrayObject(_useVertexArrayObject) || state.getCurrentVertexArrayState()->getRequiresSetArrays();
+#else
+    bool request_bind_unbind = true;
+#endif
+
+    if (_drawElements->getOrCreateGLBufferObject(state.getContextID()))
+    {
+        state.unbindElementBufferObject();
+    }
 
     // unbind the VBO's if any are used.
     if (request_bind_unbind)
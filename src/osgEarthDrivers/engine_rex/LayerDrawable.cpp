@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "LayerDrawable"
+#include <osgEarth/Metrics>
+#include <osgEarth/StringUtils>
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
 
@@ -66,11 +68,30 @@ LayerDrawable::drawImplementation(osg::RenderInfo& ri) const
             ds._ext->glUniform1f(ds._layerMaxRangeUL, (GLfloat)FLT_MAX);
     }
 
+    ds._numTileDraws = 0u;
+    ds._numGeometryBinds = 0u;
+
     for (DrawTileCommands::const_iterator tile = _tiles.begin(); tile != _tiles.end(); ++tile)
     {
         tile->draw(ri, *_drawState, 0L);
     }
 
+    if (Metrics::enabled())
+    {
+        // one graph per layer; each layer's drawable reports its own counts.
+        Metrics::counter(
+            Stringify() << "RexStats " << (_layer ? _layer->getName() : "shared"),
+            "TileDraws", (double)ds._numTileDraws,
+            "GeometryBinds", (double)ds._numGeometryBinds);
+    }
+
+    // Release the last batched geometry's vertex arrays.
+    if (ds._boundGeom)
+    {
+        ds._boundGeom->unbindArrays(*ri.getState());
+        ds._boundGeom = 0L;
+    }
+
     // If set, dirty all OSG state to prevent any leakage - this is sometimes
     // necessary when doing custom OpenGL within a Drawable.
     if (_clearOsgState)
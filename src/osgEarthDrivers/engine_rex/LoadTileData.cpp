@@ -79,6 +79,37 @@ LoadTileData::invoke()
         tilenode->getKey(),           
         _filter,
         progress.get() );
+
+    // Record the GL objects the loader may want compiled before merging.
+    _texturesToCompile.clear();
+    _drawablesToCompile.clear();
+
+    if (_dataModel.valid())
+    {
+        const TerrainTileModel* model = _dataModel.get();
+
+        for (TerrainTileImageLayerModelVector::const_iterator i = model->colorLayers().begin(); i != model->colorLayers().end(); ++i)
+        {
+            if (i->valid() && i->get()->getTexture())
+                _texturesToCompile.push_back(i->get()->getTexture());
+        }
+
+        for (TerrainTileImageLayerModelVector::const_iterator i = model->sharedLayers().begin(); i != model->sharedLayers().end(); ++i)
+        {
+            if (i->valid() && i->get()->getTexture())
+                _texturesToCompile.push_back(i->get()->getTexture());
+        }
+
+        if (model->elevationModel().valid() && model->elevationModel()->getTexture())
+            _texturesToCompile.push_back(model->elevationModel()->getTexture());
+
+        if (model->normalModel().valid() && model->normalModel()->getTexture())
+            _texturesToCompile.push_back(model->normalModel()->getTexture());
+
+        SurfaceNode* surface = tilenode->getSurfaceNode();
+        if (surface && surface->getDrawable() && surface->getDrawable()->_geom.valid())
+            _drawablesToCompile.push_back(surface->getDrawable()->_geom.get());
+    }
 }
 
 
@@ -140,4 +171,7 @@ LoadTileData::apply(const osg::FrameStamp* stamp)
         // Delete the model immediately
         _dataModel = 0L;
     }
+
+    _texturesToCompile.clear();
+    _drawablesToCompile.clear();
 }
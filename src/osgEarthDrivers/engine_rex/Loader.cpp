@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "Loader"
+#include "CompileQueue"
 #include "RexTerrainEngineNode"
 
 #include <osgEarth/Registry>
@@ -29,6 +30,7 @@
 #include <osgDB/Registry>
 #include <osgDB/ReaderWriter>
 
+#include <algorithm>
 #include <string>
 
 #define REPORT_ACTIVITY true
@@ -201,6 +203,11 @@ _numLODs       ( 20u )
     }
 }
 
+PagerLoader::~PagerLoader()
+{
+    //nop
+}
+
 void
 PagerLoader::setNumLODs(unsigned lods)
 {
@@ -230,6 +237,19 @@ PagerLoader::setLODPriorityOffset(unsigned lod, float offset)
         _priorityOffsets[lod] = offset;
 }
 
+void
+PagerLoader::setCompileQueue(CompileQueue* queue)
+{
+    if (_compileQueue.valid())
+        osg::Group::removeChild(_compileQueue.get());
+
+    _compileQueue = queue;
+
+    // a child, so it gets culled (and drawn) along with the loader:
+    if (_compileQueue.valid())
+        osg::Group::addChild(_compileQueue.get());
+}
+
 bool
 PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv)
 {
@@ -313,6 +333,19 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
             setFrameStamp(nv.getFrameStamp());
         }
 
+        // requests whose GL objects are now resident are ready to merge.
+        if ( _compileQueue.valid() )
+        {
+            CompileQueue::RequestList compiled;
+            _compileQueue->getCompleted( compiled );
+            for(CompileQueue::RequestList::iterator i = compiled.begin(); i != compiled.end(); ++i)
+            {
+                // skip requests that expired while waiting to compile
+                if ( i->get()->isMerging() )
+                    merge( i->get() );
+            }
+        }
+
         // process pending merges.
         {
             METRIC_BEGIN("loader.merge");
@@ -403,27 +436,15 @@ PagerLoader::addChild(osg::Node* node)
         Request* req = result->getRequest();
         if ( req )
         {
-            if ( req->_lastTick >= _checkpoint )
+            if ( req->_lastTick >= _checkpoint && _compileQueue.valid() && req->hasGLObjectsToCompile() )
             {
-                if ( _mergesPerFrame > 0 )
-                {
-                    _mergeQueue.insert( req );
-                    req->setState( Request::MERGING );
-                }
-                else
-                {
-                    req->apply( getFrameStamp() );
-                    req->setState( Request::FINISHED );
-                    if ( REPORT_ACTIVITY )
-                        Registry::instance()->endActivity( req->getName() );
-                }
-            }                
-
+                // hold off merging until the request's GL objects are resident:
+                req->setState( Request::MERGING );
+                _compileQueue->push( req );
+            }
             else
             {
-                req->setState( Request::FINISHED );
-                if ( REPORT_ACTIVITY )
-                    Registry::instance()->endActivity( req->getName() );
+                merge( req );
             }
         }
     }
@@ -435,6 +456,33 @@ PagerLoader::addChild(osg::Node* node)
     return true;
 }
 
+void
+PagerLoader::merge(Loader::Request* req)
+{
+    if ( req->_lastTick >= _checkpoint )
+    {
+        if ( _mergesPerFrame > 0 )
+        {
+            _mergeQueue.insert( req );
+            req->setState( Request::MERGING );
+        }
+        else
+        {
+            req->apply( getFrameStamp() );
+            req->setState( Request::FINISHED );
+            if ( REPORT_ACTIVITY )
+                Registry::instance()->endActivity( req->getName() );
+        }
+    }
+
+    else
+    {
+        req->setState( Request::FINISHED );
+        if ( REPORT_ACTIVITY )
+            Registry::instance()->endActivity( req->getName() );
+    }
+}
+
 TileKey
 PagerLoader::getTileKeyForRequest(UID requestUID) const
 {
@@ -481,6 +529,349 @@ PagerLoader::invokeAndRelease(UID requestUID)
 
 
 
+//...............................................
+
+#undef  LC
+#define LC "[PriorityLoader] "
+
+namespace
+{
+    // Worker thread that invokes requests from a PriorityLoader.
+    struct PriorityLoaderThread : public Threading::Thread
+    {
+        PriorityLoaderThread(PriorityLoader* loader) : _loader(loader) { }
+
+        void run()
+        {
+            osg::ref_ptr<Loader::Request> request;
+            while (_loader->next(request))
+            {
+                if ( REPORT_ACTIVITY )
+                    Registry::instance()->startActivity( request->getName() );
+
+                request->invoke();
+
+                if ( REPORT_ACTIVITY )
+                    Registry::instance()->endActivity( request->getName() );
+
+                _loader->finished(request.get());
+                request = 0L;
+            }
+        }
+
+        PriorityLoader* _loader;
+    };
+}
+
+PriorityLoader::PriorityLoader(unsigned numThreads) :
+_checkpoint    ( (osg::Timer_t)0 ),
+_mergesPerFrame( 0 ),
+_cancelFrames  ( 2u ),
+_numLODs       ( 20u ),
+_numWasted     ( 0u ),
+_done          ( false )
+{
+    // initialize the LOD priority scales and offsets
+    for (unsigned i = 0; i < 64; ++i)
+    {
+        _priorityScales[i] = 1.0f;
+        _priorityOffsets[i] = 0.0f;
+    }
+
+    // we need the update traversal to merge and expire requests
+    this->setNumChildrenRequiringUpdateTraversal( 1 );
+
+    numThreads = std::max(numThreads, 1u);
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        PriorityLoaderThread* thread = new PriorityLoaderThread(this);
+        thread->start();
+        _threads.push_back(thread);
+    }
+
+    OE_INFO << LC << "Started " << numThreads << " loading threads" << std::endl;
+}
+
+PriorityLoader::~PriorityLoader()
+{
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        _done = true;
+
+        // abort any in-flight work:
+        for (Requests::iterator i = _inFlight.begin(); i != _inFlight.end(); ++i)
+            i->second->setState( Request::IDLE );
+
+        _pendingCondition.broadcast();
+    }
+
+    for (unsigned i = 0; i < _threads.size(); ++i)
+    {
+        _threads[i]->join();
+        delete _threads[i];
+    }
+    _threads.clear();
+}
+
+void
+PriorityLoader::setNumLODs(unsigned lods)
+{
+    _numLODs = std::max(lods, 1u);
+}
+
+void
+PriorityLoader::setMergesPerFrame(int value)
+{
+    _mergesPerFrame = std::max(value, 0);
+    OE_INFO << LC << "Merges per frame = " << _mergesPerFrame << std::endl;
+}
+
+void
+PriorityLoader::setLODPriorityScale(unsigned lod, float priorityScale)
+{
+    if (lod < 64)
+        _priorityScales[lod] = priorityScale;
+}
+
+void
+PriorityLoader::setLODPriorityOffset(unsigned lod, float offset)
+{
+    if (lod < 64)
+        _priorityOffsets[lod] = offset;
+}
+
+void
+PriorityLoader::setCompileQueue(CompileQueue* queue)
+{
+    if (_compileQueue.valid())
+        osg::Group::removeChild(_compileQueue.get());
+
+    _compileQueue = queue;
+
+    if (_compileQueue.valid())
+        osg::Group::addChild(_compileQueue.get());
+}
+
+bool
+PriorityLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv)
+{
+    if ( !request )
+        return false;
+
+    unsigned fn = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+
+    // scale and bias the priority, and then normalize it to [0..1] range.
+    unsigned lod = request->getTileKey().getLOD();
+    float p = priority * _priorityScales[lod] + _priorityOffsets[lod];
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    // already completed but unmerged:
+    if ( request->isMerging() || request->isFinished() )
+        return false;
+
+    // Re-submitting a request refreshes its priority and its cancelation deadline.
+    request->_priority = p / (float)(_numLODs+1);
+    request->setFrameNumber( fn );
+    request->_lastTick = osg::Timer::instance()->tick();
+
+    // A canceled request that a worker is still unwinding cannot be restarted yet;
+    // the next submission will pick it up.
+    if ( request->isIdle() && _inFlight.find(request->getUID()) == _inFlight.end() )
+    {
+        request->setState( Request::RUNNING );
+        _pending.push_back( request );
+        _newRequests.push_back( request );
+        _pendingCondition.signal();
+        return true;
+    }
+
+    return false;
+}
+
+void
+PriorityLoader::clear()
+{
+    // Set a time checkpoint for invalidating old requests.
+    _checkpoint = osg::Timer::instance()->tick();
+}
+
+bool
+PriorityLoader::next(osg::ref_ptr<Request>& output)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    while ( !_done )
+    {
+        // Priorities change every frame, so find the best one now
+        // rather than keeping the list sorted.
+        RequestList::iterator best = _pending.end();
+        for (RequestList::iterator i = _pending.begin(); i != _pending.end(); ++i)
+        {
+            if ( best == _pending.end() || i->get()->_priority > best->get()->_priority )
+                best = i;
+        }
+
+        if ( best != _pending.end() )
+        {
+            output = best->get();
+            *best = _pending.back();
+            _pending.pop_back();
+            _inFlight[output->getUID()] = output.get();
+            return true;
+        }
+
+        _pendingCondition.wait( &_mutex );
+    }
+
+    return false;
+}
+
+void
+PriorityLoader::finished(Request* request)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    _inFlight.erase( request->getUID() );
+
+    // canceled while running; the work is lost.
+    if ( request->isIdle() )
+    {
+        ++_numWasted;
+    }
+    else
+    {
+        request->setState( Request::MERGING );
+        _completed.push_back( request );
+    }
+}
+
+void
+PriorityLoader::traverse(osg::NodeVisitor& nv)
+{
+    if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
+    {
+        if ( nv.getFrameStamp() )
+        {
+            setFrameStamp(nv.getFrameStamp());
+        }
+
+        unsigned fn = 0;
+        if ( nv.getFrameStamp() )
+            fn = nv.getFrameStamp()->getFrameNumber();
+
+        unsigned numMerged = 0u, numCanceled = 0u, numWasted = 0u;
+
+        // collect new and completed requests from the other threads.
+        RequestList completed;
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+
+            for (RequestList::iterator i = _newRequests.begin(); i != _newRequests.end(); ++i)
+                _requests[i->get()->getUID()] = i->get();
+            _newRequests.clear();
+
+            completed.swap( _completed );
+
+            numWasted = _numWasted;
+            _numWasted = 0u;
+        }
+
+        for (RequestList::iterator i = completed.begin(); i != completed.end(); ++i)
+        {
+            if ( _compileQueue.valid() && i->get()->hasGLObjectsToCompile() )
+                _compileQueue->push( i->get() );
+            else
+                _mergeQueue.insert( i->get() );
+        }
+
+        if ( _compileQueue.valid() )
+        {
+            CompileQueue::RequestList compiled;
+            _compileQueue->getCompleted( compiled );
+            for (CompileQueue::RequestList::iterator i = compiled.begin(); i != compiled.end(); ++i)
+                _mergeQueue.insert( i->get() );
+        }
+
+        // process pending merges, highest priority first.
+        {
+            METRIC_BEGIN("loader.merge");
+            int count;
+            for(count=0; (_mergesPerFrame == 0 || count < _mergesPerFrame) && !_mergeQueue.empty(); ++count)
+            {
+                Request* req = _mergeQueue.begin()->get();
+                if ( req->_lastTick >= _checkpoint )
+                {
+                    req->apply( getFrameStamp() );
+                    ++numMerged;
+                }
+                else
+                {
+                    ++numWasted;
+                }
+
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    req->setState( Request::FINISHED );
+                }
+
+                _mergeQueue.erase( _mergeQueue.begin() );
+            }
+            METRIC_END("loader.merge");
+        }
+
+        // retire finished requests and cancel the ones nobody wants anymore.
+        {
+            METRIC_SCOPED("loader.cull");
+
+            Threading::ScopedMutexLock lock( _mutex );
+
+            for(Requests::iterator i = _requests.begin(); i != _requests.end(); )
+            {
+                Request* req = i->second.get();
+                const unsigned frameDiff = fn - req->getLastFrameSubmitted();
+
+                if ( req->isFinished() )
+                {
+                    req->setState( Request::IDLE );
+                    _requests.erase( i++ );
+                }
+
+                // Not re-submitted in time: cancel it. If a worker is running it, the
+                // request's progress callback will see the IDLE state and abort.
+                else if ( req->isRunning() && frameDiff > _cancelFrames )
+                {
+                    req->setState( Request::IDLE );
+
+                    RequestList::iterator p = std::find( _pending.begin(), _pending.end(), i->second );
+                    if ( p != _pending.end() )
+                    {
+                        *p = _pending.back();
+                        _pending.pop_back();
+                    }
+
+                    ++numCanceled;
+                    _requests.erase( i++ );
+                }
+
+                else // still valid.
+                {
+                    ++i;
+                }
+            }
+        }
+
+        Metrics::counter("RexStats",
+            "LoaderMerged", (double)numMerged,
+            "LoaderCanceled", (double)numCanceled,
+            "LoaderWasted", (double)numWasted);
+    }
+
+    LoaderGroup::traverse( nv );
+}
+
+
+
 namespace osgEarth { namespace Drivers { namespace RexTerrainEngine
 {
     using namespace osgEarth;
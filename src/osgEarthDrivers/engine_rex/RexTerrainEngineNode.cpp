@@ -21,6 +21,7 @@
 #include "SelectionInfo"
 #include "TerrainCuller"
 #include "GeometryPool"
+#include "CompileQueue"
 
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Registry>
@@ -31,6 +32,8 @@
 #include <osgEarth/ShaderLoader>
 #include <osgEarth/Utils>
 #include <osgEarth/ObjectIndex>
+#include <osgEarth/Metrics>
+#include <osgEarth/TraversalData>
 
 #include <osg/Version>
 #include <osg/BlendFunc>
@@ -180,6 +183,33 @@ RexTerrainEngineNode::~RexTerrainEngineNode()
     OE_DEBUG << LC << "~RexTerrainEngineNode\n";
 }
 
+namespace
+{
+    // Applies the loader-related options to either kind of loader.
+    template<typename LOADER>
+    void configureLoader(LOADER* loader, const RexTerrainEngineOptions& options)
+    {
+        loader->setNumLODs(options.maxLOD().getOrUse(DEFAULT_MAX_LOD));
+        loader->setMergesPerFrame( options.mergesPerFrame().get() );
+        for (std::vector<RexTerrainEngineOptions::LODOptions>::const_iterator i = options.lods().begin(); i != options.lods().end(); ++i) {
+            if (i->_lod.isSet()) {
+                loader->setLODPriorityScale(i->_lod.get(), i->_priorityScale.getOrUse(1.0f));
+                loader->setLODPriorityOffset(i->_lod.get(), i->_priorityOffset.getOrUse(0.0f));
+            }
+        }
+
+        // Optionally upload each tile's GL objects incrementally before merging it
+        if (options.incrementalCompile() == true)
+        {
+            CompileQueue* compileQueue = new CompileQueue();
+            compileQueue->setTimeBudget( options.compileTimeBudget().get() );
+            compileQueue->setByteBudget( options.compileByteBudget().get() );
+            loader->setCompileQueue( compileQueue );
+            OE_INFO << LC << "Incremental compile enabled\n";
+        }
+    }
+}
+
 void
 RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
 {
@@ -263,17 +293,19 @@ RexTerrainEngineNode::setMap(const Map* map, const TerrainOptions& options)
     this->addChild( _geometryPool.get() );
 
     // Make a tile loader
-    PagerLoader* loader = new PagerLoader( this );
-    loader->setNumLODs(_terrainOptions.maxLOD().getOrUse(DEFAULT_MAX_LOD));
-    loader->setMergesPerFrame( _terrainOptions.mergesPerFrame().get() );
-    for (std::vector<RexTerrainEngineOptions::LODOptions>::const_iterator i = _terrainOptions.lods().begin(); i != _terrainOptions.lods().end(); ++i) {
-        if (i->_lod.isSet()) {
-            loader->setLODPriorityScale(i->_lod.get(), i->_priorityScale.getOrUse(1.0f));
-            loader->setLODPriorityOffset(i->_lod.get(), i->_priorityOffset.getOrUse(0.0f));
-        }
+    if (_terrainOptions.priorityLoading() == true)
+    {
+        PriorityLoader* loader = new PriorityLoader( _terrainOptions.loadingThreads().get() );
+        loader->setCancelFrames( _terrainOptions.loadCancelFrames().get() );
+        configureLoader( loader, _terrainOptions );
+        _loader = loader;
+    }
+    else
+    {
+        PagerLoader* loader = new PagerLoader( this );
+        configureLoader( loader, _terrainOptions );
+        _loader = loader;
     }
-
-    _loader = loader;
     this->addChild( _loader.get() );
 
     // Make a tile unloader
@@ -514,6 +546,20 @@ namespace
                 OE_WARN << LC << "Oh no! " << count << " orphaned tiles in the reg" << std::endl;
         }
     };
+
+    // Selects coherent cull data whose camera is gone or has not culled in a while.
+    struct ExpireCoherentCullData
+    {
+        ExpireCoherentCullData(unsigned frame) : _frame(frame) { }
+
+        bool operator()(const osg::Camera*, const CoherentCullData& data) const
+        {
+            const unsigned maxIdleFrames = 60u;
+            return !data._camera.valid() || _frame > data._lastFrame + maxIdleFrames;
+        }
+
+        unsigned _frame;
+    };
 }
 
 
@@ -536,7 +582,16 @@ RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
             UpdateRenderModels visitor(_mapFrame);
             _terrain->accept(visitor);
             _renderModelUpdateRequired = false;
+            _liveTiles->bumpTerrainRevision();
         }
+
+        // Culling never overlaps the update traversal, so no one holds an entry now.
+        if (nv.getFrameStamp())
+        {
+            ExpireCoherentCullData expire(nv.getFrameStamp()->getFrameNumber());
+            _coherentCullData.removeIf(expire);
+        }
+
         TerrainEngineNode::traverse( nv );
     }
     
@@ -560,14 +615,56 @@ RexTerrainEngineNode::traverse(osg::NodeVisitor& nv)
         // Prepare the culler with the set of renderable layers:
         culler.setup(_mapFrame, _cachedLayerExtents, this->getEngineContext()->getRenderBindings());
 
-        // Assemble the terrain drawables:
-        _terrain->accept(culler);
+        // In coherent mode, try to reuse previous cull results for this camera:
+        bool coherent =
+            _terrainOptions.coherentCulling() == true &&
+            !VisitorData::isSet(*cv, "osgEarth.Stealth");
+
+        CoherentCullData* coherentData = 0L;
+        if (coherent)
+        {
+            osg::Camera* camera = cv->getCurrentCamera();
+            coherentData = &_coherentCullData.get(camera);
+
+            // A new entry, or a stale one left by a deleted camera at the same address:
+            if (coherentData->_camera.get() != camera)
+            {
+                *coherentData = CoherentCullData();
+                coherentData->_camera = camera;
+            }
+            coherentData->_lastFrame = nv.getFrameStamp() ? nv.getFrameStamp()->getFrameNumber() : 0u;
+        }
+
+        unsigned reused = 0u;
+        {
+            METRIC_SCOPED("rex.cull");
+
+            if (coherentData)
+            {
+                // Reuse what we can from the last cull and traverse the rest:
+                reused = culler.cullCoherent(_terrain, *coherentData, _terrainOptions.coherentCullingTolerance().get());
+            }
+            else
+            {
+                // Assemble the terrain drawables:
+                _terrain->accept(culler);
+            }
+
+            // If we're using geometry pooling, optimize the drawable for shared state
+            // by sorting the draw commands
+            if (getEngineContext()->getGeometryPool()->isEnabled())
+            {
+                culler._terrain.sortDrawCommands();
+            }
+        }
+
+        // Sorted commands let the draw skip redundant geometry binds.
+        culler._terrain._drawState->_batchDrawCommands = getEngineContext()->getGeometryPool()->isEnabled();
 
-        // If we're using geometry pooling, optimize the drawable for shared state
-        // by sorting the draw commands
-        if (getEngineContext()->getGeometryPool()->isEnabled())
+        if (coherent && Metrics::enabled())
         {
-            culler._terrain.sortDrawCommands();
+            Metrics::counter("RexStats", "CoherentCullReused",
+                _terrain->getNumChildren() > 0u ? (double)reused / (double)_terrain->getNumChildren() : 0.0);
         }
 
         // The common stateset for the terrain:
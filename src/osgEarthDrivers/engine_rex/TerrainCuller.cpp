@@ -31,7 +31,9 @@ _camera(0L),
 _currentTileNode(0L),
 _orphanedPassesDetected(0u),
 _cv(cullVisitor),
-_context(context)
+_context(context),
+_isStable(true),
+_visited(0L)
 {
     setVisitorType(CULL_VISITOR);
     setTraversalMode(TRAVERSE_ALL_CHILDREN);
@@ -50,6 +52,7 @@ void
 TerrainCuller::setup(const MapFrame& frame, LayerExtentVector& layerExtents, const RenderBindings& bindings)
 {
     unsigned frameNum = getFrameStamp() ? getFrameStamp()->getFrameNumber() : 0u;
+    _frame = &frame;
     _layerExtents = &layerExtents;
     _terrain.setup(frame, bindings, frameNum, _cv);
 }
@@ -61,6 +64,214 @@ TerrainCuller::getDistanceToViewPoint(const osg::Vec3& pos, bool withLODScale) c
     else return (pos-getViewPointLocal()).length();
 }
 
+void
+TerrainCuller::getLayerUIDs(std::vector<UID>& out) const
+{
+    out.clear();
+    for (LayerDrawableList::const_iterator i = _terrain.layers().begin(); i != _terrain.layers().end(); ++i)
+    {
+        const LayerDrawable* ld = i->get();
+        out.push_back(ld->_layer ? ld->_layer->getUID() : -1);
+    }
+}
+
+void
+TerrainCuller::getEyeAndLook(osg::Vec3d& eye, osg::Vec3d& look) const
+{
+    osg::Vec3d center, up;
+    getModelViewMatrix()->getLookAt(eye, center, up);
+    look = center - eye;
+    look.normalize();
+}
+
+unsigned
+TerrainCuller::cullCoherent(osg::Group* root, CoherentCullData& data, float tolerance)
+{
+    std::vector<UID> layers;
+    getLayerUIDs(layers);
+    osg::Vec4d viewport(getViewport()->x(), getViewport()->y(), getViewport()->width(), getViewport()->height());
+    unsigned terrainRevision = _context->liveTiles()->getTerrainRevision();
+    Revision mapRevision = _frame ? _frame->getRevision() : Revision();
+
+    // anything that changes the layers, the view setup or the terrain as a whole
+    // invalidates the results for every root tile:
+    if (data._root.get() != root ||
+        data._terrainRevision != terrainRevision ||
+        data._mapRevision != mapRevision ||
+        data._projection != *getProjectionMatrix() ||
+        data._lodScale != getLODScale() ||
+        data._viewport != viewport ||
+        data._layers != layers ||
+        data._regions.size() != root->getNumChildren())
+    {
+        data._root = root;
+        data._terrainRevision = terrainRevision;
+        data._mapRevision = mapRevision;
+        data._projection = *getProjectionMatrix();
+        data._lodScale = getLODScale();
+        data._viewport = viewport;
+        data._layers.swap(layers);
+        data._regions.clear();
+        data._regions.resize(root->getNumChildren());
+    }
+
+    osg::Vec3d eye, look;
+    getEyeAndLook(eye, look);
+
+    unsigned reused = 0u;
+    for (unsigned i = 0; i < root->getNumChildren(); ++i)
+    {
+        CoherentCullData::Region& region = data._regions[i];
+        if (reuse(region, eye, look, tolerance))
+            ++reused;
+        else
+            cull(root->getChild(i), region, eye, look);
+    }
+
+    return reused;
+}
+
+void
+TerrainCuller::cull(osg::Node* rootTile, CoherentCullData::Region& region, const osg::Vec3d& eye, const osg::Vec3d& look)
+{
+    // remember where this subtree's draw commands start in each layer:
+    std::vector<unsigned> starts;
+    starts.reserve(_terrain.layers().size());
+    for (LayerDrawableList::const_iterator i = _terrain.layers().begin(); i != _terrain.layers().end(); ++i)
+        starts.push_back(i->get()->_tiles.size());
+
+    // collect this subtree's bounds separately:
+    osg::BoundingSphere bs = _terrain._drawState->_bs;
+    osg::BoundingBox box = _terrain._drawState->_box;
+    _terrain._drawState->_bs.init();
+    _terrain._drawState->_box.init();
+
+    region = CoherentCullData::Region();
+    _visited = &region._visited;
+    _isStable = true;
+
+    rootTile->accept(*this);
+
+    _visited = 0L;
+    region._bs = _terrain._drawState->_bs;
+    region._box = _terrain._drawState->_box;
+    bs.expandBy(region._bs);
+    box.expandBy(region._box);
+    _terrain._drawState->_bs = bs;
+    _terrain._drawState->_box = box;
+
+    // a subtree that is still loading or subdividing must be culled again next frame.
+    if (!_isStable)
+    {
+        region = CoherentCullData::Region();
+        return;
+    }
+
+    region._modelView = *getModelViewMatrix();
+    region._eye = eye;
+    region._look = look;
+
+    // map each draw command back to its tile so we can store the tile center.
+    std::map<const TileKey*, TileNode*> tiles;
+    for (CoherentCullData::VisitedTiles::iterator i = region._visited.begin(); i != region._visited.end(); ++i)
+    {
+        osg::ref_ptr<TileNode> tile;
+        if (i->_tile.lock(tile))
+            tiles[&tile->getKey()] = tile.get();
+    }
+
+    osg::Vec3d eyeLocal = getViewPointLocal();
+
+    unsigned layer = 0u;
+    for (LayerDrawableList::const_iterator i = _terrain.layers().begin(); i != _terrain.layers().end(); ++i, ++layer)
+    {
+        const LayerDrawable* ld = i->get();
+        if (ld->_tiles.size() == starts[layer])
+            continue;
+
+        CoherentCullData::Commands& commands = region._commands[ld->_layer ? ld->_layer->getUID() : -1];
+        commands.reserve(ld->_tiles.size() - starts[layer]);
+
+        for (unsigned t = starts[layer]; t < ld->_tiles.size(); ++t)
+        {
+            const DrawTileCommand& tile = ld->_tiles[t];
+            std::map<const TileKey*, TileNode*>::const_iterator n = tiles.find(tile._key);
+            if (n == tiles.end())
+            {
+                // should not happen, but if it does we cannot safely reuse this subtree.
+                region = CoherentCullData::Region();
+                return;
+            }
+
+            commands.push_back(CoherentCullData::Command());
+            CoherentCullData::Command& c = commands.back();
+            c._cmd = tile;
+            c._center = n->second->getSurfaceNode()->getBound().center();
+            region._farthestRange = osg::maximum(region._farthestRange, (c._center - eyeLocal).length());
+            ++region._numCommands;
+        }
+    }
+
+    region._valid = true;
+}
+
+bool
+TerrainCuller::reuse(CoherentCullData::Region& region, const osg::Vec3d& eye, const osg::Vec3d& look, float tolerance)
+{
+    // A subtree that drew nothing was out of view; culling it again is cheap
+    // and is the only way to tell whether it has come into view.
+    if (!region._valid || region._numCommands == 0u)
+        return false;
+
+    // has the camera moved too far? Rotation moves the farthest tile the most,
+    // so scale the change in look vector by that range.
+    if ((eye - region._eye).length() > tolerance ||
+        (look - region._look).length() * region._farthestRange > tolerance)
+        return false;
+
+    // all the tiles must still exist and be unchanged:
+    std::vector< osg::ref_ptr<TileNode> > tiles(region._visited.size());
+    for (unsigned i = 0; i < region._visited.size(); ++i)
+    {
+        if (!region._visited[i]._tile.lock(tiles[i]) ||
+            tiles[i]->getRevision() != region._visited[i]._revision)
+            return false;
+    }
+
+    // Good to go. Keep the tiles alive as if we had traversed them:
+    for (unsigned i = 0; i < tiles.size(); ++i)
+    {
+        tiles[i]->touch(getFrameStamp(), region._visited[i]._acceptedSurface);
+    }
+
+    // The view may have moved slightly, so re-express each tile's modelview
+    // matrix relative to the current one.
+    osg::Matrixd delta = osg::Matrixd::inverse(region._modelView) * (*getModelViewMatrix());
+    osg::Vec3d eyeLocal = getViewPointLocal();
+    float lodScale = getLODScale();
+
+    for (LayerDrawableList::iterator i = _terrain.layers().begin(); i != _terrain.layers().end(); ++i)
+    {
+        LayerDrawable* ld = i->get();
+        CoherentCullData::CommandsByLayer::const_iterator commands = region._commands.find(ld->_layer ? ld->_layer->getUID() : -1);
+        if (commands == region._commands.end())
+            continue;
+
+        for (CoherentCullData::Commands::const_iterator c = commands->second.begin(); c != commands->second.end(); ++c)
+        {
+            ld->_tiles.push_back(c->_cmd);
+            DrawTileCommand& tile = ld->_tiles.back();
+            tile._modelViewMatrix = createOrReuseMatrix((*c->_cmd._modelViewMatrix) * delta);
+            tile._range = (c->_center - eyeLocal).length() * lodScale;
+        }
+    }
+
+    _terrain._drawState->_bs.expandBy(region._bs);
+    _terrain._drawState->_box.expandBy(region._box);
+
+    return true;
+}
+
 DrawTileCommand*
 TerrainCuller::addDrawCommand(UID uid, const TileRenderModel* model, const RenderingPass* pass, TileNode* tileNode, unsigned orderInTile)
 {
@@ -146,6 +357,11 @@ TerrainCuller::apply(osg::Node& node)
     {
         _currentTileNode = tileNode;
         _currentTileDrawCommands = 0u;
+
+        if (_visited)
+        {
+            _visited->push_back(CoherentCullData::VisitedTile(tileNode, tileNode->getRevision()));
+        }
         
         if (!_terrain.patchLayers().empty())
         {
@@ -198,6 +414,11 @@ TerrainCuller::apply(osg::Node& node)
         {
             TileRenderModel& renderModel = _currentTileNode->renderModel();
 
+            if (_visited && !_visited->empty() && _visited->back()._tile == _currentTileNode)
+            {
+                _visited->back()._acceptedSurface = true;
+            }
+
             // push the surface matrix:
             osg::Matrix mvm = *getModelViewMatrix();
             surface->computeLocalToWorldMatrix(mvm, this);
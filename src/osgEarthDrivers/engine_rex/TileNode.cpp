@@ -71,6 +71,7 @@ _minExpiryTime( 0.0 ),
 _minExpiryFrames( 0 ),
 _lastTraversalTime(0.0),
 _lastTraversalFrame(0.0),
+_revision(0u),
 _count(0),
 _stitchNormalMap(false),
 _empty(false)               // an "empty" node exists but has no geometry or children.
@@ -290,6 +291,9 @@ void
 TileNode::setDirty(bool value)
 {
     _dirty = value;
+
+    if (_dirty)
+        ++_revision;
     
     if (_dirty == false && !_newLayers.empty())
     {
@@ -390,6 +394,13 @@ TileNode::cull(TerrainCuller* culler)
     // determine whether we can and should subdivide to a higher resolution:
     bool childrenInRange = shouldSubDivide(culler, context->getSelectionInfo());
 
+    // a tile that's still loading or waiting on children means this frame's
+    // results are in flux and cannot be reused by coherent culling.
+    if ( _dirty || (childrenInRange && !_childrenReady) )
+    {
+        culler->_isStable = false;
+    }
+
     // whether it is OK to create child TileNodes is necessary.
     bool canCreateChildren = childrenInRange;
 
@@ -479,6 +490,18 @@ TileNode::cull(TerrainCuller* culler)
     return true;
 }
 
+void
+TileNode::touch(const osg::FrameStamp* fs, bool acceptedSurface)
+{
+    _lastTraversalFrame.exchange( fs->getFrameNumber() );
+    _lastTraversalTime = fs->getReferenceTime();
+
+    if ( acceptedSurface )
+    {
+        _lastAcceptSurfaceFrame.exchange( fs->getFrameNumber() );
+    }
+}
+
 bool
 TileNode::accept_cull(TerrainCuller* culler)
 {
@@ -586,6 +609,9 @@ TileNode::merge(const TerrainTileModel* model, const RenderBindings& bindings)
 {
     bool newElevationData = false;
 
+    // rendering data is about to change; invalidate any coherent cull results.
+    ++_revision;
+
     // Add color passes:
     const SamplerBinding& color = bindings[SamplerBinding::COLOR];
     if (color.isActive())
@@ -917,6 +943,7 @@ void
 TileNode::removeSubTiles()
 {
     _childrenReady = false;
+    ++_revision;
     this->removeChildren(0, this->getNumChildren());
 }
 
@@ -34,7 +34,8 @@ using namespace osgEarth;
 TileNodeRegistry::TileNodeRegistry(const std::string& name) :
 _name              ( name ),
 _revisioningEnabled( false ),
-_frameNumber       ( 0u )
+_frameNumber       ( 0u ),
+_terrainRevision   ( 0u )
 {
     //nop
 }
@@ -0,0 +1,418 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "GDALBlockReader"
+#include <osgEarth/Registry>
+#include <string.h>
+#include <math.h>
+
+#define LC "[GDALBlockReader] "
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+//------------------------------------------------------------------------
+
+bool
+GDALBlockReader::BlockKey::operator < (const BlockKey& rhs) const
+{
+    if ( _band  < rhs._band  ) return true;
+    if ( _band  > rhs._band  ) return false;
+    if ( _level < rhs._level ) return true;
+    if ( _level > rhs._level ) return false;
+    if ( _y     < rhs._y     ) return true;
+    if ( _y     > rhs._y     ) return false;
+    if ( _x     < rhs._x     ) return true;
+    if ( _x     > rhs._x     ) return false;
+    return _type < rhs._type;
+}
+
+//------------------------------------------------------------------------
+
+GDALBlockReader::GDALBlockReader(GDALDataset*       dataset,
+                                 const std::string& reopenName,
+                                 unsigned           maxHandles,
+                                 unsigned           maxBytes) :
+_dataset   ( dataset ),
+_reopenName( reopenName ),
+_maxHandles( osg::maximum(maxHandles, 1u) ),
+_maxBytes  ( maxBytes ),
+_bytes     ( 0u )
+{
+    GDAL_SCOPED_LOCK;
+
+    int numBands = _dataset->GetRasterCount();
+    if ( numBands > 0 )
+    {
+        GDALRasterBand* band1 = _dataset->GetRasterBand(1);
+
+        Level level;
+        level._width  = band1->GetXSize();
+        level._height = band1->GetYSize();
+        band1->GetBlockSize( &level._blockWidth, &level._blockHeight );
+        _levels.push_back( level );
+
+        // Only use overview levels that every band has at the same size,
+        // so that a level number means the same thing for all bands.
+        for (int i = 0; i < band1->GetOverviewCount(); ++i)
+        {
+            GDALRasterBand* ov1 = band1->GetOverview(i);
+            if ( !ov1 )
+                break;
+
+            bool complete = true;
+            for (int b = 2; b <= numBands && complete; ++b)
+            {
+                GDALRasterBand* band = _dataset->GetRasterBand(b);
+                GDALRasterBand* ov = i < band->GetOverviewCount() ? band->GetOverview(i) : 0L;
+                complete = ov && ov->GetXSize() == ov1->GetXSize() && ov->GetYSize() == ov1->GetYSize();
+            }
+            if ( !complete )
+                break;
+
+            level._width  = ov1->GetXSize();
+            level._height = ov1->GetYSize();
+            ov1->GetBlockSize( &level._blockWidth, &level._blockHeight );
+            _levels.push_back( level );
+        }
+    }
+
+    for (int b = 1; b <= numBands; ++b)
+    {
+        int success = 0;
+        double value = _dataset->GetRasterBand(b)->GetNoDataValue(&success);
+        _noData.push_back( value );
+        _hasNoData.push_back( success );
+    }
+
+    // Make sure the dataset really can be reopened before relying on it;
+    // if not, fall back on reading the shared dataset.
+    if ( !_reopenName.empty() )
+    {
+        GDALDataset* ds = (GDALDataset*)GDALOpen( _reopenName.c_str(), GA_ReadOnly );
+        if ( ds && ds->GetRasterCount() == numBands )
+        {
+            _handles.push_back( ds );
+            _freeHandles.push_back( ds );
+        }
+        else
+        {
+            if ( ds )
+                GDALClose( ds );
+            OE_INFO << LC << "Cannot reopen \"" << _reopenName << "\"; reads will not be concurrent" << std::endl;
+            _reopenName.clear();
+        }
+    }
+
+    OE_DEBUG << LC << "Levels=" << _levels.size()
+        << ", block=" << (_levels.empty() ? 0 : _levels[0]._blockWidth) << "x" << (_levels.empty() ? 0 : _levels[0]._blockHeight)
+        << ", handles=" << (isConcurrent() ? _maxHandles : 1u)
+        << ", cache=" << (_maxBytes / 1048576u) << "MB" << std::endl;
+}
+
+GDALBlockReader::~GDALBlockReader()
+{
+    GDAL_SCOPED_LOCK;
+
+    for (unsigned i = 0; i < _handles.size(); ++i)
+    {
+        GDALClose( _handles[i] );
+    }
+    _handles.clear();
+    _freeHandles.clear();
+}
+
+double
+GDALBlockReader::getNoDataValue(int band, int* success) const
+{
+    if ( band < 1 || band > (int)_noData.size() )
+    {
+        if ( success ) *success = 0;
+        return 0.0;
+    }
+    if ( success ) *success = _hasNoData[band-1];
+    return _noData[band-1];
+}
+
+GDALRasterBand*
+GDALBlockReader::getBand(GDALDataset* ds, int band, int level) const
+{
+    GDALRasterBand* b = ds->GetRasterBand(band);
+    if ( b && level > 0 )
+        b = b->GetOverview(level-1);
+    return b;
+}
+
+int
+GDALBlockReader::selectLevel(double xScale, double yScale) const
+{
+    // Pick the coarsest level that still has at least the resolution of
+    // the output buffer.
+    double scale = osg::minimum(xScale, yScale);
+    int    best  = 0;
+    double bestFactor = 1.0;
+
+    for (unsigned i = 1; i < _levels.size(); ++i)
+    {
+        double factor = (double)_levels[0]._width / (double)_levels[i]._width;
+        if ( factor <= scale * 1.001 && factor > bestFactor )
+        {
+            best = i;
+            bestFactor = factor;
+        }
+    }
+    return best;
+}
+
+GDALDataset*
+GDALBlockReader::acquireHandle()
+{
+    if ( !isConcurrent() )
+        return _dataset;
+
+    Threading::ScopedMutexLock lock( _handleMutex );
+
+    while ( _freeHandles.empty() )
+    {
+        if ( _handles.size() < _maxHandles )
+        {
+            GDALDataset* ds = 0L;
+            {
+                GDAL_SCOPED_LOCK;
+                ds = (GDALDataset*)GDALOpen( _reopenName.c_str(), GA_ReadOnly );
+            }
+            if ( ds )
+            {
+                _handles.push_back( ds );
+                return ds;
+            }
+
+            // Could not open another one; make do with the ones we have.
+            _maxHandles = _handles.size();
+        }
+        else
+        {
+            _handleAvailable.wait( &_handleMutex );
+        }
+    }
+
+    GDALDataset* ds = _freeHandles.back();
+    _freeHandles.pop_back();
+    return ds;
+}
+
+void
+GDALBlockReader::releaseHandle(GDALDataset* ds)
+{
+    if ( !isConcurrent() )
+        return;
+
+    Threading::ScopedMutexLock lock( _handleMutex );
+    _freeHandles.push_back( ds );
+    _handleAvailable.signal();
+}
+
+osg::ref_ptr<GDALBlockReader::Block>
+GDALBlockReader::getBlock(const BlockKey& key)
+{
+    {
+        Threading::ScopedMutexLock lock( _cacheMutex );
+        std::map<BlockKey, Entry>::iterator i = _blocks.find( key );
+        if ( i != _blocks.end() )
+        {
+            _lru.splice( _lru.begin(), _lru, i->second._lru );
+            return i->second._block;
+        }
+    }
+
+    const Level& level = _levels[key._level];
+    int x0 = key._x * level._blockWidth;
+    int y0 = key._y * level._blockHeight;
+
+    osg::ref_ptr<Block> block = new Block();
+    block->_width  = osg::minimum( level._blockWidth,  level._width  - x0 );
+    block->_height = osg::minimum( level._blockHeight, level._height - y0 );
+    block->_data.resize( block->_width * block->_height * (GDALGetDataTypeSize(key._type) / 8) );
+
+    CPLErr err = CE_Failure;
+    GDALDataset* ds = acquireHandle();
+    if ( isConcurrent() )
+    {
+        GDALRasterBand* band = getBand( ds, key._band, key._level );
+        if ( band )
+            err = band->RasterIO( GF_Read, x0, y0, block->_width, block->_height, &block->_data[0], block->_width, block->_height, key._type, 0, 0 );
+    }
+    else
+    {
+        GDAL_SCOPED_LOCK;
+        GDALRasterBand* band = getBand( ds, key._band, key._level );
+        if ( band )
+            err = band->RasterIO( GF_Read, x0, y0, block->_width, block->_height, &block->_data[0], block->_width, block->_height, key._type, 0, 0 );
+    }
+    releaseHandle( ds );
+
+    if ( err != CE_None )
+    {
+        OE_WARN << LC << "Failed to read block " << key._x << "," << key._y
+            << " of band " << key._band << " at level " << key._level << std::endl;
+        return 0L;
+    }
+
+    Threading::ScopedMutexLock lock( _cacheMutex );
+
+    // another thread may have read the same block in the meantime
+    std::map<BlockKey, Entry>::iterator i = _blocks.find( key );
+    if ( i != _blocks.end() )
+        return i->second._block;
+
+    _lru.push_front( key );
+    Entry& entry = _blocks[key];
+    entry._block = block.get();
+    entry._lru   = _lru.begin();
+    _bytes += block->_data.size();
+
+    // evict least recently used blocks, always keeping the new one.
+    while ( _bytes > _maxBytes && _lru.size() > 1 )
+    {
+        std::map<BlockKey, Entry>::iterator e = _blocks.find( _lru.back() );
+        if ( e != _blocks.end() )
+        {
+            _bytes -= e->second._block->_data.size();
+            _blocks.erase( e );
+        }
+        _lru.pop_back();
+    }
+
+    return block;
+}
+
+bool
+GDALBlockReader::read(int          band,
+                      int          xOff,
+                      int          yOff,
+                      int          xSize,
+                      int          ySize,
+                      void*        buffer,
+                      int          bufXSize,
+                      int          bufYSize,
+                      GDALDataType type,
+                      int          pixelSpace,
+                      int          lineSpace)
+{
+    if ( _levels.empty() || band < 1 || band > (int)_noData.size() )
+        return false;
+
+    if ( xSize <= 0 || ySize <= 0 || bufXSize <= 0 || bufYSize <= 0 )
+        return false;
+
+    // same as RasterIO: the window must lie within the raster.
+    if ( xOff < 0 || yOff < 0 || xOff + xSize > _levels[0]._width || yOff + ySize > _levels[0]._height )
+        return false;
+
+    int elementSize = GDALGetDataTypeSize(type) / 8;
+    if ( elementSize <= 0 )
+        return false;
+
+    if ( pixelSpace == 0 ) pixelSpace = elementSize;
+    if ( lineSpace  == 0 ) lineSpace  = pixelSpace * bufXSize;
+
+    double xScale = (double)xSize / (double)bufXSize;
+    double yScale = (double)ySize / (double)bufYSize;
+
+    int levelNum = selectLevel( xScale, yScale );
+    const Level& level = _levels[levelNum];
+    double xFactor = (double)_levels[0]._width  / (double)level._width;
+    double yFactor = (double)_levels[0]._height / (double)level._height;
+
+    // Map each buffer column and row to a block and an offset within it,
+    // sampling at pixel centers like GDAL's nearest neighbor RasterIO.
+    std::vector<int> colBlock( bufXSize ), colOffset( bufXSize );
+    for (int i = 0; i < bufXSize; ++i)
+    {
+        int x = (int)floor( (xOff + ((double)i + 0.5) * xScale) / xFactor );
+        x = osg::clampBetween( x, 0, level._width - 1 );
+        colBlock[i]  = x / level._blockWidth;
+        colOffset[i] = x % level._blockWidth;
+    }
+
+    std::vector<int> rowBlock( bufYSize ), rowOffset( bufYSize );
+    for (int j = 0; j < bufYSize; ++j)
+    {
+        int y = (int)floor( (yOff + ((double)j + 0.5) * yScale) / yFactor );
+        y = osg::clampBetween( y, 0, level._height - 1 );
+        rowBlock[j]  = y / level._blockHeight;
+        rowOffset[j] = y % level._blockHeight;
+    }
+
+    // Distinct block columns the sampled columns fall in (colBlock is
+    // non-decreasing), and the slot of each buffer column among them.
+    std::vector<int> blockCols, colSlot( bufXSize );
+    for (int i = 0; i < bufXSize; ++i)
+    {
+        if ( blockCols.empty() || blockCols.back() != colBlock[i] )
+            blockCols.push_back( colBlock[i] );
+        colSlot[i] = blockCols.size() - 1;
+    }
+
+    BlockKey key;
+    key._band  = band;
+    key._level = levelNum;
+    key._type  = type;
+
+    unsigned char* out = (unsigned char*)buffer;
+
+    // Work down one band of block rows at a time, fetching only the blocks
+    // that sampled rows and columns actually hit, so a sparse sample of a
+    // large window does not pull (and evict) blocks it never reads.
+    std::vector< osg::ref_ptr<Block> > blocks( blockCols.size() );
+
+    for (int j0 = 0; j0 < bufYSize; )
+    {
+        int j1 = j0;
+        while ( j1 < bufYSize && rowBlock[j1] == rowBlock[j0] )
+            ++j1;
+
+        key._y = rowBlock[j0];
+        for (unsigned b = 0; b < blockCols.size(); ++b)
+        {
+            key._x = blockCols[b];
+            blocks[b] = getBlock( key );
+            if ( !blocks[b].valid() )
+                return false;
+        }
+
+        for (int j = j0; j < j1; ++j)
+        {
+            unsigned char* dst = out + j * lineSpace;
+
+            for (int i = 0; i < bufXSize; ++i, dst += pixelSpace)
+            {
+                const Block* block = blocks[colSlot[i]].get();
+                const unsigned char* src = &block->_data[(rowOffset[j] * block->_width + colOffset[i]) * elementSize];
+                memcpy( dst, src, elementSize );
+            }
+        }
+
+        j0 = j1;
+    }
+
+    return true;
+}
@@ -26,6 +26,9 @@
 #include <osgEarth/ImageUtils>
 #include <osgEarth/URI>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/Progress>
+
+#include <osgEarthUtil/TileIndex>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -35,6 +38,8 @@
 #include <osgDB/ImageOptions>
 
 #include <sstream>
+#include <algorithm>
+#include <float.h>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -43,6 +48,7 @@
 #include <ogr_spatialref.h>
 
 #include "GDALOptions"
+#include "GDALBlockReader"
 
 #define LC "[GDAL driver] "
 
@@ -84,6 +90,7 @@ float Hue_2_RGB( float v1, float v2, float vH )
 using namespace std;
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
+using osgEarth::Util::TileIndex;
 
 #define GEOTRSFRM_TOPLEFT_X            0
 #define GEOTRSFRM_WE_RES               1
@@ -661,6 +668,29 @@ GeoExtent getGeoExtent(std::string& filename)
 
 
 
+namespace
+{
+    // Holds the GDAL mutex for its lifetime, unless told not to.
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock(bool lock) : _locked(lock) { if (_locked) osgEarth::getGDALMutex().lock(); }
+        ~OptionalGDALLock() { if (_locked) osgEarth::getGDALMutex().unlock(); }
+        bool _locked;
+    };
+
+    // Orders index entries from the finest resolution to the coarsest;
+    // entries of unknown resolution go last.
+    struct FinerFirst
+    {
+        bool operator()(const osgEarth::Util::TileIndex::Entry& lhs, const osgEarth::Util::TileIndex::Entry& rhs) const
+        {
+            if ( lhs._resolution <= 0.0 ) return false;
+            if ( rhs._resolution <= 0.0 ) return true;
+            return lhs._resolution < rhs._resolution;
+        }
+    };
+}
+
 class GDALTileSource : public TileSource
 {
 public:
@@ -668,7 +698,11 @@ public:
       TileSource( options ),
       _srcDS(NULL),
       _warpedDS(NULL),
+      _rasterXSize(0),
+      _rasterYSize(0),
       _options(options),
+      _mosaicSources(true),
+      _forceMaxDataLevel(false),
       _maxDataLevel(30)
     {
     }
@@ -677,6 +711,9 @@ public:
     {
         GDAL_SCOPED_LOCK;
 
+        // Closes the block reader's own dataset handles.
+        _blockReader = 0L;
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -737,6 +774,11 @@ public:
             }
         }
 
+        if (useExternalDataset == false && _options.index().isSet())
+        {
+            return initializeMosaic();
+        }
+
         if (useExternalDataset == false &&
             (!_options.url().isSet() || _options.url()->empty()) &&
             (!_options.connection().isSet() || _options.connection()->empty()) )
@@ -1057,6 +1099,26 @@ public:
             return Status::Error( "Failed to create a warping VRT" );
         }
 
+        // Cache the raster size so that tile reads do not have to query the
+        // shared dataset (or take the GDAL mutex) for it.
+        _rasterXSize = _warpedDS->GetRasterXSize();
+        _rasterYSize = _warpedDS->GetRasterYSize();
+
+        if ( _options.blockReads() == true )
+        {
+            // Private handles can only be opened on a dataset that has a name;
+            // warped VRTs, in-memory VRTs and external datasets do not.
+            std::string reopenName;
+            if ( !useExternalDataset && _warpedDS == _srcDS && _srcDS->GetDescription() )
+                reopenName = _srcDS->GetDescription();
+
+            _blockReader = new GDALBlockReader(
+                _warpedDS,
+                reopenName,
+                _options.maxDatasetHandles().get(),
+                _options.blockCacheSize().get() * 1048576u );
+        }
+
         //Get the _geotransform
         if ( getProfile() )
         {
@@ -1217,6 +1279,225 @@ public:
     }
 
 
+    /**
+     * Sets up reading from a tile index instead of a single dataset. Only
+     * the index is read here; the files themselves are opened on demand.
+     */
+    Status initializeMosaic()
+    {
+        _index = TileIndex::load( _options.index()->full() );
+        if ( !_index.valid() )
+        {
+            return Status::Error( Status::ResourceUnavailable, Stringify()
+                << "Failed to load tile index " << _options.index()->full() );
+        }
+
+        const Profile* profile = getProfile();
+        if ( !profile )
+        {
+            profile = Registry::instance()->getGlobalGeodeticProfile();
+        }
+
+        // One pass over the index for the overall extent and the finest
+        // resolution, without opening any of the files.
+        std::vector<TileIndex::Entry> entries;
+        _index->getEntries( GeoExtent::INVALID, entries );
+        if ( entries.empty() )
+        {
+            return Status::Error( Status::ResourceUnavailable, Stringify()
+                << "Tile index " << _options.index()->full() << " is empty" );
+        }
+
+        GeoExtent extent;
+        double finest = DBL_MAX;
+        for (std::vector<TileIndex::Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+        {
+            GeoExtent e = i->_extent.transform( profile->getSRS() );
+            if ( !e.isValid() )
+                continue;
+
+            if ( extent.isValid() )
+                extent.expandToInclude( e );
+            else
+                extent = e;
+
+            if ( i->_resolution > 0.0 && i->_extent.width() > 0.0 )
+            {
+                finest = osg::minimum( finest, i->_resolution * e.width() / i->_extent.width() );
+            }
+        }
+
+        if ( !extent.isValid() )
+        {
+            return Status::Error( Status::ResourceUnavailable, Stringify()
+                << "Tile index " << _options.index()->full() << " has no valid extents" );
+        }
+
+        if (_options.maxDataLevelOverride().isSet())
+        {
+            _maxDataLevel = _options.maxDataLevelOverride().value();
+            _forceMaxDataLevel = true;
+        }
+        else if ( finest < DBL_MAX )
+        {
+            unsigned int max_level = 30;
+            for (unsigned int i = 0; i < max_level; ++i)
+            {
+                _maxDataLevel = i;
+                double w, h;
+                profile->getTileDimensions(i, w, h);
+                if ( w / (double)getPixelsPerTile() < finest || h / (double)getPixelsPerTile() < finest )
+                {
+                    break;
+                }
+            }
+            _forceMaxDataLevel = true;
+        }
+        else
+        {
+            OE_INFO << LC << INDENT << _options.index()->full()
+                << " does not record resolutions; each file will use its own max data level" << std::endl;
+        }
+
+        _extents = extent;
+        _bounds = extent.bounds();
+        _mosaicSources.setMaxSize( osg::maximum(_options.maxOpenDatasets().get(), 1u) );
+
+        getDataExtents().push_back( DataExtent(extent, 0, _maxDataLevel) );
+        setProfile( profile );
+
+        OE_INFO << LC << INDENT << _options.index()->full() << ": " << entries.size()
+            << " files, max data level " << _maxDataLevel << std::endl;
+
+        return STATUS_OK;
+    }
+
+    /**
+     * Gets the tile source for one file of a mosaic, opening it if it is
+     * not among the most recently used ones.
+     */
+    osg::ref_ptr<GDALTileSource> getMosaicSource(const TileIndex::Entry& entry)
+    {
+        MosaicSourceCache::Record record;
+        if ( _mosaicSources.get(entry._location, record) )
+        {
+            return record.value();
+        }
+
+        GDALOptions opt( _options );
+        opt.index().unset();
+        opt.connection().unset();
+        opt.externalDataset() = 0L;
+        opt.url() = entry._location;
+        opt.L2CacheSize() = 0;
+        if ( _forceMaxDataLevel )
+        {
+            // produce data at every level of the mosaic, even if it means upsampling
+            opt.maxDataLevelOverride() = _maxDataLevel;
+        }
+
+        osg::ref_ptr<GDALTileSource> source = new GDALTileSource( opt );
+        source->setProfile( getProfile() );
+        source->setPixelsPerTile( getPixelsPerTile() );
+        source->setNoDataValue( getNoDataValue() );
+        source->setMinValidValue( getMinValidValue() );
+        source->setMaxValidValue( getMaxValidValue() );
+
+        if ( source->open(MODE_READ, _dbOptions.get()).isError() )
+        {
+            OE_WARN << LC << "Failed to open " << entry._location << std::endl;
+            // remember the failure so we don't keep trying.
+            source = 0L;
+        }
+
+        _mosaicSources.insert( entry._location, source );
+        return source;
+    }
+
+    osg::Image* createMosaicImage(const TileKey& key, ProgressCallback* progress)
+    {
+        std::vector<TileIndex::Entry> entries;
+        _index->getEntries( key.getExtent(), entries );
+
+        // composite from coarse to fine so that the finest data ends up on top.
+        std::sort( entries.begin(), entries.end(), FinerFirst() );
+
+        osg::ref_ptr<osg::Image> result;
+        for (std::vector<TileIndex::Entry>::reverse_iterator i = entries.rbegin(); i != entries.rend(); ++i)
+        {
+            if ( progress && progress->isCanceled() )
+                return 0L;
+
+            osg::ref_ptr<GDALTileSource> source = getMosaicSource( *i );
+            if ( !source.valid() )
+                continue;
+
+            osg::ref_ptr<osg::Image> image = source->createImage( key, progress );
+            if ( !image.valid() )
+                continue;
+
+            if ( !result.valid() )
+                result = image.get();
+            else
+                ImageUtils::mix( result.get(), image.get(), 1.0f );
+        }
+
+        return result.release();
+    }
+
+    osg::HeightField* createMosaicHeightField(const TileKey& key, ProgressCallback* progress)
+    {
+        std::vector<TileIndex::Entry> entries;
+        _index->getEntries( key.getExtent(), entries );
+
+        // fill from fine to coarse, each file filling in what the finer ones left empty.
+        std::sort( entries.begin(), entries.end(), FinerFirst() );
+
+        osg::ref_ptr<osg::HeightField> result;
+        for (std::vector<TileIndex::Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+        {
+            if ( progress && progress->isCanceled() )
+                return 0L;
+
+            osg::ref_ptr<GDALTileSource> source = getMosaicSource( *i );
+            if ( !source.valid() )
+                continue;
+
+            osg::ref_ptr<osg::HeightField> hf = source->createHeightField( key, progress );
+            if ( !hf.valid() )
+                continue;
+
+            bool complete = true;
+            if ( !result.valid() )
+            {
+                result = hf.get();
+                const osg::HeightField::HeightList& heights = result->getHeightList();
+                for (unsigned k = 0; k < heights.size() && complete; ++k)
+                    complete = heights[k] != NO_DATA_VALUE;
+            }
+            else
+            {
+                osg::HeightField::HeightList& heights = result->getHeightList();
+                const osg::HeightField::HeightList& fill = hf->getHeightList();
+                for (unsigned k = 0; k < heights.size() && k < fill.size(); ++k)
+                {
+                    if ( heights[k] == NO_DATA_VALUE )
+                    {
+                        heights[k] = fill[k];
+                        complete = complete && fill[k] != NO_DATA_VALUE;
+                    }
+                }
+            }
+
+            // Once every post has a value, or a file without NODATA covers the
+            // whole tile, coarser files have nothing to add; don't open them.
+            if ( complete || (!i->_noData.isSet() && i->_extent.contains(key.getExtent())) )
+                break;
+        }
+
+        return result.release();
+    }
+
     /**
     * Finds a raster band based on color interpretation
     */
@@ -1335,8 +1616,8 @@ public:
         double eps = 0.0001;
         if (osg::equivalent(x, 0, eps)) x = 0;
         if (osg::equivalent(y, 0, eps)) y = 0;
-        if (osg::equivalent(x, (double)_warpedDS->GetRasterXSize(), eps)) x = _warpedDS->GetRasterXSize();
-        if (osg::equivalent(y, (double)_warpedDS->GetRasterYSize(), eps)) y = _warpedDS->GetRasterYSize();
+        if (osg::equivalent(x, (double)_rasterXSize, eps)) x = _rasterXSize;
+        if (osg::equivalent(y, (double)_rasterYSize, eps)) y = _rasterYSize;
 
     }
 
@@ -1350,7 +1631,10 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        if ( _index.valid() )
+            return createMosaicImage( key, progress );
+
+        OptionalGDALLock lock( !concurrentReads() );
 
         int tileSize = getPixelsPerTile(); //_options.tileSize().value();
 
@@ -1415,8 +1699,8 @@ public:
         int height = (int)(src_max_y - src_min_y);
 
 
-        int rasterWidth = _warpedDS->GetRasterXSize();
-        int rasterHeight = _warpedDS->GetRasterYSize();
+        int rasterWidth = _rasterXSize;
+        int rasterHeight = _rasterYSize;
         if (off_x + width > rasterWidth || off_y + height > rasterHeight)
         {
             OE_WARN << LC << "Read window outside of bounds of dataset.  Source Dimensions=" << rasterWidth << "x" << rasterHeight << " Read Window=" << off_x << ", " << off_y << " " << width << "x" << height << std::endl;
@@ -1461,6 +1745,8 @@ public:
 
         if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
         {
+            GDAL_SCOPED_LOCK;
+
             OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
             //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
             //RGB = 3 bands
@@ -1514,13 +1800,13 @@ public:
             //Nearest interpolation just uses RasterIO to sample the imagery and should be very fast.
             if (!*_options.interpolateImagery() || _options.interpolation() == INTERP_NEAREST)
             {
-                bandRed->RasterIO(GF_Read, off_x, off_y, width, height, red, target_width, target_height, GDT_Byte, 0, 0);
-                bandGreen->RasterIO(GF_Read, off_x, off_y, width, height, green, target_width, target_height, GDT_Byte, 0, 0);
-                bandBlue->RasterIO(GF_Read, off_x, off_y, width, height, blue, target_width, target_height, GDT_Byte, 0, 0);
+                rasterIO(bandRed, off_x, off_y, width, height, red, target_width, target_height, GDT_Byte, 0, 0);
+                rasterIO(bandGreen, off_x, off_y, width, height, green, target_width, target_height, GDT_Byte, 0, 0);
+                rasterIO(bandBlue, off_x, off_y, width, height, blue, target_width, target_height, GDT_Byte, 0, 0);
 
                 if (bandAlpha)
                 {
-                    bandAlpha->RasterIO(GF_Read, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
+                    rasterIO(bandAlpha, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
                 }
 
                 for (int src_row = 0, dst_row = tile_offset_top;
@@ -1580,7 +1866,11 @@ public:
         {
             if ( getOptions().coverage() == true )
             {
-                GDALDataType gdalDataType = bandGray->GetRasterDataType();
+                GDALDataType gdalDataType;
+                {
+                    GDAL_SCOPED_LOCK;
+                    gdalDataType = bandGray->GetRasterDataType();
+                }
                 int          gdalSampleSize;
                 GLenum       glDataType;
                 GLint        internalFormat;
@@ -1631,11 +1921,15 @@ public:
 
 
                 int success;
-                float nodata = bandGray->GetNoDataValue(&success);
+                float nodata;
+                {
+                    GDAL_SCOPED_LOCK;
+                    nodata = bandGray->GetNoDataValue(&success);
+                }
                 if ( !success )
                     nodata = NO_DATA_VALUE; //getNoDataValue(); //getOptions().noDataValue().get();
 
-                CPLErr err = bandGray->RasterIO(GF_Read, off_x, off_y, width, height, data, target_width, target_height, gdalDataType, 0, 0);
+                CPLErr err = rasterIO(bandGray, off_x, off_y, width, height, data, target_width, target_height, gdalDataType, 0, 0);
                 if ( err == CE_None )
                 {
                     // copy from data to image.
@@ -1686,11 +1980,11 @@ public:
 
                 if (!*_options.interpolateImagery() || _options.interpolation() == INTERP_NEAREST)
                 {
-                    bandGray->RasterIO(GF_Read, off_x, off_y, width, height, gray, target_width, target_height, GDT_Byte, 0, 0);
+                    rasterIO(bandGray, off_x, off_y, width, height, gray, target_width, target_height, GDT_Byte, 0, 0);
 
                     if (bandAlpha)
                     {
-                        bandAlpha->RasterIO(GF_Read, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
+                        rasterIO(bandAlpha, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
                     }
 
                     for (int src_row = 0, dst_row = tile_offset_top;
@@ -1773,7 +2067,17 @@ public:
                 memset(image->data(), 0, image->getImageSizeInBytes());
             }
 
-            bandPalette->RasterIO(GF_Read, off_x, off_y, width, height, palette, target_width, target_height, GDT_Byte, 0, 0);
+            rasterIO(bandPalette, off_x, off_y, width, height, palette, target_width, target_height, GDT_Byte, 0, 0);
+
+            // Look up the color table once, under the lock, instead of per pixel.
+            std::vector<osg::Vec4ub> colors;
+            if ( _options.coverage() != true )
+            {
+                GDAL_SCOPED_LOCK;
+                colors.resize(256);
+                for (int i = 0; i < 256; ++i)
+                    getPalleteIndexColor( bandPalette, i, colors[i] );
+            }
 
             ImageUtils::PixelWriter write(image);
 
@@ -1799,8 +2103,7 @@ public:
                     }
                     else
                     {
-                        osg::Vec4ub color;
-                        getPalleteIndexColor( bandPalette, p, color );
+                        osg::Vec4ub color = colors[p];
                         if (!isValidValue( p, bandPalette))
                         {
                             color.a() = 0.0f;
@@ -1832,11 +2135,37 @@ public:
         return image.release();
     }
 
+    /**
+     * Whether tiles can be read concurrently without holding the GDAL mutex.
+     */
+    bool concurrentReads() const
+    {
+        return _blockReader.valid() && _blockReader->isConcurrent();
+    }
+
+    /**
+     * Reads a window of a band of _warpedDS like GDALRasterBand::RasterIO,
+     * going through the block cache if block reads are enabled.
+     */
+    CPLErr rasterIO(GDALRasterBand* band, int xOff, int yOff, int xSize, int ySize,
+                    void* data, int bufXSize, int bufYSize, GDALDataType type,
+                    int pixelSpace, int lineSpace)
+    {
+        if ( _blockReader.valid() )
+        {
+            return _blockReader->read(band->GetBand(), xOff, yOff, xSize, ySize, data, bufXSize, bufYSize, type, pixelSpace, lineSpace) ?
+                CE_None : CE_Failure;
+        }
+        return band->RasterIO(GF_Read, xOff, yOff, xSize, ySize, data, bufXSize, bufYSize, type, pixelSpace, lineSpace);
+    }
+
     bool isValidValue_noLock(float v, GDALRasterBand* band)
     {
         float bandNoData = -32767.0f;
         int success;
-        float value = band->GetNoDataValue(&success);
+        float value = _blockReader.valid() ?
+            (float)_blockReader->getNoDataValue(band->GetBand(), &success) :
+            band->GetNoDataValue(&success);
         if (success)
         {
             bandNoData = value;
@@ -1856,6 +2185,9 @@ public:
 
     bool isValidValue(float v, GDALRasterBand* band)
     {
+        if ( concurrentReads() )
+            return isValidValue_noLock( v, band );
+
         GDAL_SCOPED_LOCK;
         return isValidValue_noLock( v, band );
     }
@@ -1880,30 +2212,30 @@ public:
             {
                 c = 0;
             }
-            else if (c > _warpedDS->GetRasterXSize()-1 && c <= _warpedDS->GetRasterXSize()-0.5)
+            else if (c > _rasterXSize-1 && c <= _rasterXSize-0.5)
             {
-                c = _warpedDS->GetRasterXSize()-1;
+                c = _rasterXSize-1;
             }
 
             if (r < 0 && r >= -0.5)
             {
                 r = 0;
             }
-            else if (r > _warpedDS->GetRasterYSize()-1 && r <= _warpedDS->GetRasterYSize()-0.5)
+            else if (r > _rasterYSize-1 && r <= _rasterYSize-0.5)
             {
-                r = _warpedDS->GetRasterYSize()-1;
+                r = _rasterYSize-1;
             }
         }
 
         float result = 0.0f;
 
         //If the location is outside of the pixel values of the dataset, just return 0
-        if (c < 0 || r < 0 || c > _warpedDS->GetRasterXSize()-1 || r > _warpedDS->GetRasterYSize()-1)
+        if (c < 0 || r < 0 || c > _rasterXSize-1 || r > _rasterYSize-1)
             return NO_DATA_VALUE;
 
         if ( _options.interpolation() == INTERP_NEAREST )
         {
-            band->RasterIO(GF_Read, (int)osg::round(c), (int)osg::round(r), 1, 1, &result, 1, 1, GDT_Float32, 0, 0);
+            rasterIO(band, (int)osg::round(c), (int)osg::round(r), 1, 1, &result, 1, 1, GDT_Float32, 0, 0);
             if (!isValidValue( result, band))
             {
                 return NO_DATA_VALUE;
@@ -1912,19 +2244,19 @@ public:
         else
         {
             int rowMin = osg::maximum((int)floor(r), 0);
-            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_warpedDS->GetRasterYSize()-1)), 0);
+            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_rasterYSize-1)), 0);
             int colMin = osg::maximum((int)floor(c), 0);
-            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_warpedDS->GetRasterXSize()-1)), 0);
+            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_rasterXSize-1)), 0);
 
             if (rowMin > rowMax) rowMin = rowMax;
             if (colMin > colMax) colMin = colMax;
 
             float urHeight, llHeight, ulHeight, lrHeight;
 
-            band->RasterIO(GF_Read, colMin, rowMin, 1, 1, &llHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMin, rowMax, 1, 1, &ulHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMin, 1, 1, &lrHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMax, 1, 1, &urHeight, 1, 1, GDT_Float32, 0, 0);
+            rasterIO(band, colMin, rowMin, 1, 1, &llHeight, 1, 1, GDT_Float32, 0, 0);
+            rasterIO(band, colMin, rowMax, 1, 1, &ulHeight, 1, 1, GDT_Float32, 0, 0);
+            rasterIO(band, colMax, rowMin, 1, 1, &lrHeight, 1, 1, GDT_Float32, 0, 0);
+            rasterIO(band, colMax, rowMax, 1, 1, &urHeight, 1, 1, GDT_Float32, 0, 0);
 
             /*
             if (!isValidValue(urHeight, band)) urHeight = 0.0f;
@@ -1996,7 +2328,10 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        if ( _index.valid() )
+            return createMosaicHeightField( key, progress );
+
+        OptionalGDALLock lock( !concurrentReads() );
 
         int tileSize = getPixelsPerTile();
 
@@ -2015,6 +2350,7 @@ public:
             if (band == NULL)
             {
                 // Just get first band
+                GDAL_SCOPED_LOCK;
                 band = _warpedDS->GetRasterBand(1);
             }
 
@@ -2034,9 +2370,9 @@ public:
                 int iNumRows = iRowMax - iRowMin + 1;
 
                 int iWinColMin = max(0, iColMin);
-                int iWinColMax = min(_warpedDS->GetRasterXSize()-1, iColMax);
+                int iWinColMax = min(_rasterXSize-1, iColMax);
                 int iWinRowMin = max(0, iRowMin);
-                int iWinRowMax = min(_warpedDS->GetRasterYSize()-1, iRowMax);
+                int iWinRowMax = min(_rasterYSize-1, iRowMax);
                 int iNumWinCols = iWinColMax - iWinColMin + 1;
                 int iNumWinRows = iWinRowMax - iWinRowMin + 1;
 
@@ -2050,7 +2386,7 @@ public:
                 int startOffset = iBufRowMin * tileSize + iBufColMin;
                 int lineSpace = tileSize * sizeof(float);
 
-                band->RasterIO(GF_Read, iWinColMin, iWinRowMin, iNumWinCols, iNumWinRows, &buffer[startOffset], iNumBufCols, iNumBufRows, GDT_Float32, 0, lineSpace);
+                rasterIO(band, iWinColMin, iWinRowMin, iNumWinCols, iNumWinRows, &buffer[startOffset], iNumBufCols, iNumBufRows, GDT_Float32, 0, lineSpace);
 
                 for (int r = 0, ir = tileSize - 1; r < tileSize; ++r, --ir)
                 {
@@ -2388,6 +2724,8 @@ private:
 
     GDALDataset* _srcDS;
     GDALDataset* _warpedDS;
+    int          _rasterXSize;
+    int          _rasterYSize;
     double       _geotransform[6];
     double       _invtransform[6];
 
@@ -2399,6 +2737,13 @@ private:
     osg::ref_ptr< CacheBin > _cacheBin;
     osg::ref_ptr< osgDB::Options > _dbOptions;
 
+    osg::ref_ptr< GDALBlockReader > _blockReader;
+
+    typedef LRUCache< std::string, osg::ref_ptr<GDALTileSource> > MosaicSourceCache;
+    osg::ref_ptr< TileIndex > _index;
+    MosaicSourceCache _mosaicSources;
+    bool _forceMaxDataLevel;
+
     unsigned int _maxDataLevel;
 };
 
@@ -24,6 +24,7 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/ImageDecoder>
 #include <osgDB/FileUtils>
 
 #include <sstream>
@@ -352,33 +353,27 @@ MBTilesTileSource::createImage(const TileKey&    key,
         const char* data = (const char*)sqlite3_column_blob( select, 0 );
         int dataLen = sqlite3_column_bytes( select, 0 );
 
-        std::string dataBuffer( data, dataLen );
-
         // decompress if necessary:
+        std::string decompressed;
         if ( _compressor.valid() )
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
+            std::istringstream inputStream( std::string(data, dataLen) );
+            if ( !_compressor->decompress(inputStream, decompressed) )
             {
                 OE_WARN << LC << "Decompression failed" << std::endl;
                 valid = false;
             }
             else
             {
-                dataBuffer = value;
+                data = decompressed.data();
+                dataLen = decompressed.size();
             }
         }
 
-        // decode the raw image data:
+        // decode the raw image data straight from memory:
         if ( valid )
         {
-            std::istringstream inputStream(dataBuffer);
-            osgDB::ReaderWriter::ReadResult rr = _rw->readImage( inputStream, _dbOptions.get() );
-            if (rr.validImage())
-            {
-                result = rr.takeImage();
-            }
+            result = ImageDecoder().decode( data, dataLen, _dbOptions.get(), _rw.get() ).release();
         }
     }
     else
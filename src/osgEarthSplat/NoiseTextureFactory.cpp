@@ -21,7 +21,9 @@
 #include <osgEarth/ImageUtils>
 #include <osgEarth/Random>
 #include <osgEarth/SimplexNoise>
+#include <OpenThreads/Thread>
 #include <osg/Texture2D>
+#include <vector>
 
 using namespace osgEarth;
 using namespace osgEarth::Splat;
@@ -63,15 +65,21 @@ NoiseTextureFactory::create(unsigned dim, unsigned chans) const
         float nmin = 10.0f;
         float nmax = -10.0f;
 
+        // generate the whole channel of simplex noise at once:
+        std::vector<double> values;
+        if ( k != 1 && k != 2 )
+        {
+            values.resize(dim*dim);
+            noise.getTiledValues(dim, dim, &values[0], (unsigned)osg::maximum(1, OpenThreads::GetNumberOfProcessors()));
+        }
+
         // write repeating noise to the image:
         ImageUtils::PixelReader read ( image );
         ImageUtils::PixelWriter write( image );
         for(int t=0; t<(int)dim; ++t)
         {
-            double rt = (double)t/(double)dim;
             for(int s=0; s<(int)dim; ++s)
             {
-                double rs = (double)s/(double)dim;
                 osg::Vec4f v = read(s, t);
                 double n;
 
@@ -81,7 +89,7 @@ NoiseTextureFactory::create(unsigned dim, unsigned chans) const
                 }
                 else
                 {
-                    n = noise.getTiledValue(rs, rt);
+                    n = values[t*dim + s];
                     n = osg::clampBetween(n, 0.0, 1.0);
                 }
 
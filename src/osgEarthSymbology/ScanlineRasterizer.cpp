@@ -0,0 +1,515 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2016 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthSymbology/ScanlineRasterizer>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/Notify>
+#include <OpenThreads/Thread>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+#define LC "[ScanlineRasterizer] "
+
+namespace
+{
+    // Number of image rows in each unit of parallel work
+    const int BAND_ROWS = 16;
+
+    enum Target
+    {
+        TARGET_COLOR,   // RGBA8, blended
+        TARGET_FLOAT,   // one float channel, thresholded
+        TARGET_BYTE     // one byte channel, thresholded
+    };
+
+    // Hands out bands of rows to the render threads.
+    struct BandQueue
+    {
+        BandQueue(int height) : _next(0), _height(height) { }
+
+        bool next(int& y0, int& y1)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_next >= _height)
+                return false;
+            y0 = _next;
+            y1 = std::min(_next + BAND_ROWS, _height);
+            _next = y1;
+            return true;
+        }
+
+        Threading::Mutex _mutex;
+        int _next, _height;
+    };
+}
+
+namespace osgEarth { namespace Symbology
+{
+    /**
+     * Rasterizes all the paths of a ScanlineRasterizer into one band of rows
+     * at a time. Each thread owns one of these, so the cell buffers are
+     * never shared.
+     */
+    class ScanlineBandRenderer
+    {
+    public:
+        ScanlineBandRenderer(const ScanlineRasterizer& ras, osg::Image* image, Target target) :
+            _ras(ras), _image(image), _target(target), _width(image->s()), _y0(0), _y1(0)
+        {
+            _rows.resize(BAND_ROWS);
+        }
+
+        void renderBand(int y0, int y1)
+        {
+            _y0 = y0;
+            _y1 = y1;
+
+            for (std::vector<ScanlineRasterizer::Path>::const_iterator path = _ras._paths.begin();
+                path != _ras._paths.end();
+                ++path)
+            {
+                if (path->ymax <= (float)_y0 || path->ymin >= (float)_y1 ||
+                    path->xmax <= 0.0f || path->xmin >= (float)_width)
+                {
+                    continue;
+                }
+
+                for (unsigned c = path->firstContour; c < path->endContour; ++c)
+                {
+                    const ScanlineRasterizer::Contour& contour = _ras._contours[c];
+                    const osg::Vec2f* prev = &_ras._points[contour.end - 1];
+                    for (unsigned p = contour.begin; p < contour.end; ++p)
+                    {
+                        const osg::Vec2f* curr = &_ras._points[p];
+                        addLine(prev->x(), prev->y(), curr->x(), curr->y());
+                        prev = curr;
+                    }
+                }
+
+                int r0 = std::max(_y0, (int)floor(path->ymin));
+                int r1 = std::min(_y1, (int)ceil(path->ymax));
+                for (int y = r0; y < r1; ++y)
+                {
+                    sweep(y, *path);
+                }
+            }
+        }
+
+    private:
+        struct Cell
+        {
+            Cell(int x_, float cover_, float area_) : x(x_), cover(cover_), area(area_) { }
+            bool operator < (const Cell& rhs) const { return x < rhs.x; }
+            int   x;
+            float cover;  // signed height of the edges crossing this cell
+            float area;   // portion of the cover lying right of the edges, within the cell
+        };
+        typedef std::vector<Cell> CellRow;
+
+        // Records a cell. Cells left of the image collapse into column -1,
+        // which only contributes cover; cells right of the image never
+        // affect a visible pixel.
+        inline void addCell(CellRow& row, int x, double cover, double area)
+        {
+            if (x >= _width)
+                return;
+            if (x < 0)
+                row.push_back(Cell(-1, (float)cover, 0.0f));
+            else
+                row.push_back(Cell(x, (float)cover, (float)area));
+        }
+
+        // Adds an edge, clipped to the current band.
+        void addLine(double x0, double y0, double x1, double y1)
+        {
+            if (y0 == y1)
+                return;
+
+            double dir = 1.0;
+            if (y0 > y1)
+            {
+                std::swap(x0, x1);
+                std::swap(y0, y1);
+                dir = -1.0;
+            }
+
+            double ylo = std::max(y0, (double)_y0);
+            double yhi = std::min(y1, (double)_y1);
+            if (ylo >= yhi)
+                return;
+
+            double dxdy = (x1 - x0) / (y1 - y0);
+            int rowStart = (int)floor(ylo);
+            int rowEnd = (int)ceil(yhi);
+
+            for (int r = rowStart; r < rowEnd; ++r)
+            {
+                double ya = std::max(ylo, (double)r);
+                double yb = std::min(yhi, (double)(r + 1));
+                if (ya >= yb)
+                    continue;
+
+                double xa = x0 + (ya - y0)*dxdy;
+                double xb = x0 + (yb - y0)*dxdy;
+                addRowSegment(_rows[r - _y0], xa, xb, (yb - ya)*dir);
+            }
+        }
+
+        // Distributes the cover of an edge segment lying within one row
+        // across the cells it passes through.
+        void addRowSegment(CellRow& row, double xa, double xb, double dy)
+        {
+            if (xa > xb)
+                std::swap(xa, xb);
+
+            int ca = (int)floor(xa);
+            int cb = (int)floor(xb);
+
+            if (ca == cb)
+            {
+                addCell(row, ca, dy, dy*(1.0 - ((xa + xb)*0.5 - ca)));
+                return;
+            }
+
+            double dydx = dy / (xb - xa);
+
+            // clip horizontally; anything left of the image is pure cover.
+            if (xb <= 0.0)
+            {
+                addCell(row, -1, dy, 0.0);
+                return;
+            }
+            if (xa >= (double)_width)
+            {
+                return;
+            }
+            if (xa < 0.0)
+            {
+                addCell(row, -1, -xa*dydx, 0.0);
+                xa = 0.0;
+                ca = 0;
+            }
+            if (xb > (double)_width)
+            {
+                xb = (double)_width;
+                cb = _width;
+            }
+            if (ca == cb)
+            {
+                double d = (xb - xa)*dydx;
+                addCell(row, ca, d, d*(1.0 - ((xa + xb)*0.5 - ca)));
+                return;
+            }
+
+            // first (partial) column
+            double xnext = (double)(ca + 1);
+            double d = (xnext - xa)*dydx;
+            addCell(row, ca, d, d*(1.0 - ((xa + xnext)*0.5 - ca)));
+
+            // whole columns
+            for (int c = ca + 1; c < cb; ++c)
+            {
+                addCell(row, c, dydx, dydx*0.5);
+            }
+
+            // last (partial) column
+            d = (xb - cb)*dydx;
+            if (d != 0.0)
+            {
+                addCell(row, cb, d, d*(1.0 - (xb - cb)*0.5));
+            }
+        }
+
+        // Converts accumulated coverage to an 8-bit alpha per the fill rule.
+        inline unsigned alpha(float acc) const
+        {
+            float v = fabs(acc);
+            if (_ras._fillRule == ScanlineRasterizer::FILL_EVEN_ODD)
+            {
+                v = fmod(v, 2.0f);
+                if (v > 1.0f)
+                    v = 2.0f - v;
+            }
+            int a = (int)(v * 256.0f);
+            return a > 255 ? 255u : a < 0 ? 0u : (unsigned)a;
+        }
+
+        // Writes a run of pixels that share the same coverage.
+        inline void emit(unsigned char* row, int x, int count, unsigned a, const ScanlineRasterizer::Path& path)
+        {
+            if (a == 0u || count <= 0)
+                return;
+
+            if (_target == TARGET_COLOR)
+            {
+                const osg::Vec4ub& c = path.color;
+                int blend = (int)_ras._gammaTable[a] * (int)c.a();
+                unsigned char* p = row + (x << 2);
+                for (int i = 0; i < count; ++i, p += 4)
+                {
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        int v = p[k];
+                        p[k] = (unsigned char)((((int)c[k] - v) * blend + (v << 16)) >> 16);
+                    }
+                }
+            }
+            else if (a > 127u)
+            {
+                if (_target == TARGET_FLOAT)
+                {
+                    float* p = ((float*)row) + x;
+                    for (int i = 0; i < count; ++i)
+                        p[i] = path.value;
+                }
+                else
+                {
+                    unsigned char* p = row + x;
+                    unsigned char value = (unsigned char)osg::clampBetween(path.value, 0.0f, 255.0f);
+                    for (int i = 0; i < count; ++i)
+                        p[i] = value;
+                }
+            }
+        }
+
+        // Sweeps the cells of one row left to right, writing pixels.
+        void sweep(int y, const ScanlineRasterizer::Path& path)
+        {
+            CellRow& cells = _rows[y - _y0];
+            if (cells.empty())
+                return;
+
+            std::sort(cells.begin(), cells.end());
+
+            unsigned char* row = _image->data(0, y);
+            float acc = 0.0f;
+            unsigned i = 0;
+            const unsigned n = cells.size();
+
+            while (i < n)
+            {
+                int x = cells[i].x;
+                float cover = 0.0f, area = 0.0f;
+                for (; i < n && cells[i].x == x; ++i)
+                {
+                    cover += cells[i].cover;
+                    area += cells[i].area;
+                }
+
+                // the cell's own pixel is partially covered by its edges:
+                if (x >= 0)
+                    emit(row, x, 1, alpha(acc + area), path);
+
+                acc += cover;
+
+                // pixels between this cell and the next share the running cover:
+                int start = std::max(x + 1, 0);
+                int end = i < n ? cells[i].x : _width;
+                emit(row, start, end - start, alpha(acc), path);
+            }
+
+            cells.clear();
+        }
+
+        const ScanlineRasterizer& _ras;
+        osg::Image* _image;
+        Target _target;
+        int _width;
+        int _y0, _y1;
+        std::vector<CellRow> _rows;
+    };
+} }
+
+namespace
+{
+    // Pulls bands from the queue until it runs dry.
+    struct BandThread : public Threading::Thread
+    {
+        BandThread(const ScanlineRasterizer& ras, osg::Image* image, Target target, BandQueue& queue) :
+            _renderer(ras, image, target), _queue(queue) { }
+
+        void run()
+        {
+            int y0, y1;
+            while (_queue.next(y0, y1))
+                _renderer.renderBand(y0, y1);
+        }
+
+        ScanlineBandRenderer _renderer;
+        BandQueue& _queue;
+    };
+}
+
+//........................................................................
+
+ScanlineRasterizer::ScanlineRasterizer() :
+_fillRule  ( FILL_EVEN_ODD ),
+_numThreads( 0u ),
+_xmin      ( 0.0 ),
+_ymin      ( 0.0 ),
+_xscale    ( 1.0 ),
+_yscale    ( 1.0 )
+{
+    setGamma(1.0);
+}
+
+void
+ScanlineRasterizer::setGamma(double value)
+{
+    _gamma = value;
+    for (unsigned i = 0; i < 256; ++i)
+    {
+        _gammaTable[i] = (unsigned char)(pow(double(i) / 255.0, _gamma) * 255.0);
+    }
+}
+
+void
+ScanlineRasterizer::setTransform(double xmin, double ymin, double xscale, double yscale)
+{
+    _xmin = xmin;
+    _ymin = ymin;
+    _xscale = xscale;
+    _yscale = yscale;
+}
+
+void
+ScanlineRasterizer::add(const Geometry* geom, const osg::Vec4ub& color)
+{
+    addPath(geom, color, 0.0f);
+}
+
+void
+ScanlineRasterizer::add(const Geometry* geom, float value)
+{
+    addPath(geom, osg::Vec4ub(0, 0, 0, 0), value);
+}
+
+void
+ScanlineRasterizer::addPath(const Geometry* geom, const osg::Vec4ub& color, float value)
+{
+    if (!geom)
+        return;
+
+    Path path;
+    path.firstContour = _contours.size();
+    path.xmin = path.ymin = FLT_MAX;
+    path.xmax = path.ymax = -FLT_MAX;
+    path.color = color;
+    path.value = value;
+
+    ConstGeometryIterator gi(geom);
+    while (gi.hasMore())
+    {
+        const Geometry* part = gi.next();
+        if (part->size() < 2)
+            continue;
+
+        Contour contour;
+        contour.begin = _points.size();
+
+        for (Geometry::const_iterator p = part->begin(); p != part->end(); ++p)
+        {
+            osg::Vec2f pixel(
+                (float)(_xscale*(p->x() - _xmin)),
+                (float)(_yscale*(p->y() - _ymin)));
+
+            path.xmin = std::min(path.xmin, pixel.x());
+            path.ymin = std::min(path.ymin, pixel.y());
+            path.xmax = std::max(path.xmax, pixel.x());
+            path.ymax = std::max(path.ymax, pixel.y());
+
+            _points.push_back(pixel);
+        }
+
+        contour.end = _points.size();
+        _contours.push_back(contour);
+    }
+
+    path.endContour = _contours.size();
+
+    if (path.endContour > path.firstContour)
+        _paths.push_back(path);
+}
+
+void
+ScanlineRasterizer::clear()
+{
+    _paths.clear();
+    _contours.clear();
+    _points.clear();
+}
+
+bool
+ScanlineRasterizer::render(osg::Image* image) const
+{
+    if (!image || !image->data() || image->s() <= 0 || image->t() <= 0)
+        return false;
+
+    Target target;
+    unsigned numComponents = osg::Image::computeNumComponents(image->getPixelFormat());
+
+    if (image->getPixelFormat() == GL_RGBA && image->getDataType() == GL_UNSIGNED_BYTE)
+        target = TARGET_COLOR;
+    else if (numComponents == 1 && image->getDataType() == GL_FLOAT)
+        target = TARGET_FLOAT;
+    else if (numComponents == 1 && image->getDataType() == GL_UNSIGNED_BYTE)
+        target = TARGET_BYTE;
+    else
+    {
+        OE_WARN << LC << "Unsupported image format" << std::endl;
+        return false;
+    }
+
+    if (_paths.empty())
+        return true;
+
+    BandQueue queue(image->t());
+    int numBands = (image->t() + BAND_ROWS - 1) / BAND_ROWS;
+
+    unsigned numThreads = _numThreads > 0u ? _numThreads : (unsigned)osg::maximum(1, OpenThreads::GetNumberOfProcessors());
+    numThreads = std::min(numThreads, (unsigned)numBands);
+
+    if (numThreads <= 1u)
+    {
+        ScanlineBandRenderer renderer(*this, image, target);
+        int y0, y1;
+        while (queue.next(y0, y1))
+            renderer.renderBand(y0, y1);
+        return true;
+    }
+
+    std::vector<BandThread*> threads;
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        BandThread* thread = new BandThread(*this, image, target, queue);
+        thread->start();
+        threads.push_back(thread);
+    }
+
+    for (unsigned i = 0; i < threads.size(); ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    return true;
+}
@@ -20,9 +20,24 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarthUtil/DataScanner>
+#include <osgEarthUtil/TileIndex>
 #include <osgEarthDrivers/gdal/GDALOptions>
+#include <osgEarth/FileUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <OpenThreads/Thread>
+#include <gdal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
 
 #define LC "[DataScanner] "
 
@@ -32,9 +47,14 @@ using namespace osgEarth::Drivers;
 
 namespace
 {
+    const int MANIFEST_VERSION = 1;
+
+    // Number of files each probe task handles
+    const unsigned FILES_PER_TASK = 16u;
+
     void traverse(const std::string&              path,
                   const std::vector<std::string>& extensions,
-                  ImageLayerVector&               out_imageLayers)
+                  std::vector<std::string>&       out_files)
     {
         if ( osgDB::fileType(path) == osgDB::DIRECTORY )
         {
@@ -45,7 +65,7 @@ namespace
                     continue;
 
                 std::string filepath = osgDB::concatPaths( path, *f );
-                traverse( filepath, extensions, out_imageLayers );
+                traverse( filepath, extensions, out_files );
             }
         }
 
@@ -55,26 +75,434 @@ namespace
 
             if ( std::find(extensions.begin(), extensions.end(), ext) != extensions.end() )
             {
-                GDALOptions gdal;
-                gdal.url() = path;
-                //gdal.interpolation() = INTERP_NEAREST;
+                out_files.push_back( path );
+            }
+        }
+    }
+
+    ImageLayer* createImageLayer(const std::string& path)
+    {
+        GDALOptions gdal;
+        gdal.url() = path;
+        //gdal.interpolation() = INTERP_NEAREST;
+
+        ImageLayerOptions options( path, gdal );
+        options.cachePolicy() = CachePolicy::NO_CACHE;
+
+        return new ImageLayer(options);
+    }
+
+    bool getFileStats(const std::string& path, TimeStamp& modified, double& size)
+    {
+#if defined(WIN32) && !defined(__CYGWIN__)
+        struct _stati64 buf;
+        if ( ::_stati64(path.c_str(), &buf) != 0 )
+            return false;
+#else
+        struct stat buf;
+        if ( ::stat(path.c_str(), &buf) != 0 )
+            return false;
+#endif
+        modified = buf.st_mtime;
+        size = (double)buf.st_size;
+        return true;
+    }
+
+    // Reads the footprint, SRS, resolution and NODATA value of a raster.
+    // Every probe opens its own dataset, which GDAL supports from several
+    // threads at once, so this does not take the global GDAL mutex.
+    void probe(DataScanner::Entry& entry)
+    {
+        entry._valid = false;
+
+        GDALDatasetH ds = GDALOpen( entry._path.c_str(), GA_ReadOnly );
+        if ( !ds )
+            return;
+
+        std::string wkt;
+        double gt[6];
+        int width = GDALGetRasterXSize( ds );
+        int height = GDALGetRasterYSize( ds );
+        bool ok =
+            GDALGetRasterCount( ds ) > 0 &&
+            GDALGetGeoTransform( ds, gt ) == CE_None &&
+            width > 0 && height > 0;
 
-                ImageLayerOptions options( path, gdal );
-                options.cachePolicy() = CachePolicy::NO_CACHE;
+        if ( ok )
+        {
+            const char* proj = GDALGetProjectionRef( ds );
+            if ( proj )
+                wkt = proj;
+
+            int success = 0;
+            double value = GDALGetRasterNoDataValue( GDALGetRasterBand(ds, 1), &success );
+            if ( success )
+                entry._noData = value;
+        }
+
+        GDALClose( ds );
+
+        if ( !ok || wkt.empty() )
+            return;
+
+        // corners of the raster, allowing for a rotated geotransform
+        double xmin = DBL_MAX, ymin = DBL_MAX, xmax = -DBL_MAX, ymax = -DBL_MAX;
+        for(int c = 0; c < 4; ++c)
+        {
+            double px = (c & 1) ? width : 0.0, py = (c & 2) ? height : 0.0;
+            double x = gt[0] + px*gt[1] + py*gt[2];
+            double y = gt[3] + px*gt[4] + py*gt[5];
+            xmin = std::min(xmin, x), xmax = std::max(xmax, x);
+            ymin = std::min(ymin, y), ymax = std::max(ymax, y);
+        }
+
+        osg::ref_ptr<const SpatialReference> srs = SpatialReference::create( wkt );
+        if ( !srs.valid() )
+            return;
 
-                ImageLayer* layer = new ImageLayer(options);
-                out_imageLayers.push_back( layer );
-                OE_INFO << LC << "Found " << path << std::endl;
+        entry._extent = GeoExtent( srs.get(), xmin, ymin, xmax, ymax );
+        entry._resolution = sqrt(gt[1]*gt[1] + gt[4]*gt[4]);
+        entry._valid = entry._extent.isValid() && entry._resolution > 0.0;
+    }
+
+    // Progress shared by the probe tasks of a scan.
+    struct ScanState
+    {
+        ScanState(unsigned total, ProgressCallback* progress) :
+            _total(total), _done(0u), _probed(0u), _added(0u), _reused(0u), _progress(progress) { }
+
+        bool isCanceled() const
+        {
+            return _progress && _progress->isCanceled();
+        }
+
+        void report(unsigned count, unsigned probed, unsigned added, unsigned reused)
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            _done += count;
+            _probed += probed;
+            _added += added;
+            _reused += reused;
+            if ( _progress )
+            {
+                std::stringstream buf;
+                buf << "Scanned " << _done << " of " << _total << " files";
+                _progress->reportProgress( (double)_done, (double)_total, buf.str() );
             }
         }
+
+        unsigned          _total;
+        unsigned          _done;
+        unsigned          _probed;
+        unsigned          _added;  // probes that succeeded
+        unsigned          _reused;
+        ProgressCallback* _progress;
+        Threading::Mutex  _mutex;
+    };
+
+    typedef std::map<std::string, DataScanner::Entry> EntryMap;
+
+    // Stats a range of files, reusing their manifest entries when they have
+    // not changed and probing them otherwise.
+    struct ProbeTask : public TaskRequest
+    {
+        ProbeTask(std::vector<DataScanner::Entry>& entries, unsigned begin, unsigned end,
+                  const EntryMap& cached, ScanState& state, MultiEvent& done) :
+            _entries(entries), _begin(begin), _end(end), _cached(cached), _state(state), _done(done) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            unsigned probed = 0u, added = 0u, reused = 0u;
+            if ( !_state.isCanceled() )
+            {
+                for(unsigned i = _begin; i < _end; ++i)
+                {
+                    DataScanner::Entry& entry = _entries[i];
+                    if ( !getFileStats(entry._path, entry._modified, entry._size) )
+                        continue;
+
+                    EntryMap::const_iterator c = _cached.find( entry._path );
+                    if ( c != _cached.end() && c->second._modified == entry._modified && c->second._size == entry._size )
+                    {
+                        entry = c->second;
+                        ++reused;
+                    }
+                    else
+                    {
+                        probe( entry );
+                        ++probed;
+                        if ( entry._valid )
+                            ++added;
+                    }
+                }
+            }
+            _state.report( _end - _begin, probed, added, reused );
+            _done.set();
+        }
+
+        std::vector<DataScanner::Entry>& _entries;
+        unsigned                         _begin, _end;
+        const EntryMap&                  _cached;
+        ScanState&                       _state;
+        MultiEvent&                      _done;
+    };
+
+    // Whether a scan of "root" for the extensions would find "path" if the
+    // file exists.
+    bool isInScope(const std::string&              path,
+                   const std::string&              root,
+                   const std::vector<std::string>& extensions)
+    {
+        const std::string ext = osgDB::getLowerCaseFileExtension(path);
+        if ( std::find(extensions.begin(), extensions.end(), ext) == extensions.end() )
+            return false;
+
+        // traverse() builds paths with concatPaths, so match its separator.
+        const std::string prefix = osgDB::concatPaths( root, "" );
+        return path == root || path.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    void readManifest(const std::string& filename, EntryMap& out_entries)
+    {
+        std::ifstream in( filename.c_str() );
+        if ( !in.is_open() )
+            return;
+
+        std::stringstream buf;
+        buf << in.rdbuf();
+
+        Config conf;
+        if ( !conf.fromJSON(buf.str()) )
+        {
+            OE_WARN << LC << "Failed to read manifest " << filename << std::endl;
+            return;
+        }
+
+        if ( conf.key() != "manifest" )
+            conf = conf.child("manifest");
+
+        if ( conf.value<int>("version", 0) != MANIFEST_VERSION )
+            return;
+
+        const ConfigSet files = conf.child("files").children("file");
+        for(ConfigSet::const_iterator i = files.begin(); i != files.end(); ++i)
+        {
+            DataScanner::Entry entry;
+            entry._path       = i->value("path");
+            entry._modified   = (TimeStamp)i->value<double>("modified", 0.0);
+            entry._size       = i->value<double>("size", 0.0);
+            entry._valid      = i->value<bool>("valid", false);
+            entry._resolution = i->value<double>("resolution", 0.0);
+            i->getIfSet("nodata", entry._noData);
+
+            // older manifests recorded failures; probe those files again.
+            if ( !entry._valid )
+                continue;
+
+            osg::ref_ptr<const SpatialReference> srs = SpatialReference::create( i->value("srs") );
+            if ( !srs.valid() )
+                continue;
+
+            entry._extent = GeoExtent(
+                srs.get(),
+                i->value<double>("xmin", 0.0), i->value<double>("ymin", 0.0),
+                i->value<double>("xmax", 0.0), i->value<double>("ymax", 0.0) );
+
+            out_entries[entry._path] = entry;
+        }
+    }
+
+    bool writeManifest(const std::string& filename, const std::vector<DataScanner::Entry>& entries)
+    {
+        Config files("files");
+        for(std::vector<DataScanner::Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+        {
+            // files that vanished or went unprobed are left out, and so are
+            // failures, which may succeed later (e.g. once a sidecar appears).
+            if ( i->_modified == 0 || !i->_valid )
+                continue;
+
+            Config file("file");
+            file.set("path",       i->_path);
+            file.set("modified",   (double)i->_modified);
+            file.set("size",       i->_size);
+            file.set("valid",      i->_valid);
+            file.set("srs",        i->_extent.getSRS()->getHorizInitString());
+            file.set("xmin",       i->_extent.xMin());
+            file.set("ymin",       i->_extent.yMin());
+            file.set("xmax",       i->_extent.xMax());
+            file.set("ymax",       i->_extent.yMax());
+            file.set("resolution", i->_resolution);
+            file.set("nodata",     i->_noData);
+            files.add( file );
+        }
+
+        Config conf("manifest");
+        conf.set("version", MANIFEST_VERSION);
+        conf.add( files );
+
+        osgEarth::makeDirectoryForFile( filename );
+        std::ofstream out( filename.c_str() );
+        if ( !out.is_open() )
+            return false;
+
+        out << conf.toJSON(true);
+        return !out.fail();
     }
 }
 
+DataScanner::DataScanner() :
+_numThreads( (unsigned)std::max(1, OpenThreads::GetNumberOfProcessors()) )
+{
+    //nop
+}
 
 void
 DataScanner::findImageLayers(const std::string&              absRootPath,
                              const std::vector<std::string>& extensions,
                              ImageLayerVector&               out_imageLayers) const
 {
-    traverse( absRootPath, extensions, out_imageLayers );
+    std::vector<std::string> files;
+    traverse( absRootPath, extensions, files );
+
+    for(std::vector<std::string>::const_iterator f = files.begin(); f != files.end(); ++f)
+    {
+        out_imageLayers.push_back( createImageLayer(*f) );
+        OE_INFO << LC << "Found " << *f << std::endl;
+    }
+}
+
+bool
+DataScanner::scan(const std::string&              absRootPath,
+                  const std::vector<std::string>& extensions,
+                  std::vector<Entry>&             out_entries) const
+{
+    // probes call GDAL directly, so make sure its drivers are registered.
+    osgEarth::Registry::instance();
+
+    std::vector<std::string> files;
+    traverse( absRootPath, extensions, files );
+    std::sort( files.begin(), files.end() );
+
+    EntryMap cached;
+    if ( !_manifest.empty() )
+        readManifest( _manifest, cached );
+
+    std::vector<Entry> entries( files.size() );
+    for(unsigned i = 0; i < files.size(); ++i)
+        entries[i]._path = files[i];
+
+    ScanState state( entries.size(), _progress.get() );
+    if ( !entries.empty() )
+    {
+        unsigned numTasks = (entries.size() + FILES_PER_TASK - 1) / FILES_PER_TASK;
+        MultiEvent done( numTasks );
+        {
+            osg::ref_ptr<TaskService> service = new TaskService( "DataScanner", std::max(_numThreads, 1u) );
+            for(unsigned t = 0; t < numTasks; ++t)
+            {
+                unsigned begin = t * FILES_PER_TASK;
+                unsigned end = std::min(begin + FILES_PER_TASK, (unsigned)entries.size());
+                service->add( new ProbeTask(entries, begin, end, cached, state, done) );
+            }
+            done.wait();
+        }
+    }
+
+    bool canceled = state.isCanceled();
+
+    OE_INFO << LC << "Scanned " << entries.size() << " files under " << absRootPath
+        << "; probed " << state._probed << ", " << (entries.size() - state._probed) << " from the manifest"
+        << (canceled ? " (canceled)" : "") << std::endl;
+
+    if ( !_manifest.empty() )
+    {
+        std::vector<Entry> manifest( entries );
+
+        // Keep the entries of files outside this scan. The other entries
+        // are either reused, or their files changed or are gone.
+        unsigned numCachedInScope = 0u;
+        for(EntryMap::const_iterator c = cached.begin(); c != cached.end(); ++c)
+        {
+            if ( !isInScope(c->first, absRootPath, extensions) )
+                manifest.push_back( c->second );
+            else
+                ++numCachedInScope;
+        }
+
+        // a canceled scan forgets nothing about the files it skipped.
+        if ( canceled )
+        {
+            for(unsigned i = 0; i < files.size(); ++i)
+            {
+                EntryMap::const_iterator c = cached.find( files[i] );
+                if ( manifest[i]._modified == 0 && c != cached.end() )
+                    manifest[i] = c->second;
+            }
+        }
+
+        if ( state._added > 0u || state._reused != numCachedInScope )
+        {
+            if ( !writeManifest(_manifest, manifest) )
+                OE_WARN << LC << "Failed to write manifest " << _manifest << std::endl;
+        }
+    }
+
+    for(std::vector<Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        if ( i->_valid )
+            out_entries.push_back( *i );
+    }
+
+    return !canceled;
+}
+
+void
+DataScanner::createImageLayers(const std::vector<Entry>& entries,
+                               ImageLayerVector&         out_imageLayers)
+{
+    for(std::vector<Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        if ( i->_valid )
+            out_imageLayers.push_back( createImageLayer(i->_path) );
+    }
+}
+
+bool
+DataScanner::writeTileIndex(const std::vector<Entry>& entries,
+                            const std::string&        indexFilename,
+                            const SpatialReference*   srs)
+{
+    if ( !TileIndex::isPackedFilename(indexFilename) )
+    {
+        OE_WARN << LC << "Can only write a packed (.oeidx) index" << std::endl;
+        return false;
+    }
+
+    osg::ref_ptr<const SpatialReference> indexSRS = srs ? srs : SpatialReference::create("wgs84");
+
+    std::string indexDir = osgDB::getFilePath( indexFilename );
+
+    std::vector<TileIndex::Entry> indexEntries;
+    indexEntries.reserve( entries.size() );
+    for(std::vector<Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        if ( !i->_valid )
+            continue;
+
+        TileIndex::Entry entry;
+        entry._location = osgDB::getPathRelative( indexDir, i->_path );
+        entry._extent   = i->_extent.transform( indexSRS.get() );
+        if ( !entry._extent.isValid() )
+            continue;
+
+        // pixel size in the units of the index SRS
+        if ( i->_extent.width() > 0.0 )
+            entry._resolution = i->_resolution * entry._extent.width() / i->_extent.width();
+
+        entry._noData = i->_noData;
+        indexEntries.push_back( entry );
+    }
+
+    return TileIndex::writePacked( indexFilename, indexSRS.get(), indexEntries );
 }
@@ -193,6 +193,27 @@ namespace
 
     typedef std::vector<Widths> WidthsList;
     
+    // A flattening polygon along with data we only want to compute once per tile.
+    struct PolygonRecord
+    {
+        PolygonRecord(const Polygon* p, double bw) :
+            polygon(p), bounds(p->getBounds()), bufferWidth(bw), hasElevInternal(false) { }
+
+        const Polygon* polygon;
+        Bounds bounds;
+        double bufferWidth;
+        bool hasElevInternal;
+        float elevInternal;
+    };
+
+    // squared distance from P to the (2D) bounds; zero if P is inside.
+    double inline getDistanceSquaredToBounds(const POINT& P, const Bounds& b)
+    {
+        double dx = std::max(std::max(b.xMin() - P.x(), 0.0), P.x() - b.xMax());
+        double dy = std::max(std::max(b.yMin() - P.y(), 0.0), P.y() - b.yMax());
+        return dx*dx + dy*dy;
+    }
+    
     // Creates a heightfield that flattens an area intersecting the input polygon geometry.
     // The height of the area is found by sampling a point internal to the polygon.
     // bufferWidth = width of transition from flat area to natural terrain.
@@ -210,6 +231,20 @@ namespace
         POINT Pex, P, internalP;
 
         bool needsTransform = ex.getSRS() != geomSRS;
+
+        // Collect the polygons up front so we can reuse their bounds and internal elevations.
+        std::vector<PolygonRecord> polygons;
+        for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+        {
+            Geometry* component = geom->getComponents()[geomIndex];
+            ConstGeometryIterator giter(component, false);
+            while (giter.hasMore())
+            {
+                const Polygon* polygon = dynamic_cast<const Polygon*>(giter.next());
+                if (polygon)
+                    polygons.push_back(PolygonRecord(polygon, widths[geomIndex].bufferWidth));
+            }
+        }
         
         for (unsigned col = 0; col < hf->getNumColumns(); ++col)
         {
@@ -228,53 +263,53 @@ namespace
                 else
                     P = Pex;
                 
-                bool done = false;
                 double minD2 = DBL_MAX;//bufferWidth * bufferWidth; // minimum distance(squared) to closest polygon edge
                 double bufferWidth = 0.0;
 
-                const Polygon* bestPoly = 0L;
+                PolygonRecord* best = 0L;
 
-                for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+                for (unsigned i = 0; i < polygons.size(); ++i)
                 {
-                    Geometry* component = geom->getComponents()[geomIndex];
-                    Widths width = widths[geomIndex];
-                    ConstGeometryIterator giter(component, false);
-                    while (giter.hasMore() && !done)
+                    PolygonRecord& record = polygons[i];
+
+                    // No polygon edge can be closer than the polygon's bounds.
+                    double boundsD2 = getDistanceSquaredToBounds(P, record.bounds);
+
+                    // Does the point P fall within the polygon?
+                    if (boundsD2 == 0.0 && record.polygon->contains2D(P.x(), P.y()))
+                    {
+                        // yes, flatten it to the polygon's centroid elevation;
+                        // and we're dont with this point.
+                        best = &record;
+                        minD2 = -1.0;
+                        bufferWidth = record.bufferWidth;
+                        break;
+                    }
+
+                    // If not in the polygon, how far to the closest edge?
+                    else if (boundsD2 < minD2)
                     {
-                        const Polygon* polygon = dynamic_cast<const Polygon*>(giter.next());
-                        if (polygon)
+                        double D2 = getDistanceSquaredToClosestEdge(P, record.polygon);
+                        if (D2 < minD2)
                         {
-                            // Does the point P fall within the polygon?
-                            if (polygon->contains2D(P.x(), P.y()))
-                            {
-                                // yes, flatten it to the polygon's centroid elevation;
-                                // and we're dont with this point.
-                                done = true;
-                                bestPoly = polygon;
-                                minD2 = -1.0;
-                                bufferWidth = width.bufferWidth;
-                            }
-
-                            // If not in the polygon, how far to the closest edge?
-                            else
-                            {
-                                double D2 = getDistanceSquaredToClosestEdge(P, polygon);
-                                if (D2 < minD2)
-                                {
-                                    minD2 = D2;
-                                    bestPoly = polygon;
-                                    bufferWidth = width.bufferWidth;
-                                }
-                            }
-                        }                    
+                            minD2 = D2;
+                            best = &record;
+                            bufferWidth = record.bufferWidth;
+                        }
                     }
                 }
 
-                if (bestPoly && minD2 != 0.0)
+                if (best && minD2 != 0.0)
                 {
                     float h;
-                    POINT internalP = getInternalPoint(bestPoly);
-                    float elevInternal = envelope->getElevation(internalP.x(), internalP.y());
+
+                    if (!best->hasElevInternal)
+                    {
+                        POINT internalP = getInternalPoint(best->polygon);
+                        best->elevInternal = envelope->getElevation(internalP.x(), internalP.y());
+                        best->hasElevInternal = true;
+                    }
+                    float elevInternal = best->elevInternal;
 
                     if (minD2 < 0.0)
                     {
@@ -376,6 +411,69 @@ namespace
         return samples.size() > 0 ? (numer / (double)(samples.size())) : FLT_MAX;
     }
 
+    // A line segment to flatten along, with the radii of the feature it came from.
+    struct SegmentRecord
+    {
+        SegmentRecord(const osg::Vec3d& a, const osg::Vec3d& b, double inner, double outer) :
+            A(a), B(b), innerRadius(inner), outerRadius(outer) { }
+
+        osg::Vec3d A, B;
+        double innerRadius;
+        double outerRadius;
+    };
+    typedef std::vector<SegmentRecord> SegmentRecords;
+
+    // Uniform grid over a tile's sample points. Each cell lists (in ascending order)
+    // the segments whose flattening radius overlaps the cell.
+    class SegmentGrid
+    {
+    public:
+        typedef std::vector<unsigned> Cell;
+
+        SegmentGrid(const osg::Vec2d& min, const osg::Vec2d& max, unsigned dim) :
+            _min(min), _max(max), _dim(std::max(dim, 1u))
+        {
+            _cellWidth = std::max((max.x() - min.x()) / (double)_dim, 1e-9);
+            _cellHeight = std::max((max.y() - min.y()) / (double)_dim, 1e-9);
+            _cells.resize(_dim * _dim);
+        }
+
+        void insert(unsigned index, const SegmentRecord& s)
+        {
+            double xmin = std::min(s.A.x(), s.B.x()) - s.outerRadius;
+            double xmax = std::max(s.A.x(), s.B.x()) + s.outerRadius;
+            double ymin = std::min(s.A.y(), s.B.y()) - s.outerRadius;
+            double ymax = std::max(s.A.y(), s.B.y()) + s.outerRadius;
+
+            if (xmax < _min.x() || xmin > _max.x() || ymax < _min.y() || ymin > _max.y())
+                return;
+
+            unsigned c0 = col(xmin), c1 = col(xmax);
+            unsigned r0 = row(ymin), r1 = row(ymax);
+            for (unsigned r = r0; r <= r1; ++r)
+                for (unsigned c = c0; c <= c1; ++c)
+                    _cells[r*_dim + c].push_back(index);
+        }
+
+        const Cell& getCell(double x, double y) const
+        {
+            return _cells[row(y)*_dim + col(x)];
+        }
+
+    private:
+        unsigned col(double x) const {
+            return (unsigned)clamp(floor((x - _min.x()) / _cellWidth), 0.0, (double)(_dim-1));
+        }
+        unsigned row(double y) const {
+            return (unsigned)clamp(floor((y - _min.y()) / _cellHeight), 0.0, (double)(_dim-1));
+        }
+
+        osg::Vec2d _min, _max;
+        unsigned _dim;
+        double _cellWidth, _cellHeight;
+        std::vector<Cell> _cells;
+    };
+
     /**
      * Create a heightfield that flattens the terrain around linear geometry.
      * lineWidth = width of completely flat area
@@ -399,31 +497,78 @@ namespace
 
         const GeoExtent& ex = key.getExtent();
 
-        double col_interval = ex.width() / (double)(hf->getNumColumns()-1);
-        double row_interval = ex.height() / (double)(hf->getNumRows()-1);
+        const unsigned numCols = hf->getNumColumns();
+        const unsigned numRows = hf->getNumRows();
+
+        double col_interval = ex.width() / (double)(numCols-1);
+        double row_interval = ex.height() / (double)(numRows-1);
 
         osg::Vec3d Pex, P, PROJ;
 
         bool needsTransform = ex.getSRS() != geomSRS;
-        
-        // Loop over the new heightfield.
-        for (unsigned col = 0; col < hf->getNumColumns(); ++col)
+
+        // Move all the sample points into the working SRS, and find their bounds.
+        std::vector<osg::Vec3d> points(numCols*numRows);
+        osg::Vec2d pointsMin(DBL_MAX, DBL_MAX), pointsMax(-DBL_MAX, -DBL_MAX);
+
+        for (unsigned col = 0; col < numCols; ++col)
         {
             Pex.x() = ex.xMin() + (double)col * col_interval;
 
-            for (unsigned row = 0; row < hf->getNumRows(); ++row)
+            for (unsigned row = 0; row < numRows; ++row)
             {
-                // check for cancelation periodically
-                //if (progress && progress->isCanceled())
-                //    return false;
-
                 Pex.y() = ex.yMin() + (double)row * row_interval;
 
-                // Move the point into the working SRS if necessary
+                osg::Vec3d& point = points[row*numCols + col];
                 if (needsTransform)
-                    ex.getSRS()->transform(Pex, geomSRS, P);
+                    ex.getSRS()->transform(Pex, geomSRS, point);
                 else
-                    P = Pex;
+                    point = Pex;
+
+                pointsMin.x() = std::min(pointsMin.x(), point.x());
+                pointsMin.y() = std::min(pointsMin.y(), point.y());
+                pointsMax.x() = std::max(pointsMax.x(), point.x());
+                pointsMax.y() = std::max(pointsMax.y(), point.y());
+            }
+        }
+
+        // Break all the geometry into segments and bin them into a grid over the
+        // sample points, so each sample only measures the segments near it.
+        SegmentRecords segments;
+        for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+        {
+            const Widths& w = widths[geomIndex];
+            double innerRadius = w.lineWidth * 0.5;
+            double outerRadius = innerRadius + w.bufferWidth;
+
+            Geometry* component = geom->getComponents()[geomIndex];
+            ConstGeometryIterator giter(component);
+            while (giter.hasMore())
+            {
+                const Geometry* part = giter.next();
+                for (unsigned i = 0; i+1 < part->size(); ++i)
+                {
+                    segments.push_back(SegmentRecord((*part)[i], (*part)[i+1], innerRadius, outerRadius));
+                }
+            }
+        }
+
+        SegmentGrid grid(pointsMin, pointsMax, 32u);
+        for (unsigned i = 0; i < segments.size(); ++i)
+        {
+            grid.insert(i, segments[i]);
+        }
+        
+        // Loop over the new heightfield.
+        for (unsigned col = 0; col < numCols; ++col)
+        {
+            for (unsigned row = 0; row < numRows; ++row)
+            {
+                // check for cancelation periodically
+                //if (progress && progress->isCanceled())
+                //    return false;
+
+                P = points[row*numCols + col];
 
                 // For each point, we need to find the closest line segments to that point
                 // because the elevation values on these line segments will be the flattening
@@ -432,90 +577,82 @@ namespace
                 static const unsigned Maxsamples = 4;
                 Samples samples;
 
-                for (unsigned int geomIndex = 0; geomIndex < geom->getNumComponents(); geomIndex++)
+                // Only the segments binned into this point's grid cell can be in range.
+                const SegmentGrid::Cell& candidates = grid.getCell(P.x(), P.y());
+
+                for (SegmentGrid::Cell::const_iterator c = candidates.begin(); c != candidates.end(); ++c)
                 {
-                    Widths w = widths[geomIndex];
-                    double innerRadius = w.lineWidth * 0.5;
-                    double outerRadius = innerRadius + w.bufferWidth;
+                    const SegmentRecord& segment = segments[*c];
+
+                    // AB is a candidate line segment:
+                    const osg::Vec3d& A = segment.A;
+                    const osg::Vec3d& B = segment.B;
+                    double innerRadius = segment.innerRadius;
+                    double outerRadius = segment.outerRadius;
                     double outerRadius2 = outerRadius * outerRadius;
 
-                    Geometry* component = geom->getComponents()[geomIndex];
-                    // Search for line segments.
-                    ConstGeometryIterator giter(component);
-                    while (giter.hasMore())
+                    osg::Vec3d AB = B - A;    // current segment AB
+
+                    double t;                 // parameter [0..1] on segment AB
+                    double D2;                // shortest distance from point P to segment AB, squared
+                    double L2 = AB.length2(); // length (squared) of segment AB
+                    osg::Vec3d AP = P - A;    // vector from endpoint A to point P
+
+                    if (L2 == 0.0)
+                    {
+                        // trivial case: zero-length segment
+                        t = 0.0;
+                        D2 = AP.length2();
+                    }
+                    else
                     {
-                        const Geometry* part = giter.next();                        
+                        // Calculate parameter "t" [0..1] which will yield the closest point on AB to P.
+                        // Clamping it means the closest point won't be beyond the endpoints of the segment.
+                        t = clamp((AP * AB)/L2, 0.0, 1.0);
+
+                        // project our point P onto segment AB:
+                        PROJ.set( A + AB*t );
+
+                        // measure the distance (squared) from P to the projected point on AB:
+                        D2 = (P - PROJ).length2();
+                    }
 
-                        for (int i = 0; i < part->size()-1; ++i)
+                    // If the distance from our point to the line segment falls within
+                    // the maximum flattening distance, store it.
+                    if (D2 <= outerRadius2)
+                    {
+                        // see if P is a new sample.
+                        Sample* b;
+                        if (samples.size() < Maxsamples)
                         {
-                            // AB is a candidate line segment:
-                            const osg::Vec3d& A = (*part)[i];
-                            const osg::Vec3d& B = (*part)[i+1];
-
-                            osg::Vec3d AB = B - A;    // current segment AB
-
-                            double t;                 // parameter [0..1] on segment AB
-                            double D2;                // shortest distance from point P to segment AB, squared
-                            double L2 = AB.length2(); // length (squared) of segment AB
-                            osg::Vec3d AP = P - A;    // vector from endpoint A to point P
-
-                            if (L2 == 0.0)
-                            {
-                                // trivial case: zero-length segment
-                                t = 0.0;
-                                D2 = AP.length2();
-                            }
-                            else
-                            {
-                                // Calculate parameter "t" [0..1] which will yield the closest point on AB to P.
-                                // Clamping it means the closest point won't be beyond the endpoints of the segment.
-                                t = clamp((AP * AB)/L2, 0.0, 1.0);
-
-                                // project our point P onto segment AB:
-                                PROJ.set( A + AB*t );
-
-                                // measure the distance (squared) from P to the projected point on AB:
-                                D2 = (P - PROJ).length2();
-                            }
-
-                            // If the distance from our point to the line segment falls within
-                            // the maximum flattening distance, store it.
-                            if (D2 <= outerRadius2)
-                            {
-                                // see if P is a new sample.
-                                Sample* b;
-                                if (samples.size() < Maxsamples)
-                                {
-                                    // If we haven't collected the maximum number of samples yet,
-                                    // just add this to the list:
-                                    samples.push_back(Sample());
-                                    b = &samples.back();
-                                }
-                                else
-                                {
-                                    // If we are maxed out on samples, find the farthest one we have so far
-                                    // and replace it if the new point is closer:
-                                    unsigned max_i = 0;
-                                    for (unsigned i=1; i<samples.size(); ++i)
-                                        if (samples[i].D2 > samples[max_i].D2)
-                                            max_i = i;
-
-                                    b = &samples[max_i];
-
-                                    if (b->D2 < D2)
-                                        b = 0L;
-                                }
-
-                                if (b)
-                                {
-                                    b->D2 = D2;
-                                    b->A = A;
-                                    b->B = B;
-                                    b->T = t;
-                                    b->innerRadius = innerRadius;
-                                    b->outerRadius = outerRadius;
-                                }
-                            }
+                            // If we haven't collected the maximum number of samples yet,
+                            // just add this to the list:
+                            samples.push_back(Sample());
+                            b = &samples.back();
+                        }
+                        else
+                        {
+                            // If we are maxed out on samples, find the farthest one we have so far
+                            // and replace it if the new point is closer:
+                            unsigned max_i = 0;
+                            for (unsigned i=1; i<samples.size(); ++i)
+                                if (samples[i].D2 > samples[max_i].D2)
+                                    max_i = i;
+
+                            b = &samples[max_i];
+
+                            if (b->D2 < D2)
+                                b = 0L;
+                        }
+
+                        if (b)
+                        {
+                            b->D2 = D2;
+                            b->A = A;
+                            b->B = B;
+                            b->T = t;
+                            b->innerRadius = innerRadius;
+                            b->outerRadius = outerRadius;
                         }
                     }
                 }
@@ -619,11 +756,23 @@ namespace
 
 //........................................................................
 
+// Features (in the working SRS) for one cache key, with their flattening widths
+// as evaluated; each tile converts the widths to its own units.
+struct FlatteningLayer::FeatureData : public osg::Referenced
+{
+    GeometryCollection  _geoms;
+    std::vector<Bounds> _bounds;
+    WidthsList          _widths;
+};
+
+//........................................................................
+
 
 FlatteningLayer::FlatteningLayer(const FlatteningLayerOptions& options) :
 ElevationLayer(&_optionsConcrete),
 _options(&_optionsConcrete),
-_optionsConcrete(options)
+_optionsConcrete(options),
+_featureCache(true, 16u)
 {
     // Experiment with this and see what will work.
     _pool = new ElevationPool();
@@ -683,6 +832,9 @@ FlatteningLayer::open()
 void
 FlatteningLayer::setFeatureSource(FeatureSource* fs)
 {
+    // cached features came from the old source.
+    _featureCache.clear();
+
     if (fs)
     {
         _featureSource = fs;
@@ -797,43 +949,112 @@ FlatteningLayer::createImplementation(const TileKey& key,
 
     OE_START_TIMER(create);
 
-    // If the feature source has a tiling profile, we are going to have to map the incoming
-    // TileKey to a set of intersecting TileKeys in the feature source's tiling profile.
-    GeoExtent queryExtent = key.getExtent().transform(featureSRS);
-
-    // Lat/Long extent:
-    GeoExtent geoExtent = queryExtent.transform(featureSRS->getGeographicSRS());
-
-    // Buffer the query extent to include the potentially flattened area.
-    /*
-    double linewidth = SpatialReference::transformUnits(
-        options().lineWidth().get(),
-        featureSRS,
-        geoExtent.getCentroid().y());
-
-    double bufferwidth = SpatialReference::transformUnits(
-        options().bufferWidth().get(),
-        featureSRS,
-        geoExtent.getCentroid().y());
-    */
+    // Buffered extent of this tile in the feature SRS.
     // TODO:  JBFIX.  Add a "max" setting somewhere.
     double linewidth = 10.0;
     double bufferwidth = 10.0;
     double queryBuffer = 0.5*linewidth + bufferwidth;
+    GeoExtent queryExtent = key.getExtent().transform(featureSRS);
     queryExtent.expand(queryBuffer, queryBuffer);
 
     // We must do all the feature processing in a projected system since we're using vector math.
-#if 0
-    osg::ref_ptr<const SpatialReference> workingSRS = queryExtent.getSRS();
-    //if (workingSRS->isGeographic())
+    const SpatialReference* workingSRS = featureSRS->isGeographic() ? SpatialReference::get("spherical-mercator") :
+        featureSRS;
+
+    // Sibling tiles need nearly the same features, so query once for the parent
+    // key and share the result.
+    TileKey cacheKey = key.getLOD() > 0u ? key.createParentKey() : key;
+    osg::ref_ptr<FeatureData> data;
+
+    FeatureDataCache::Record record;
+    if (_featureCache.get(cacheKey, record))
+    {
+        data = record.value();
+    }
+    else
+    {
+        data = createFeatureData(cacheKey, key.getLOD(), workingSRS, progress);
+
+        // don't cache partial results.
+        if (progress && progress->isCanceled())
+            return;
+
+        _featureCache.insert(cacheKey, data.get());
+    }
+
+    // We will collection all the feature geometries in this multigeometry,
+    // skipping the ones that cannot reach this tile:
+    MultiGeometry geoms;
+    WidthsList widths;
+
+    GeoExtent workingExtent = key.getExtent().transform(workingSRS);
+
+    // Convert the widths at this tile's latitude rather than the cache key's,
+    // the same as querying this tile alone would.
+    GeoExtent geoExtent = key.getExtent().transform(featureSRS).transform(featureSRS->getGeographicSRS());
+    double latitude = geoExtent.getCentroid().y();
+
+    for (unsigned i = 0; i < data->_geoms.size(); ++i)
     {
-        osg::Vec3d refPos = queryExtent.getCentroid();
-        workingSRS = workingSRS->createTangentPlaneSRS(refPos);
+        const Bounds& b = data->_bounds[i];
+        Widths w(
+            SpatialReference::transformUnits(Distance(data->_widths[i].bufferWidth), featureSRS, latitude),
+            SpatialReference::transformUnits(Distance(data->_widths[i].lineWidth), featureSRS, latitude));
+        double radius = 0.5*w.lineWidth + w.bufferWidth;
+
+        if (b.xMax() + radius >= workingExtent.xMin() && b.xMin() - radius <= workingExtent.xMax() &&
+            b.yMax() + radius >= workingExtent.yMin() && b.yMin() - radius <= workingExtent.yMax())
+        {
+            geoms.getComponents().push_back(data->_geoms[i].get());
+            widths.push_back(w);
+        }
     }
-#else
-    const SpatialReference* workingSRS = queryExtent.getSRS()->isGeographic() ? SpatialReference::get("spherical-mercator") :
-        queryExtent.getSRS();
-#endif
+
+    if (!geoms.getComponents().empty())
+    {
+        if (!hf.valid())
+        {
+            // Make an empty heightfield to populate:
+            hf = HeightFieldUtils::createReferenceHeightField(
+                queryExtent,
+                257, 257,           // base tile size for elevation data
+                0u,                 // no border
+                true);              // initialize to HAE (0.0) heights
+
+            // Initialize to NO DATA.
+            hf->getFloatArray()->assign(hf->getNumColumns()*hf->getNumRows(), NO_DATA_VALUE);
+        }
+
+        // Create an elevation query envelope at the LOD we are creating
+        osg::ref_ptr<ElevationEnvelope> envelope = _pool->createEnvelope(workingSRS, key.getLOD());
+
+        bool fill = (options().fill() == true);     
+        
+        integrate(key, hf, &geoms, workingSRS, widths, envelope, fill, progress);
+    }
+}
+
+FlatteningLayer::FeatureData*
+FlatteningLayer::createFeatureData(const TileKey& cacheKey,
+                                   unsigned lod,
+                                   const SpatialReference* workingSRS,
+                                   ProgressCallback* progress)
+{
+    FeatureData* data = new FeatureData();
+
+    const FeatureProfile* featureProfile = _featureSource->getFeatureProfile();
+    const SpatialReference* featureSRS = featureProfile->getSRS();
+
+    // If the feature source has a tiling profile, we are going to have to map the incoming
+    // TileKey to a set of intersecting TileKeys in the feature source's tiling profile.
+    GeoExtent queryExtent = cacheKey.getExtent().transform(featureSRS);
+
+    // Buffer the query extent to include the potentially flattened area.
+    // TODO:  JBFIX.  Add a "max" setting somewhere.
+    double linewidth = 10.0;
+    double bufferwidth = 10.0;
+    double queryBuffer = 0.5*linewidth + bufferwidth;
+    queryExtent.expand(queryBuffer, queryBuffer);
 
     bool needsTransform = !featureSRS->isHorizEquivalentTo(workingSRS);
 
@@ -841,15 +1062,15 @@ FlatteningLayer::createImplementation(const TileKey& key,
     styleSheet->setScript(options().getScript());
     osg::ref_ptr< Session > session = new Session( _map.get(), styleSheet.get());
 
-    // We will collection all the feature geometries in this multigeometry:
-    MultiGeometry geoms;
-    WidthsList widths;
+    std::vector<Query> queries;
 
     if (featureProfile->getProfile())
     {
-        // Tiled source, must resolve complete set of intersecting tiles:
+        // Tiled source, must resolve complete set of intersecting tiles.
+        // Use the LOD of the requesting tile, not of the cache key, so we get
+        // the same feature tiles as if we had queried each tile separately.
         std::vector<TileKey> intersectingKeys;
-        featureProfile->getProfile()->getIntersectingTiles(queryExtent, key.getLOD(), intersectingKeys);
+        featureProfile->getProfile()->getIntersectingTiles(queryExtent, lod, intersectingKeys);
 
         std::set<TileKey> featureKeys;
         for (int i = 0; i < intersectingKeys.size(); ++i)
@@ -860,50 +1081,11 @@ FlatteningLayer::createImplementation(const TileKey& key,
                 featureKeys.insert(intersectingKeys[i]);
         }
 
-        // Query and collect all the features we need for this tile.
         for (std::set<TileKey>::const_iterator i = featureKeys.begin(); i != featureKeys.end(); ++i)
         {
             Query query;        
             query.tileKey() = *i;
-
-            osg::ref_ptr<FeatureCursor> cursor = _featureSource->createFeatureCursor(query);
-            while (cursor.valid() && cursor->hasMore())
-            {
-                Feature* feature = cursor->nextFeature();
-
-                double lineWidth = 0.0;
-                double bufferWidth = 0.0;
-                if (options().lineWidth().isSet())
-                {
-                    NumericExpression lineWidthExpr(options().lineWidth().get());
-                    lineWidth = feature->eval(lineWidthExpr, session);
-                }
-
-                if (options().bufferWidth().isSet())
-                {
-                    NumericExpression bufferWidthExpr(options().bufferWidth().get());
-                    bufferWidth = feature->eval(bufferWidthExpr, session);
-                }
-
-                // Transform the feature geometry to our working (projected) SRS.
-                if (needsTransform)
-                    feature->transform(workingSRS);
-
-                lineWidth = SpatialReference::transformUnits(
-                    Distance(lineWidth),
-                    featureSRS,
-                    geoExtent.getCentroid().y());
-
-                bufferWidth = SpatialReference::transformUnits(
-                    Distance(bufferWidth),
-                    featureSRS,
-                    geoExtent.getCentroid().y());
-
-                //TODO: optimization: test the geometry bounds against the expanded tilekey bounds
-                //      in order to discard geometries we don't care about
-                geoms.getComponents().push_back(feature->getGeometry());
-                widths.push_back(Widths(bufferWidth, lineWidth));
-            }
+            queries.push_back(query);
         }
     }
     else
@@ -912,9 +1094,16 @@ FlatteningLayer::createImplementation(const TileKey& key,
         // Set up the query; bounds must be in the feature SRS:
         Query query;
         query.bounds() = queryExtent.bounds();
+        queries.push_back(query);
+    }
 
-        // Run the query and fill the list.
-        osg::ref_ptr<FeatureCursor> cursor = _featureSource->createFeatureCursor(query);
+    // Query and collect all the features we need.
+    for (std::vector<Query>::const_iterator q = queries.begin(); q != queries.end(); ++q)
+    {
+        if (progress && progress->isCanceled())
+            break;
+
+        osg::ref_ptr<FeatureCursor> cursor = _featureSource->createFeatureCursor(*q);
         while (cursor.valid() && cursor->hasMore())
         {
             Feature* feature = cursor->nextFeature();
@@ -937,48 +1126,14 @@ FlatteningLayer::createImplementation(const TileKey& key,
             if (needsTransform)
                 feature->transform(workingSRS);
 
-            lineWidth = SpatialReference::transformUnits(
-                Distance(lineWidth),
-                featureSRS,
-                geoExtent.getCentroid().y());
-
-            bufferWidth = SpatialReference::transformUnits(
-                Distance(bufferWidth),
-                featureSRS,
-                geoExtent.getCentroid().y());
-
-            // Transform the feature geometry to our working (projected) SRS.
-            if (needsTransform)
-                feature->transform(workingSRS);
-
-            //TODO: optimization: test the geometry bounds against the expanded tilekey bounds
-            //      in order to discard geometries we don't care about
-
-            geoms.getComponents().push_back(feature->getGeometry());
-            widths.push_back(Widths(bufferWidth, lineWidth));
+            if (feature->getGeometry())
+            {
+                data->_geoms.push_back(feature->getGeometry());
+                data->_bounds.push_back(feature->getGeometry()->getBounds());
+                data->_widths.push_back(Widths(bufferWidth, lineWidth));
+            }
         }
     }
 
-    if (!geoms.getComponents().empty())
-    {
-        if (!hf.valid())
-        {
-            // Make an empty heightfield to populate:
-            hf = HeightFieldUtils::createReferenceHeightField(
-                queryExtent,
-                257, 257,           // base tile size for elevation data
-                0u,                 // no border
-                true);              // initialize to HAE (0.0) heights
-
-            // Initialize to NO DATA.
-            hf->getFloatArray()->assign(hf->getNumColumns()*hf->getNumRows(), NO_DATA_VALUE);
-        }
-
-        // Create an elevation query envelope at the LOD we are creating
-        osg::ref_ptr<ElevationEnvelope> envelope = _pool->createEnvelope(workingSRS, key.getLOD());
-
-        bool fill = (options().fill() == true);     
-        
-        integrate(key, hf, &geoms, workingSRS, widths, envelope, fill, progress);
-    }
+    return data;
 }
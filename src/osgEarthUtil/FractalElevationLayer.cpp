@@ -265,15 +265,31 @@ FractalElevationLayer::createImplementation(const TileKey& key,
     osg::ref_ptr<osg::HeightField> hf = HeightFieldUtils::createReferenceHeightField(
         key.getExtent(), getTileSize(), getTileSize(), 0u);
 
+    // default amplitude:
+    float defaultAmp = options().amplitude().get();
+
     // land cover tile
-    GeoImage lcTile;
+    osg::ref_ptr<LandCoverTile> lcTile;
+
+    // amplitude for each land cover palette index in the tile, resolved once
+    // here so the loop below does not have to look up classes by name.
+    std::vector<float> ampByIndex;
 
     osg::ref_ptr<LandCoverLayer> lcLayer;
     _landCover.lock(lcLayer);
 
     if (lcLayer.valid())
     {
-        lcTile = lcLayer->createImage(key, progress);
+        lcTile = lcLayer->createTile(key, progress);
+        if (lcTile.valid())
+        {
+            ampByIndex.resize(lcTile->getPaletteSize());
+            for (unsigned i = 0; i < lcTile->getPaletteSize(); ++i)
+            {
+                const FractalElevationLayerLandCoverMapping* mapping = getMapping(lcTile->getPaletteClass(i));
+                ampByIndex[i] = mapping ? mapping->amplitude.getOrUse(defaultAmp) : defaultAmp;
+            }
+        }
     }
 
     for (int s = 0; s < getTileSize(); ++s)
@@ -314,22 +330,8 @@ FractalElevationLayer::createImplementation(const TileKey& key,
 
             n *= finalScale;
 
-            // default amplitude:
-            float amp = options().amplitude().get();
-
             // if we have land cover mappings, use them:
-            if (lcTile.valid())
-            {
-                const LandCoverClass* lcClass = lcLayer->getClassByUV(lcTile, u, v);
-                if (lcClass)
-                {
-                    const FractalElevationLayerLandCoverMapping* mapping = getMapping(lcClass);
-                    if (mapping)
-                    {
-                        amp = mapping->amplitude.getOrUse(amp);
-                    }
-                }
-            }
+            float amp = lcTile.valid() ? ampByIndex[lcTile->getIndexByUV(u, v)] : defaultAmp;
 
             hf->setHeight(s, t, n * amp);
 
@@ -22,9 +22,18 @@
 #include <osgEarth/Registry>
 #include <osgEarth/ShaderLoader>
 #include <osgEarth/ObjectIndex>
+#include <osgEarth/ThreadingUtils>
 
 #include <osgDB/WriteFile>
 #include <osg/BlendFunc>
+#include <osg/BufferObject>
+#include <osg/FrameBufferObject>
+#include <osg/GLExtensions>
+#include <osg/Vec4i>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <deque>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -104,6 +113,185 @@ namespace
         "} \n";
 }
 
+//........................................................................
+
+namespace
+{
+    // Number of pixel buffer objects readbacks rotate through
+    const unsigned NUM_PBOS = 3u;
+
+    // Number of draws after which a readback is mapped; by then the GPU
+    // has finished it, so mapping does not stall.
+    const unsigned READBACK_LATENCY = 2u;
+}
+
+/**
+ * Reads regions of the pick image back into rotating pixel buffer objects
+ * after the pick camera draws, and maps each one a couple of draws later.
+ * Requests come from the picker and completed readbacks go back to it.
+ */
+class RTTPicker::Readback : public osg::Camera::DrawCallback
+{
+public:
+    struct Request
+    {
+        Request() : _id(0u), _x(0), _y(0), _width(0), _height(0) { }
+        unsigned                   _id;
+        int                        _x, _y, _width, _height;
+        std::vector<unsigned char> _pixels;  // empty if the readback failed
+    };
+
+    Readback(osg::Texture2D* texture, unsigned maxBytes) :
+        _texture(texture),
+        _slots(NUM_PBOS)
+    {
+        for (unsigned i = 0; i < _slots.size(); ++i)
+        {
+            _slots[i]._pbo = new osg::PixelDataBufferObject();
+            _slots[i]._pbo->setDataSize(maxBytes);
+            _slots[i]._pbo->setUsage(GL_STREAM_READ_ARB);
+        }
+    }
+
+    // Queues a region to read after the next draw (any thread).
+    void submit(const Request& request)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _pending.push_back(request);
+    }
+
+    // Takes the readbacks that have completed (any thread).
+    void takeComplete(std::vector<Request>& output)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        output.swap(_complete);
+        _complete.clear();
+    }
+
+public: // osg::Camera::DrawCallback
+
+    void operator () (osg::RenderInfo& renderInfo) const
+    {
+        osg::State& state = *renderInfo.getState();
+        osg::GLExtensions* ext = osg::GLExtensions::Get(state.getContextID(), true);
+
+        // Map the readbacks issued long enough ago.
+        for (unsigned i = 0; i < _slots.size(); ++i)
+        {
+            if (_slots[i]._busy && ++_slots[i]._age >= READBACK_LATENCY)
+                resolve(state, ext, _slots[i]);
+        }
+
+        // One new readback per draw.
+        Request request;
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (_pending.empty())
+                return;
+            request = _pending.front();
+            _pending.pop_front();
+        }
+
+        // Nothing to read for a batch of misses.
+        if (request._width <= 0 || request._height <= 0)
+        {
+            complete(request);
+            return;
+        }
+
+        // The camera's FBO is unbound by now, so bind our own to read the texture.
+        if (!_fbo.valid())
+        {
+            _fbo = new osg::FrameBufferObject();
+            _fbo->setAttachment(osg::Camera::COLOR_BUFFER0, osg::FrameBufferAttachment(_texture.get()));
+        }
+        _fbo->apply(state, osg::FrameBufferObject::READ_FRAMEBUFFER);
+
+        if (ext->isPBOSupported)
+        {
+            // Use a free slot, or finish the oldest readback to free one.
+            Slot* slot = 0L;
+            for (unsigned i = 0; i < _slots.size(); ++i)
+            {
+                if (!_slots[i]._busy)
+                    slot = &_slots[i];
+                else if (!slot || (slot->_busy && _slots[i]._age > slot->_age))
+                    slot = &_slots[i];
+            }
+            if (slot->_busy)
+                resolve(state, ext, *slot);
+
+            slot->_pbo->bindBufferInWriteMode(state);
+            glReadPixels(request._x, request._y, request._width, request._height, GL_RGBA, GL_UNSIGNED_BYTE, 0L);
+            slot->_pbo->unbindBuffer(state.getContextID());
+
+            slot->_request = request;
+            slot->_busy = true;
+            slot->_age = 0u;
+        }
+        else
+        {
+            request._pixels.resize(request._width * request._height * 4);
+            glReadPixels(request._x, request._y, request._width, request._height, GL_RGBA, GL_UNSIGNED_BYTE, &request._pixels[0]);
+            complete(request);
+        }
+
+        ext->glBindFramebuffer(GL_READ_FRAMEBUFFER_EXT, 0);
+    }
+
+protected:
+    virtual ~Readback() { }
+
+private:
+    struct Slot
+    {
+        Slot() : _age(0u), _busy(false) { }
+        osg::ref_ptr<osg::PixelDataBufferObject> _pbo;
+        Request                                  _request;
+        unsigned                                 _age;
+        bool                                     _busy;
+    };
+
+    // Copies a finished readback out of its buffer object.
+    void resolve(osg::State& state, osg::GLExtensions* ext, Slot& slot) const
+    {
+        Request& request = slot._request;
+        request._pixels.resize(request._width * request._height * 4);
+
+        slot._pbo->bindBufferInWriteMode(state);
+        const void* src = ext->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+        if (src)
+        {
+            ::memcpy(&request._pixels[0], src, request._pixels.size());
+            ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+        }
+        else
+        {
+            request._pixels.clear();
+        }
+        slot._pbo->unbindBuffer(state.getContextID());
+
+        slot._busy = false;
+        complete(request);
+        request = Request();
+    }
+
+    void complete(const Request& request) const
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+        _complete.push_back(request);
+    }
+
+    osg::ref_ptr<osg::Texture2D>                  _texture;
+    mutable osg::ref_ptr<osg::FrameBufferObject>  _fbo;
+    mutable std::vector<Slot>                     _slots;
+    mutable Threading::Mutex                      _mutex;
+    mutable std::deque<Request>                   _pending;
+    mutable std::vector<Request>                  _complete;
+};
+
+//........................................................................
+
 VirtualProgram* 
 RTTPicker::createRTTProgram()
 {    
@@ -135,6 +323,8 @@ RTTPicker::RTTPicker(int cameraSize)
     
     // Cull mask for RTT cameras
     _cullMask = ~0;
+
+    _nextRequest = 0u;
 }
 
 RTTPicker::~RTTPicker()
@@ -154,15 +344,6 @@ osg::Texture2D*
 RTTPicker::getOrCreateTexture(osg::View* view)
 {
     PickContext& pc = getOrCreatePickContext(view);
-    if ( !pc._tex.valid() )
-    {
-        pc._tex = new osg::Texture2D( pc._image.get() );
-        pc._tex->setTextureSize(pc._image->s(), pc._image->t());
-        pc._tex->setUnRefImageDataAfterApply(false);
-        pc._tex->setFilter(pc._tex->MIN_FILTER, pc._tex->NEAREST); // no filtering
-        pc._tex->setFilter(pc._tex->MAG_FILTER, pc._tex->NEAREST); // no filtering
-        pc._tex->setMaxAnisotropy(1.0f); // no filtering
-    }
     return pc._tex.get();
 }
 
@@ -195,10 +376,20 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
 
     c._view = view;
 
-    c._image = new osg::Image();
-    c._image->allocateImage(_rttSize, _rttSize, 1, GL_RGBA, GL_UNSIGNED_BYTE);    
+    c._tex = new osg::Texture2D();
+    c._tex->setTextureSize(_rttSize, _rttSize);
+    c._tex->setInternalFormat(GL_RGBA8);
+    c._tex->setSourceFormat(GL_RGBA);
+    c._tex->setSourceType(GL_UNSIGNED_BYTE);
+    c._tex->setFilter(c._tex->MIN_FILTER, c._tex->NEAREST); // no filtering
+    c._tex->setFilter(c._tex->MAG_FILTER, c._tex->NEAREST); // no filtering
+    c._tex->setMaxAnisotropy(1.0f); // no filtering
+
+    // Reads back the pixels under the picks after the camera draws.
+    c._readback = new Readback(c._tex.get(), _rttSize*_rttSize*4);
     
-    // Make an RTT camera and bind it to our image.
+    // Make an RTT camera and bind it to our texture. It is only read back
+    // when there are picks, and then asynchronously (see Readback).
     // Note: don't use RF_INHERIT_VIEWPOINT because it's unnecessary and
     //       doesn't work with a slave camera anyway
     // Note: NESTED_RENDER mode makes the RTT camera track the clip planes
@@ -212,7 +403,7 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     c._pickCamera->setViewport( 0, 0, _rttSize, _rttSize );
     c._pickCamera->setRenderOrder( osg::Camera::NESTED_RENDER );
     c._pickCamera->setRenderTargetImplementation( osg::Camera::FRAME_BUFFER_OBJECT );
-    c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._image.get() );
+    c._pickCamera->attach( osg::Camera::COLOR_BUFFER0, c._tex.get() );
     c._pickCamera->setSmallFeatureCullingPixelSize( -1.0f );
     c._pickCamera->setCullMask( _cullMask );
 
@@ -259,6 +450,7 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
     // is better than assigning the same pre-draw callback, because the callback can
     // change over time (such as installing or uninstalling a Logarithmic Depth Buffer)
     c._pickCamera->setPreDrawCallback( new CallHostCameraPreDrawCallback(view->getCamera()) );
+    c._pickCamera->setPostDrawCallback( c._readback.get() );
 
     // associate the RTT camara with the view's camera.
     // (e.g., decluttering uses this to find the "true" viewport)
@@ -272,16 +464,16 @@ RTTPicker::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa)
 {
     if ( ea.getEventType() == ea.FRAME )
     {
-        osg::FrameStamp* fs = aa.asView() ? aa.asView()->getFrameStamp() : 0L;
-        if ( fs )
-        {
-            runPicks( fs->getFrameNumber() );           
-        }
+        runPicks();
 
-        // if there are picks in the queue, need to continuing rendering:
-        if ( !_picks.empty() )
+        // if there are picks waiting for readbacks, need to continuing rendering:
+        for (PickContexts::const_iterator i = _pickContexts.begin(); i != _pickContexts.end(); ++i)
         {
-            aa.requestRedraw();
+            if ( !i->_inFlight.empty() )
+            {
+                aa.requestRedraw();
+                break;
+            }
         }
     }
 
@@ -301,15 +493,8 @@ RTTPicker::pick(osg::View* view, float mouseX, float mouseY)
 }
 
 bool
-RTTPicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
+RTTPicker::getPickPixel(osg::View* view, float mouseX, float mouseY, int& s, int& t) const
 {
-    if ( !view )
-        return false;
-
-    Callback* callbackToUse = callback ? callback : _defaultCallback.get();
-    if ( !callbackToUse )
-        return false;
-    
     osg::Camera* cam = view->getCamera();
     if ( !cam )
         return false;
@@ -326,16 +511,34 @@ RTTPicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
     if ( u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f )
         return false;
 
+    s = std::min( (int)(u * (float)_rttSize), _rttSize-1 );
+    t = std::min( (int)(v * (float)_rttSize), _rttSize-1 );
+    return true;
+}
+
+bool
+RTTPicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
+{
+    if ( !view )
+        return false;
+
+    Callback* callbackToUse = callback ? callback : _defaultCallback.get();
+    if ( !callbackToUse )
+        return false;
+
+    int s, t;
+    if ( !getPickPixel(view, mouseX, mouseY, s, t) )
+        return false;
+
     // install the RTT pick camera under this view's camera if it's not already:
     PickContext& context = getOrCreatePickContext( view );
     
     // Create a new pick
     Pick pick;
     pick._context  = &context;
-    pick._u        = u;
-    pick._v        = v;
+    pick._pixels.push_back( s );
+    pick._pixels.push_back( t );
     pick._callback = callbackToUse;
-    pick._frame    = view->getFrameStamp() ? view->getFrameStamp()->getFrameNumber() : 0u;
     
     // Queue it up.
     _picks.push( pick );
@@ -343,20 +546,104 @@ RTTPicker::pick(osg::View* view, float mouseX, float mouseY, Callback* callback)
     return true;
 }
 
+bool
+RTTPicker::pick(osg::View* view, const std::vector<osg::Vec2f>& points, BatchCallback* callback)
+{
+    if ( !view || !callback || !view->getCamera() || !view->getCamera()->getViewport() )
+        return false;
+
+    PickContext& context = getOrCreatePickContext( view );
+
+    Pick pick;
+    pick._context = &context;
+    pick._batchCallback = callback;
+    pick._pixels.reserve( points.size()*2 );
+
+    for(std::vector<osg::Vec2f>::const_iterator i = points.begin(); i != points.end(); ++i)
+    {
+        int s = -1, t = -1;
+        getPickPixel(view, i->x(), i->y(), s, t);
+        pick._pixels.push_back( s );
+        pick._pixels.push_back( t );
+    }
+
+    _picks.push( pick );
+
+    return true;
+}
+
 void
-RTTPicker::runPicks(unsigned frameNumber)
+RTTPicker::runPicks()
 {
-    while( _picks.size() > 0 )
+    // Submit the queued picks: one readback per pick context, covering
+    // the search area around every pick pixel.
+    if ( !_picks.empty() )
     {
-        Pick& pick = _picks.front();
-        if ( frameNumber > pick._frame )
+        std::map<PickContext*, Readback::Request> requests;
+        std::map<PickContext*, osg::Vec4i> regions;
+        int buffer = std::max(_buffer, 1);
+
+        while( !_picks.empty() )
         {
-            checkForPickResult(pick);
+            Pick& pick = _picks.front();
+
+            Readback::Request& request = requests[pick._context];
+            if ( request._id == 0u )
+            {
+                request._id = ++_nextRequest;
+                regions[pick._context].set(INT_MAX, INT_MAX, INT_MIN, INT_MIN);
+            }
+
+            osg::Vec4i& region = regions[pick._context];
+            for(unsigned i = 0; i+1 < pick._pixels.size(); i += 2)
+            {
+                int s = pick._pixels[i], t = pick._pixels[i+1];
+                if ( s < 0 )
+                    continue;
+                region[0] = std::min(region[0], std::max(s-buffer, 0));
+                region[1] = std::min(region[1], std::max(t-buffer, 0));
+                region[2] = std::max(region[2], std::min(s+buffer, _rttSize-1));
+                region[3] = std::max(region[3], std::min(t+buffer, _rttSize-1));
+            }
+
+            pick._context->_inFlight[request._id].push_back( pick );
             _picks.pop();
         }
-        else
+
+        for(std::map<PickContext*, Readback::Request>::iterator i = requests.begin(); i != requests.end(); ++i)
+        {
+            const osg::Vec4i& region = regions[i->first];
+            Readback::Request& request = i->second;
+            if ( region[0] <= region[2] )
+            {
+                request._x      = region[0];
+                request._y      = region[1];
+                request._width  = region[2] - region[0] + 1;
+                request._height = region[3] - region[1] + 1;
+            }
+            i->first->_readback->submit( request );
+        }
+    }
+
+    // Fire the callbacks of picks whose readbacks have completed.
+    for(PickContexts::iterator c = _pickContexts.begin(); c != _pickContexts.end(); ++c)
+    {
+        std::vector<Readback::Request> completed;
+        c->_readback->takeComplete( completed );
+
+        for(std::vector<Readback::Request>::const_iterator r = completed.begin(); r != completed.end(); ++r)
         {
-            break;
+            std::map<unsigned, std::vector<Pick> >::iterator f = c->_inFlight.find( r->_id );
+            if ( f == c->_inFlight.end() )
+                continue;
+
+            const unsigned char* pixels = r->_pixels.empty() ? 0L : &r->_pixels[0];
+            for(std::vector<Pick>::iterator pick = f->second.begin(); pick != f->second.end(); ++pick)
+            {
+                checkForPickResult( *pick, pixels, r->_x, r->_y, r->_width, r->_height );
+            }
+
+            c->_inFlight.erase( f );
         }
     }
 }
@@ -377,17 +664,21 @@ namespace
         int      _offsetX, _offsetY;
         unsigned _count;
 
-        SpiralIterator(int w, int h, int maxDist, float u, float v) : 
-            _w(w), _h(h), _maxRing(maxDist), _count(0), _ring(1), _leg(0), _x(0), _y(0)
+        int      _x0, _y0;
+
+        // Spirals out from pixel (s, t), within the w x h window whose first
+        // pixel is (x0, y0).
+        SpiralIterator(int x0, int y0, int w, int h, int maxDist, int s, int t) : 
+            _ring(1), _maxRing(maxDist), _leg(0), _x(0), _y(0), _w(w), _h(h),
+            _offsetX(s), _offsetY(t), _count(0), _x0(x0), _y0(y0)
         {
-            _offsetX = (int)(u * (float)w);
-            _offsetY = (int)(v * (float)h);
+            //nop
         }
 
         bool next()
         {
-            // first time, just use the start point
-            if ( _count++ == 0 )
+            // first time, use the start point if it's in bounds
+            if ( _count++ == 0 && inBounds() )
                 return true;
 
             // spiral until we get to the next valid in-bounds pixel:
@@ -399,48 +690,73 @@ namespace
                 case 3: --_y; if ( -_y == _ring ) { _leg = 0; ++_ring; } break;
                 }
             }
-            while(_ring <= _maxRing && (_x+_offsetX < 0 || _x+_offsetX >= _w || _y+_offsetY < 0 || _y+_offsetY >= _h));
+            while(_ring <= _maxRing && !inBounds());
 
             return _ring <= _maxRing;
         }
 
+        bool inBounds() const
+        {
+            return s() >= _x0 && s() < _x0+_w && t() >= _y0 && t() < _y0+_h;
+        }
+
         int s() const { return _x+_offsetX; }
 
         int t() const { return _y+_offsetY; }
     };
 }
 
-void
-RTTPicker::checkForPickResult(Pick& pick)
+ObjectID
+RTTPicker::decodeObjectID(const unsigned char* pixels,
+                          int x, int y, int width, int height,
+                          int s, int t, int buffer)
 {
-    // decode the results
-    osg::Image* image = pick._context->_image.get();
-    ImageUtils::PixelReader read( image );
-
-    // uncomment to see the RTT image.
-    //osg::ref_ptr<osgDB::Options> o = new osgDB::Options();
-    //osgDB::writeImageFile(*image, "out.tif", o.get());
+    if ( !pixels )
+        return 0u;
 
-    osg::Vec4f value;
-    SpiralIterator iter(image->s(), image->t(), std::max(_buffer,1), pick._u, pick._v);
+    SpiralIterator iter(x, y, width, height, buffer, s, t);
     while(iter.next())
     {
-        value = read(iter.s(), iter.t());
+        const unsigned char* p = pixels + 4*((iter.t()-y)*width + (iter.s()-x));
 
         ObjectID id = (ObjectID)(
-            ((unsigned)(value.r()*255.0) << 24) +
-            ((unsigned)(value.g()*255.0) << 16) +
-            ((unsigned)(value.b()*255.0) <<  8) +
-            ((unsigned)(value.a()*255.0)));
+            ((unsigned)p[0] << 24) +
+            ((unsigned)p[1] << 16) +
+            ((unsigned)p[2] <<  8) +
+            ((unsigned)p[3]));
 
         if ( id > 0 )
-        {
-            pick._callback->onHit( id );
-            return;
-        }
+            return id;
     }
 
-    pick._callback->onMiss();
+    return 0u;
+}
+
+void
+RTTPicker::checkForPickResult(Pick& pick, const unsigned char* pixels, int x, int y, int width, int height)
+{
+    int buffer = std::max(_buffer, 1);
+
+    // decode the results (-1 marks a pick outside the viewport)
+    std::vector<ObjectID> ids( pick._pixels.size()/2, 0u );
+    for(unsigned i = 0; i < ids.size(); ++i)
+    {
+        int s = pick._pixels[2*i], t = pick._pixels[2*i+1];
+        if ( s >= 0 )
+            ids[i] = decodeObjectID(pixels, x, y, width, height, s, t, buffer);
+    }
+
+    if ( pick._batchCallback.valid() )
+    {
+        pick._batchCallback->onResults( ids );
+    }
+    else if ( pick._callback.valid() )
+    {
+        if ( !ids.empty() && ids[0] > 0 )
+            pick._callback->onHit( ids[0] );
+        else
+            pick._callback->onMiss();
+    }
 }
 
 bool
@@ -25,9 +25,18 @@
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/ImageLayer>
 #include <osgEarth/ElevationLayer>
+#include <osgEarth/Metrics>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
 #include <osgDB/WriteFile>
+#include <OpenThreads/Condition>
+#include <fstream>
+#include <sstream>
+
+#ifdef OSGEARTH_HAVE_SQLITE3
+#include <sqlite3.h>
+#endif
 
 
 #define LC "[TMSPackager] "
@@ -35,6 +44,620 @@
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
+namespace
+{
+    // FNV-1a hash of an encoded tile.
+    unsigned long long hashData(const std::string& data)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for(std::string::const_iterator c = data.begin(); c != data.end(); ++c)
+        {
+            hash ^= (unsigned char)*c;
+            hash *= 1099511628211ULL;
+        }
+        return hash != 0ULL ? hash : 1ULL;
+    }
+}
+
+/*****************************************************************************************************/
+
+/**
+ * Encode and write stages of the packaging pipeline. Fetching happens on the
+ * TileVisitor's threads, which hand images to add().
+ */
+class TMSPackager::Pipeline : public osg::Referenced
+{
+public:
+    Pipeline(TileWriter* writer, const std::string& extension, osgDB::Options* options,
+             unsigned numEncodeThreads, unsigned batchSize);
+
+    bool valid() const { return _rw.valid(); }
+
+    /** Queues a fetched tile for encoding; blocks while the encode queue is full. */
+    void add(const TileKey& key, osg::Image* image, double fetchSeconds);
+
+    /** Waits until every queued tile is written, commits, and reports throughput. */
+    void finish();
+
+    void encode(const TileKey& key, osg::Image* image);
+    void write(const TileKey& key, const std::string& data, unsigned long long hash);
+
+private:
+    struct Stage
+    {
+        Stage() : _tiles(0u), _seconds(0.0), _bytes(0.0) { }
+        unsigned _tiles;
+        double   _seconds;
+        double   _bytes;
+    };
+
+    struct EncodeTask : public TaskRequest
+    {
+        EncodeTask(Pipeline* pipeline, const TileKey& key, osg::Image* image) :
+            _pipeline(pipeline), _key(key), _image(image) { }
+        void operator()(ProgressCallback* progress) { _pipeline->encode(_key, _image.get()); }
+        Pipeline*                _pipeline;
+        TileKey                  _key;
+        osg::ref_ptr<osg::Image> _image;
+    };
+
+    struct WriteTask : public TaskRequest
+    {
+        WriteTask(Pipeline* pipeline, const TileKey& key, const std::string& data, unsigned long long hash) :
+            _pipeline(pipeline), _key(key), _data(data), _hash(hash) { }
+        void operator()(ProgressCallback* progress) { _pipeline->write(_key, _data, _hash); }
+        Pipeline*          _pipeline;
+        TileKey            _key;
+        std::string        _data;
+        unsigned long long _hash;
+    };
+
+    void done(bool ok);
+    void report(const char* name, const Stage& stage, unsigned threads) const;
+
+    osg::ref_ptr<TileWriter>          _writer;
+    osg::ref_ptr<osgDB::ReaderWriter> _rw;
+    osg::ref_ptr<osgDB::Options>      _options;
+    osg::ref_ptr<TaskService>         _encodeService;
+    osg::ref_ptr<TaskService>         _writeService;
+    unsigned                          _numEncodeThreads;
+    unsigned                          _batchSize;
+    unsigned                          _uncommitted;  // write thread only
+    bool                              _hashSingleColor;
+    osg::Timer_t                      _start;
+
+    Threading::Mutex                  _mutex;
+    OpenThreads::Condition            _idle;
+    unsigned                          _inFlight;
+    unsigned                          _failures;
+    unsigned                          _shared;
+    Stage                             _fetch, _encode, _write;
+};
+
+TMSPackager::Pipeline::Pipeline(TileWriter*        writer,
+                                const std::string& extension,
+                                osgDB::Options*    options,
+                                unsigned           numEncodeThreads,
+                                unsigned           batchSize) :
+_writer          ( writer ),
+_options         ( options ),
+_numEncodeThreads( numEncodeThreads ),
+_batchSize       ( std::max(batchSize, 1u) ),
+_uncommitted     ( 0u ),
+_hashSingleColor ( writer->sharesTiles() ),
+_inFlight        ( 0u ),
+_failures        ( 0u ),
+_shared          ( 0u )
+{
+    _rw = osgDB::Registry::instance()->getReaderWriterForExtension( extension );
+    if ( !_rw.valid() )
+    {
+        OE_WARN << LC << "No plugin to encode \"" << extension << "\" tiles" << std::endl;
+        return;
+    }
+
+    // Bounded queues keep the fetch stage from running far ahead of the others.
+    _encodeService = new TaskService( "TMSPackager encode", numEncodeThreads, 4u*numEncodeThreads );
+    _writeService  = new TaskService( "TMSPackager write",  1, _batchSize );
+
+    _start = osg::Timer::instance()->tick();
+}
+
+void
+TMSPackager::Pipeline::add(const TileKey& key, osg::Image* image, double fetchSeconds)
+{
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        ++_inFlight;
+        ++_fetch._tiles;
+        _fetch._seconds += fetchSeconds;
+    }
+    _encodeService->add( new EncodeTask(this, key, image) );
+}
+
+void
+TMSPackager::Pipeline::encode(const TileKey& key, osg::Image* image)
+{
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+
+    std::stringstream buf;
+    osgDB::ReaderWriter::WriteResult wr = _rw->writeImage( *image, buf, _options.get() );
+    if ( wr.error() )
+    {
+        OE_WARN << LC << "Failed to encode " << key.str() << ": " << wr.message() << std::endl;
+        done( false );
+        return;
+    }
+
+    std::string data = buf.str();
+
+    unsigned long long hash = 0ULL;
+    if ( _hashSingleColor && ImageUtils::isSingleColorImage(image) )
+    {
+        hash = hashData( data );
+    }
+
+    double seconds = osg::Timer::instance()->delta_s( t0, osg::Timer::instance()->tick() );
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        ++_encode._tiles;
+        _encode._seconds += seconds;
+        _encode._bytes   += data.size();
+    }
+
+    _writeService->add( new WriteTask(this, key, data, hash) );
+}
+
+void
+TMSPackager::Pipeline::write(const TileKey& key, const std::string& data, unsigned long long hash)
+{
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+
+    bool ok = _writer->write( key, data, hash );
+
+    if ( ++_uncommitted >= _batchSize )
+    {
+        _writer->commit();
+        _uncommitted = 0u;
+    }
+
+    double seconds = osg::Timer::instance()->delta_s( t0, osg::Timer::instance()->tick() );
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        ++_write._tiles;
+        _write._seconds += seconds;
+        _write._bytes   += data.size();
+        if ( hash != 0ULL )
+            ++_shared;
+    }
+
+    Metrics::counter("TMSPackager",
+        "EncodeQueue", (double)_encodeService->getNumRequests(),
+        "WriteQueue",  (double)_writeService->getNumRequests());
+
+    done( ok );
+}
+
+void
+TMSPackager::Pipeline::done(bool ok)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    if ( !ok )
+        ++_failures;
+    if ( --_inFlight == 0u )
+        _idle.broadcast();
+}
+
+void
+TMSPackager::Pipeline::finish()
+{
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        while ( _inFlight > 0u )
+            _idle.wait( &_mutex );
+    }
+
+    // No tasks remain, so the writer can be used from this thread.
+    _writer->commit();
+    _uncommitted = 0u;
+
+    double wall = osg::Timer::instance()->delta_s( _start, osg::Timer::instance()->tick() );
+
+    OE_NOTICE << LC << "Packaged " << _write._tiles << " tiles in " << prettyPrintTime(wall)
+        << " (" << (wall > 0.0 ? _write._tiles/wall : 0.0) << " tiles/s)" << std::endl;
+    report( "fetch",  _fetch,  0u );
+    report( "encode", _encode, _numEncodeThreads );
+    report( "write",  _write,  1u );
+    if ( _hashSingleColor )
+        OE_NOTICE << LC << "  " << _shared << " single-color tiles shared" << std::endl;
+    if ( _failures > 0u )
+        OE_WARN << LC << "  " << _failures << " tiles failed to encode or write" << std::endl;
+}
+
+void
+TMSPackager::Pipeline::report(const char* name, const Stage& stage, unsigned threads) const
+{
+    // tiles per busy second is the rate one thread of the stage can sustain.
+    double rate = stage._seconds > 0.0 ? stage._tiles / stage._seconds : 0.0;
+
+    std::stringstream buf;
+    buf << "  " << name << ": " << stage._tiles << " tiles, "
+        << stage._seconds << " s busy, " << rate << " tiles/s per thread";
+    if ( threads > 0u )
+        buf << " x " << threads << " threads";
+    if ( stage._bytes > 0.0 )
+        buf << ", " << (stage._bytes / 1048576.0) << " MB";
+
+    OE_NOTICE << LC << buf.str() << std::endl;
+}
+
+/*****************************************************************************************************/
+
+TMSTileWriter::TMSTileWriter()
+{
+    //nop
+}
+
+bool
+TMSTileWriter::open(TMSPackager* packager, const Profile* profile)
+{
+    _root      = osgDB::concatPaths( packager->getDestination(), toLegalFileName(packager->getLayerName()) );
+    _extension = packager->getExtension();
+    return true;
+}
+
+std::string
+TMSTileWriter::getPathForTile(const TileKey& key) const
+{
+    unsigned w, h;
+    key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+
+    return Stringify()
+        << _root
+        << "/" << key.getLevelOfDetail()
+        << "/" << key.getTileX()
+        << "/" << h - key.getTileY() - 1
+        << "." << _extension;
+}
+
+bool
+TMSTileWriter::write(const TileKey& key, const std::string& data, unsigned long long hash)
+{
+    std::string path = getPathForTile( key );
+    osgEarth::makeDirectoryForFile( path );
+
+    std::ofstream out( path.c_str(), std::ios_base::out | std::ios_base::binary );
+    if ( !out.is_open() )
+        return false;
+
+    out.write( data.c_str(), data.size() );
+    return !out.fail();
+}
+
+bool
+TMSTileWriter::exists(const TileKey& key) const
+{
+    return osgDB::fileExists( getPathForTile(key) );
+}
+
+/*****************************************************************************************************/
+
+#undef  LC
+#define LC "[MBTilesTileWriter] "
+
+MBTilesTileWriter::MBTilesTileWriter(const std::string& filename) :
+_filename     ( filename ),
+_deduplicate  ( false ),
+_useMap       ( false ),
+_inTransaction( false ),
+_database     ( 0L ),
+_insertTile   ( 0L ),
+_insertImage  ( 0L ),
+_selectTile   ( 0L )
+{
+    //nop
+}
+
+MBTilesTileWriter::~MBTilesTileWriter()
+{
+    close();
+}
+
+#ifdef OSGEARTH_HAVE_SQLITE3
+
+bool
+MBTilesTileWriter::exec(const std::string& sql)
+{
+    char* errorMsg = 0L;
+    if ( SQLITE_OK != sqlite3_exec(_database, sql.c_str(), 0L, 0L, &errorMsg) )
+    {
+        OE_WARN << LC << "Failed SQL \"" << sql << "\": " << (errorMsg ? errorMsg : "") << std::endl;
+        sqlite3_free( errorMsg );
+        return false;
+    }
+    return true;
+}
+
+bool
+MBTilesTileWriter::putMetaData(const std::string& name, const std::string& value)
+{
+    sqlite3_stmt* del = 0L;
+    sqlite3_prepare_v2( _database, "DELETE FROM metadata WHERE name = ?", -1, &del, 0L );
+    if ( del )
+    {
+        sqlite3_bind_text( del, 1, name.c_str(), name.length(), SQLITE_STATIC );
+        sqlite3_step( del );
+        sqlite3_finalize( del );
+    }
+
+    sqlite3_stmt* insert = 0L;
+    if ( SQLITE_OK != sqlite3_prepare_v2(_database, "INSERT INTO metadata (name, value) VALUES (?, ?)", -1, &insert, 0L) )
+        return false;
+
+    sqlite3_bind_text( insert, 1, name.c_str(), name.length(), SQLITE_STATIC );
+    sqlite3_bind_text( insert, 2, value.c_str(), value.length(), SQLITE_STATIC );
+    int rc = sqlite3_step( insert );
+    sqlite3_finalize( insert );
+    return rc == SQLITE_DONE;
+}
+
+bool
+MBTilesTileWriter::open(TMSPackager* packager, const Profile* profile)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    closeDatabase();
+
+    _path = !_filename.empty() ? _filename : osgDB::concatPaths(
+        packager->getDestination(),
+        toLegalFileName(packager->getLayerName()) + ".mbtiles" );
+
+    osgEarth::makeDirectoryForFile( _path );
+
+    int rc = sqlite3_open_v2( _path.c_str(), &_database, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, 0L );
+    if ( rc != SQLITE_OK )
+    {
+        OE_WARN << LC << "Cannot open \"" << _path << "\": " << sqlite3_errmsg(_database) << std::endl;
+        sqlite3_close( _database );
+        _database = 0L;
+        return false;
+    }
+
+    // other packaging processes may write to the same file.
+    sqlite3_busy_timeout( _database, 60000 );
+
+    exec( "PRAGMA journal_mode=WAL" );
+    exec( "PRAGMA synchronous=NORMAL" );
+
+    // An existing database keeps its layout.
+    std::string tilesType;
+    sqlite3_stmt* select = 0L;
+    if ( SQLITE_OK == sqlite3_prepare_v2(_database, "SELECT type FROM sqlite_master WHERE name = 'tiles'", -1, &select, 0L) )
+    {
+        if ( sqlite3_step(select) == SQLITE_ROW )
+            tilesType = (const char*)sqlite3_column_text( select, 0 );
+        sqlite3_finalize( select );
+    }
+
+    _useMap = tilesType.empty() ? _deduplicate : tilesType == "view";
+    if ( _deduplicate && !_useMap )
+    {
+        OE_WARN << LC << "\"" << _path << "\" has a plain tiles table; tiles will not be shared" << std::endl;
+    }
+
+    bool ok = exec( "CREATE TABLE IF NOT EXISTS metadata (name text, value text)" );
+
+    if ( _useMap )
+    {
+        ok = ok &&
+            exec( "CREATE TABLE IF NOT EXISTS images (tile_id text, tile_data blob)" ) &&
+            exec( "CREATE UNIQUE INDEX IF NOT EXISTS images_id ON images (tile_id)" ) &&
+            exec( "CREATE TABLE IF NOT EXISTS map (zoom_level integer, tile_column integer, tile_row integer, tile_id text)" ) &&
+            exec( "CREATE UNIQUE INDEX IF NOT EXISTS map_index ON map (zoom_level, tile_column, tile_row)" ) &&
+            exec( "CREATE VIEW IF NOT EXISTS tiles AS"
+                  " SELECT map.zoom_level AS zoom_level, map.tile_column AS tile_column,"
+                  " map.tile_row AS tile_row, images.tile_data AS tile_data"
+                  " FROM map JOIN images ON images.tile_id = map.tile_id" );
+
+        ok = ok &&
+            SQLITE_OK == sqlite3_prepare_v2( _database,
+                "INSERT OR REPLACE INTO map (zoom_level, tile_column, tile_row, tile_id) VALUES (?, ?, ?, ?)", -1, &_insertTile, 0L ) &&
+            SQLITE_OK == sqlite3_prepare_v2( _database,
+                "INSERT OR REPLACE INTO images (tile_id, tile_data) VALUES (?, ?)", -1, &_insertImage, 0L );
+    }
+    else
+    {
+        ok = ok &&
+            exec( "CREATE TABLE IF NOT EXISTS tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob)" ) &&
+            exec( "CREATE UNIQUE INDEX IF NOT EXISTS tile_index ON tiles (zoom_level, tile_column, tile_row)" );
+
+        ok = ok &&
+            SQLITE_OK == sqlite3_prepare_v2( _database,
+                "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)", -1, &_insertTile, 0L );
+    }
+
+    // "tiles" is a view over "map" and "images" in the shared layout.
+    ok = ok &&
+        SQLITE_OK == sqlite3_prepare_v2( _database,
+            "SELECT 1 FROM tiles WHERE zoom_level = ? AND tile_column = ? AND tile_row = ?", -1, &_selectTile, 0L );
+
+    if ( !ok )
+    {
+        OE_WARN << LC << "Failed to set up \"" << _path << "\": " << sqlite3_errmsg(_database) << std::endl;
+        closeDatabase();
+        return false;
+    }
+
+    putMetaData( "name",    packager->getLayerName() );
+    putMetaData( "format",  packager->getExtension() );
+    putMetaData( "version", "1.0" );
+    if ( profile )
+        putMetaData( "profile", profile->toProfileOptions().getConfig().toJSON(false) );
+
+    OE_INFO << LC << "Writing to \"" << _path << "\"" << (_useMap ? " (shared tiles)" : "") << std::endl;
+    return true;
+}
+
+bool
+MBTilesTileWriter::write(const TileKey& key, const std::string& data, unsigned long long hash)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( !_database )
+        return false;
+
+    if ( !_inTransaction )
+    {
+        if ( !exec("BEGIN") )
+            return false;
+        _inTransaction = true;
+    }
+
+    // MBTiles rows count from the bottom
+    unsigned numCols, numRows;
+    key.getProfile()->getNumTiles( key.getLevelOfDetail(), numCols, numRows );
+    int z = key.getLevelOfDetail();
+    int x = key.getTileX();
+    int y = numRows - key.getTileY() - 1;
+
+    bool ok = true;
+
+    if ( _useMap )
+    {
+        std::stringstream tileID;
+        if ( hash != 0ULL )
+            tileID << std::hex << hash;
+        else
+            tileID << z << "/" << x << "/" << y;
+        std::string id = tileID.str();
+
+        // shared tiles are stored once
+        if ( hash == 0ULL || _images.insert(hash).second )
+        {
+            sqlite3_bind_text( _insertImage, 1, id.c_str(), id.length(), SQLITE_STATIC );
+            sqlite3_bind_blob( _insertImage, 2, data.c_str(), data.length(), SQLITE_STATIC );
+            ok = sqlite3_step( _insertImage ) == SQLITE_DONE;
+            sqlite3_reset( _insertImage );
+        }
+
+        sqlite3_bind_int ( _insertTile, 1, z );
+        sqlite3_bind_int ( _insertTile, 2, x );
+        sqlite3_bind_int ( _insertTile, 3, y );
+        sqlite3_bind_text( _insertTile, 4, id.c_str(), id.length(), SQLITE_STATIC );
+        ok = ok && sqlite3_step( _insertTile ) == SQLITE_DONE;
+        sqlite3_reset( _insertTile );
+    }
+    else
+    {
+        sqlite3_bind_int ( _insertTile, 1, z );
+        sqlite3_bind_int ( _insertTile, 2, x );
+        sqlite3_bind_int ( _insertTile, 3, y );
+        sqlite3_bind_blob( _insertTile, 4, data.c_str(), data.length(), SQLITE_STATIC );
+        ok = sqlite3_step( _insertTile ) == SQLITE_DONE;
+        sqlite3_reset( _insertTile );
+    }
+
+    if ( !ok )
+    {
+        OE_WARN << LC << "Failed to write " << key.str() << ": " << sqlite3_errmsg(_database) << std::endl;
+    }
+
+    return ok;
+}
+
+bool
+MBTilesTileWriter::commit()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( !_database || !_inTransaction )
+        return true;
+
+    _inTransaction = false;
+    return exec( "COMMIT" );
+}
+
+void
+MBTilesTileWriter::close()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    closeDatabase();
+}
+
+bool
+MBTilesTileWriter::exists(const TileKey& key) const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( !_database || !_selectTile )
+        return false;
+
+    // MBTiles rows count from the bottom
+    unsigned numCols, numRows;
+    key.getProfile()->getNumTiles( key.getLevelOfDetail(), numCols, numRows );
+
+    // the connection sees its own uncommitted writes, so this includes
+    // tiles written earlier in the current transaction.
+    sqlite3_bind_int( _selectTile, 1, key.getLevelOfDetail() );
+    sqlite3_bind_int( _selectTile, 2, key.getTileX() );
+    sqlite3_bind_int( _selectTile, 3, numRows - key.getTileY() - 1 );
+    bool found = sqlite3_step( _selectTile ) == SQLITE_ROW;
+    sqlite3_reset( _selectTile );
+    return found;
+}
+
+void
+MBTilesTileWriter::closeDatabase()
+{
+    if ( !_database )
+        return;
+
+    if ( _inTransaction )
+    {
+        _inTransaction = false;
+        exec( "COMMIT" );
+    }
+
+    if ( _insertTile )
+        sqlite3_finalize( _insertTile );
+    if ( _insertImage )
+        sqlite3_finalize( _insertImage );
+    if ( _selectTile )
+        sqlite3_finalize( _selectTile );
+    _insertTile = 0L;
+    _insertImage = 0L;
+    _selectTile = 0L;
+
+    sqlite3_close( _database );
+    _database = 0L;
+    _images.clear();
+}
+
+#else // OSGEARTH_HAVE_SQLITE3
+
+bool MBTilesTileWriter::exec(const std::string& sql) { return false; }
+bool MBTilesTileWriter::putMetaData(const std::string& name, const std::string& value) { return false; }
+
+bool
+MBTilesTileWriter::open(TMSPackager* packager, const Profile* profile)
+{
+    OE_WARN << LC << "osgEarth was built without SQLite; cannot write MBTiles" << std::endl;
+    return false;
+}
+
+bool MBTilesTileWriter::write(const TileKey& key, const std::string& data, unsigned long long hash) { return false; }
+bool MBTilesTileWriter::commit() { return false; }
+void MBTilesTileWriter::close() { }
+bool MBTilesTileWriter::exists(const TileKey& key) const { return false; }
+void MBTilesTileWriter::closeDatabase() { }
+
+#endif // OSGEARTH_HAVE_SQLITE3
+
+#undef  LC
+#define LC "[TMSPackager] "
+
+/*****************************************************************************************************/
+
 WriteTMSTileHandler::WriteTMSTileHandler(TerrainLayer* layer,  Map* map, TMSPackager* packager):
     _layer( layer ),
     _map(map),
@@ -69,8 +692,19 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
     // Get the user set TileSource for output if it is set
     osgEarth::TileSource* tileSource = _packager->getTileSource();
 
+    // Hand tiles to the encode stage when pipelining
+    TMSPackager::Pipeline* pipeline = _packager->_pipeline.get();
+    osg::Timer_t fetchStart = osg::Timer::instance()->tick();
+
     // Don't write out a new file if we're not overwriting
-    if (!tileSource && osgDB::fileExists(path) && !_packager->getOverwrite())
+    if (pipeline)
+    {
+        if (!_packager->getOverwrite() && _packager->getTileWriter()->exists(key))
+        {
+            return true;
+        }
+    }
+    else if (!tileSource && osgDB::fileExists(path) && !_packager->getOverwrite())
     {
         return true;
     }
@@ -114,6 +748,12 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
                 final = ImageUtils::convertToRGB8( final );
             }
 
+            if (pipeline)
+            {
+                pipeline->add(key, final.get(), osg::Timer::instance()->delta_s(fetchStart, osg::Timer::instance()->tick()));
+                return true;
+            }
+
             // use the TileSource provided if set, else use writeImageFile
             if (tileSource)
             {
@@ -137,6 +777,12 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             ImageToHeightFieldConverter conv;
             osg::ref_ptr< osg::Image > image = conv.convert( hf.getHeightField(), _packager->getElevationPixelDepth() );
 
+            if (pipeline)
+            {
+                pipeline->add(key, image.get(), osg::Timer::instance()->delta_s(fetchStart, osg::Timer::instance()->tick()));
+                return true;
+            }
+
             // use the TileSource provided if set, else use writeImageFile
             if (tileSource)
             {
@@ -224,6 +870,18 @@ std::string WriteTMSTileHandler::getProcessString() const
     {
         buf << " --alpha-mask ";
     }
+    if (_packager->getNumEncodeThreads() > 0)
+    {
+        buf << " --encode-threads " << _packager->getNumEncodeThreads() << " ";
+        buf << " --write-batch " << _packager->getWriteBatchSize() << " ";
+        MBTilesTileWriter* mbtiles = dynamic_cast<MBTilesTileWriter*>(_packager->getTileWriter());
+        if (mbtiles)
+        {
+            buf << " --mbtiles ";
+            if (mbtiles->getDeduplicate())
+                buf << " --dedup ";
+        }
+    }
     return buf.str();
 }
 
@@ -240,8 +898,15 @@ _visitor(new TileVisitor()),
     _overwrite(false),
     _keepEmpties(false),
     _applyAlphaMask(false),
-    _tileSource(0L)
+    _tileSource(0L),
+    _numEncodeThreads(0u),
+    _writeBatchSize(1000u)
+{
+}
+
+TMSPackager::~TMSPackager()
 {
+    //nop
 }
 
 const std::string& TMSPackager::getDestination() const
@@ -431,9 +1096,39 @@ void TMSPackager::run( TerrainLayer* layer,  Map* map  )
     }
 
 
+    // Set up the encode and write stages if requested.
+    if (_numEncodeThreads > 0 && !_tileSource.valid())
+    {
+        if (!_tileWriter.valid())
+        {
+            _tileWriter = new TMSTileWriter();
+        }
+
+        if (!_tileWriter->open(this, map->getProfile()))
+        {
+            OE_WARN << LC << "Failed to open the tile writer; writing tiles directly" << std::endl;
+        }
+        else
+        {
+            _pipeline = new Pipeline(_tileWriter.get(), _extension, _writeOptions.get(), _numEncodeThreads, _writeBatchSize);
+            if (!_pipeline->valid())
+            {
+                _pipeline = 0L;
+                _tileWriter->close();
+            }
+        }
+    }
+
     _handler = new WriteTMSTileHandler(layer, map, this);
     _visitor->setTileHandler( _handler );
     _visitor->run( map->getProfile() );
+
+    if (_pipeline.valid())
+    {
+        _pipeline->finish();
+        _pipeline = 0L;
+        _tileWriter->close();
+    }
 }
 
 void TMSPackager::writeXML(TerrainLayer* layer, Map* map)
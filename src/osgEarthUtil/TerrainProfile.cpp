@@ -23,6 +23,11 @@
 #include <osgEarth/MapNode>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/GeoMath>
+#include <osgEarth/Map>
+#include <OpenThreads/Thread>
+#include <algorithm>
+
+#define LC "[TerrainProfile] "
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -235,3 +240,221 @@ void TerrainProfileCalculator::computeTerrainProfile( osgEarth::MapNode* mapNode
         profile.addElevation( slice.getDistanceHeightIntersections()[i].first, slice.getDistanceHeightIntersections()[i].second);
     }
 }
+
+/***************************************************/
+
+namespace
+{
+    typedef TerrainProfileSampler::Result         Result;
+    typedef TerrainProfileSampler::RefineCallback RefineCallback;
+
+    // Sample points along a route, in long/lat degrees, and their distances
+    // in meters from the start of the route.
+    struct Route
+    {
+        std::vector<osg::Vec3d> _points;
+        std::vector<double>     _distances;
+    };
+
+    bool buildRoute(const std::vector<GeoPoint>& polyline, const SpatialReference* srs, double spacing, Route& route)
+    {
+        std::vector<GeoPoint> geo;
+        for(unsigned i = 0; i < polyline.size(); ++i)
+        {
+            GeoPoint p;
+            if ( polyline[i].transform(srs, p) )
+                geo.push_back( p );
+        }
+
+        if ( geo.size() < 2 )
+            return false;
+
+        double total = 0.0;
+        for(unsigned s = 0; s+1 < geo.size(); ++s)
+        {
+            double lat1 = osg::DegreesToRadians(geo[s].y()),   lon1 = osg::DegreesToRadians(geo[s].x());
+            double lat2 = osg::DegreesToRadians(geo[s+1].y()), lon2 = osg::DegreesToRadians(geo[s+1].x());
+            double d = GeoMath::distance(lat1, lon1, lat2, lon2);
+            unsigned n = std::max( 1u, (unsigned)ceil(d / spacing) );
+
+            route._points.push_back( osg::Vec3d(geo[s].x(), geo[s].y(), 0.0) );
+            route._distances.push_back( total );
+
+            for(unsigned i = 1; i < n; ++i)
+            {
+                double t = (double)i / (double)n;
+                double lat, lon;
+                GeoMath::interpolate( lat1, lon1, lat2, lon2, t, lat, lon );
+                route._points.push_back( osg::Vec3d(osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), 0.0) );
+                route._distances.push_back( total + d*t );
+            }
+            total += d;
+        }
+
+        route._points.push_back( osg::Vec3d(geo.back().x(), geo.back().y(), 0.0) );
+        route._distances.push_back( total );
+        return true;
+    }
+
+    struct SampleChunkTask : public TaskRequest
+    {
+        SampleChunkTask(ElevationPool* pool, const SpatialReference* srs, unsigned lod, const Route& route,
+                        unsigned begin, unsigned end, std::vector<float>& output, MultiEvent& done) :
+            _pool(pool), _srs(srs), _lod(lod), _route(route), _begin(begin), _end(end), _output(output), _done(done) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<ElevationEnvelope> env = _pool->createEnvelope(_srs, _lod);
+            for(unsigned i = _begin; i < _end; ++i)
+            {
+                _output[i] = env->getElevation(_route._points[i].x(), _route._points[i].y());
+            }
+            _done.set();
+        }
+
+        ElevationPool*          _pool;
+        const SpatialReference* _srs;
+        unsigned                _lod;
+        const Route&            _route;
+        unsigned                _begin, _end;
+        std::vector<float>&     _output;
+        MultiEvent&             _done;
+    };
+
+    // Samples every pass of one profile, dispatching the chunks of each
+    // pass to the sampling threads.
+    struct ProfileJob : public TaskRequest
+    {
+        ProfileJob(ElevationPool* pool, const SpatialReference* srs, TaskService* service,
+                   const std::vector<GeoPoint>& polyline, double spacing,
+                   const std::vector<unsigned>& lods, unsigned chunkSize, RefineCallback* callback) :
+            _pool(pool), _srs(srs), _service(service), _polyline(polyline), _spacing(spacing),
+            _lods(lods), _chunkSize(chunkSize), _callback(callback) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            Route route;
+            if ( !buildRoute(_polyline, _srs.get(), _spacing, route) )
+            {
+                OE_WARN << LC << "Cannot sample a profile; the route needs at least two valid points" << std::endl;
+                Result* result = new Result();
+                result->isFinal = true;
+                _promise.resolve( result );
+                return;
+            }
+
+            unsigned numSamples = route._points.size();
+            unsigned numChunks  = (numSamples + _chunkSize - 1) / _chunkSize;
+            std::vector<float> elevations( numSamples, NO_DATA_VALUE );
+
+            for(unsigned p = 0; p < _lods.size(); ++p)
+            {
+                // nobody is waiting for the result any more:
+                if ( _promise.isAbandoned() )
+                    return;
+
+                MultiEvent done( numChunks );
+                for(unsigned c = 0; c < numChunks; ++c)
+                {
+                    unsigned begin = c * _chunkSize;
+                    unsigned end   = std::min( begin + _chunkSize, numSamples );
+                    _service->add( new SampleChunkTask(_pool.get(), _srs.get(), _lods[p], route, begin, end, elevations, done) );
+                }
+                done.wait();
+
+                osg::ref_ptr<Result> result = new Result();
+                result->lod     = _lods[p];
+                result->isFinal = (p+1 == _lods.size());
+                for(unsigned i = 0; i < numSamples; ++i)
+                {
+                    if ( elevations[i] != NO_DATA_VALUE )
+                        result->profile.addElevation( route._distances[i], elevations[i] );
+                }
+
+                if ( _callback.valid() )
+                    _callback->onRefined( result.get() );
+
+                if ( result->isFinal )
+                    _promise.resolve( result.get() );
+            }
+        }
+
+        osg::ref_ptr<ElevationPool>          _pool;
+        osg::ref_ptr<const SpatialReference> _srs;
+        osg::ref_ptr<TaskService>            _service;
+        std::vector<GeoPoint>                _polyline;
+        double                               _spacing;
+        std::vector<unsigned>                _lods;
+        unsigned                             _chunkSize;
+        osg::ref_ptr<RefineCallback>         _callback;
+        Promise<Result>                      _promise;
+    };
+}
+
+TerrainProfileSampler::TerrainProfileSampler(const Map* map, unsigned numThreads) :
+_numThreads( numThreads > 0u ? numThreads : (unsigned)std::max(1, OpenThreads::GetNumberOfProcessors()) ),
+_spacing   ( 100.0 ),
+_minLOD    ( 8u ),
+_lodStep   ( 3u ),
+_chunkSize ( 1024u )
+{
+    if ( map )
+    {
+        _pool    = map->getElevationPool();
+        _profile = map->getProfile();
+        if ( _profile.valid() )
+            _srs = _profile->getSRS()->getGeographicSRS();
+    }
+
+    _jobs    = new TaskService( "TerrainProfileSampler jobs", 1 );
+    _service = new TaskService( "TerrainProfileSampler", _numThreads );
+}
+
+TerrainProfileSampler::~TerrainProfileSampler()
+{
+    // let a running job finish before its sampling threads go away:
+    _jobs    = 0L;
+    _service = 0L;
+}
+
+unsigned
+TerrainProfileSampler::getMaxLOD() const
+{
+    if ( _maxLOD.isSet() )
+        return _maxLOD.get();
+
+    double res = _spacing;
+    if ( _profile->getSRS()->isGeographic() )
+        res = osg::RadiansToDegrees(_spacing / _profile->getSRS()->getEllipsoid()->getRadiusEquator());
+
+    return _profile->getLevelOfDetailForHorizResolution( res, _pool->getTileSize() );
+}
+
+Future<TerrainProfileSampler::Result>
+TerrainProfileSampler::compute(const std::vector<GeoPoint>& polyline, RefineCallback* callback)
+{
+    if ( !_pool.valid() || !_srs.valid() || _spacing <= 0.0 || polyline.size() < 2 )
+    {
+        Promise<Result> promise;
+        Result* result = new Result();
+        result->isFinal = true;
+        promise.resolve( result );
+        return promise.getFuture();
+    }
+
+    unsigned maxLOD = getMaxLOD();
+    unsigned step   = std::max( 1u, _lodStep );
+
+    std::vector<unsigned> lods;
+    for(unsigned lod = std::min(_minLOD, maxLOD); lod < maxLOD; lod += step)
+        lods.push_back( lod );
+    lods.push_back( maxLOD );
+
+    ProfileJob* job = new ProfileJob(
+        _pool.get(), _srs.get(), _service.get(), polyline, _spacing,
+        lods, std::max(1u, _chunkSize), callback );
+
+    Future<Result> result = job->_promise.getFuture();
+    _jobs->add( job );
+    return result;
+}
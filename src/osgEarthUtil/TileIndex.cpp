@@ -27,6 +27,28 @@
 #include <ogr_api.h>
 #include <osgEarthFeatures/OgrUtils>
 #include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef NOGDI
+#    define NOGDI
+#  endif
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#define LC "[TileIndex] "
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -36,6 +58,374 @@ using namespace std;
 
 #define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Layout of a packed index file. Values are in the byte order of the
+    // machine that wrote the file; readers reject a different order.
+    //
+    //   PackedHeader
+    //   SRS WKT       (_srsLength bytes)
+    //   level ends    (uint32_t per level, leaves first)
+    //   boxes         (PackedBox per node, leaves first)
+    //   entries       (PackedEntry per leaf, in leaf order)
+    //   strings       (file locations, unterminated)
+    //
+    // The leaves are the entries sorted along a Hilbert curve. Each level
+    // above holds one box per run of _nodeSize boxes in the level below, so
+    // a node's children are found from its position alone.
+    const char     PACKED_MAGIC[8]   = { 'O','E','T','I','N','D','E','X' };
+    const uint32_t PACKED_BYTE_ORDER = 0x01020304u;
+    const uint32_t PACKED_VERSION    = 1u;
+    const uint32_t PACKED_NODE_SIZE  = 16u;
+
+    struct PackedHeader
+    {
+        char     _magic[8];
+        uint32_t _byteOrder;
+        uint32_t _version;
+        uint32_t _nodeSize;
+        uint32_t _numEntries;
+        uint32_t _numLevels;
+        uint32_t _numBoxes;
+        uint32_t _srsLength;
+        uint32_t _stringsLength;
+        uint64_t _levelsOffset;
+        uint64_t _boxesOffset;
+        uint64_t _entriesOffset;
+        uint64_t _stringsOffset;
+    };
+
+    struct PackedBox
+    {
+        double _xMin, _yMin, _xMax, _yMax;
+    };
+
+    struct PackedEntry
+    {
+        double   _resolution;
+        double   _noData;
+        uint32_t _location;
+        uint32_t _locationLength;
+        uint32_t _hasNoData;
+        uint32_t _order;        // position in the list the index was built from
+    };
+
+    uint64_t align8(uint64_t offset)
+    {
+        return (offset + 7u) & ~(uint64_t)7u;
+    }
+
+    // Distance along a Hilbert curve filling a 65536x65536 grid.
+    uint32_t hilbert(uint32_t x, uint32_t y)
+    {
+        const uint32_t n = 1u << 16;
+        uint32_t d = 0u;
+        for (uint32_t s = n/2; s > 0; s /= 2)
+        {
+            uint32_t rx = (x & s) > 0 ? 1u : 0u;
+            uint32_t ry = (y & s) > 0 ? 1u : 0u;
+            d += s * s * ((3u * rx) ^ ry);
+            if ( ry == 0 )
+            {
+                if ( rx == 1 )
+                {
+                    x = n-1 - x;
+                    y = n-1 - y;
+                }
+                std::swap( x, y );
+            }
+        }
+        return d;
+    }
+
+    struct SortByHilbert
+    {
+        SortByHilbert(const std::vector<uint32_t>& values) : _values(values) { }
+        bool operator()(uint32_t lhs, uint32_t rhs) const { return _values[lhs] < _values[rhs]; }
+        const std::vector<uint32_t>& _values;
+    };
+
+    struct SortByOrder
+    {
+        SortByOrder(const PackedEntry* entries) : _entries(entries) { }
+        bool operator()(uint32_t lhs, uint32_t rhs) const { return _entries[lhs]._order < _entries[rhs]._order; }
+        const PackedEntry* _entries;
+    };
+
+    void pad(std::ostream& out, uint64_t& offset, uint64_t target)
+    {
+        for( ; offset < target; ++offset )
+            out.put( 0 );
+    }
+
+    template<typename T>
+    void writeArray(std::ostream& out, uint64_t& offset, const std::vector<T>& values)
+    {
+        if ( !values.empty() )
+        {
+            out.write( reinterpret_cast<const char*>(&values[0]), values.size()*sizeof(T) );
+            offset += values.size()*sizeof(T);
+        }
+    }
+}
+
+/**
+ * Read-only view of a packed index file mapped into memory. Nothing changes
+ * after open(), so any number of threads can query it at once.
+ */
+class TileIndex::PackedIndex : public osg::Referenced
+{
+public:
+    PackedIndex() :
+        _data   ( 0L ),
+        _size   ( 0 ),
+#ifdef _WIN32
+        _file   ( INVALID_HANDLE_VALUE ),
+        _mapping( 0L ),
+#endif
+        _header ( 0L ),
+        _levels ( 0L ),
+        _boxes  ( 0L ),
+        _entries( 0L ),
+        _strings( 0L )
+    {
+    }
+
+    bool open(const std::string& filename)
+    {
+        if ( !map(filename) )
+        {
+            OE_WARN << LC << "Failed to map " << filename << std::endl;
+            return false;
+        }
+
+        if ( _size < sizeof(PackedHeader) )
+            return fail(filename, "file is too small");
+
+        _header = reinterpret_cast<const PackedHeader*>(_data);
+        const PackedHeader& h = *_header;
+
+        if ( ::memcmp(h._magic, PACKED_MAGIC, sizeof(PACKED_MAGIC)) != 0 )
+            return fail(filename, "not a packed index");
+        if ( h._byteOrder != PACKED_BYTE_ORDER )
+            return fail(filename, "written on a machine with a different byte order");
+        if ( h._version != PACKED_VERSION )
+            return fail(filename, "unsupported version");
+
+        if (!fits(sizeof(PackedHeader), h._srsLength) ||
+            !fits(h._levelsOffset,  (uint64_t)h._numLevels  * sizeof(uint32_t)) ||
+            !fits(h._boxesOffset,   (uint64_t)h._numBoxes   * sizeof(PackedBox)) ||
+            !fits(h._entriesOffset, (uint64_t)h._numEntries * sizeof(PackedEntry)) ||
+            !fits(h._stringsOffset, h._stringsLength) ||
+            h._levelsOffset % 8 != 0 || h._boxesOffset % 8 != 0 || h._entriesOffset % 8 != 0 ||
+            h._nodeSize < 2 || h._numLevels == 0 || h._numBoxes < h._numEntries)
+        {
+            return fail(filename, "corrupt header");
+        }
+
+        const char* base = static_cast<const char*>(_data);
+        _levels  = reinterpret_cast<const uint32_t*>(base + h._levelsOffset);
+        _boxes   = reinterpret_cast<const PackedBox*>(base + h._boxesOffset);
+        _entries = reinterpret_cast<const PackedEntry*>(base + h._entriesOffset);
+        _strings = base + h._stringsOffset;
+
+        // Each level must hold exactly the parents of the level below it, so
+        // the child ranges query() computes stay inside the boxes.
+        if ( _levels[0] != h._numEntries )
+            return fail(filename, "corrupt tree");
+
+        for (uint32_t level = 1; level < h._numLevels; ++level)
+        {
+            uint64_t start = level > 1 ? _levels[level-2] : 0u;
+            uint64_t end   = _levels[level-1];
+            if ( end <= start + 1 || _levels[level] != end + (end - start + h._nodeSize - 1) / h._nodeSize )
+                return fail(filename, "corrupt tree");
+        }
+
+        uint64_t topStart = h._numLevels > 1 ? _levels[h._numLevels-2] : 0u;
+        if ( _levels[h._numLevels-1] != h._numBoxes || h._numBoxes > topStart + 1 )
+            return fail(filename, "corrupt tree");
+
+        std::string wkt( base + sizeof(PackedHeader), h._srsLength );
+        _srs = SpatialReference::create( wkt );
+        if ( !_srs.valid() )
+            return fail(filename, "invalid SRS");
+
+        OE_DEBUG << LC << "Mapped " << filename << " with " << h._numEntries << " entries" << std::endl;
+        return true;
+    }
+
+    const SpatialReference* getSRS() const { return _srs.get(); }
+
+    /**
+     * Indices of the leaves whose boxes intersect an extent, or of all the
+     * leaves if the extent is invalid, in the order the index was built.
+     */
+    void query(const GeoExtent& extent, std::vector<uint32_t>& leaves) const
+    {
+        const PackedHeader& h = *_header;
+        leaves.clear();
+
+        if ( !extent.isValid() )
+        {
+            for (uint32_t i = 0; i < h._numEntries; ++i)
+                leaves.push_back( i );
+        }
+        else if ( h._numBoxes > 0 )
+        {
+            GeoExtent transformed = extent.transform( _srs.get() );
+            const Bounds b = transformed.bounds();
+
+            // node index and level of each node still to visit
+            std::vector< std::pair<uint32_t, uint32_t> > stack;
+            stack.push_back( std::make_pair(h._numBoxes-1, h._numLevels-1) );
+
+            while ( !stack.empty() )
+            {
+                uint32_t node  = stack.back().first;
+                uint32_t level = stack.back().second;
+                stack.pop_back();
+
+                const PackedBox& box = _boxes[node];
+                if (box._xMin > b.xMax() || box._xMax < b.xMin() ||
+                    box._yMin > b.yMax() || box._yMax < b.yMin())
+                {
+                    continue;
+                }
+
+                if ( level == 0 )
+                {
+                    leaves.push_back( node );
+                }
+                else
+                {
+                    uint32_t levelStart = level > 1 ? _levels[level-2] : 0u;
+                    uint32_t first      = levelStart + (node - _levels[level-1]) * h._nodeSize;
+                    uint32_t last       = std::min( first + h._nodeSize, _levels[level-1] );
+                    for (uint32_t child = first; child < last; ++child)
+                        stack.push_back( std::make_pair(child, level-1) );
+                }
+            }
+        }
+
+        std::sort( leaves.begin(), leaves.end(), SortByOrder(_entries) );
+    }
+
+    void getEntry(uint32_t leaf, const std::string& indexFilename, Entry& entry) const
+    {
+        const PackedEntry& e   = _entries[leaf];
+        const PackedBox&   box = _boxes[leaf];
+        entry._location   = getFullPath( indexFilename, getLocation(leaf) );
+        entry._extent     = GeoExtent( _srs.get(), box._xMin, box._yMin, box._xMax, box._yMax );
+        entry._resolution = e._resolution;
+        if ( e._hasNoData )
+            entry._noData = e._noData;
+    }
+
+    std::string getLocation(uint32_t leaf) const
+    {
+        const PackedEntry& e = _entries[leaf];
+        if ( (uint64_t)e._location + e._locationLength > _header->_stringsLength )
+            return std::string();
+        return std::string( _strings + e._location, e._locationLength );
+    }
+
+protected:
+    virtual ~PackedIndex()
+    {
+        unmap();
+    }
+
+private:
+    bool fits(uint64_t offset, uint64_t length) const
+    {
+        return offset <= _size && length <= _size - offset;
+    }
+
+    bool fail(const std::string& filename, const char* reason)
+    {
+        OE_WARN << LC << "Cannot read " << filename << ": " << reason << std::endl;
+        return false;
+    }
+
+#ifdef _WIN32
+    bool map(const std::string& filename)
+    {
+        _file = ::CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0L, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0L );
+        if ( _file == INVALID_HANDLE_VALUE )
+            return false;
+
+        LARGE_INTEGER size;
+        if ( !::GetFileSizeEx(_file, &size) || size.QuadPart == 0 )
+            return false;
+        _size = (size_t)size.QuadPart;
+
+        _mapping = ::CreateFileMappingA( _file, 0L, PAGE_READONLY, 0, 0, 0L );
+        if ( !_mapping )
+            return false;
+
+        _data = ::MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+        return _data != 0L;
+    }
+
+    void unmap()
+    {
+        if ( _data )
+            ::UnmapViewOfFile( _data );
+        if ( _mapping )
+            ::CloseHandle( _mapping );
+        if ( _file != INVALID_HANDLE_VALUE )
+            ::CloseHandle( _file );
+    }
+#else
+    bool map(const std::string& filename)
+    {
+        int fd = ::open( filename.c_str(), O_RDONLY );
+        if ( fd < 0 )
+            return false;
+
+        struct stat info;
+        if ( ::fstat(fd, &info) != 0 || info.st_size == 0 )
+        {
+            ::close( fd );
+            return false;
+        }
+        _size = (size_t)info.st_size;
+
+        void* data = ::mmap( 0L, _size, PROT_READ, MAP_SHARED, fd, 0 );
+        ::close( fd );
+        if ( data == MAP_FAILED )
+            return false;
+
+        _data = data;
+        return true;
+    }
+
+    void unmap()
+    {
+        if ( _data )
+            ::munmap( _data, _size );
+    }
+#endif
+
+    void*               _data;
+    size_t              _size;
+#ifdef _WIN32
+    HANDLE              _file;
+    HANDLE              _mapping;
+#endif
+    const PackedHeader* _header;
+    const uint32_t*     _levels;
+    const PackedBox*    _boxes;
+    const PackedEntry*  _entries;
+    const char*         _strings;
+    osg::ref_ptr<const SpatialReference> _srs;
+};
+
+//------------------------------------------------------------------------
+
 TileIndex::TileIndex()
 {
 }
@@ -53,6 +443,20 @@ TileIndex::load(const std::string& filename)
         return 0;
     }
 
+    if ( isPackedFilename(filename) )
+    {
+        osg::ref_ptr<PackedIndex> packed = new PackedIndex();
+        if ( !packed->open(filename) )
+        {
+            return 0L;
+        }
+
+        TileIndex* index = new TileIndex();
+        index->_packed = packed.get();
+        index->_filename = filename;
+        return index;
+    }
+
     //Load up an index file
     OGRFeatureOptions featureOpt;
     featureOpt.url() = filename;        
@@ -103,16 +507,189 @@ TileIndex::create( const std::string& filename, const osgEarth::SpatialReference
     OGRFieldDefnH  field = OGR_Fld_Create("location", OFTString);
     OGR_L_CreateField( layer, field, TRUE);
 
+    //Pixel size and NODATA value of each file, so that readers of the
+    //index don't have to open the files to find them
+    OGRFieldDefnH resolutionField = OGR_Fld_Create("resolution", OFTReal);
+    OGR_L_CreateField( layer, resolutionField, TRUE);
+
+    OGRFieldDefnH noDataField = OGR_Fld_Create("nodata", OFTReal);
+    OGR_L_CreateField( layer, noDataField, TRUE);
+
     OGR_DS_Destroy( dataSource );
 
     return load( filename );
 }
 
+bool
+TileIndex::isPackedFilename(const std::string& filename)
+{
+    return osgDB::getLowerCaseFileExtension( filename ) == "oeidx";
+}
+
+bool
+TileIndex::writePacked(const std::string& filename, const osgEarth::SpatialReference* srs, const std::vector< Entry >& entries)
+{
+    if ( !srs )
+    {
+        return false;
+    }
+
+    // Entries to store, in the order given, and the extent of them all.
+    std::vector<const Entry*> valid;
+    Bounds total;
+    for (std::vector<Entry>::const_iterator i = entries.begin(); i != entries.end(); ++i)
+    {
+        if ( i->_extent.isValid() )
+        {
+            valid.push_back( &(*i) );
+            total.expandBy( i->_extent.bounds() );
+        }
+        else
+        {
+            OE_WARN << LC << "Skipping " << i->_location << ", which has no valid extent" << std::endl;
+        }
+    }
+
+    const uint32_t numEntries = valid.size();
+
+    // Sort the entries along a Hilbert curve through their centers so that
+    // neighbors end up under the same nodes.
+    std::vector<uint32_t> curve( numEntries );
+    std::vector<uint32_t> sorted( numEntries );
+    double width  = total.width();
+    double height = total.height();
+    for (uint32_t i = 0; i < numEntries; ++i)
+    {
+        const Bounds b = valid[i]->_extent.bounds();
+        double x = width  > 0.0 ? (0.5*(b.xMin()+b.xMax()) - total.xMin()) / width  : 0.0;
+        double y = height > 0.0 ? (0.5*(b.yMin()+b.yMax()) - total.yMin()) / height : 0.0;
+        curve[i]  = hilbert( (uint32_t)(x * 65535.0), (uint32_t)(y * 65535.0) );
+        sorted[i] = i;
+    }
+    std::stable_sort( sorted.begin(), sorted.end(), SortByHilbert(curve) );
+
+    // Leaves and their records, then each level of parents above them.
+    std::vector<PackedBox>   boxes;
+    std::vector<PackedEntry> records;
+    std::vector<uint32_t>    levels;
+    std::string              strings;
+
+    for (uint32_t i = 0; i < numEntries; ++i)
+    {
+        const Entry&  entry = *valid[sorted[i]];
+        const Bounds  b     = entry._extent.bounds();
+
+        PackedBox box = { b.xMin(), b.yMin(), b.xMax(), b.yMax() };
+        boxes.push_back( box );
+
+        PackedEntry record;
+        record._resolution     = entry._resolution;
+        record._noData         = entry._noData.isSet() ? entry._noData.get() : 0.0;
+        record._hasNoData      = entry._noData.isSet() ? 1u : 0u;
+        record._location       = strings.size();
+        record._locationLength = entry._location.size();
+        record._order          = sorted[i];
+        records.push_back( record );
+
+        strings.append( entry._location );
+    }
+    levels.push_back( numEntries );
+
+    uint32_t levelStart = 0, levelEnd = numEntries;
+    while ( levelEnd - levelStart > 1 )
+    {
+        for (uint32_t i = levelStart; i < levelEnd; i += PACKED_NODE_SIZE)
+        {
+            PackedBox parent = boxes[i];
+            uint32_t last = std::min( i + PACKED_NODE_SIZE, levelEnd );
+            for (uint32_t j = i+1; j < last; ++j)
+            {
+                parent._xMin = std::min( parent._xMin, boxes[j]._xMin );
+                parent._yMin = std::min( parent._yMin, boxes[j]._yMin );
+                parent._xMax = std::max( parent._xMax, boxes[j]._xMax );
+                parent._yMax = std::max( parent._yMax, boxes[j]._yMax );
+            }
+            boxes.push_back( parent );
+        }
+        levelStart = levelEnd;
+        levelEnd   = boxes.size();
+        levels.push_back( levelEnd );
+    }
+
+    const std::string& wkt = srs->getWKT();
+
+    PackedHeader header;
+    ::memcpy( header._magic, PACKED_MAGIC, sizeof(PACKED_MAGIC) );
+    header._byteOrder     = PACKED_BYTE_ORDER;
+    header._version       = PACKED_VERSION;
+    header._nodeSize      = PACKED_NODE_SIZE;
+    header._numEntries    = numEntries;
+    header._numLevels     = levels.size();
+    header._numBoxes      = boxes.size();
+    header._srsLength     = wkt.size();
+    header._stringsLength = strings.size();
+    header._levelsOffset  = align8( sizeof(PackedHeader) + wkt.size() );
+    header._boxesOffset   = align8( header._levelsOffset  + levels.size()  * sizeof(uint32_t) );
+    header._entriesOffset = align8( header._boxesOffset   + boxes.size()   * sizeof(PackedBox) );
+    header._stringsOffset = align8( header._entriesOffset + records.size() * sizeof(PackedEntry) );
+
+    std::ofstream out( filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    if ( !out.is_open() )
+    {
+        OE_WARN << LC << "Failed to create " << filename << std::endl;
+        return false;
+    }
+
+    uint64_t offset = 0;
+    out.write( reinterpret_cast<const char*>(&header), sizeof(PackedHeader) );
+    out.write( wkt.data(), wkt.size() );
+    offset = sizeof(PackedHeader) + wkt.size();
+
+    pad( out, offset, header._levelsOffset );
+    writeArray( out, offset, levels );
+    pad( out, offset, header._boxesOffset );
+    writeArray( out, offset, boxes );
+    pad( out, offset, header._entriesOffset );
+    writeArray( out, offset, records );
+    pad( out, offset, header._stringsOffset );
+    out.write( strings.data(), strings.size() );
+
+    out.close();
+    if ( out.fail() )
+    {
+        OE_WARN << LC << "Failed to write " << filename << std::endl;
+        return false;
+    }
+
+    OE_INFO << LC << "Wrote " << numEntries << " entries to " << filename << std::endl;
+    return true;
+}
+
+const SpatialReference*
+TileIndex::getSRS() const
+{
+    if ( _packed.valid() )
+        return _packed->getSRS();
+
+    return _features->getFeatureProfile()->getSRS();
+}
 
 void
 TileIndex::getFiles(const osgEarth::GeoExtent& extent, std::vector< std::string >& files)
 {            
     files.clear();
+
+    if ( _packed.valid() )
+    {
+        std::vector<uint32_t> leaves;
+        _packed->query( extent, leaves );
+        for (std::vector<uint32_t>::const_iterator i = leaves.begin(); i != leaves.end(); ++i)
+        {
+            files.push_back( getFullPath(_filename, _packed->getLocation(*i)) );
+        }
+        return;
+    }
+
     osgEarth::Symbology::Query query;    
 
     GeoExtent transformed = extent.transform( _features->getFeatureProfile()->getSRS() );
@@ -130,9 +707,63 @@ TileIndex::getFiles(const osgEarth::GeoExtent& extent, std::vector< std::string
     }    
 }
 
+void
+TileIndex::getEntries(const osgEarth::GeoExtent& extent, std::vector< Entry >& entries)
+{
+    entries.clear();
+
+    if ( _packed.valid() )
+    {
+        std::vector<uint32_t> leaves;
+        _packed->query( extent, leaves );
+        entries.resize( leaves.size() );
+        for (unsigned i = 0; i < leaves.size(); ++i)
+        {
+            _packed->getEntry( leaves[i], _filename, entries[i] );
+        }
+        return;
+    }
+
+    osgEarth::Symbology::Query query;
+
+    const SpatialReference* srs = _features->getFeatureProfile()->getSRS();
+    if ( extent.isValid() )
+    {
+        GeoExtent transformed = extent.transform( srs );
+        query.bounds() = transformed.bounds();
+    }
+    osg::ref_ptr< osgEarth::Features::FeatureCursor> cursor = _features->createFeatureCursor( query );
+
+    while (cursor.valid() && cursor->hasMore())
+    {
+        osg::ref_ptr< osgEarth::Features::Feature> feature = cursor->nextFeature();
+        if (feature.valid() && feature->getGeometry())
+        {
+            Entry entry;
+            entry._location = getFullPath(_filename, feature->getString("location"));
+            entry._extent = GeoExtent( srs, feature->getGeometry()->getBounds() );
+            entry._resolution = feature->getDouble("resolution", 0.0);
+            if ( feature->isSet("nodata") )
+                entry._noData = feature->getDouble("nodata");
+            entries.push_back( entry );
+        }
+    }
+}
+
 bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
+{
+    return add( filename, extent, 0.0, optional<double>() );
+}
+
+bool TileIndex::add( const std::string& filename, const GeoExtent& extent, double resolution, const optional<double>& noData )
 {       
-    osg::ref_ptr< Polygon > polygon = new Polygon();
+    if ( _packed.valid() )
+    {
+        OE_WARN << LC << "Cannot add to packed index " << _filename << "; rebuild it instead" << std::endl;
+        return false;
+    }
+
+    osg::ref_ptr< osgEarth::Symbology::Polygon > polygon = new osgEarth::Symbology::Polygon();
     polygon->push_back( osg::Vec3d(extent.bounds().xMin(), extent.bounds().yMin(), 0) );
     polygon->push_back( osg::Vec3d(extent.bounds().xMax(), extent.bounds().yMin(), 0) );
     polygon->push_back( osg::Vec3d(extent.bounds().xMax(), extent.bounds().yMax(), 0) );
@@ -143,6 +774,19 @@ bool TileIndex::add( const std::string& filename, const GeoExtent& extent )
     feature->set("location", filename );
     
     const SpatialReference* wgs84 = SpatialReference::create("epsg:4326");
+
+    if ( resolution > 0.0 && extent.width() > 0.0 )
+    {
+        // express the pixel size in the units of the stored footprint.
+        GeoExtent stored = extent.transform( wgs84 );
+        feature->set("resolution", resolution * stored.width() / extent.width() );
+    }
+
+    if ( noData.isSet() )
+    {
+        feature->set("nodata", noData.get() );
+    }
+
     feature->transform( wgs84 );
 
     return _features->insertFeature( feature.get() );    
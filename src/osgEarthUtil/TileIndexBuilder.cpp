@@ -28,6 +28,7 @@
 #include <osgEarthDrivers/gdal/GDALOptions>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <gdal.h>
 
 using namespace osgDB;
 using namespace osgEarth;
@@ -36,6 +37,32 @@ using namespace osgEarth::Drivers;
 using namespace osgEarth::Features;
 using namespace std;
 
+namespace
+{
+    // Reads the raster width and NODATA value of a file, so that they can
+    // be recorded in the index.
+    bool getRasterInfo( const std::string& filename, int& width, optional<double>& noData )
+    {
+        GDAL_SCOPED_LOCK;
+
+        GDALDatasetH ds = GDALOpen( filename.c_str(), GA_ReadOnly );
+        if ( !ds )
+            return false;
+
+        width = GDALGetRasterXSize( ds );
+        if ( GDALGetRasterCount( ds ) > 0 )
+        {
+            int success = 0;
+            double value = GDALGetRasterNoDataValue( GDALGetRasterBand(ds, 1), &success );
+            if ( success )
+                noData = value;
+        }
+
+        GDALClose( ds );
+        return width > 0;
+    }
+}
+
 TileIndexBuilder::TileIndexBuilder()
 {
 }
@@ -45,7 +72,7 @@ void TileIndexBuilder::setProgressCallback( osgEarth::ProgressCallback* progress
     _progress = progress;
 }
 
-void TileIndexBuilder::build(const std::string& indexFilename, const osgEarth::SpatialReference* srs)
+bool TileIndexBuilder::build(const std::string& indexFilename, const osgEarth::SpatialReference* srs)
 {
     expandFilenames();
 
@@ -54,7 +81,17 @@ void TileIndexBuilder::build(const std::string& indexFilename, const osgEarth::S
         srs = osgEarth::SpatialReference::create("wgs84");
     }
 
-    osg::ref_ptr< osgEarth::Util::TileIndex > index = osgEarth::Util::TileIndex::create( indexFilename, srs );
+    // A packed index is written in one go once all the files are scanned.
+    bool packed = TileIndex::isPackedFilename( indexFilename );
+    std::vector< TileIndex::Entry > entries;
+
+    osg::ref_ptr< osgEarth::Util::TileIndex > index;
+    if ( !packed )
+    {
+        index = osgEarth::Util::TileIndex::create( indexFilename, srs );
+        if ( !index.valid() )
+            return false;
+    }
 
     _indexFilename = indexFilename;
     std::string indexDir = getFilePath( _indexFilename );    
@@ -77,11 +114,29 @@ void TileIndexBuilder::build(const std::string& indexFilename, const osgEarth::S
             osg::ref_ptr< TileSource > source = layer->getTileSource();
             if (source.valid())
             {
+                int width = 0;
+                optional<double> noData;
+                getRasterInfo( filename, width, noData );
+
                 for (DataExtentList::iterator itr = source->getDataExtents().begin(); itr != source->getDataExtents().end(); ++itr)
                 {
                     // We want the filename as it is relative to the index file                
                     std::string relative = getPathRelative( indexDir, filename );                
-                    index->add( relative, *itr);    
+                    double resolution = width > 0 ? itr->width() / (double)width : 0.0;
+                    if ( packed )
+                    {
+                        TileIndex::Entry entry;
+                        entry._location = relative;
+                        entry._extent = itr->transform( srs );
+                        if ( resolution > 0.0 && itr->width() > 0.0 )
+                            entry._resolution = resolution * entry._extent.width() / itr->width();
+                        entry._noData = noData;
+                        entries.push_back( entry );
+                    }
+                    else
+                    {
+                        index->add( relative, *itr, resolution, noData );
+                    }
                     ok = true;
                 }                
             }
@@ -104,7 +159,47 @@ void TileIndexBuilder::build(const std::string& indexFilename, const osgEarth::S
         }
     }
 
-    osg::Timer_t end = osg::Timer::instance()->tick();    
+    if ( packed )
+    {
+        return TileIndex::writePacked( indexFilename, srs, entries );
+    }
+
+    return true;
+}
+
+bool TileIndexBuilder::convert(const std::string& sourceFilename, const std::string& indexFilename)
+{
+    if ( !TileIndex::isPackedFilename(indexFilename) )
+    {
+        OE_WARN << "Can only convert to a packed (.oeidx) index" << std::endl;
+        return false;
+    }
+
+    osg::ref_ptr< TileIndex > source = TileIndex::load( sourceFilename );
+    if ( !source.valid() )
+    {
+        OE_WARN << "Failed to load " << sourceFilename << std::endl;
+        return false;
+    }
+
+    std::vector< TileIndex::Entry > entries;
+    source->getEntries( GeoExtent::INVALID, entries );
+
+    // Locations come back as full paths; store them relative to the new index.
+    std::string indexDir = getFilePath( indexFilename );
+    for (unsigned int i = 0; i < entries.size(); i++)
+    {
+        entries[i]._location = getPathRelative( indexDir, entries[i]._location );
+    }
+
+    if (_progress.valid())
+    {
+        std::stringstream buf;
+        buf << "Converted " << entries.size() << " files";
+        _progress->reportProgress( 1.0, 1.0, buf.str() );
+    }
+
+    return TileIndex::writePacked( indexFilename, source->getSRS(), entries );
 }
 
 void TileIndexBuilder::expandFilenames()
@@ -0,0 +1,490 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthUtil/Viewshed>
+#include <osgEarth/GeoMath>
+#include <osgEarth/Map>
+#include <OpenThreads/Thread>
+#include <osg/Image>
+#include <algorithm>
+#include <float.h>
+
+#define LC "[Viewshed] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Largest number of cells from the center to the edge of a viewshed raster
+    const int MAX_HALF_SIZE = 2048;
+
+    // Cell states in a visibility buffer; merged by taking the maximum.
+    const unsigned char CELL_UNKNOWN = 0u;
+    const unsigned char CELL_HIDDEN  = 1u;
+    const unsigned char CELL_VISIBLE = 2u;
+
+    // Settings shared by all the jobs of one call.
+    struct Params
+    {
+        osg::ref_ptr<ElevationPool>          _pool;
+        osg::ref_ptr<const SpatialReference> _srs;
+        unsigned                             _lod;
+        double                               _radius;
+        double                               _resolution;
+        double                               _targetHeight;
+        double                               _curvature;   // (1-k)/2R
+    };
+
+    void initParams(Params& params, const Viewshed& viewshed, ElevationPool* pool, const SpatialReference* srs, unsigned lod)
+    {
+        params._pool         = pool;
+        params._srs          = srs;
+        params._lod          = lod;
+        params._radius       = viewshed.getRadius();
+        params._resolution   = viewshed.getResolution();
+        params._targetHeight = viewshed.getTargetHeight();
+        params._curvature    = (1.0 - viewshed.getRefraction()) / (2.0 * srs->getEllipsoid()->getRadiusEquator());
+    }
+
+    // Elevation raster centered on an observer.
+    struct Grid
+    {
+        int                _half;
+        int                _size;
+        double             _lon, _lat;
+        double             _dLon, _dLat;
+        double             _cellSize;
+        double             _eye;
+        std::vector<float> _z;          // curvature-corrected; NO_DATA_VALUE outside the radius
+    };
+
+    // Locates the observer and sizes the grid. Elevations are not sampled yet.
+    bool initGrid(const Params& params, const GeoPoint& observer, ElevationEnvelope* env, Grid& grid)
+    {
+        GeoPoint p;
+        if ( !observer.transform(params._srs.get(), p) )
+            return false;
+
+        grid._lon = p.x();
+        grid._lat = p.y();
+
+        if ( p.altitudeMode() == ALTMODE_RELATIVE )
+        {
+            float ground = env->getElevation(grid._lon, grid._lat);
+            if ( ground == NO_DATA_VALUE )
+                return false;
+            grid._eye = ground + p.z();
+        }
+        else
+        {
+            grid._eye = p.z();
+        }
+
+        grid._half     = std::max(1, std::min(MAX_HALF_SIZE, (int)ceil(params._radius / params._resolution)));
+        grid._size     = 2*grid._half + 1;
+        grid._cellSize = params._radius / (double)grid._half;
+
+        double R = params._srs->getEllipsoid()->getRadiusEquator();
+        grid._dLat = osg::RadiansToDegrees(grid._cellSize / R);
+        grid._dLon = grid._dLat / std::max(cos(osg::DegreesToRadians(grid._lat)), 0.01);
+
+        grid._z.assign( grid._size*grid._size, NO_DATA_VALUE );
+        return true;
+    }
+
+    // Samples rows [begin, end) of the grid.
+    void sampleRows(const Params& params, Grid& grid, ElevationEnvelope* env, int begin, int end)
+    {
+        int h = grid._half;
+        for(int y = begin; y < end; ++y)
+        {
+            int dy = y - h;
+            double lat = grid._lat + dy*grid._dLat;
+            for(int x = 0; x < grid._size; ++x)
+            {
+                int dx = x - h;
+                if ( dx*dx + dy*dy > h*h )
+                    continue;
+
+                float z = env->getElevation(grid._lon + dx*grid._dLon, lat);
+                if ( z != NO_DATA_VALUE )
+                {
+                    double d = grid._cellSize * sqrt((double)(dx*dx + dy*dy));
+                    z -= d*d*params._curvature;
+                }
+                grid._z[y*grid._size + x] = z;
+            }
+        }
+    }
+
+    // Casts rays [begin, end) from the center to the cells on the edge of
+    // the grid, numbered counter-clockwise from the south-west corner.
+    void sweep(const Grid& grid, double targetHeight, int begin, int end, std::vector<unsigned char>& vis)
+    {
+        int h = grid._half;
+
+        if ( grid._z[h*grid._size + h] != NO_DATA_VALUE )
+            vis[h*grid._size + h] = CELL_VISIBLE;
+
+        for(int ray = begin; ray < end; ++ray)
+        {
+            int side = ray / (2*h), k = ray % (2*h);
+            int ex, ey;
+            if      ( side == 0 ) { ex = -h + k; ey = -h; }
+            else if ( side == 1 ) { ex =  h;     ey = -h + k; }
+            else if ( side == 2 ) { ex =  h - k; ey =  h; }
+            else                  { ex = -h;     ey =  h - k; }
+
+            double horizon = -DBL_MAX;
+
+            for(int s = 1; s <= h; ++s)
+            {
+                int dx = (int)floor((double)(s*ex)/(double)h + 0.5);
+                int dy = (int)floor((double)(s*ey)/(double)h + 0.5);
+                int i = (h+dy)*grid._size + (h+dx);
+
+                float z = grid._z[i];
+                if ( z == NO_DATA_VALUE )
+                    continue;
+
+                double d = grid._cellSize * sqrt((double)(dx*dx + dy*dy));
+
+                unsigned char state = (z + targetHeight - grid._eye)/d >= horizon ? CELL_VISIBLE : CELL_HIDDEN;
+                if ( state > vis[i] )
+                    vis[i] = state;
+
+                horizon = std::max(horizon, (z - grid._eye)/d);
+            }
+        }
+    }
+
+    GeoImage createImage(const Params& params, const Grid& grid, const std::vector<unsigned char>& vis,
+                         const osg::Vec4f& good, const osg::Vec4f& bad)
+    {
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(grid._size, grid._size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        image->setInternalTextureFormat(GL_RGBA8);
+
+        unsigned char colors[3][4] = {
+            { 0, 0, 0, 0 },
+            { (unsigned char)(bad.r()*255.0f),  (unsigned char)(bad.g()*255.0f),  (unsigned char)(bad.b()*255.0f),  (unsigned char)(bad.a()*255.0f) },
+            { (unsigned char)(good.r()*255.0f), (unsigned char)(good.g()*255.0f), (unsigned char)(good.b()*255.0f), (unsigned char)(good.a()*255.0f) }
+        };
+
+        unsigned char* out = image->data();
+        for(unsigned i = 0; i < vis.size(); ++i, out += 4)
+        {
+            const unsigned char* c = colors[vis[i]];
+            out[0] = c[0]; out[1] = c[1]; out[2] = c[2]; out[3] = c[3];
+        }
+
+        GeoExtent extent(
+            params._srs.get(),
+            grid._lon - (grid._half + 0.5)*grid._dLon,
+            grid._lat - (grid._half + 0.5)*grid._dLat,
+            grid._lon + (grid._half + 0.5)*grid._dLon,
+            grid._lat + (grid._half + 0.5)*grid._dLat);
+
+        return GeoImage(image.get(), extent);
+    }
+
+    // Line of sight from an observer to one target.
+    bool isVisible(const Params& params, ElevationEnvelope* env, const GeoPoint& observer, double eye, const GeoPoint& target)
+    {
+        GeoPoint t;
+        if ( !target.transform(params._srs.get(), t) )
+            return false;
+
+        double tz = t.z();
+        if ( t.altitudeMode() == ALTMODE_RELATIVE )
+        {
+            float ground = env->getElevation(t.x(), t.y());
+            if ( ground == NO_DATA_VALUE )
+                return false;
+            tz += ground;
+        }
+
+        double R = params._srs->getEllipsoid()->getRadiusEquator();
+        double D = GeoMath::distance(
+            osg::DegreesToRadians(observer.y()), osg::DegreesToRadians(observer.x()),
+            osg::DegreesToRadians(t.y()), osg::DegreesToRadians(t.x()), R);
+
+        if ( D <= 0.0 )
+            return true;
+
+        double slope = (tz - D*D*params._curvature - eye) / D;
+
+        int n = (int)ceil(D / params._resolution);
+        for(int s = 1; s < n; ++s)
+        {
+            double f = (double)s / (double)n;
+            float z = env->getElevation(observer.x() + f*(t.x()-observer.x()), observer.y() + f*(t.y()-observer.y()));
+            if ( z == NO_DATA_VALUE )
+                continue;
+
+            double d = f*D;
+            if ( (z - d*d*params._curvature - eye)/d > slope )
+                return false;
+        }
+        return true;
+    }
+
+    struct SampleRowsTask : public TaskRequest
+    {
+        SampleRowsTask(const Params& params, Grid& grid, int begin, int end, MultiEvent& done) :
+            _params(params), _grid(grid), _begin(begin), _end(end), _done(done) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<ElevationEnvelope> env = _params._pool->createEnvelope(_params._srs.get(), _params._lod);
+            sampleRows(_params, _grid, env.get(), _begin, _end);
+            _done.set();
+        }
+
+        const Params& _params;
+        Grid&         _grid;
+        int           _begin, _end;
+        MultiEvent&   _done;
+    };
+
+    struct SweepTask : public TaskRequest
+    {
+        SweepTask(const Grid& grid, double targetHeight, int begin, int end, std::vector<unsigned char>& vis, MultiEvent& done) :
+            _grid(grid), _targetHeight(targetHeight), _begin(begin), _end(end), _vis(vis), _done(done) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            sweep(_grid, _targetHeight, _begin, _end, _vis);
+            _done.set();
+        }
+
+        const Grid&                 _grid;
+        double                      _targetHeight;
+        int                         _begin, _end;
+        std::vector<unsigned char>& _vis;
+        MultiEvent&                 _done;
+    };
+
+    struct ObserverTask : public TaskRequest
+    {
+        ObserverTask(const Params& params, const GeoPoint& observer, const osg::Vec4f& good, const osg::Vec4f& bad,
+                     GeoImage& output, MultiEvent& done) :
+            _params(params), _observer(observer), _good(good), _bad(bad), _output(output), _done(done) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<ElevationEnvelope> env = _params._pool->createEnvelope(_params._srs.get(), _params._lod);
+            Grid grid;
+            if ( initGrid(_params, _observer, env.get(), grid) )
+            {
+                sampleRows(_params, grid, env.get(), 0, grid._size);
+                std::vector<unsigned char> vis(grid._z.size(), CELL_UNKNOWN);
+                sweep(grid, _params._targetHeight, 0, 8*grid._half, vis);
+                _output = createImage(_params, grid, vis, _good, _bad);
+            }
+            _done.set();
+        }
+
+        const Params& _params;
+        GeoPoint      _observer;
+        osg::Vec4f    _good, _bad;
+        GeoImage&     _output;
+        MultiEvent&   _done;
+    };
+
+    struct TargetsTask : public TaskRequest
+    {
+        TargetsTask(const Params& params, const GeoPoint& observer, const std::vector<GeoPoint>& targets,
+                    unsigned begin, unsigned end, std::vector<char>& output, MultiEvent& done) :
+            _params(params), _observer(observer), _targets(targets), _begin(begin), _end(end), _output(output), _done(done) { }
+
+        void operator()(ProgressCallback* progress)
+        {
+            osg::ref_ptr<ElevationEnvelope> env = _params._pool->createEnvelope(_params._srs.get(), _params._lod);
+            GeoPoint observer;
+            bool ok = _observer.transform(_params._srs.get(), observer);
+
+            double eye = observer.z();
+            if ( ok && observer.altitudeMode() == ALTMODE_RELATIVE )
+            {
+                float ground = env->getElevation(observer.x(), observer.y());
+                ok = ground != NO_DATA_VALUE;
+                eye += ground;
+            }
+
+            for(unsigned i = _begin; i < _end; ++i)
+            {
+                _output[i] = ok && isVisible(_params, env.get(), observer, eye, _targets[i]) ? 1 : 0;
+            }
+            _done.set();
+        }
+
+        const Params&                _params;
+        GeoPoint                     _observer;
+        const std::vector<GeoPoint>& _targets;
+        unsigned                     _begin, _end;
+        std::vector<char>&           _output;
+        MultiEvent&                  _done;
+    };
+}
+
+//........................................................................
+
+Viewshed::Viewshed(const Map* map, unsigned numThreads) :
+_numThreads  ( numThreads > 0u ? numThreads : (unsigned)std::max(1, OpenThreads::GetNumberOfProcessors()) ),
+_radius      ( 5000.0 ),
+_resolution  ( 30.0 ),
+_targetHeight( 0.0 ),
+_refraction  ( 0.13 ),
+_goodColor   ( 0.0f, 1.0f, 0.0f, 0.5f ),
+_badColor    ( 1.0f, 0.0f, 0.0f, 0.5f )
+{
+    if ( map )
+    {
+        _pool    = map->getElevationPool();
+        _profile = map->getProfile();
+        if ( _profile.valid() )
+            _srs = _profile->getSRS()->getGeographicSRS();
+    }
+
+    _service = new TaskService( "Viewshed", _numThreads );
+}
+
+unsigned
+Viewshed::getSamplingLOD() const
+{
+    if ( _lod.isSet() )
+        return _lod.get();
+
+    double res = _resolution;
+    if ( _profile->getSRS()->isGeographic() )
+        res = osg::RadiansToDegrees(_resolution / _profile->getSRS()->getEllipsoid()->getRadiusEquator());
+
+    return _profile->getLevelOfDetailForHorizResolution( res, _pool->getTileSize() );
+}
+
+GeoImage
+Viewshed::createViewshed(const GeoPoint& observer)
+{
+    if ( !_pool.valid() || !_srs.valid() || _resolution <= 0.0 || _radius <= 0.0 )
+        return GeoImage::INVALID;
+
+    Params params;
+    initParams( params, *this, _pool.get(), _srs.get(), getSamplingLOD() );
+
+    Grid grid;
+    {
+        osg::ref_ptr<ElevationEnvelope> env = _pool->createEnvelope( _srs.get(), params._lod );
+        if ( !initGrid(params, observer, env.get(), grid) )
+        {
+            OE_WARN << LC << "No elevation data at observer " << observer.toString() << std::endl;
+            return GeoImage::INVALID;
+        }
+    }
+
+    // sample the grid in bands of rows:
+    unsigned numJobs = std::min( _numThreads, (unsigned)grid._size );
+    {
+        MultiEvent done( numJobs );
+        for(unsigned j = 0; j < numJobs; ++j)
+        {
+            int begin = (grid._size * j) / numJobs;
+            int end   = (grid._size * (j+1)) / numJobs;
+            _service->add( new SampleRowsTask(params, grid, begin, end, done) );
+        }
+        done.wait();
+    }
+
+    // sweep the rays in sectors, each into its own buffer, then merge:
+    int numRays = 8*grid._half;
+    numJobs = std::min( _numThreads, (unsigned)numRays );
+    std::vector< std::vector<unsigned char> > vis( numJobs );
+    {
+        MultiEvent done( numJobs );
+        for(unsigned j = 0; j < numJobs; ++j)
+        {
+            vis[j].assign( grid._z.size(), CELL_UNKNOWN );
+            int begin = (numRays * j) / numJobs;
+            int end   = (numRays * (j+1)) / numJobs;
+            _service->add( new SweepTask(grid, _targetHeight, begin, end, vis[j], done) );
+        }
+        done.wait();
+    }
+
+    for(unsigned j = 1; j < numJobs; ++j)
+    {
+        for(unsigned i = 0; i < vis[0].size(); ++i)
+            vis[0][i] = std::max( vis[0][i], vis[j][i] );
+    }
+
+    return createImage( params, grid, vis[0], _goodColor, _badColor );
+}
+
+void
+Viewshed::createViewsheds(const std::vector<GeoPoint>& observers,
+                          std::vector<GeoImage>&       output)
+{
+    output.assign( observers.size(), GeoImage::INVALID );
+
+    if ( observers.empty() || !_pool.valid() || !_srs.valid() || _resolution <= 0.0 || _radius <= 0.0 )
+        return;
+
+    Params params;
+    initParams( params, *this, _pool.get(), _srs.get(), getSamplingLOD() );
+
+    MultiEvent done( (int)observers.size() );
+    for(unsigned i = 0; i < observers.size(); ++i)
+    {
+        _service->add( new ObserverTask(params, observers[i], _goodColor, _badColor, output[i], done) );
+    }
+    done.wait();
+}
+
+void
+Viewshed::computeLineOfSight(const GeoPoint&              observer,
+                             const std::vector<GeoPoint>& targets,
+                             std::vector<bool>&           output)
+{
+    output.assign( targets.size(), false );
+
+    if ( targets.empty() || !_pool.valid() || !_srs.valid() || _resolution <= 0.0 )
+        return;
+
+    Params params;
+    initParams( params, *this, _pool.get(), _srs.get(), getSamplingLOD() );
+
+    // one flag per byte so that jobs never share a word:
+    std::vector<char> visible( targets.size(), 0 );
+
+    unsigned numJobs = std::min( _numThreads, (unsigned)targets.size() );
+    MultiEvent done( numJobs );
+    for(unsigned j = 0; j < numJobs; ++j)
+    {
+        unsigned begin = (targets.size() * j) / numJobs;
+        unsigned end   = (targets.size() * (j+1)) / numJobs;
+        _service->add( new TargetsTask(params, observer, targets, begin, end, visible, done) );
+    }
+    done.wait();
+
+    for(unsigned i = 0; i < visible.size(); ++i)
+        output[i] = visible[i] != 0;
+}
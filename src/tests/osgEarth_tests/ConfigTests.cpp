@@ -0,0 +1,86 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarth/Config>
+#include <sstream>
+
+using namespace osgEarth;
+
+TEST_CASE( "Config binary encoding" ) {
+
+    Config map("map");
+    map.set("name", "test");
+    map.set("version", "2");
+    for (int i = 0; i < 3; ++i)
+    {
+        Config layer("image");
+        layer.set("name", std::string(Stringify() << "layer" << i));
+        layer.set("opacity", 0.5);
+        Config url("url", "data/world.tif");
+        url.setIsLocation(true);
+        url.setExternalRef("world");
+        layer.add(url);
+        map.add(layer);
+    }
+    map.add(Config("empty"));
+
+    std::stringstream buf;
+    REQUIRE(map.toBinary(buf));
+    std::string data = buf.str();
+    REQUIRE(Config::isBinary(data.data(), data.size()));
+
+    SECTION("Round trip") {
+        Config out;
+        REQUIRE(out.fromBinary(data.data(), data.size()));
+        REQUIRE(out.toJSON() == map.toJSON());
+        REQUIRE(out.children("image").size() == 3u);
+        REQUIRE(out.child("image").child("url").isLocation());
+        REQUIRE(out.child("image").child("url").externalRef() == "world");
+        REQUIRE(out.hasChild("empty"));
+    }
+
+    SECTION("Rejects bad data") {
+        Config out;
+        REQUIRE(out.fromBinary(data.data(), data.size() - 1) == false);
+        std::string xml = "<map name=\"test\"/>";
+        REQUIRE(Config::isBinary(xml.data(), xml.size()) == false);
+        REQUIRE(out.fromBinary(xml.data(), xml.size()) == false);
+    }
+}
+
+TEST_CASE( "ConfigIndex" ) {
+
+    Config layer("image");
+    layer.set("name", "world");
+    layer.add("url", "a.tif");
+    layer.add("url", "b.tif");
+
+    ConfigIndex index(layer);
+    REQUIRE(index.hasChild("name"));
+    REQUIRE(index.hasChild("driver") == false);
+    REQUIRE(index.value("name") == "world");
+    REQUIRE(index.child_ptr("driver") == 0L);
+    REQUIRE(index.child("driver").empty());
+    REQUIRE(index.children("url").size() == 2u);
+    REQUIRE(index.children("url")[1]->value() == "b.tif");
+    REQUIRE(index.value("url") == "a.tif");
+}
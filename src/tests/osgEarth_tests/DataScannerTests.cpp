@@ -0,0 +1,348 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarthUtil/DataScanner>
+#include <osgEarthUtil/TileIndex>
+#include <osgEarth/Config>
+#include <osgEarth/FileUtils>
+#include <osgEarth/Registry>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#if defined(WIN32) && !defined(__CYGWIN__)
+#include <direct.h>
+#define RMDIR _rmdir
+#else
+#include <unistd.h>
+#define RMDIR rmdir
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace DataScannerTest
+{
+    // A temporary folder of ESRI ASCII grids, removed when it goes away.
+    class Sandbox
+    {
+    public:
+        Sandbox()
+        {
+            Registry::instance(); // registers the GDAL drivers
+            _root = getTempName( osgDB::concatPaths(getTempPath(), "DataScannerTests") );
+            makeDirectory( _root );
+            _dirs.push_back( _root );
+        }
+
+        ~Sandbox()
+        {
+            for (unsigned i = 0; i < _files.size(); ++i)
+                ::remove( _files[i].c_str() );
+            for (unsigned i = _dirs.size(); i > 0; --i)
+                RMDIR( _dirs[i-1].c_str() );
+        }
+
+        std::string path(const std::string& name) const
+        {
+            return osgDB::concatPaths( _root, name );
+        }
+
+        std::string mkdir(const std::string& name)
+        {
+            std::string dir = path( name );
+            makeDirectory( dir );
+            _dirs.push_back( dir );
+            return dir;
+        }
+
+        void write(const std::string& filename, const std::string& content)
+        {
+            std::ofstream out( filename.c_str() );
+            out << content;
+            if ( std::find(_files.begin(), _files.end(), filename) == _files.end() )
+                _files.push_back( filename );
+        }
+
+        // A 4x4 WGS84 grid with 0.5 degree cells and a NODATA value, and
+        // its .prj sidecar.
+        std::string writeGrid(const std::string& dir, const std::string& name, double xmin, double ymin)
+        {
+            std::string asc = osgDB::concatPaths( dir, name + ".asc" );
+            std::stringstream buf;
+            buf << "ncols 4\nnrows 4\n"
+                << "xllcorner " << xmin << "\nyllcorner " << ymin << "\n"
+                << "cellsize 0.5\nNODATA_value -9999\n"
+                << "1 2 3 4\n5 6 7 8\n9 10 11 12\n13 14 15 -9999\n";
+            write( asc, buf.str() );
+            write( osgDB::concatPaths(dir, name + ".prj"),
+                "GEOGCS[\"GCS_WGS_1984\",DATUM[\"D_WGS_1984\",SPHEROID[\"WGS_1984\",6378137.0,298.257223563]],"
+                "PRIMEM[\"Greenwich\",0.0],UNIT[\"Degree\",0.0174532925199433]]" );
+            return asc;
+        }
+
+        std::string _root;
+        std::vector<std::string> _files;
+        std::vector<std::string> _dirs;
+    };
+
+    std::vector<std::string> extensions()
+    {
+        std::vector<std::string> ext;
+        ext.push_back( "asc" );
+        return ext;
+    }
+
+    // Paths of the files recorded in a manifest.
+    std::vector<std::string> readManifest(const std::string& filename)
+    {
+        std::ifstream in( filename.c_str() );
+        std::stringstream buf;
+        buf << in.rdbuf();
+
+        Config conf;
+        conf.fromJSON( buf.str() );
+        if ( conf.key() != "manifest" )
+            conf = conf.child( "manifest" );
+
+        std::vector<std::string> paths;
+        const ConfigSet files = conf.child("files").children("file");
+        for (ConfigSet::const_iterator i = files.begin(); i != files.end(); ++i)
+            paths.push_back( i->value("path") );
+        std::sort( paths.begin(), paths.end() );
+        return paths;
+    }
+
+    void requireGrid(const DataScanner::Entry& entry, double xmin, double ymin)
+    {
+        REQUIRE( entry._valid );
+        REQUIRE( entry._extent.getSRS()->isGeographic() );
+        REQUIRE( entry._extent.xMin() == Approx(xmin) );
+        REQUIRE( entry._extent.yMin() == Approx(ymin) );
+        REQUIRE( entry._extent.xMax() == Approx(xmin + 2.0) );
+        REQUIRE( entry._extent.yMax() == Approx(ymin + 2.0) );
+        REQUIRE( entry._resolution == Approx(0.5) );
+        REQUIRE( entry._noData.isSet() );
+        REQUIRE( entry._noData.get() == Approx(-9999.0) );
+    }
+}
+
+TEST_CASE( "DataScanner round-trips its results through the manifest" ) {
+
+    DataScannerTest::Sandbox sandbox;
+    std::string dir = sandbox.mkdir( "data" );
+    std::string one = sandbox.writeGrid( dir, "one", 10.0, 40.0 );
+    std::string two = sandbox.writeGrid( dir, "two", -20.0, -30.0 );
+    std::string manifest = sandbox.path( "manifest.json" );
+    sandbox._files.push_back( manifest );
+
+    DataScanner scanner;
+    scanner.setNumThreads( 2u );
+    scanner.setManifest( manifest );
+
+    std::vector<DataScanner::Entry> probed;
+    REQUIRE( scanner.scan(dir, DataScannerTest::extensions(), probed) );
+    REQUIRE( probed.size() == 2u );
+    DataScannerTest::requireGrid( probed[0], 10.0, 40.0 );
+    DataScannerTest::requireGrid( probed[1], -20.0, -30.0 );
+
+    std::vector<std::string> recorded = DataScannerTest::readManifest( manifest );
+    REQUIRE( recorded.size() == 2u );
+    REQUIRE( recorded[0] == one );
+    REQUIRE( recorded[1] == two );
+
+    // Another scanner reads back exactly what was probed.
+    DataScanner reader;
+    reader.setManifest( manifest );
+
+    std::vector<DataScanner::Entry> loaded;
+    REQUIRE( reader.scan(dir, DataScannerTest::extensions(), loaded) );
+    REQUIRE( loaded.size() == probed.size() );
+    for (unsigned i = 0; i < loaded.size(); ++i)
+    {
+        REQUIRE( loaded[i]._path == probed[i]._path );
+        REQUIRE( loaded[i]._modified == probed[i]._modified );
+        REQUIRE( loaded[i]._size == probed[i]._size );
+        REQUIRE( loaded[i]._extent.getSRS()->isHorizEquivalentTo(probed[i]._extent.getSRS()) );
+        REQUIRE( loaded[i]._extent == probed[i]._extent );
+        REQUIRE( loaded[i]._resolution == probed[i]._resolution );
+        REQUIRE( loaded[i]._noData.get() == probed[i]._noData.get() );
+    }
+}
+
+TEST_CASE( "DataScanner reuses manifest entries of unchanged files" ) {
+
+    DataScannerTest::Sandbox sandbox;
+    std::string dir = sandbox.mkdir( "data" );
+    std::string one = sandbox.writeGrid( dir, "one", 10.0, 40.0 );
+    std::string manifest = sandbox.path( "manifest.json" );
+    sandbox._files.push_back( manifest );
+
+    DataScanner scanner;
+    scanner.setManifest( manifest );
+
+    std::vector<DataScanner::Entry> entries;
+    REQUIRE( scanner.scan(dir, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.size() == 1u );
+
+    // Without its .prj the grid has no SRS, so probing it again would
+    // reject it; the grid itself is unchanged, so the manifest entry wins.
+    ::remove( osgDB::concatPaths(dir, "one.prj").c_str() );
+
+    std::vector<DataScanner::Entry> unmanaged;
+    REQUIRE( DataScanner().scan(dir, DataScannerTest::extensions(), unmanaged) );
+    REQUIRE( unmanaged.empty() );
+
+    entries.clear();
+    REQUIRE( scanner.scan(dir, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.size() == 1u );
+    REQUIRE( entries[0]._path == one );
+    DataScannerTest::requireGrid( entries[0], 10.0, 40.0 );
+}
+
+TEST_CASE( "DataScanner keeps manifest entries outside the scan and drops deleted files" ) {
+
+    DataScannerTest::Sandbox sandbox;
+    std::string a = sandbox.mkdir( "a" );
+    std::string b = sandbox.mkdir( "ab" ); // shares a prefix with "a"
+    std::string a1 = sandbox.writeGrid( a, "one", 10.0, 40.0 );
+    std::string a2 = sandbox.writeGrid( a, "two", 12.0, 40.0 );
+    std::string b1 = sandbox.writeGrid( b, "one", 50.0, 10.0 );
+    std::string manifest = sandbox.path( "manifest.json" );
+    sandbox._files.push_back( manifest );
+
+    DataScanner scanner;
+    scanner.setManifest( manifest );
+
+    std::vector<DataScanner::Entry> entries;
+    REQUIRE( scanner.scan(a, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.size() == 2u );
+
+    entries.clear();
+    REQUIRE( scanner.scan(b, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.size() == 1u );
+
+    std::vector<std::string> recorded = DataScannerTest::readManifest( manifest );
+    REQUIRE( recorded.size() == 3u );
+
+    // Nothing needs probing; the manifest still loses the deleted file.
+    ::remove( a2.c_str() );
+
+    entries.clear();
+    REQUIRE( scanner.scan(a, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.size() == 1u );
+    REQUIRE( entries[0]._path == a1 );
+
+    recorded = DataScannerTest::readManifest( manifest );
+    REQUIRE( recorded.size() == 2u );
+    REQUIRE( std::find(recorded.begin(), recorded.end(), a1) != recorded.end() );
+    REQUIRE( std::find(recorded.begin(), recorded.end(), b1) != recorded.end() );
+}
+
+TEST_CASE( "DataScanner probes files that failed before again" ) {
+
+    DataScannerTest::Sandbox sandbox;
+    std::string dir = sandbox.mkdir( "data" );
+    std::string one = sandbox.writeGrid( dir, "one", 10.0, 40.0 );
+    std::string manifest = sandbox.path( "manifest.json" );
+    sandbox._files.push_back( manifest );
+
+    // Without its .prj the grid has no SRS, so it fails to probe.
+    std::string prj = osgDB::concatPaths( dir, "one.prj" );
+    std::ifstream in( prj.c_str() );
+    std::stringstream wkt;
+    wkt << in.rdbuf();
+    in.close();
+    ::remove( prj.c_str() );
+
+    DataScanner scanner;
+    scanner.setManifest( manifest );
+
+    std::vector<DataScanner::Entry> entries;
+    REQUIRE( scanner.scan(dir, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.empty() );
+    REQUIRE( DataScannerTest::readManifest(manifest).empty() );
+
+    // The failure was not recorded, so the grid is probed again once
+    // its .prj is back.
+    sandbox.write( prj, wkt.str() );
+
+    REQUIRE( scanner.scan(dir, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.size() == 1u );
+    REQUIRE( entries[0]._path == one );
+    DataScannerTest::requireGrid( entries[0], 10.0, 40.0 );
+}
+
+TEST_CASE( "DataScanner writes a packed tile index of the scanned files" ) {
+
+    DataScannerTest::Sandbox sandbox;
+    std::string dir = sandbox.mkdir( "data" );
+    sandbox.writeGrid( dir, "one", 10.0, 40.0 );
+    sandbox.writeGrid( dir, "two", -20.0, -30.0 );
+
+    std::vector<DataScanner::Entry> entries;
+    REQUIRE( DataScanner().scan(dir, DataScannerTest::extensions(), entries) );
+    REQUIRE( entries.size() == 2u );
+
+    REQUIRE_FALSE( DataScanner::writeTileIndex(entries, sandbox.path("index.shp")) );
+
+    std::string indexFilename = sandbox.path( "index.oeidx" );
+    sandbox._files.push_back( indexFilename );
+    REQUIRE( DataScanner::writeTileIndex(entries, indexFilename) );
+
+    osg::ref_ptr<TileIndex> index = TileIndex::load( indexFilename );
+    REQUIRE( index.valid() );
+    REQUIRE( index->isPacked() );
+
+    std::vector<TileIndex::Entry> indexed;
+    index->getEntries( GeoExtent::INVALID, indexed );
+    REQUIRE( indexed.size() == entries.size() );
+
+    for (unsigned i = 0; i < entries.size(); ++i)
+    {
+        const TileIndex::Entry* match = 0L;
+        for (unsigned j = 0; j < indexed.size(); ++j)
+        {
+            if ( osgDB::getSimpleFileName(indexed[j]._location) == osgDB::getSimpleFileName(entries[i]._path) )
+                match = &indexed[j];
+        }
+        REQUIRE( match != 0L );
+        REQUIRE( osgDB::fileExists(match->_location) );
+        REQUIRE( match->_extent.getSRS()->isGeographic() );
+        REQUIRE( match->_extent.xMin() == Approx(entries[i]._extent.xMin()) );
+        REQUIRE( match->_extent.yMin() == Approx(entries[i]._extent.yMin()) );
+        REQUIRE( match->_extent.xMax() == Approx(entries[i]._extent.xMax()) );
+        REQUIRE( match->_extent.yMax() == Approx(entries[i]._extent.yMax()) );
+        REQUIRE( match->_resolution == Approx(0.5) );
+        REQUIRE( match->_noData.isSet() );
+        REQUIRE( match->_noData.get() == Approx(-9999.0) );
+    }
+
+    // only the footprints that intersect a query come back.
+    indexed.clear();
+    index->getEntries( GeoExtent(SpatialReference::create("wgs84"), 10.5, 40.5, 11.0, 41.0), indexed );
+    REQUIRE( indexed.size() == 1u );
+    REQUIRE( osgDB::getSimpleFileName(indexed[0]._location) == "one.asc" );
+}
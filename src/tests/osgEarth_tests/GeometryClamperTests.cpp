@@ -0,0 +1,191 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarth/GeometryClamper>
+#include <osgEarth/GeoData>
+#include <osgEarth/Profile>
+#include <osgEarth/Registry>
+#include <osgUtil/UpdateVisitor>
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/Geometry>
+#include <OpenThreads/Thread>
+
+using namespace osgEarth;
+
+namespace GeometryClamperTest
+{
+    const double LON = 10.0;
+    const double LAT = 45.0;
+
+    osg::Vec3d toWorld(const Profile* profile, double lon, double lat, double z)
+    {
+        osg::Vec3d world;
+        GeoPoint(profile->getSRS(), lon, lat, z, ALTMODE_ABSOLUTE).toWorld(world);
+        return world;
+    }
+
+    // Vertices are relative to this point to keep float precision.
+    osg::Vec3d center(const Profile* profile)
+    {
+        return toWorld(profile, LON, LAT, 0.0);
+    }
+
+    double height(const Profile* profile, const osg::Vec3f& local)
+    {
+        GeoPoint point;
+        point.fromWorld(profile->getSRS(), osg::Vec3d(local) + center(profile));
+        return point.z();
+    }
+
+    // A small flat terrain patch "z" meters above the ellipsoid.
+    osg::Node* makeTile(const Profile* profile, double z)
+    {
+        const double d = 0.001;
+        const osg::Vec3d c = center(profile);
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        verts->push_back(toWorld(profile, LON-d, LAT-d, z) - c);
+        verts->push_back(toWorld(profile, LON+d, LAT-d, z) - c);
+        verts->push_back(toWorld(profile, LON+d, LAT+d, z) - c);
+        verts->push_back(toWorld(profile, LON-d, LAT+d, z) - c);
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setUseVertexBufferObjects(true);
+        geom->setVertexArray(verts);
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, 4));
+
+        osg::Geode* geode = new osg::Geode();
+        geode->addDrawable(geom);
+
+        osg::MatrixTransform* xform = new osg::MatrixTransform(osg::Matrixd::translate(c));
+        xform->addChild(geode);
+        return xform;
+    }
+
+    // Geometry on the ellipsoid, near the middle of the terrain patch.
+    osg::MatrixTransform* makeGraph(const Profile* profile)
+    {
+        const double d = 0.0002;
+        const osg::Vec3d c = center(profile);
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        verts->push_back(toWorld(profile, LON-d, LAT, 0.0) - c);
+        verts->push_back(toWorld(profile, LON+d, LAT, 0.0) - c);
+        verts->push_back(toWorld(profile, LON, LAT+d, 0.0) - c);
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setUseVertexBufferObjects(true);
+        geom->setVertexArray(verts);
+        geom->addPrimitiveSet(new osg::DrawArrays(GL_LINE_STRIP, 0, 3));
+
+        osg::Geode* geode = new osg::Geode();
+        geode->addDrawable(geom);
+
+        osg::MatrixTransform* xform = new osg::MatrixTransform(osg::Matrixd::translate(c));
+        xform->addChild(geode);
+        return xform;
+    }
+
+    const osg::Vec3Array* getVerts(osg::MatrixTransform* graph)
+    {
+        osg::Geode* geode = graph->getChild(0)->asGeode();
+        return static_cast<const osg::Vec3Array*>(geode->getDrawable(0)->asGeometry()->getVertexArray());
+    }
+
+    bool waitForJobs(AsyncGeometryClamper* clamper)
+    {
+        for (int i = 0; i < 10000 && clamper->getNumPendingJobs() > 0u; ++i)
+            OpenThreads::Thread::microSleep(1000);
+        return clamper->getNumPendingJobs() == 0u;
+    }
+}
+
+TEST_CASE( "AsyncGeometryClamper delivers clamped vertices on the next update traversal" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    osg::ref_ptr<AsyncGeometryClamper> clamper = new AsyncGeometryClamper(profile);
+    clamper->setIndexLevel(10u);
+
+    osg::ref_ptr<osg::MatrixTransform> graph = GeometryClamperTest::makeGraph(profile);
+    clamper->add(graph.get(), false, 10.0f);
+
+    osg::ref_ptr<osg::Node> tile = GeometryClamperTest::makeTile(profile, 100.0);
+    TileKey key = profile->createTileKey(GeometryClamperTest::LON, GeometryClamperTest::LAT, 8u);
+    TerrainCallbackContext context(0L);
+    clamper->onTileAdded(key, tile.get(), context);
+
+    REQUIRE(GeometryClamperTest::waitForJobs(clamper.get()));
+
+    // nothing changes until the update traversal publishes the results.
+    const osg::Vec3Array* verts = GeometryClamperTest::getVerts(graph.get());
+    for (unsigned i = 0; i < verts->size(); ++i)
+        REQUIRE(GeometryClamperTest::height(profile, (*verts)[i]) == Approx(0.0).margin(0.5));
+
+    osgUtil::UpdateVisitor uv;
+    graph->accept(uv);
+
+    for (unsigned i = 0; i < verts->size(); ++i)
+        REQUIRE(GeometryClamperTest::height(profile, (*verts)[i]) == Approx(110.0).margin(0.5));
+
+    // the terrain rises; a finer tile re-clamps the same vertices.
+    osg::ref_ptr<osg::Node> higher = GeometryClamperTest::makeTile(profile, 250.0);
+    TileKey child = profile->createTileKey(GeometryClamperTest::LON, GeometryClamperTest::LAT, 12u);
+    clamper->onTileAdded(child, higher.get(), context);
+
+    REQUIRE(GeometryClamperTest::waitForJobs(clamper.get()));
+    graph->accept(uv);
+
+    for (unsigned i = 0; i < verts->size(); ++i)
+        REQUIRE(GeometryClamperTest::height(profile, (*verts)[i]) == Approx(260.0).margin(0.5));
+}
+
+TEST_CASE( "AsyncGeometryClamper ignores tiles away from its geometry and removed graphs" ) {
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    osg::ref_ptr<AsyncGeometryClamper> clamper = new AsyncGeometryClamper(profile);
+    clamper->setIndexLevel(10u);
+
+    osg::ref_ptr<osg::MatrixTransform> graph = GeometryClamperTest::makeGraph(profile);
+    clamper->add(graph.get());
+
+    osg::ref_ptr<osg::Node> tile = GeometryClamperTest::makeTile(profile, 100.0);
+    TerrainCallbackContext context(0L);
+
+    // a tile on the other side of the world queues nothing.
+    TileKey far = profile->createTileKey(-GeometryClamperTest::LON, -GeometryClamperTest::LAT, 8u);
+    clamper->onTileAdded(far, tile.get(), context);
+    REQUIRE(clamper->getNumPendingJobs() == 0u);
+
+    // once removed, the graph is left alone.
+    clamper->remove(graph.get());
+    TileKey key = profile->createTileKey(GeometryClamperTest::LON, GeometryClamperTest::LAT, 8u);
+    clamper->onTileAdded(key, tile.get(), context);
+    REQUIRE(clamper->getNumPendingJobs() == 0u);
+
+    osgUtil::UpdateVisitor uv;
+    graph->accept(uv);
+
+    const osg::Vec3Array* verts = GeometryClamperTest::getVerts(graph.get());
+    for (unsigned i = 0; i < verts->size(); ++i)
+        REQUIRE(GeometryClamperTest::height(profile, (*verts)[i]) == Approx(0.0).margin(0.5));
+}
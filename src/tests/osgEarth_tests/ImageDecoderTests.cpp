@@ -0,0 +1,341 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ImageDecoder>
+#include <osgEarth/ThreadingUtils>
+#include <osgDB/Registry>
+#include <osg/Image>
+#include <OpenThreads/Thread>
+#include <set>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+using namespace osgEarth;
+
+namespace DecoderTest
+{
+    // 4x2 16-bit grayscale PNG. Top row: 0, 1000, 30000, 65535;
+    // bottom row: 256, 512, 1024, 2048.
+    const unsigned char gray16PNG[] = {
+        0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+        0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x02, 0x10, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x53, 0xfe,
+        0xfc, 0x00, 0x00, 0x00, 0x1a, 0x49, 0x44, 0x41, 0x54, 0x08, 0x99, 0x63, 0x60, 0x60, 0x60, 0x7e,
+        0x51, 0x6a, 0xf0, 0xff, 0x3f, 0x23, 0x23, 0x03, 0x23, 0x03, 0x13, 0x03, 0x0b, 0x03, 0x00, 0x2a,
+        0x32, 0x03, 0x98, 0x3c, 0x13, 0x66, 0xe4, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae,
+        0x42, 0x60, 0x82
+    };
+
+    // 8x8 CMYK JPEG.
+    const unsigned char cmykJPEG[] = {
+        0xff, 0xd8, 0xff, 0xee, 0x00, 0x0e, 0x41, 0x64, 0x6f, 0x62, 0x65, 0x00, 0x64, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0xff, 0xdb, 0x00, 0x43, 0x00, 0x10, 0x0b, 0x0c, 0x0e, 0x0c, 0x0a, 0x10, 0x0e, 0x0d,
+        0x0e, 0x12, 0x11, 0x10, 0x13, 0x18, 0x28, 0x1a, 0x18, 0x16, 0x16, 0x18, 0x31, 0x23, 0x25, 0x1d,
+        0x28, 0x3a, 0x33, 0x3d, 0x3c, 0x39, 0x33, 0x38, 0x37, 0x40, 0x48, 0x5c, 0x4e, 0x40, 0x44, 0x57,
+        0x45, 0x37, 0x38, 0x50, 0x6d, 0x51, 0x57, 0x5f, 0x62, 0x67, 0x68, 0x67, 0x3e, 0x4d, 0x71, 0x79,
+        0x70, 0x64, 0x78, 0x5c, 0x65, 0x67, 0x63, 0xff, 0xc0, 0x00, 0x14, 0x08, 0x00, 0x08, 0x00, 0x08,
+        0x04, 0x43, 0x11, 0x00, 0x4d, 0x11, 0x00, 0x59, 0x11, 0x00, 0x4b, 0x11, 0x00, 0xff, 0xc4, 0x00,
+        0x17, 0x00, 0x00, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x03, 0x05, 0x06, 0x07, 0xff, 0xc4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xda, 0x00, 0x0e,
+        0x04, 0x43, 0x00, 0x4d, 0x00, 0x59, 0x00, 0x4b, 0x00, 0x00, 0x3f, 0x00, 0xcf, 0xd3, 0xa1, 0x9d,
+        0x3f, 0xff, 0xd9
+    };
+
+    osg::Image* makeImage(int s, int t, GLenum format)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(s, t, 1, format, GL_UNSIGNED_BYTE);
+        unsigned n = osg::Image::computeNumComponents(format);
+        for (int y = 0; y < t; ++y)
+            for (int x = 0; x < s; ++x)
+                for (unsigned c = 0; c < n; ++c)
+                    image->data(x, y)[c] = (unsigned char)(x * 6 + y * 4 + c * 20);
+        return image;
+    }
+
+    // Encodes an image with the osgDB plugin for "ext".
+    std::string encode(const osg::Image* image, const std::string& ext, const std::string& options = "")
+    {
+        osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension(ext);
+        if (!rw)
+            return std::string();
+
+        osg::ref_ptr<osgDB::Options> dbOptions = new osgDB::Options(options);
+        std::stringstream buf;
+        if (!rw->writeImage(*image, buf, dbOptions.get()).success())
+            return std::string();
+        return buf.str();
+    }
+
+    int maxDifference(const osg::Image* a, const osg::Image* b)
+    {
+        int diff = 0;
+        for (unsigned i = 0; i < a->getTotalSizeInBytes(); ++i)
+            diff = osg::maximum(diff, std::abs((int)a->data()[i] - (int)b->data()[i]));
+        return diff;
+    }
+
+    // Fallback that records what it was asked to read.
+    class RecordingReaderWriter : public osgDB::ReaderWriter
+    {
+    public:
+        RecordingReaderWriter() : _bytes(0u) { }
+
+        ReadResult readImage(std::istream& in, const osgDB::Options* options) const
+        {
+            std::stringstream buf;
+            buf << in.rdbuf();
+            _bytes = (unsigned)buf.str().size();
+
+            osg::Image* image = new osg::Image();
+            image->allocateImage(1, 1, 1, GL_RGB, GL_UNSIGNED_BYTE);
+            return image;
+        }
+
+        mutable unsigned _bytes;
+    };
+
+    // Images that some thread is using right now.
+    struct InUse
+    {
+        InUse() : _collisions(0) { }
+
+        void acquire(osg::Image* image)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            if (!_images.insert(image).second)
+                ++_collisions;
+        }
+
+        void release(osg::Image* image)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            _images.erase(image);
+        }
+
+        Threading::Mutex     _mutex;
+        std::set<osg::Image*> _images;
+        int                  _collisions;
+    };
+
+    // Decodes its own tile over and over through a shared pool, checking
+    // that nobody else decodes into the image while it holds it.
+    class DecodeThread : public OpenThreads::Thread
+    {
+    public:
+        DecodeThread(const ImageDecoder& decoder, const std::string& data, const osg::Image* expected, InUse& inUse) :
+            _decoder(decoder), _data(data), _expected(expected), _inUse(inUse), _failures(0) { }
+
+        void run()
+        {
+            for (int n = 0; n < 200; ++n)
+            {
+                osg::ref_ptr<osg::Image> image = _decoder.decode(_data.data(), _data.size());
+                if (!image.valid())
+                {
+                    ++_failures;
+                    continue;
+                }
+                _inUse.acquire(image.get());
+                OpenThreads::Thread::YieldCurrentThread();
+                if (memcmp(image->data(), _expected->data(), _expected->getTotalSizeInBytes()) != 0)
+                    ++_failures;
+                _inUse.release(image.get());
+            }
+        }
+
+        const ImageDecoder& _decoder;
+        std::string         _data;
+        const osg::Image*   _expected;
+        InUse&              _inUse;
+        int                 _failures;
+    };
+}
+
+TEST_CASE( "ImageDecoder identifies payloads by their signature" ) {
+
+    std::string webp("RIFF\0\0\0\0WEBPVP8 ", 16);
+
+    REQUIRE(ImageDecoder::getFormat(DecoderTest::gray16PNG, sizeof(DecoderTest::gray16PNG)) == ImageDecoder::FORMAT_PNG);
+    REQUIRE(ImageDecoder::getFormat(DecoderTest::cmykJPEG, sizeof(DecoderTest::cmykJPEG)) == ImageDecoder::FORMAT_JPEG);
+    REQUIRE(ImageDecoder::getFormat(webp.data(), webp.size()) == ImageDecoder::FORMAT_WEBP);
+    REQUIRE(ImageDecoder::getFormat("GIF89a", 6) == ImageDecoder::FORMAT_UNKNOWN);
+    REQUIRE(ImageDecoder::getFormat(DecoderTest::gray16PNG, 4) == ImageDecoder::FORMAT_UNKNOWN);
+}
+
+TEST_CASE( "ImageDecoder round-trips PNG images" ) {
+
+    ImageDecoder decoder;
+
+    GLenum formats[] = { GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA };
+    for (unsigned f = 0; f < 4; ++f)
+    {
+        osg::ref_ptr<osg::Image> source = DecoderTest::makeImage(16, 8, formats[f]);
+        std::string data = DecoderTest::encode(source.get(), "png");
+        REQUIRE(!data.empty());
+
+        osg::ref_ptr<osg::Image> image = decoder.decode(data.data(), data.size());
+        REQUIRE(image.valid());
+        REQUIRE(image->s() == 16);
+        REQUIRE(image->t() == 8);
+        REQUIRE(image->getPixelFormat() == formats[f]);
+        REQUIRE(image->getDataType() == GL_UNSIGNED_BYTE);
+
+        // lossless, and in the same (bottom-up) row order as the source.
+        REQUIRE(memcmp(image->data(), source->data(), source->getTotalSizeInBytes()) == 0);
+
+        // decoding into an existing image reuses its buffer.
+        if (ImageDecoder::isSupported(ImageDecoder::FORMAT_PNG))
+        {
+            const unsigned char* buffer = image->data();
+            REQUIRE(decoder.decodeInto(data.data(), data.size(), image.get()));
+            REQUIRE(image->data() == buffer);
+            REQUIRE(memcmp(image->data(), source->data(), source->getTotalSizeInBytes()) == 0);
+        }
+    }
+}
+
+TEST_CASE( "ImageDecoder round-trips JPEG images" ) {
+
+    ImageDecoder decoder;
+
+    GLenum formats[] = { GL_LUMINANCE, GL_RGB };
+    for (unsigned f = 0; f < 2; ++f)
+    {
+        osg::ref_ptr<osg::Image> source = DecoderTest::makeImage(16, 16, formats[f]);
+        std::string data = DecoderTest::encode(source.get(), "jpg", "JPEG_QUALITY 100");
+        REQUIRE(!data.empty());
+
+        osg::ref_ptr<osg::Image> image = decoder.decode(data.data(), data.size());
+        REQUIRE(image.valid());
+        REQUIRE(image->s() == 16);
+        REQUIRE(image->t() == 16);
+        REQUIRE(image->getPixelFormat() == formats[f]);
+
+        // lossy, but a smooth gradient at full quality comes back close,
+        // and flipped rows would not.
+        REQUIRE(DecoderTest::maxDifference(image.get(), source.get()) <= 12);
+    }
+}
+
+TEST_CASE( "ImageDecoder leaves 16-bit PNGs to the plugin, keeping full precision" ) {
+
+    ImageDecoder decoder;
+    const unsigned char* data = DecoderTest::gray16PNG;
+    unsigned size = sizeof(DecoderTest::gray16PNG);
+
+    osg::ref_ptr<osg::Image> scratch = new osg::Image();
+    REQUIRE(!decoder.decodeInto(data, size, scratch.get()));
+
+    osg::ref_ptr<osg::Image> image = decoder.decode(data, size);
+    REQUIRE(image.valid());
+    REQUIRE(image->s() == 4);
+    REQUIRE(image->t() == 2);
+    REQUIRE(image->getDataType() == GL_UNSIGNED_SHORT);
+
+    // bottom-up: row 1 is the top of the PNG.
+    const unsigned short* top = (const unsigned short*)image->data(0, 1);
+    const unsigned short* bottom = (const unsigned short*)image->data(0, 0);
+    REQUIRE(top[1] == 1000);
+    REQUIRE(top[3] == 65535);
+    REQUIRE(bottom[0] == 256);
+    REQUIRE(bottom[3] == 2048);
+}
+
+TEST_CASE( "ImageDecoder leaves CMYK JPEGs to the fallback ReaderWriter" ) {
+
+    ImageDecoder decoder;
+    const unsigned char* data = DecoderTest::cmykJPEG;
+    unsigned size = sizeof(DecoderTest::cmykJPEG);
+
+    osg::ref_ptr<osg::Image> scratch = new osg::Image();
+    REQUIRE(!decoder.decodeInto(data, size, scratch.get()));
+
+    osg::ref_ptr<DecoderTest::RecordingReaderWriter> fallback = new DecoderTest::RecordingReaderWriter();
+    osg::ref_ptr<osg::Image> image = decoder.decode(data, size, 0L, fallback.get());
+    REQUIRE(image.valid());
+
+    // the fallback reads the whole payload from memory.
+    REQUIRE(fallback->_bytes == size);
+}
+
+TEST_CASE( "ImageDecoder::ImagePool hands out an image to one holder at a time" ) {
+
+    osg::ref_ptr<ImageDecoder::ImagePool> pool = new ImageDecoder::ImagePool(2u);
+
+    osg::ref_ptr<osg::Image> a = pool->get();
+    osg::ref_ptr<osg::Image> b = pool->get();
+    REQUIRE(a.valid());
+    REQUIRE(b.valid());
+    REQUIRE(a.get() != b.get());
+
+    // both pooled images are held, so a third is a new, unpooled one.
+    osg::ref_ptr<osg::Image> c = pool->get();
+    REQUIRE(c.get() != a.get());
+    REQUIRE(c.get() != b.get());
+
+    // once released, a pooled image comes back.
+    osg::Image* released = a.get();
+    a = 0L;
+    osg::ref_ptr<osg::Image> d = pool->get();
+    REQUIRE(d.get() == released);
+}
+
+TEST_CASE( "ImageDecoder decodes concurrently through a shared pool" ) {
+
+    if (!ImageDecoder::isSupported(ImageDecoder::FORMAT_PNG))
+        return;
+
+    ImageDecoder decoder;
+    decoder.setImagePool(new ImageDecoder::ImagePool(2u));
+
+    DecoderTest::InUse inUse;
+
+    // each thread has its own tile, all of the same size and format.
+    const unsigned numThreads = 4u;
+    std::vector< osg::ref_ptr<osg::Image> > sources;
+    std::vector<DecoderTest::DecodeThread*> threads;
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        osg::ref_ptr<osg::Image> source = DecoderTest::makeImage(32, 32, GL_RGBA);
+        memset(source->data(), (int)(i * 50 + 10), source->getTotalSizeInBytes() / 2);
+        sources.push_back(source.get());
+
+        std::string data = DecoderTest::encode(source.get(), "png");
+        REQUIRE(!data.empty());
+        threads.push_back(new DecoderTest::DecodeThread(decoder, data, source.get(), inUse));
+    }
+
+    for (unsigned i = 0; i < numThreads; ++i)
+        threads[i]->start();
+
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        threads[i]->join();
+        REQUIRE(threads[i]->_failures == 0);
+        delete threads[i];
+    }
+
+    REQUIRE(inUse._collisions == 0);
+}
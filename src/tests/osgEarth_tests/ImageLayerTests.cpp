@@ -23,7 +23,12 @@
 #include <osgEarth/catch.hpp>
 
 #include <osgEarth/ImageLayer>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Progress>
 #include <osgEarth/Registry>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Thread>
+#include <vector>
 
 #include <osgEarthDrivers/gdal/GDALOptions>
 
@@ -57,3 +62,149 @@ TEST_CASE( "ImageLayers can be created from TileSourceOptions" ) {
         REQUIRE(image.getExtent() == key.getExtent());
     }
 }
+
+namespace CoalescingTest
+{
+    // Tile source that counts the images it creates and holds each request
+    // until the test releases it.
+    class GatedTileSource : public TileSource
+    {
+    public:
+        GatedTileSource() : TileSource(TileSourceOptions()), _count(0) { }
+
+        Status initialize(const osgDB::Options* readOptions)
+        {
+            setProfile( Registry::instance()->getGlobalGeodeticProfile() );
+            return STATUS_OK;
+        }
+
+        osg::Image* createImage(const TileKey& key, ProgressCallback* progress)
+        {
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                ++_count;
+            }
+            _entered.set();
+            _release.wait();
+            return ImageUtils::createEmptyImage(256, 256);
+        }
+
+        CachePolicy getCachePolicyHint() const {
+            return CachePolicy::NO_CACHE;
+        }
+
+        Threading::Mutex _mutex;
+        int              _count;
+        Threading::Event _entered;
+        Threading::Event _release;
+    };
+
+    // Progress of a request that joined another one: the waiting thread
+    // polls it until the other request completes.
+    class WaitingProgress : public ProgressCallback
+    {
+    public:
+        bool isCanceled()
+        {
+            _waiting.set();
+            return ProgressCallback::isCanceled();
+        }
+
+        Threading::Event _waiting;
+    };
+
+    class RequestThread : public OpenThreads::Thread
+    {
+    public:
+        RequestThread(ImageLayer* layer, const TileKey& key, ProgressCallback* progress) :
+            _layer(layer), _key(key), _progress(progress) { }
+
+        void run()
+        {
+            _image = _layer->createImage(_key, _progress.get());
+        }
+
+        ImageLayer*                    _layer;
+        TileKey                        _key;
+        osg::ref_ptr<ProgressCallback> _progress;
+        GeoImage                       _image;
+    };
+}
+
+TEST_CASE( "Concurrent requests for the same image are coalesced" ) {
+
+    osg::ref_ptr<CoalescingTest::GatedTileSource> source = new CoalescingTest::GatedTileSource();
+
+    ImageLayerOptions options;
+    options.cachePolicy() = CachePolicy::NO_CACHE;
+    osg::ref_ptr<ImageLayer> layer = new ImageLayer(options, source.get());
+    REQUIRE(layer->open().isOK());
+
+    TileKey key(1, 0, 0, layer->getProfile());
+
+    // the first request reaches the tile source and stays there..
+    const unsigned numThreads = 4u;
+    std::vector<CoalescingTest::RequestThread*> threads;
+    threads.push_back(new CoalescingTest::RequestThread(layer.get(), key, 0L));
+    threads.back()->start();
+    REQUIRE(source->_entered.wait(10000u));
+
+    // ..while the others join it.
+    std::vector< osg::ref_ptr<CoalescingTest::WaitingProgress> > waiting;
+    for (unsigned i = 1; i < numThreads; ++i)
+    {
+        waiting.push_back(new CoalescingTest::WaitingProgress());
+        threads.push_back(new CoalescingTest::RequestThread(layer.get(), key, waiting.back().get()));
+        threads.back()->start();
+    }
+    for (unsigned i = 0; i < waiting.size(); ++i)
+        REQUIRE(waiting[i]->_waiting.wait(10000u));
+
+    source->_release.set();
+
+    for (unsigned i = 0; i < numThreads; ++i)
+    {
+        threads[i]->join();
+        REQUIRE(threads[i]->_image.valid());
+        REQUIRE(threads[i]->_image.getImage() == threads[0]->_image.getImage());
+        REQUIRE(threads[i]->_image.getExtent() == threads[0]->_image.getExtent());
+    }
+    for (unsigned i = 0; i < numThreads; ++i)
+        delete threads[i];
+
+    REQUIRE(source->_count == 1);
+    REQUIRE(layer->getNumTileRequests() == 1u);
+    REQUIRE(layer->getNumCoalescedTileRequests() == numThreads - 1u);
+}
+
+TEST_CASE( "A canceled request stops waiting for the request it joined" ) {
+
+    osg::ref_ptr<CoalescingTest::GatedTileSource> source = new CoalescingTest::GatedTileSource();
+
+    ImageLayerOptions options;
+    options.cachePolicy() = CachePolicy::NO_CACHE;
+    osg::ref_ptr<ImageLayer> layer = new ImageLayer(options, source.get());
+    REQUIRE(layer->open().isOK());
+
+    TileKey key(1, 0, 0, layer->getProfile());
+
+    CoalescingTest::RequestThread leader(layer.get(), key, 0L);
+    leader.start();
+    REQUIRE(source->_entered.wait(10000u));
+
+    osg::ref_ptr<CoalescingTest::WaitingProgress> progress = new CoalescingTest::WaitingProgress();
+    CoalescingTest::RequestThread waiter(layer.get(), key, progress.get());
+    waiter.start();
+    REQUIRE(progress->_waiting.wait(10000u));
+
+    // the waiter gives up while the leader is still in the tile source.
+    progress->cancel();
+    waiter.join();
+    REQUIRE_FALSE(waiter._image.valid());
+    REQUIRE(layer->getNumCoalescedTileRequests() == 0u);
+
+    source->_release.set();
+    leader.join();
+    REQUIRE(leader._image.valid());
+    REQUIRE(source->_count == 1);
+}
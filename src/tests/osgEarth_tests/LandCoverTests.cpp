@@ -0,0 +1,77 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarth/LandCover>
+#include <osgEarth/GeoCommon>
+#include <osg/Image>
+
+using namespace osgEarth;
+
+TEST_CASE( "LandCoverTile encodes and decodes" ) {
+
+    // land cover raster: class value in the red channel
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(32, 16, 1, GL_RGB, GL_FLOAT);
+    float* ptr = (float*)image->data();
+    for (int t = 0; t < 16; ++t)
+    {
+        for (int s = 0; s < 32; ++s, ptr += 3)
+        {
+            ptr[0] = s < 4 ? NO_DATA_VALUE : s < 20 ? 11.0f : (float)(230 + t % 2);
+            ptr[1] = 0.0f;
+            ptr[2] = 0.0f;
+        }
+    }
+
+    osg::ref_ptr<LandCoverDictionary> dict = new LandCoverDictionary();
+    dict->addClass("forest", 11);
+    dict->addClass("water", 230);
+
+    LandCoverTile tile(image.get(), dict.get());
+    REQUIRE(tile.valid());
+    REQUIRE(tile.getPaletteSize() == 4u);
+    REQUIRE(tile.getIndex(0, 0) == 0u);
+    REQUIRE(tile.getPaletteValue(tile.getIndex(10, 3)) == 11);
+    REQUIRE(tile.getPaletteClass(tile.getIndex(10, 3))->getName() == "forest");
+    REQUIRE(tile.getPaletteValue(tile.getIndex(25, 1)) == 231);
+    REQUIRE(tile.getPaletteClass(tile.getIndex(25, 1)) == 0L);
+
+    std::string buffer;
+    tile.encode(buffer);
+
+    // run-length encoding should beat one float per texel by a wide margin
+    REQUIRE(buffer.size() < 32u*16u);
+
+    LandCoverTile decoded(buffer, dict.get());
+    REQUIRE(decoded.valid());
+    REQUIRE(decoded.s() == 32u);
+    REQUIRE(decoded.t() == 16u);
+    REQUIRE(decoded.getPaletteSize() == tile.getPaletteSize());
+    for (unsigned t = 0; t < 16; ++t)
+        for (unsigned s = 0; s < 32; ++s)
+            REQUIRE(decoded.getIndex(s, t) == tile.getIndex(s, t));
+
+    REQUIRE(decoded.getClassByUV(0.5, 0.5)->getName() == "forest");
+
+    LandCoverTile corrupt(buffer.substr(0, buffer.size()/2), dict.get());
+    REQUIRE(!corrupt.valid());
+}
@@ -0,0 +1,58 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarthUtil/RTTPicker>
+#include <vector>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+TEST_CASE( "RTTPicker decodes object IDs from a readback window" ) {
+
+    // 8x6 window whose first pixel is (10,20) in the pick image,
+    // with object 0x01020304 encoded at pixel (13,22).
+    const int x = 10, y = 20, w = 8, h = 6;
+    std::vector<unsigned char> pixels(w*h*4, 0);
+    unsigned char* p = &pixels[4*((22-y)*w + (13-x))];
+    p[0] = 0x01, p[1] = 0x02, p[2] = 0x03, p[3] = 0x04;
+
+    SECTION("Hit on the pixel") {
+        REQUIRE(RTTPicker::decodeObjectID(&pixels[0], x, y, w, h, 13, 22, 1) == 0x01020304u);
+    }
+
+    SECTION("Hit within the buffer") {
+        REQUIRE(RTTPicker::decodeObjectID(&pixels[0], x, y, w, h, 14, 22, 1) == 0x01020304u);
+        REQUIRE(RTTPicker::decodeObjectID(&pixels[0], x, y, w, h, 15, 23, 2) == 0x01020304u);
+    }
+
+    SECTION("Miss outside the buffer") {
+        REQUIRE(RTTPicker::decodeObjectID(&pixels[0], x, y, w, h, 15, 23, 1) == 0u);
+    }
+
+    SECTION("Start pixel outside the window") {
+        REQUIRE(RTTPicker::decodeObjectID(&pixels[0], x, y, w, h, 9, 22, 4) == 0x01020304u);
+    }
+
+    SECTION("Failed readback") {
+        REQUIRE(RTTPicker::decodeObjectID(0L, x, y, w, h, 13, 22, 1) == 0u);
+    }
+}
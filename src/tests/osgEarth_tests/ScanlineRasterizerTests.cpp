@@ -0,0 +1,248 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarthSymbology/ScanlineRasterizer>
+#include <osgEarthSymbology/Geometry>
+#include <osgEarth/GeoCommon>
+#include <osg/Image>
+#include <cstring>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+
+namespace ScanlineTest
+{
+    osg::Image* makeCoverageImage(int s, int t)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(s, t, 1, GL_LUMINANCE, GL_FLOAT);
+        float* f = (float*)image->data();
+        for (int i = 0; i < s*t; ++i)
+            f[i] = NO_DATA_VALUE;
+        return image;
+    }
+
+    float value(osg::Image* image, int s, int t)
+    {
+        return *(float*)image->data(s, t);
+    }
+
+    Polygon* makeBox(double xmin, double ymin, double xmax, double ymax)
+    {
+        Polygon* box = new Polygon();
+        box->push_back(xmin, ymin);
+        box->push_back(xmax, ymin);
+        box->push_back(xmax, ymax);
+        box->push_back(xmin, ymax);
+        return box;
+    }
+}
+
+TEST_CASE( "ScanlineRasterizer fills a pixel-aligned square" ) {
+
+    osg::ref_ptr<Polygon> box = ScanlineTest::makeBox(4, 4, 12, 12);
+
+    ScanlineRasterizer ras;
+    ras.add(box.get(), 1.0f);
+
+    osg::ref_ptr<osg::Image> image = ScanlineTest::makeCoverageImage(16, 16);
+    REQUIRE(ras.render(image.get()));
+
+    for (int t = 0; t < 16; ++t)
+    {
+        for (int s = 0; s < 16; ++s)
+        {
+            bool inside = s >= 4 && s < 12 && t >= 4 && t < 12;
+            REQUIRE(ScanlineTest::value(image.get(), s, t) == (inside ? 1.0f : NO_DATA_VALUE));
+        }
+    }
+}
+
+TEST_CASE( "ScanlineRasterizer only writes coverage values to pixels at least half covered" ) {
+
+    // the edge columns are 3/4 covered on the left and 1/4 covered on the right.
+    osg::ref_ptr<Polygon> box = ScanlineTest::makeBox(2.25, 0, 6.25, 4);
+
+    ScanlineRasterizer ras;
+    ras.add(box.get(), 5.0f);
+
+    osg::ref_ptr<osg::Image> image = ScanlineTest::makeCoverageImage(8, 4);
+    REQUIRE(ras.render(image.get()));
+
+    REQUIRE(ScanlineTest::value(image.get(), 1, 2) == NO_DATA_VALUE);
+    REQUIRE(ScanlineTest::value(image.get(), 2, 2) == 5.0f);
+    REQUIRE(ScanlineTest::value(image.get(), 5, 2) == 5.0f);
+    REQUIRE(ScanlineTest::value(image.get(), 6, 2) == NO_DATA_VALUE);
+
+    // a pixel below the threshold keeps whatever an earlier feature wrote:
+    osg::ref_ptr<Polygon> left = ScanlineTest::makeBox(0, 0, 3, 4);
+    osg::ref_ptr<Polygon> right = ScanlineTest::makeBox(2.75, 0, 8, 4);
+    ScanlineRasterizer ras2;
+    ras2.add(left.get(), 7.0f);
+    ras2.add(right.get(), 9.0f);
+    REQUIRE(ras2.render(image.get()));
+
+    REQUIRE(ScanlineTest::value(image.get(), 2, 2) == 7.0f);
+    REQUIRE(ScanlineTest::value(image.get(), 3, 2) == 9.0f);
+}
+
+TEST_CASE( "ScanlineRasterizer fills a triangle" ) {
+
+    // right triangle whose hypotenuse runs through the pixel corners,
+    // so the pixels along it are exactly half covered.
+    osg::ref_ptr<Polygon> tri = new Polygon();
+    tri->push_back(0, 0);
+    tri->push_back(16, 0);
+    tri->push_back(0, 16);
+
+    ScanlineRasterizer ras;
+    ras.add(tri.get(), 1.0f);
+
+    osg::ref_ptr<osg::Image> image = ScanlineTest::makeCoverageImage(16, 16);
+    REQUIRE(ras.render(image.get()));
+
+    for (int t = 0; t < 16; ++t)
+    {
+        for (int s = 0; s < 16; ++s)
+        {
+            REQUIRE(ScanlineTest::value(image.get(), s, t) == (s + t <= 15 ? 1.0f : NO_DATA_VALUE));
+        }
+    }
+
+    // anti-aliased, the total coverage equals the triangle's area.
+    osg::ref_ptr<osg::Image> color = new osg::Image();
+    color->allocateImage(16, 16, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    memset(color->data(), 0, color->getTotalSizeInBytes());
+
+    ScanlineRasterizer ras2;
+    ras2.add(tri.get(), osg::Vec4ub(255, 255, 255, 255));
+    REQUIRE(ras2.render(color.get()));
+
+    double area = 0.0;
+    for (int t = 0; t < 16; ++t)
+        for (int s = 0; s < 16; ++s)
+            area += (double)color->data(s, t)[3] / 255.0;
+
+    REQUIRE(area == Approx(128.0).epsilon(0.01));
+}
+
+TEST_CASE( "ScanlineRasterizer leaves even-odd holes empty" ) {
+
+    osg::ref_ptr<Polygon> poly = ScanlineTest::makeBox(0, 0, 16, 16);
+    poly->getHoles().push_back(ScanlineTest::makeBox(4, 4, 12, 12));
+
+    ScanlineRasterizer ras;
+    ras.setFillRule(ScanlineRasterizer::FILL_EVEN_ODD);
+    ras.add(poly.get(), 1.0f);
+
+    osg::ref_ptr<osg::Image> image = ScanlineTest::makeCoverageImage(16, 16);
+    REQUIRE(ras.render(image.get()));
+
+    for (int t = 0; t < 16; ++t)
+    {
+        for (int s = 0; s < 16; ++s)
+        {
+            bool hole = s >= 4 && s < 12 && t >= 4 && t < 12;
+            REQUIRE(ScanlineTest::value(image.get(), s, t) == (hole ? NO_DATA_VALUE : 1.0f));
+        }
+    }
+
+    // with the non-zero rule, a hole wound the same way as the outer ring is filled.
+    ras.setFillRule(ScanlineRasterizer::FILL_NON_ZERO);
+    osg::ref_ptr<osg::Image> image2 = ScanlineTest::makeCoverageImage(16, 16);
+    REQUIRE(ras.render(image2.get()));
+    REQUIRE(ScanlineTest::value(image2.get(), 8, 8) == 1.0f);
+}
+
+TEST_CASE( "ScanlineRasterizer clips geometry to the image edges" ) {
+
+    ScanlineRasterizer ras;
+
+    // covers the whole image and more on every side:
+    osg::ref_ptr<Polygon> all = ScanlineTest::makeBox(-10, -10, 26, 26);
+    ras.add(all.get(), 1.0f);
+
+    osg::ref_ptr<osg::Image> image = ScanlineTest::makeCoverageImage(16, 16);
+    REQUIRE(ras.render(image.get()));
+
+    for (int t = 0; t < 16; ++t)
+        for (int s = 0; s < 16; ++s)
+            REQUIRE(ScanlineTest::value(image.get(), s, t) == 1.0f);
+
+    // hangs off the left and the top:
+    osg::ref_ptr<Polygon> corner = ScanlineTest::makeBox(-5, 10, 4, 40);
+    ras.clear();
+    ras.add(corner.get(), 2.0f);
+
+    image = ScanlineTest::makeCoverageImage(16, 16);
+    REQUIRE(ras.render(image.get()));
+
+    for (int t = 0; t < 16; ++t)
+    {
+        for (int s = 0; s < 16; ++s)
+        {
+            bool inside = s < 4 && t >= 10;
+            REQUIRE(ScanlineTest::value(image.get(), s, t) == (inside ? 2.0f : NO_DATA_VALUE));
+        }
+    }
+
+    // entirely outside:
+    osg::ref_ptr<Polygon> east = ScanlineTest::makeBox(20, 2, 30, 8);
+    osg::ref_ptr<Polygon> west = ScanlineTest::makeBox(-30, 2, -20, 8);
+    ras.clear();
+    ras.add(east.get(), 3.0f);
+    ras.add(west.get(), 3.0f);
+
+    image = ScanlineTest::makeCoverageImage(16, 16);
+    REQUIRE(ras.render(image.get()));
+
+    for (int t = 0; t < 16; ++t)
+        for (int s = 0; s < 16; ++s)
+            REQUIRE(ScanlineTest::value(image.get(), s, t) == NO_DATA_VALUE);
+}
+
+TEST_CASE( "ScanlineRasterizer renders the same with one or many threads" ) {
+
+    osg::ref_ptr<Polygon> tri = new Polygon();
+    tri->push_back(-20, -10);
+    tri->push_back(150, 40);
+    tri->push_back(-5, 97);
+
+    osg::ref_ptr<osg::Image> single = new osg::Image();
+    single->allocateImage(128, 96, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    memset(single->data(), 0, single->getTotalSizeInBytes());
+
+    osg::ref_ptr<osg::Image> multi = new osg::Image();
+    multi->allocateImage(128, 96, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    memset(multi->data(), 0, multi->getTotalSizeInBytes());
+
+    ScanlineRasterizer ras;
+    ras.add(tri.get(), osg::Vec4ub(255, 128, 0, 255));
+
+    ras.setNumThreads(1u);
+    REQUIRE(ras.render(single.get()));
+
+    ras.setNumThreads(4u);
+    REQUIRE(ras.render(multi.get()));
+
+    REQUIRE(memcmp(single->data(), multi->data(), single->getTotalSizeInBytes()) == 0);
+}
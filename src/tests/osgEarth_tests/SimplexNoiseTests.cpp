@@ -0,0 +1,67 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <cmath>
+#include <vector>
+#include <osgEarth/catch.hpp>
+#include <osgEarth/SimplexNoise>
+
+using namespace osgEarth;
+
+TEST_CASE( "SimplexNoise batched values match scalar values" ) {
+
+    SimplexNoise noise;
+    noise.setFrequency(0.37);
+    noise.setOctaves(6);
+    noise.setNormalize(true);
+    noise.setRange(0.0, 1.0);
+
+    // more points than a single batch, and not a multiple of it
+    const unsigned count = 150;
+    std::vector<double> x(count), y(count), z(count), out(count);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        x[i] = -12.5 + 0.731*i;
+        y[i] = 3.2 - 0.417*i;
+        z[i] = 0.05*i*i;
+    }
+
+    SECTION("2D") {
+        noise.getValues(&x[0], &y[0], count, &out[0]);
+        for (unsigned i = 0; i < count; ++i)
+            REQUIRE(fabs(out[i] - noise.getValue(x[i], y[i])) <= 1e-9);
+    }
+
+    SECTION("3D") {
+        noise.getValues(&x[0], &y[0], &z[0], count, &out[0]);
+        for (unsigned i = 0; i < count; ++i)
+            REQUIRE(fabs(out[i] - noise.getValue(x[i], y[i], z[i])) <= 1e-9);
+    }
+
+    SECTION("Tiled, multithreaded") {
+        const unsigned w = 70, h = 33;
+        std::vector<double> grid(w*h);
+        noise.getTiledValues(w, h, &grid[0], 4u);
+        for (unsigned t = 0; t < h; ++t)
+            for (unsigned s = 0; s < w; ++s)
+                REQUIRE(fabs(grid[t*w+s] - noise.getTiledValue((double)s/(double)w, (double)t/(double)h)) <= 1e-9);
+    }
+}
@@ -0,0 +1,71 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarth/TextureCompressor>
+#include <osgEarth/ImageUtils>
+#include <osg/Image>
+
+using namespace osgEarth;
+
+TEST_CASE( "TextureCompressor encodes BC1 and BC3 tiles" ) {
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(64, 64, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    unsigned char* ptr = image->data();
+    for (unsigned i = 0; i < 64u * 64u; ++i, ptr += 4)
+    {
+        // pure red encodes exactly in 5:6:5
+        ptr[0] = 255, ptr[1] = 0, ptr[2] = 0, ptr[3] = 255;
+    }
+
+    TextureCompressor compressor;
+
+    SECTION("Opaque RGBA uses BC1 with a full mipmap chain") {
+        osg::ref_ptr<osg::Image> out = compressor.compress(image.get());
+        REQUIRE(out.valid());
+        REQUIRE(out->getPixelFormat() == GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+        REQUIRE(out->getNumMipmapLevels() == 7u);
+
+        // first block: color0 == color1 == 0xF800, all indices zero
+        const unsigned char* block = out->data();
+        REQUIRE(block[0] == 0x00);
+        REQUIRE(block[1] == 0xF8);
+        REQUIRE(block[2] == 0x00);
+        REQUIRE(block[3] == 0xF8);
+        REQUIRE(block[4] == 0);
+    }
+
+    SECTION("Transparency selects BC3") {
+        image->data(5, 5)[3] = 0;
+        compressor.setGenerateMipmaps(false);
+        osg::ref_ptr<osg::Image> out = compressor.compress(image.get());
+        REQUIRE(out.valid());
+        REQUIRE(out->getPixelFormat() == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+        REQUIRE(out->getNumMipmapLevels() == 1u);
+        REQUIRE(out->getTotalSizeInBytes() == 16u * 16u * 16u);
+    }
+
+    SECTION("Compressed images are left alone") {
+        osg::ref_ptr<osg::Image> out = compressor.compress(image.get());
+        REQUIRE(compressor.compress(out.get()) == 0L);
+    }
+}
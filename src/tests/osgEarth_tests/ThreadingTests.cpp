@@ -132,4 +132,43 @@ TEST_CASE( "ReadWriteMutex can handle mulitple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+namespace FutureTest
+{
+    // Resolves a promise once released.
+    class Resolver : public OpenThreads::Thread
+    {
+    public:
+        Resolver(Threading::Promise<osg::Referenced>& promise, osg::Referenced* value) :
+            _promise(promise), _value(value) { }
+
+        void run()
+        {
+            _release.wait();
+            _promise.resolve(_value.get());
+        }
+
+        Threading::Promise<osg::Referenced>& _promise;
+        osg::ref_ptr<osg::Referenced>        _value;
+        Threading::Event                     _release;
+    };
+}
+
+TEST_CASE( "Future::wait times out until the promise is resolved" ) {
+
+    Threading::Promise<osg::Referenced> promise;
+    Threading::Future<osg::Referenced> future = promise.getFuture();
+
+    osg::ref_ptr<osg::Referenced> value = new osg::Referenced();
+    FutureTest::Resolver resolver(promise, value.get());
+    resolver.start();
+
+    REQUIRE_FALSE(future.wait(10u));
+    REQUIRE_FALSE(future.isAvailable());
+
+    resolver._release.set();
+    REQUIRE(future.wait(10000u));
+    REQUIRE(future.get() == value.get());
+
+    resolver.join();
+}
@@ -0,0 +1,202 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2016 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarth/catch.hpp>
+#include <osgEarth/URI>
+#include <osgEarth/Progress>
+#include <osgEarth/DateTime>
+#include <OpenThreads/Thread>
+#include <osg/Image>
+#include <vector>
+#include <cstring>
+
+using namespace osgEarth;
+
+namespace ImageCacheTest
+{
+    // 16x16 RGBA = 1024 bytes
+    const unsigned imageBytes = 16u * 16u * 4u;
+
+    ReadResult makeResult(unsigned char value)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(16, 16, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        memset(image->data(), value, image->getTotalSizeInBytes());
+        return ReadResult(image);
+    }
+
+    // Caches an image under "key" the way URI::readImage does.
+    void store(const std::string& key, unsigned char value)
+    {
+        ReadResult result;
+        bool leader = false;
+        URIImageCache::instance()->acquire(key, CachePolicy::DEFAULT, 0L, result, leader);
+        if (leader)
+            URIImageCache::instance()->release(key, makeResult(value), true);
+    }
+
+    bool isCached(const std::string& key)
+    {
+        ReadResult result;
+        bool leader = false;
+        bool hit = URIImageCache::instance()->acquire(key, CachePolicy::DEFAULT, 0L, result, leader);
+        if (leader)
+            URIImageCache::instance()->release(key, ReadResult(), false);
+        return hit;
+    }
+
+    class WaitThread : public OpenThreads::Thread
+    {
+    public:
+        WaitThread(const std::string& key) : _key(key), _hit(false), _leader(false) { }
+
+        void run()
+        {
+            _hit = URIImageCache::instance()->acquire(_key, CachePolicy::DEFAULT, 0L, _result, _leader);
+        }
+
+        std::string _key;
+        ReadResult  _result;
+        bool        _hit;
+        bool        _leader;
+    };
+
+    // Restores the shared cache when a test case finishes.
+    struct Scope
+    {
+        Scope() : _maxBytes(URIImageCache::instance()->getMaxBytes()) { URIImageCache::instance()->clear(); }
+        ~Scope() { URIImageCache::instance()->clear(); URIImageCache::instance()->setMaxBytes(_maxBytes); }
+        unsigned _maxBytes;
+    };
+}
+
+TEST_CASE( "URIImageCache reads an image once for concurrent readers" ) {
+
+    ImageCacheTest::Scope scope;
+    URIImageCache* cache = URIImageCache::instance();
+    cache->setMaxBytes(1024u * 1024u);
+
+    unsigned misses = cache->getMisses();
+
+    // the first reader leads the read.
+    ReadResult result;
+    bool leader = false;
+    REQUIRE(!cache->acquire("test://single", CachePolicy::DEFAULT, 0L, result, leader));
+    REQUIRE(leader);
+
+    // the rest either wait on that read or, if they start late, hit the cache.
+    std::vector<ImageCacheTest::WaitThread*> threads;
+    for (unsigned i = 0; i < 4u; ++i)
+    {
+        threads.push_back(new ImageCacheTest::WaitThread("test://single"));
+        threads.back()->start();
+    }
+
+    ReadResult image = ImageCacheTest::makeResult(7);
+    cache->release("test://single", image, true);
+
+    for (unsigned i = 0; i < threads.size(); ++i)
+    {
+        threads[i]->join();
+        REQUIRE(threads[i]->_hit);
+        REQUIRE(!threads[i]->_leader);
+        REQUIRE(threads[i]->_result.succeeded());
+
+        // every reader gets its own copy.
+        REQUIRE(threads[i]->_result.getImage() != image.getImage());
+        REQUIRE(threads[i]->_result.getImage()->data()[0] == 7);
+        delete threads[i];
+    }
+
+    REQUIRE(cache->getMisses() == misses + 1u);
+}
+
+TEST_CASE( "URIImageCache stops waiting when the reader cancels" ) {
+
+    ImageCacheTest::Scope scope;
+    URIImageCache* cache = URIImageCache::instance();
+    cache->setMaxBytes(1024u * 1024u);
+
+    ReadResult result;
+    bool leader = false;
+    REQUIRE(!cache->acquire("test://cancel", CachePolicy::DEFAULT, 0L, result, leader));
+    REQUIRE(leader);
+
+    // this would wait forever on the read above if it ignored the callback.
+    osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
+    progress->cancel();
+
+    ReadResult waited;
+    bool waitLeader = false;
+    REQUIRE(cache->acquire("test://cancel", CachePolicy::DEFAULT, progress.get(), waited, waitLeader));
+    REQUIRE(!waitLeader);
+    REQUIRE(waited.code() == ReadResult::RESULT_CANCELED);
+
+    cache->release("test://cancel", ReadResult(), false);
+}
+
+TEST_CASE( "URIImageCache evicts the least recently used images to stay within its byte budget" ) {
+
+    ImageCacheTest::Scope scope;
+    URIImageCache* cache = URIImageCache::instance();
+    cache->setMaxBytes(3u * ImageCacheTest::imageBytes);
+
+    ImageCacheTest::store("test://a", 1);
+    ImageCacheTest::store("test://b", 2);
+    ImageCacheTest::store("test://c", 3);
+    REQUIRE(cache->getBytes() == 3u * ImageCacheTest::imageBytes);
+
+    // reading "a" makes "b" the least recently used.
+    REQUIRE(ImageCacheTest::isCached("test://a"));
+
+    ImageCacheTest::store("test://d", 4);
+    REQUIRE(cache->getBytes() == 3u * ImageCacheTest::imageBytes);
+    REQUIRE(!ImageCacheTest::isCached("test://b"));
+    REQUIRE(ImageCacheTest::isCached("test://a"));
+    REQUIRE(ImageCacheTest::isCached("test://c"));
+    REQUIRE(ImageCacheTest::isCached("test://d"));
+
+    // shrinking the budget trims right away.
+    cache->setMaxBytes(ImageCacheTest::imageBytes);
+    REQUIRE(cache->getBytes() == ImageCacheTest::imageBytes);
+    REQUIRE(ImageCacheTest::isCached("test://d"));
+}
+
+TEST_CASE( "URIImageCache discards images the reader's cache policy considers expired" ) {
+
+    ImageCacheTest::Scope scope;
+    URIImageCache* cache = URIImageCache::instance();
+    cache->setMaxBytes(1024u * 1024u);
+
+    ImageCacheTest::store("test://old", 1);
+    REQUIRE(cache->getBytes() == ImageCacheTest::imageBytes);
+
+    CachePolicy policy;
+    policy.minTime() = DateTime().asTimeStamp() + 60;
+
+    ReadResult result;
+    bool leader = false;
+    REQUIRE(!cache->acquire("test://old", policy, 0L, result, leader));
+    REQUIRE(leader);
+    REQUIRE(cache->getBytes() == 0u);
+
+    cache->release("test://old", ReadResult(), false);
+}